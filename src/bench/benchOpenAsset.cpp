@@ -0,0 +1,90 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+//
+// Read time and peak RSS of ReplaceResolver::OpenAsset, then of a layer
+// load, for a given file.
+//
+// Usage: openAssetBench <file.usdc>
+//
+// Run it once with REPLACE_RESOLVER_MMAP_ASSETS=0 and once with
+// REPLACE_RESOLVER_MMAP_ASSETS=1 to compare the stdio and mmap assets. The
+// layer load goes through Ar, PXR_PLUGINPATH_NAME must point to the plugin
+// and PXR_AR_DEFAULT_PLUGIN (or the preferred resolver) to ReplaceResolver.
+
+#include "replaceResolver.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/tf/getenv.h>
+#include <pxr/usd/ar/asset.h>
+#include <pxr/usd/sdf/layer.h>
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+
+double
+_Seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+long
+_PeakRssKb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+} // anonymous
+
+int
+main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file>\n", argv[0]);
+        return 1;
+    }
+    const std::string filePath = argv[1];
+
+    printf("mmap assets: %s\n",
+           TfGetenvBool("REPLACE_RESOLVER_MMAP_ASSETS", true) ? "on" : "off");
+
+    ReplaceResolver resolver;
+
+    // Read the whole asset through GetBuffer, as the text file format does.
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<ArAsset> asset = resolver.OpenAsset(filePath);
+    if (!asset) {
+        fprintf(stderr, "Could not open %s\n", filePath.c_str());
+        return 1;
+    }
+    std::shared_ptr<const char> buffer = asset->GetBuffer();
+    size_t checksum = 0;
+    for (size_t i = 0; i < asset->GetSize(); i += 4096) {
+        checksum += static_cast<unsigned char>(buffer.get()[i]);
+    }
+    printf("%-12s %10.3f s  peak RSS %8ld KB  (%zu bytes, checksum %zu)\n",
+           "GetBuffer", _Seconds(start), _PeakRssKb(),
+           asset->GetSize(), checksum);
+    buffer.reset();
+    asset.reset();
+
+    start = std::chrono::steady_clock::now();
+    SdfLayerRefPtr layer = SdfLayer::FindOrOpen(filePath);
+    if (!layer) {
+        fprintf(stderr, "Could not open layer %s\n", filePath.c_str());
+        return 1;
+    }
+    printf("%-12s %10.3f s  peak RSS %8ld KB\n",
+           "layer load", _Seconds(start), _PeakRssKb());
+
+    return 0;
+}
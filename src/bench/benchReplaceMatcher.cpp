@@ -0,0 +1,124 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+//
+// Per-resolve cost of the replace step as the number of replace pairs grows.
+//
+// Compares the compiled ReplaceMatcher with the former implementation, a
+// std::string::find per pair.
+
+#include "replaceMatcher.h"
+
+#include <pxr/pxr.h>
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+
+std::string
+_AssetPath(size_t index, const char* version)
+{
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer),
+             "assets/asset%06zu/%s/asset%06zu.usda", index, version, index);
+    return buffer;
+}
+
+bool
+_LinearReplace(
+    const std::map<std::string, std::string>& pairs,
+    const std::string& path,
+    std::string* result)
+{
+    for (const auto& pair : pairs) {
+        const size_t found = path.find(pair.first);
+        if (found != std::string::npos) {
+            *result = path;
+            result->replace(found, pair.first.size(), pair.second);
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class Fn>
+double
+_NanosecondsPerCall(const std::vector<std::string>& paths, Fn&& fn)
+{
+    const size_t minIterations = 200000;
+    size_t iterations = 0;
+    size_t matches = 0;
+    const auto start = std::chrono::steady_clock::now();
+    while (iterations < minIterations) {
+        for (const std::string& path : paths) {
+            matches += fn(path) ? 1 : 0;
+        }
+        iterations += paths.size();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    // Keep the calls from being optimized out.
+    if (matches == 0) {
+        fprintf(stderr, "no match\n");
+    }
+
+    return std::chrono::duration<double, std::nano>(end - start).count() /
+        iterations;
+}
+
+} // anonymous
+
+int
+main(int argc, char* argv[])
+{
+    const size_t numPairsList[] = {10, 100, 1000, 10000, 100000};
+    const size_t numQueries = 1000;
+
+    printf("%10s %14s %14s %14s\n",
+           "pairs", "compile (ms)", "matcher (ns)", "linear (ns)");
+
+    for (const size_t numPairs : numPairsList) {
+        std::map<std::string, std::string> pairs;
+        for (size_t i = 0; i < numPairs; ++i) {
+            pairs.emplace(_AssetPath(i, "v001"), _AssetPath(i, "v002"));
+        }
+
+        // Half of the queries hit a pair, the other half miss.
+        std::vector<std::string> paths;
+        paths.reserve(numQueries);
+        for (size_t i = 0; i < numQueries; ++i) {
+            const size_t index = (i * 7919) % numPairs;
+            paths.push_back(_AssetPath(index, i % 2 ? "v001" : "v003"));
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        const ReplaceMatcher matcher(pairs);
+        const auto end = std::chrono::steady_clock::now();
+        const double compileMs =
+            std::chrono::duration<double, std::milli>(end - start).count();
+
+        std::string result;
+        const double matcherNs = _NanosecondsPerCall(paths,
+            [&](const std::string& path) {
+                return matcher.Replace(path, &result);
+            });
+
+        // The linear scan gets too slow to be worth waiting for.
+        double linearNs = -1.0;
+        if (numPairs <= 10000) {
+            linearNs = _NanosecondsPerCall(paths,
+                [&](const std::string& path) {
+                    return _LinearReplace(pairs, path, &result);
+                });
+        }
+
+        printf("%10zu %14.2f %14.1f %14.1f\n",
+               numPairs, compileMs, matcherNs, linearNs);
+    }
+
+    return 0;
+}
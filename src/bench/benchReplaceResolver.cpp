@@ -0,0 +1,366 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+//
+// Throughput of the resolve hot path, from 1 to 64 threads.
+//
+// Benchmarks Resolve while varying the number of replace rules, the number
+// of search paths and whether a cache scope is open, then the replace step
+// alone, AnchorRelativePath, context hashing and BindContext/UnbindContext.
+// The asset tree and the replace tables are generated in a temporary
+// directory.
+//
+// Usage: replaceResolverBench [--output results.json] [--duration seconds]
+//                             [--quick]
+//
+// Every run is written as a JSON record to the output file, to compare
+// builds with each other.
+
+#include "replaceResolver.h"
+#include "replaceResolverContext.h"
+#include "replaceRuleTable.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/js/json.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/base/vt/value.h>
+#include <pxr/usd/ar/resolverContext.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+
+const size_t _NumAssets = 1000;
+
+std::string
+_AssetPath(size_t index, const char* version)
+{
+    return TfStringPrintf(
+        "assets/asset%06zu/%s/asset%06zu.usda", index, version, index);
+}
+
+struct _Run
+{
+    std::string benchmark;
+    size_t rules = 0;
+    size_t searchPaths = 0;
+    bool cacheScope = false;
+    size_t threads = 1;
+    double opsPerSecond = 0.0;
+    double nsPerOp = 0.0;
+};
+
+// Call \p fn on run->threads threads for \p duration seconds, with a
+// per thread operation index. \p begin and \p end set up and tear down
+// the state of each thread.
+void
+_Measure(
+    _Run* run,
+    double duration,
+    const std::function<void()>& begin,
+    const std::function<void(size_t)>& fn,
+    const std::function<void()>& end)
+{
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> ready(0);
+    std::vector<size_t> counts(run->threads, 0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < run->threads; ++t) {
+        threads.emplace_back([&, t]() {
+            begin();
+            ++ready;
+            size_t count = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                // Check the clock every few operations only.
+                for (size_t i = 0; i < 64; ++i) {
+                    fn(t * 7919 + count++);
+                }
+            }
+            counts[t] = count;
+            end();
+        });
+    }
+
+    while (ready.load() != run->threads) {
+        std::this_thread::yield();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+    stop = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    size_t total = 0;
+    for (const size_t count : counts) {
+        total += count;
+    }
+    run->opsPerSecond = total / seconds;
+    run->nsPerOp = seconds * 1.0e9 * run->threads / total;
+}
+
+void
+_Print(const _Run& run)
+{
+    printf("%-20s %8zu %8zu %6s %8zu %14.0f %10.1f\n",
+           run.benchmark.c_str(), run.rules, run.searchPaths,
+           run.cacheScope ? "on" : "off", run.threads,
+           run.opsPerSecond, run.nsPerOp);
+    fflush(stdout);
+}
+
+JsValue
+_ToJson(const _Run& run)
+{
+    JsObject object;
+    object["benchmark"] = JsValue(run.benchmark);
+    object["rules"] = JsValue(static_cast<uint64_t>(run.rules));
+    object["searchPaths"] = JsValue(static_cast<uint64_t>(run.searchPaths));
+    object["cacheScope"] = JsValue(run.cacheScope);
+    object["threads"] = JsValue(static_cast<uint64_t>(run.threads));
+    object["opsPerSecond"] = JsValue(run.opsPerSecond);
+    object["nsPerOp"] = JsValue(run.nsPerOp);
+    return JsValue(object);
+}
+
+// Search paths, the assets only exist under the last one so that a
+// resolve probes all of them.
+std::vector<std::string>
+_MakeSearchPaths(const std::string& root, size_t numSearchPaths)
+{
+    std::vector<std::string> searchPaths;
+    for (size_t i = 0; i + 1 < numSearchPaths; ++i) {
+        searchPaths.push_back(TfStringCatPaths(
+            root, TfStringPrintf("empty%02zu", i)));
+        TfMakeDirs(searchPaths.back(), -1, /* existOk = */ true);
+    }
+    searchPaths.push_back(TfStringCatPaths(root, "published"));
+    return searchPaths;
+}
+
+// Replace the v001 assets by their v002, padded with rules that never match.
+ReplaceRuleTable::PairMap
+_MakePairs(size_t numRules)
+{
+    ReplaceRuleTable::PairMap pairs;
+    for (size_t i = 0; i < numRules; ++i) {
+        if (i < _NumAssets) {
+            pairs.emplace(_AssetPath(i, "v001"), _AssetPath(i, "v002"));
+        }
+        else {
+            pairs.emplace(_AssetPath(i, "v901"), _AssetPath(i, "v902"));
+        }
+    }
+    return pairs;
+}
+
+} // anonymous
+
+int
+main(int argc, char* argv[])
+{
+    std::string outputPath = "replaceResolverBench.json";
+    double duration = 0.25;
+    bool quick = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            duration = std::atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        }
+        else {
+            fprintf(stderr, "Usage: %s [--output results.json] "
+                    "[--duration seconds] [--quick]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const std::vector<size_t> threadCounts = quick
+        ? std::vector<size_t>{1, 8}
+        : std::vector<size_t>{1, 2, 4, 8, 16, 32, 64};
+    const std::vector<size_t> ruleCounts = quick
+        ? std::vector<size_t>{10, 10000}
+        : std::vector<size_t>{10, 1000, 100000};
+    const std::vector<size_t> searchPathCounts = quick
+        ? std::vector<size_t>{1, 8}
+        : std::vector<size_t>{1, 4, 16};
+
+    const std::string root =
+        ArchMakeTmpSubdir(ArchGetTmpDir(), "replaceResolverBench");
+    const std::string publishedRoot = TfStringCatPaths(root, "published");
+    for (size_t i = 0; i < _NumAssets; ++i) {
+        const std::string filePath =
+            TfStringCatPaths(publishedRoot, _AssetPath(i, "v002"));
+        TfMakeDirs(TfGetPathName(filePath), -1, /* existOk = */ true);
+        std::ofstream(filePath.c_str()) << "#usda 1.0\n";
+    }
+
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < _NumAssets; ++i) {
+        paths.push_back(_AssetPath(i, "v001"));
+    }
+
+    ReplaceResolver resolver;
+    JsArray results;
+    auto record = [&](const _Run& run) {
+        _Print(run);
+        results.push_back(_ToJson(run));
+    };
+    auto nothing = []() {};
+
+    printf("%-20s %8s %8s %6s %8s %14s %10s\n",
+           "benchmark", "rules", "paths", "scope", "threads",
+           "ops/s", "ns/op");
+
+    // Resolve through the process wide cache, and through the filesystem.
+    for (const size_t numRules : ruleCounts) {
+        const ReplaceRuleTableConstPtr rules =
+            std::make_shared<const ReplaceRuleTable>(_MakePairs(numRules));
+
+        for (const size_t numSearchPaths : searchPathCounts) {
+            const ArResolverContext context(ReplaceResolverContext(
+                _MakeSearchPaths(root, numSearchPaths), rules));
+
+            for (const bool resolveCache : {true, false}) {
+                resolver.SetResolveCacheBudget(resolveCache ? 64 << 20 : 0);
+
+                for (const bool cacheScope : {false, true}) {
+                    for (const size_t numThreads : threadCounts) {
+                        _Run run;
+                        run.benchmark = resolveCache
+                            ? "resolve" : "resolveUncached";
+                        run.rules = numRules;
+                        run.searchPaths = numSearchPaths;
+                        run.cacheScope = cacheScope;
+                        run.threads = numThreads;
+
+                        _Measure(&run, duration,
+                            [&]() {
+                                VtValue data;
+                                resolver.BindContext(context, &data);
+                                if (cacheScope) {
+                                    resolver.BeginCacheScope(&data);
+                                }
+                            },
+                            [&](size_t i) {
+                                resolver.Resolve(paths[i % paths.size()]);
+                            },
+                            [&]() {
+                                VtValue data;
+                                if (cacheScope) {
+                                    resolver.EndCacheScope(&data);
+                                }
+                                resolver.UnbindContext(context, &data);
+                            });
+                        record(run);
+                    }
+                }
+            }
+        }
+    }
+    resolver.SetResolveCacheBudget(64 << 20);
+
+    // The replace step of a resolve, as done by _ReplaceFromContext.
+    for (const size_t numRules : ruleCounts) {
+        const ReplaceRuleTable rules(_MakePairs(numRules));
+        const ReplaceMatcher& matcher = rules.GetMatcher();
+        for (const size_t numThreads : threadCounts) {
+            _Run run;
+            run.benchmark = "replace";
+            run.rules = numRules;
+            run.threads = numThreads;
+            _Measure(&run, duration, nothing,
+                [&](size_t i) {
+                    std::string result;
+                    matcher.Replace(paths[i % paths.size()], &result);
+                },
+                nothing);
+            record(run);
+        }
+    }
+
+    const std::string anchor =
+        TfStringCatPaths(publishedRoot, _AssetPath(0, "v002"));
+    for (const size_t numThreads : threadCounts) {
+        _Run run;
+        run.benchmark = "anchorRelativePath";
+        run.threads = numThreads;
+        _Measure(&run, duration, nothing,
+            [&](size_t i) {
+                resolver.AnchorRelativePath(
+                    anchor, "../../" + paths[i % paths.size()]);
+            },
+            nothing);
+        record(run);
+    }
+
+    const ReplaceResolverContext context(
+        _MakeSearchPaths(root, 4),
+        std::make_shared<const ReplaceRuleTable>(_MakePairs(1000)));
+    const ArResolverContext arContext(context);
+    for (const size_t numThreads : threadCounts) {
+        _Run run;
+        run.benchmark = "contextHash";
+        run.rules = 1000;
+        run.searchPaths = 4;
+        run.threads = numThreads;
+        std::atomic<size_t> sink(0);
+        _Measure(&run, duration, nothing,
+            [&](size_t) {
+                sink.fetch_add(hash_value(arContext) & 1,
+                               std::memory_order_relaxed);
+            },
+            nothing);
+        record(run);
+    }
+
+    for (const size_t numThreads : threadCounts) {
+        _Run run;
+        run.benchmark = "bindContext";
+        run.rules = 1000;
+        run.searchPaths = 4;
+        run.threads = numThreads;
+        _Measure(&run, duration, nothing,
+            [&](size_t) {
+                VtValue data;
+                resolver.BindContext(arContext, &data);
+                resolver.UnbindContext(arContext, &data);
+            },
+            nothing);
+        record(run);
+    }
+
+    TfRmTree(root);
+
+    std::ofstream ofs(outputPath.c_str());
+    if (!ofs) {
+        fprintf(stderr, "Could not write %s\n", outputPath.c_str());
+        return 1;
+    }
+    JsObject output;
+    output["hardwareConcurrency"] = JsValue(
+        static_cast<uint64_t>(std::thread::hardware_concurrency()));
+    output["duration"] = JsValue(duration);
+    output["runs"] = JsValue(results);
+    JsWriteToStream(JsValue(output), ofs);
+    ofs << std::endl;
+    printf("Results written to %s\n", outputPath.c_str());
+    return 0;
+}
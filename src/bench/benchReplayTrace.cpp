@@ -0,0 +1,284 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+//
+// Replay of a trace recorded with REPLACE_RESOLVER_TRACE, on a synthetic
+// filesystem.
+//
+// The files the recorded resolves found are created empty in a temporary
+// directory and every absolute path of the trace is moved under it, so that
+// a trace recorded on a production host replays anywhere. Contexts are
+// rebuilt from their recorded search path, replace pairs, patterns and
+// replace table, rather than from the layers they were created for.
+//
+// Each recorded thread replays its calls in order on a thread of its own,
+// as fast as possible. The latency distribution of each call type is
+// printed for the recording and for every replay pass, and resolves giving
+// a different result than recorded are counted.
+//
+// Usage: replayTraceBench trace [passes]
+
+#include "replaceResolver.h"
+#include "replaceResolverContext.h"
+#include "trace.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/arch/env.h>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/base/vt/value.h>
+#include <pxr/usd/ar/resolverContext.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+
+using _Trace = ReplaceResolverTrace;
+
+// Move the absolute \p path under \p root.
+std::string
+_Remap(const std::string& root, const std::string& path)
+{
+    if (path.empty() || path[0] != '/') {
+        return path;
+    }
+    return root + path;
+}
+
+void
+_Touch(const std::string& filePath, const char* content)
+{
+    TfMakeDirs(TfGetPathName(filePath), -1, /* existOk = */ true);
+    if (!TfIsFile(filePath)) {
+        std::ofstream(filePath.c_str()) << content;
+    }
+}
+
+ReplaceResolverContext
+_MakeContext(const std::string& root, const _Trace::Context& recorded)
+{
+    std::vector<std::string> searchPath;
+    for (const std::string& path : recorded.searchPath) {
+        searchPath.push_back(_Remap(root, path));
+        TfMakeDirs(searchPath.back(), -1, /* existOk = */ true);
+    }
+
+    ReplaceResolverContext context(searchPath);
+    for (const auto& pair : recorded.pairs) {
+        context.AddReplacePair(
+            _Remap(root, pair.first), _Remap(root, pair.second));
+    }
+    for (const auto& rule : recorded.patterns) {
+        context.AddReplacePattern(rule.first, rule.second);
+    }
+    // Tables are not in the trace, the recorded one is used when it is
+    // reachable from this host.
+    if (!recorded.replaceTable.empty() &&
+        !context.SetReplaceTable(recorded.replaceTable)) {
+        fprintf(stderr, "Replace table '%s' is missing, its pairs are not "
+                "replayed\n", recorded.replaceTable.c_str());
+    }
+    return context;
+}
+
+// Latencies in nanoseconds, per event type.
+using _Latencies = std::map<_Trace::EventType, std::vector<uint64_t>>;
+
+void
+_PrintLatencies(const char* name, _Latencies* latencies)
+{
+    printf("%s\n", name);
+    printf("  %-30s %10s %10s %10s %10s %10s %10s\n", "call", "count",
+           "mean us", "p50 us", "p90 us", "p99 us", "max us");
+    for (auto& entry : *latencies) {
+        std::vector<uint64_t>& values = entry.second;
+        if (values.empty()) {
+            continue;
+        }
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (uint64_t value : values) {
+            sum += value;
+        }
+        auto percentile = [&values](double p) {
+            const size_t index = std::min(
+                values.size() - 1, static_cast<size_t>(p * values.size()));
+            return values[index] / 1000.0;
+        };
+        printf("  %-30s %10zu %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+               _Trace::GetEventName(entry.first), values.size(),
+               sum / values.size() / 1000.0, percentile(0.5),
+               percentile(0.9), percentile(0.99), values.back() / 1000.0);
+    }
+}
+
+} // anonymous
+
+int
+main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s trace [passes]\n", argv[0]);
+        return 2;
+    }
+    const size_t numPasses =
+        argc > 2 ? std::max(std::strtoul(argv[2], nullptr, 10), 1ul) : 3;
+
+    _Trace trace;
+    std::string errMsg;
+    if (!trace.Read(argv[1], &errMsg)) {
+        fprintf(stderr, "%s\n", errMsg.c_str());
+        return 1;
+    }
+
+    // The replay itself is not recorded.
+    ArchUnsetEnv("REPLACE_RESOLVER_TRACE");
+
+    const std::string root =
+        ArchMakeTmpSubdir(ArchGetTmpDir(), "replayTraceBench");
+    // Relative paths are resolved from the current directory.
+    if (chdir(root.c_str()) != 0) {
+        fprintf(stderr, "Could not change directory to '%s'\n", root.c_str());
+    }
+    for (const _Trace::Event& event : trace.events) {
+        if (event.type == _Trace::Resolve && !event.result.empty()) {
+            _Touch(_Remap(root, event.result), "");
+        }
+        else if (event.type == _Trace::CreateDefaultContextForAsset &&
+                 !event.path.empty()) {
+            _Touch(_Remap(root, event.path), "#usda 1.0\n");
+        }
+    }
+
+    std::vector<ArResolverContext> contexts;
+    for (const _Trace::Context& context : trace.contexts) {
+        contexts.emplace_back(_MakeContext(root, context));
+    }
+    const ArResolverContext noContext;
+    auto getContext = [&](uint32_t index) -> const ArResolverContext& {
+        return index == 0 ? noContext : contexts[index - 1];
+    };
+
+    // Events of each recorded thread, in order.
+    std::map<uint32_t, std::vector<const _Trace::Event*>> threadEvents;
+    _Latencies recorded;
+    for (const _Trace::Event& event : trace.events) {
+        threadEvents[event.thread].push_back(&event);
+        recorded[event.type].push_back(event.duration);
+    }
+
+    printf("trace: %zu calls on %zu threads, %zu contexts\n",
+           trace.events.size(), threadEvents.size(), trace.contexts.size());
+    _PrintLatencies("recorded", &recorded);
+
+    ReplaceResolver resolver;
+    size_t numMismatches = 0;
+    for (size_t pass = 0; pass < numPasses; ++pass) {
+        std::vector<_Latencies> threadLatencies(threadEvents.size());
+        std::atomic<size_t> mismatches(0);
+        std::vector<std::thread> threads;
+        size_t threadIndex = 0;
+        for (const auto& entry : threadEvents) {
+            threads.emplace_back([&](
+                    const std::vector<const _Trace::Event*>* events,
+                    _Latencies* latencies) {
+                std::vector<uint32_t> bound;
+                for (const _Trace::Event* event : *events) {
+                    const ArResolverContext& context =
+                        getContext(event->context);
+                    VtValue bindingData;
+
+                    // Calls recorded while a context was bound without a
+                    // recorded bind, as by ResolveMany, bind it around
+                    // them.
+                    const uint32_t current = bound.empty() ? 0 : bound.back();
+                    const bool bindAround =
+                        (event->type == _Trace::Resolve ||
+                         event->type == _Trace::AnchorRelativePath) &&
+                        event->context != current;
+                    if (bindAround) {
+                        resolver.BindContext(context, &bindingData);
+                    }
+                    if (event->type == _Trace::UnbindContext &&
+                        (bound.empty() || bound.back() != event->context)) {
+                        continue;
+                    }
+
+                    std::string result;
+                    const auto start = std::chrono::steady_clock::now();
+                    switch (event->type) {
+                    case _Trace::Resolve:
+                        result = resolver.Resolve(_Remap(root, event->path));
+                        break;
+                    case _Trace::AnchorRelativePath:
+                        result = resolver.AnchorRelativePath(
+                            _Remap(root, event->path), event->argument);
+                        break;
+                    case _Trace::BindContext:
+                        resolver.BindContext(context, &bindingData);
+                        bound.push_back(event->context);
+                        break;
+                    case _Trace::UnbindContext:
+                        resolver.UnbindContext(context, &bindingData);
+                        bound.pop_back();
+                        break;
+                    case _Trace::CreateDefaultContextForAsset:
+                        resolver.CreateDefaultContextForAsset(
+                            _Remap(root, event->path));
+                        break;
+                    }
+                    (*latencies)[event->type].push_back(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - start).count());
+
+                    if (bindAround) {
+                        resolver.UnbindContext(context, &bindingData);
+                    }
+                    if ((event->type == _Trace::Resolve ||
+                         event->type == _Trace::AnchorRelativePath) &&
+                        result != _Remap(root, event->result)) {
+                        ++mismatches;
+                    }
+                }
+
+                // Leave the thread as it was.
+                while (!bound.empty()) {
+                    VtValue bindingData;
+                    resolver.UnbindContext(getContext(bound.back()), &bindingData);
+                    bound.pop_back();
+                }
+            }, &entry.second, &threadLatencies[threadIndex++]);
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        _Latencies latencies;
+        for (const _Latencies& threadLatency : threadLatencies) {
+            for (const auto& entry : threadLatency) {
+                std::vector<uint64_t>& values = latencies[entry.first];
+                values.insert(
+                    values.end(), entry.second.begin(), entry.second.end());
+            }
+        }
+        _PrintLatencies(
+            TfStringPrintf("replay pass %zu", pass + 1).c_str(), &latencies);
+        printf("  mismatches: %zu\n", mismatches.load());
+        numMismatches += mismatches;
+    }
+
+    TfRmTree(root);
+    return numMismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+//
+// Throughput of ReplaceResolver::ResolveMany against a sequential loop of
+// Resolve calls, on a synthetic asset tree.
+//
+// Usage: resolveManyBench [numAssets]
+
+#include "replaceResolver.h"
+#include "replaceResolverContext.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/base/vt/value.h>
+#include <pxr/usd/ar/resolverContext.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+
+std::string
+_AssetPath(size_t index, const char* version)
+{
+    return TfStringPrintf(
+        "assets/asset%06zu/%s/asset%06zu.usda", index, version, index);
+}
+
+double
+_Seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+} // anonymous
+
+int
+main(int argc, char* argv[])
+{
+    const size_t numAssets = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+    const size_t numDuplicates = 4;
+
+    const std::string root = ArchMakeTmpSubdir(ArchGetTmpDir(), "resolveManyBench");
+    for (size_t i = 0; i < numAssets; ++i) {
+        const std::string filePath =
+            TfStringCatPaths(root, _AssetPath(i, "v002"));
+        TfMakeDirs(TfGetPathName(filePath), -1, /* existOk = */ true);
+        std::ofstream(filePath.c_str()) << "#usda 1.0\n";
+    }
+
+    ReplaceResolverContext context({root});
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < numAssets; ++i) {
+        context.AddReplacePair(_AssetPath(i, "v001"), _AssetPath(i, "v002"));
+    }
+    for (size_t d = 0; d < numDuplicates; ++d) {
+        for (size_t i = 0; i < numAssets; ++i) {
+            paths.push_back(_AssetPath(i, "v001"));
+        }
+    }
+    const ArResolverContext arContext(context);
+
+    ReplaceResolver resolver;
+    // Measure the filesystem work, not the resolve cache.
+    resolver.SetResolveCacheBudget(0);
+
+    auto start = std::chrono::steady_clock::now();
+    VtValue bindingData;
+    resolver.BindContext(arContext, &bindingData);
+    size_t numResolved = 0;
+    for (const std::string& path : paths) {
+        numResolved += resolver.Resolve(path).empty() ? 0 : 1;
+    }
+    resolver.UnbindContext(arContext, &bindingData);
+    const double sequential = _Seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    const std::vector<std::string> results = resolver.ResolveMany(paths, arContext);
+    const double parallel = _Seconds(start);
+
+    size_t numParallelResolved = 0;
+    for (const std::string& result : results) {
+        numParallelResolved += result.empty() ? 0 : 1;
+    }
+
+    printf("paths: %zu (%zu unique), resolved: %zu / %zu\n",
+           paths.size(), numAssets, numResolved, numParallelResolved);
+    printf("%-12s %10.3f s %12.0f paths/s\n",
+           "sequential", sequential, paths.size() / sequential);
+    printf("%-12s %10.3f s %12.0f paths/s\n",
+           "ResolveMany", parallel, paths.size() / parallel);
+
+    TfRmTree(root);
+    return numResolved == numParallelResolved ? 0 : 1;
+}
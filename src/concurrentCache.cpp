@@ -0,0 +1,163 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "concurrentCache.h"
+
+#include <pxr/pxr.h>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+constexpr size_t ReplaceResolverConcurrentCache::_NumShardBits;
+constexpr size_t ReplaceResolverConcurrentCache::_NumShards;
+constexpr size_t ReplaceResolverConcurrentCache::_InitialCapacity;
+
+ReplaceResolverConcurrentCache::_Table::_Table(size_t capacity)
+    : mask(capacity - 1)
+    , slots(new std::atomic<_Entry*>[capacity])
+{
+    for (size_t i = 0; i < capacity; ++i) {
+        slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+ReplaceResolverConcurrentCache::ReplaceResolverConcurrentCache()
+    : _shards(new _Shard[_NumShards])
+{
+    for (size_t i = 0; i < _NumShards; ++i) {
+        _Shard& shard = _shards[i];
+        shard.tables.emplace_back(new _Table(_InitialCapacity));
+        shard.table.store(shard.tables.back().get(), std::memory_order_release);
+    }
+}
+
+ReplaceResolverConcurrentCache::~ReplaceResolverConcurrentCache()
+{
+}
+
+ReplaceResolverConcurrentCache::_Shard&
+ReplaceResolverConcurrentCache::_GetShard(size_t hash) const
+{
+    // The low bits of the hash select the slots, use the high ones.
+    return _shards[(hash >> (sizeof(size_t) * 8 - _NumShardBits)) &
+                   (_NumShards - 1)];
+}
+
+ReplaceResolverConcurrentCache::_Entry*
+ReplaceResolverConcurrentCache::_Probe(
+    const _Table* table,
+    const Key& key,
+    size_t hash)
+{
+    for (size_t index = hash & table->mask; ; index = (index + 1) & table->mask) {
+        _Entry* entry = table->slots[index].load(std::memory_order_acquire);
+        if (!entry) {
+            return nullptr;
+        }
+        if (entry->hash == hash && entry->key == key) {
+            return entry;
+        }
+    }
+}
+
+void
+ReplaceResolverConcurrentCache::_InsertSlot(_Table* table, _Entry* entry)
+{
+    size_t index = entry->hash & table->mask;
+    while (table->slots[index].load(std::memory_order_relaxed)) {
+        index = (index + 1) & table->mask;
+    }
+    table->slots[index].store(entry, std::memory_order_release);
+}
+
+bool
+ReplaceResolverConcurrentCache::Find(const Key& key, Value* value) const
+{
+    const size_t hash = key.GetHash();
+    const _Shard& shard = _GetShard(hash);
+    const _Entry* entry =
+        _Probe(shard.table.load(std::memory_order_acquire), key, hash);
+    if (!entry || !entry->ready.load(std::memory_order_acquire)) {
+        return false;
+    }
+    *value = entry->value.load(std::memory_order_relaxed);
+    return true;
+}
+
+ReplaceResolverConcurrentCache::_Entry*
+ReplaceResolverConcurrentCache::_Claim(
+    const Key& key,
+    size_t hash,
+    bool* owner)
+{
+    _Shard& shard = _GetShard(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Another thread may have claimed the key since the lock free probe.
+    _Table* table = shard.table.load(std::memory_order_relaxed);
+    if (_Entry* entry = _Probe(table, key, hash)) {
+        *owner = false;
+        return entry;
+    }
+
+    shard.entries.emplace_back();
+    _Entry* entry = &shard.entries.back();
+    entry->key = key;
+    entry->hash = hash;
+
+    // Keep the load under one half, probes then stay short. The grown
+    // table is filled before being published, readers of the former one
+    // fall back here and find their entry.
+    if ((shard.entries.size() * 2) > table->mask + 1) {
+        shard.tables.emplace_back(new _Table((table->mask + 1) * 2));
+        _Table* grown = shard.tables.back().get();
+        for (_Entry& existing : shard.entries) {
+            _InsertSlot(grown, &existing);
+        }
+        shard.table.store(grown, std::memory_order_release);
+    }
+    else {
+        _InsertSlot(table, entry);
+    }
+
+    *owner = true;
+    return entry;
+}
+
+void
+ReplaceResolverConcurrentCache::_Publish(_Entry* entry, Value value)
+{
+    entry->value.store(value, std::memory_order_relaxed);
+    entry->ready.store(true, std::memory_order_release);
+
+    // Waiters check the flag under the lock, taking it here ensures none
+    // of them misses the notification.
+    _Shard& shard = _GetShard(entry->hash);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+    }
+    shard.readyCondition.notify_all();
+}
+
+ReplaceResolverConcurrentCache::Value
+ReplaceResolverConcurrentCache::_Wait(_Entry* entry)
+{
+    if (!entry->ready.load(std::memory_order_acquire)) {
+        _Shard& shard = _GetShard(entry->hash);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        shard.readyCondition.wait(lock, [entry]() {
+            return entry->ready.load(std::memory_order_acquire);
+        });
+    }
+    return entry->value.load(std::memory_order_relaxed);
+}
+
+size_t
+ReplaceResolverConcurrentCache::GetSize() const
+{
+    size_t size = 0;
+    for (size_t i = 0; i < _NumShards; ++i) {
+        std::lock_guard<std::mutex> lock(_shards[i].mutex);
+        size += _shards[i].entries.size();
+    }
+    return size;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
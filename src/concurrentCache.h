@@ -0,0 +1,149 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_CONCURRENT_CACHE_H
+#define USD_REPLACE_RESOLVER_CONCURRENT_CACHE_H
+
+#include "pathTable.h"
+#include "resolveCache.h"
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplaceResolverConcurrentCache
+///
+/// Read-mostly map from a resolve cache key to a resolved path id, used for
+/// the cache scopes.
+///
+/// Lookups of existing entries take no lock: each shard is an open
+/// addressing table of entry pointers, replaced as a whole when it grows,
+/// and entries never move. Insertions lock their shard only to claim an
+/// entry, and concurrent lookups of a key being computed wait for the
+/// first one instead of computing it again.
+///
+class ReplaceResolverConcurrentCache
+{
+public:
+    using Key = ReplaceResolverCacheKey;
+    using Value = ReplaceResolverPathTable::Id;
+
+    AR_API ReplaceResolverConcurrentCache();
+    AR_API ~ReplaceResolverConcurrentCache();
+
+    ReplaceResolverConcurrentCache(
+        const ReplaceResolverConcurrentCache&) = delete;
+    ReplaceResolverConcurrentCache& operator=(
+        const ReplaceResolverConcurrentCache&) = delete;
+
+    /// Return true and set \p value if \p key is cached and computed.
+    AR_API bool Find(const Key& key, Value* value) const;
+
+    /// Return the value cached for \p key, calling \p compute to fill it
+    /// if it is missing. If another thread is computing it, wait for its
+    /// result. \p hit is set to false only when \p compute was called.
+    template <class Fn>
+    Value FindOrCompute(const Key& key, Fn&& compute, bool* hit = nullptr);
+
+    /// Return the number of entries.
+    AR_API size_t GetSize() const;
+
+private:
+    struct _Entry
+    {
+        Key key;
+        size_t hash = 0;
+        std::atomic<Value> value{ReplaceResolverPathTable::InvalidId};
+        std::atomic<bool> ready{false};
+    };
+
+    struct _Table
+    {
+        explicit _Table(size_t capacity);
+
+        size_t mask;
+        std::unique_ptr<std::atomic<_Entry*>[]> slots;
+    };
+
+    struct _Shard
+    {
+        std::atomic<_Table*> table{nullptr};
+
+        std::mutex mutex;
+        std::condition_variable readyCondition;
+        // Tables are kept until destruction, lock free readers may still
+        // probe a replaced one.
+        std::vector<std::unique_ptr<_Table>> tables;
+        std::deque<_Entry> entries;
+    };
+
+    static constexpr size_t _NumShardBits = 6;
+    static constexpr size_t _NumShards = size_t(1) << _NumShardBits;
+    static constexpr size_t _InitialCapacity = 16;
+
+    _Shard& _GetShard(size_t hash) const;
+
+    static _Entry* _Probe(const _Table* table, const Key& key, size_t hash);
+    static void _InsertSlot(_Table* table, _Entry* entry);
+
+    // Return the entry of \p key, creating it if needed, in which case
+    // \p owner is set to true and the caller must publish its value.
+    AR_API _Entry* _Claim(const Key& key, size_t hash, bool* owner);
+    AR_API void _Publish(_Entry* entry, Value value);
+    AR_API Value _Wait(_Entry* entry);
+
+    std::unique_ptr<_Shard[]> _shards;
+};
+
+template <class Fn>
+ReplaceResolverConcurrentCache::Value
+ReplaceResolverConcurrentCache::FindOrCompute(
+    const Key& key,
+    Fn&& compute,
+    bool* hit)
+{
+    const size_t hash = key.GetHash();
+    _Shard& shard = _GetShard(hash);
+    _Entry* entry =
+        _Probe(shard.table.load(std::memory_order_acquire), key, hash);
+    if (entry && entry->ready.load(std::memory_order_acquire)) {
+        if (hit) {
+            *hit = true;
+        }
+        return entry->value.load(std::memory_order_relaxed);
+    }
+
+    bool owner = false;
+    if (!entry) {
+        entry = _Claim(key, hash, &owner);
+    }
+    if (hit) {
+        *hit = !owner;
+    }
+    if (!owner) {
+        return _Wait(entry);
+    }
+
+    // Waiters must never be left hanging.
+    Value value = ReplaceResolverPathTable::InvalidId;
+    try {
+        value = compute();
+    }
+    catch (...) {
+        _Publish(entry, value);
+        throw;
+    }
+    _Publish(entry, value);
+    return value;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_CONCURRENT_CACHE_H
@@ -0,0 +1,438 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+//
+// rdo-resolverd, the resolver daemon of a user session.
+//
+// Resolves paths for the processes of the user, which query it over a Unix
+// domain socket through ReplaceResolverDaemonClient, so that a newly
+// launched application finds the paths other applications resolved before
+// instead of probing the search paths again. The daemon holds a
+// ReplaceResolver whose resolve cache, directory listings and search
+// indices stay warm, and the contexts its clients sent, rebuilt once.
+//
+// The resolver is configured from the environment like in any process.
+// Directory listings and watching are enabled unless the environment says
+// otherwise, a long lived cache must see publishes. Clients only use a
+// daemon with the same fallback search path as theirs.
+//
+// Usage: rdo-resolverd [--socket path]
+
+#include "daemonProtocol.h"
+#include "replaceResolver.h"
+#include "replaceResolverContext.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/arch/env.h>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/usd/ar/resolverContext.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+
+using _Protocol = ReplaceResolverDaemonProtocol;
+
+// Contexts kept before all of them are dropped, clients send them again.
+constexpr size_t _MaxContexts = 4096;
+
+int _stopPipe[2] = {-1, -1};
+
+void
+_OnSignal(int)
+{
+    const char stop = 0;
+    if (write(_stopPipe[1], &stop, 1) < 0) {
+        // Nothing to do from a signal handler.
+    }
+}
+
+bool
+_MakeAddress(const std::string& socketPath, sockaddr_un* address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address->sun_path)) {
+        fprintf(stderr, "Socket path '%s' is too long\n", socketPath.c_str());
+        return false;
+    }
+    memcpy(address->sun_path, socketPath.c_str(), socketPath.size());
+    return true;
+}
+
+// Return the listening socket, or -1 if another daemon already listens.
+int
+_Listen(const std::string& socketPath)
+{
+    sockaddr_un address;
+    if (!_MakeAddress(socketPath, &address)) {
+        return -1;
+    }
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Could not create a socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // Only the user may connect.
+    const mode_t mask = umask(0077);
+    int status = bind(
+        fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    if (status != 0 && errno == EADDRINUSE) {
+        // The socket of a daemon that died is left behind.
+        const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const bool isRunning = probe >= 0 && connect(
+            probe, reinterpret_cast<const sockaddr*>(&address),
+            sizeof(address)) == 0;
+        if (probe >= 0) {
+            close(probe);
+        }
+        if (isRunning) {
+            umask(mask);
+            close(fd);
+            fprintf(stderr, "A daemon already listens on '%s'\n",
+                    socketPath.c_str());
+            return -1;
+        }
+        unlink(socketPath.c_str());
+        status = bind(
+            fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    }
+    umask(mask);
+
+    if (status != 0 || listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Could not listen on '%s': %s\n",
+                socketPath.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+class _Server
+{
+public:
+    // Answer the requests of a client until it disconnects.
+    void Serve(int fd);
+
+private:
+    // Read the context of a request, returning a status.
+    _Protocol::Status _ReadContext(
+        _Protocol::Reader* reader,
+        ArResolverContext* context);
+
+    _Protocol::Status _Resolve(
+        _Protocol::Reader* reader,
+        _Protocol::Writer* reply);
+
+    _Protocol::Status _Refresh(_Protocol::Reader* reader);
+    _Protocol::Status _Rebase(_Protocol::Reader* reader);
+
+    ReplaceResolver _resolver;
+
+    std::mutex _mutex;
+    std::map<ReplaceResolverFingerprint, ArResolverContext> _contexts;
+};
+
+void
+_Server::Serve(int fd)
+{
+    _Protocol::MessageType type;
+    std::string payload;
+    std::string errMsg;
+    while (_Protocol::Receive(fd, &type, &payload, &errMsg)) {
+        _Protocol::Reader reader(payload);
+        _Protocol::Writer reply;
+        if (type == _Protocol::Hello) {
+            reply.WriteVarint(_Protocol::Version);
+            reply.WriteFingerprint(_resolver.GetEnvironmentFingerprint());
+        }
+        else if (type == _Protocol::Resolve) {
+            // The reply is only written once the request was read.
+            const _Protocol::Status status = _Resolve(&reader, &reply);
+            if (status != _Protocol::Ok) {
+                reply.WriteVarint(status);
+            }
+        }
+        else if (type == _Protocol::Refresh) {
+            reply.WriteVarint(_Refresh(&reader));
+        }
+        else if (type == _Protocol::Rebase) {
+            reply.WriteVarint(_Rebase(&reader));
+        }
+        else {
+            errMsg = TfStringPrintf("unknown message %d", static_cast<int>(type));
+            break;
+        }
+
+        if (!_Protocol::Send(fd, type, reply.GetPayload(), &errMsg)) {
+            break;
+        }
+    }
+
+    if (!errMsg.empty()) {
+        fprintf(stderr, "Closing a connection: %s\n", errMsg.c_str());
+    }
+}
+
+_Protocol::Status
+_Server::_ReadContext(_Protocol::Reader* reader, ArResolverContext* context)
+{
+    uint64_t kind;
+    if (!reader->ReadVarint(&kind) || kind > 2) {
+        return _Protocol::InvalidRequest;
+    }
+    if (kind == 0) {
+        *context = ArResolverContext();
+        return _Protocol::Ok;
+    }
+
+    _Protocol::Context content;
+    if (kind == 1) {
+        if (!reader->ReadFingerprint(&content.fingerprint)) {
+            return _Protocol::InvalidRequest;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _contexts.find(content.fingerprint);
+        if (it == _contexts.end()) {
+            return _Protocol::UnknownContext;
+        }
+        *context = it->second;
+        return _Protocol::Ok;
+    }
+
+    // Tables and indices are opened outside of the lock.
+    if (!reader->ReadContext(&content)) {
+        return _Protocol::InvalidRequest;
+    }
+    ReplaceResolverContext replaceContext;
+    if (!_Protocol::MakeContext(content, &replaceContext)) {
+        return _Protocol::InvalidContext;
+    }
+    *context = ArResolverContext(replaceContext);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_contexts.size() >= _MaxContexts) {
+        _contexts.clear();
+    }
+    _contexts.emplace(content.fingerprint, *context);
+    return _Protocol::Ok;
+}
+
+_Protocol::Status
+_Server::_Resolve(_Protocol::Reader* reader, _Protocol::Writer* reply)
+{
+    ArResolverContext context;
+    const _Protocol::Status status = _ReadContext(reader, &context);
+    if (status != _Protocol::Ok) {
+        return status;
+    }
+
+    uint64_t size;
+    if (!reader->ReadVarint(&size)) {
+        return _Protocol::InvalidRequest;
+    }
+    std::vector<std::string> paths;
+    for (uint64_t i = 0; i < size; ++i) {
+        std::string path;
+        if (!reader->ReadString(&path)) {
+            return _Protocol::InvalidRequest;
+        }
+        paths.push_back(std::move(path));
+    }
+
+    // With an empty context, nothing is bound on this thread.
+    const std::vector<std::string> resolvedPaths =
+        _resolver.ResolveMany(paths, context);
+
+    reply->WriteVarint(_Protocol::Ok);
+    reply->WriteVarint(resolvedPaths.size());
+    for (const std::string& resolvedPath : resolvedPaths) {
+        reply->WriteString(resolvedPath);
+    }
+    return _Protocol::Ok;
+}
+
+_Protocol::Status
+_Server::_Refresh(_Protocol::Reader* reader)
+{
+    ArResolverContext context;
+    const _Protocol::Status status = _ReadContext(reader, &context);
+    if (status == _Protocol::UnknownContext) {
+        // Nothing was resolved with it.
+        return _Protocol::Ok;
+    }
+    if (status != _Protocol::Ok) {
+        return status;
+    }
+    _resolver.RefreshContext(context);
+    return _Protocol::Ok;
+}
+
+_Protocol::Status
+_Server::_Rebase(_Protocol::Reader* reader)
+{
+    ReplaceResolverFingerprint previousFingerprint;
+    if (!reader->ReadFingerprint(&previousFingerprint)) {
+        return _Protocol::InvalidRequest;
+    }
+    ArResolverContext previous;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _contexts.find(previousFingerprint);
+        if (it == _contexts.end()) {
+            // Nothing was resolved with it.
+            return _Protocol::Ok;
+        }
+        previous = it->second;
+    }
+
+    ArResolverContext context;
+    const _Protocol::Status status = _ReadContext(reader, &context);
+    if (status != _Protocol::Ok) {
+        return status;
+    }
+    // The entries of the previous context stay, other clients may still
+    // resolve with it.
+    _resolver.RebaseContext(previous, context);
+    return _Protocol::Ok;
+}
+
+struct _Connection
+{
+    int fd = -1;
+    std::thread thread;
+    std::atomic<bool> done{false};
+};
+
+} // anonymous
+
+int
+main(int argc, char* argv[])
+{
+    std::string socketPath;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            socketPath = argv[++i];
+        }
+        else {
+            fprintf(stderr, "Usage: %s [--socket path]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (socketPath.empty()) {
+        socketPath = _Protocol::GetDefaultSocketPath();
+    }
+
+    // The daemon resolves by itself.
+    ArchUnsetEnv("REPLACE_RESOLVER_DAEMON");
+    ArchSetEnv("REPLACE_RESOLVER_DIRECTORY_CACHE", "1", /* overwrite = */ false);
+    ArchSetEnv("REPLACE_RESOLVER_WATCH", "1", /* overwrite = */ false);
+
+    // Clients look up relative paths in their own current directory, the
+    // one of the daemon is empty so that they are only searched for in
+    // the search paths.
+    const std::string cwd =
+        ArchMakeTmpSubdir(ArchGetTmpDir(), "rdo-resolverd");
+    if (cwd.empty() || chdir(cwd.c_str()) != 0) {
+        fprintf(stderr, "Could not create an empty working directory\n");
+        return 1;
+    }
+
+    const int listenFd = _Listen(socketPath);
+    if (listenFd < 0) {
+        TfRmTree(cwd);
+        return 1;
+    }
+
+    if (pipe2(_stopPipe, O_CLOEXEC) != 0) {
+        fprintf(stderr, "Could not create a pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = _OnSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::unique_ptr<_Server> server(new _Server());
+    fprintf(stderr, "rdo-resolverd listening on '%s'\n", socketPath.c_str());
+
+    std::list<_Connection> connections;
+    while (true) {
+        pollfd fds[2] = {{listenFd, POLLIN, 0}, {_stopPipe[0], POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Stopped listening: %s\n", strerror(errno));
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+
+        // Connections closed since the last one are reaped here.
+        for (auto it = connections.begin(); it != connections.end(); ) {
+            if (it->done) {
+                it->thread.join();
+                close(it->fd);
+                it = connections.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
+        const int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        connections.emplace_back();
+        _Connection& connection = connections.back();
+        connection.fd = fd;
+        connection.thread = std::thread([&server, &connection]() {
+            server->Serve(connection.fd);
+            connection.done = true;
+        });
+    }
+
+    close(listenFd);
+    unlink(socketPath.c_str());
+
+    // Waiting clients see the connection closed and resolve in process.
+    for (_Connection& connection : connections) {
+        shutdown(connection.fd, SHUT_RDWR);
+    }
+    for (_Connection& connection : connections) {
+        connection.thread.join();
+        close(connection.fd);
+    }
+    server.reset();
+
+    TfRmTree(cwd);
+    return 0;
+}
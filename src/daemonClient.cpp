@@ -0,0 +1,439 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "daemonClient.h"
+#include "debugCodes.h"
+#include "replaceResolverContext.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/tf/diagnostic.h>
+#include <pxr/base/tf/stringUtils.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+
+using _Protocol = ReplaceResolverDaemonProtocol;
+
+// Time during which an unreachable daemon is not tried again.
+constexpr std::chrono::seconds _RetryDelay(1);
+
+int64_t
+_Now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef __linux__
+// Return false and set \p whyNot if the socket at \p socketPath may not
+// be the one of a daemon of the user: it must belong to the user, in a
+// directory where other users cannot replace it. A missing socket is left
+// to connect to report.
+bool
+_IsSocketPathPrivate(const std::string& socketPath, std::string* whyNot)
+{
+    const uid_t uid = getuid();
+    struct stat st;
+    if (lstat(socketPath.c_str(), &st) != 0) {
+        return true;
+    }
+    if (!S_ISSOCK(st.st_mode) || st.st_uid != uid) {
+        *whyNot = "it is not a socket of the user";
+        return false;
+    }
+
+    // Other users may add entries to a shared directory like /tmp, the
+    // sticky bit keeps them from removing or renaming the ones of the
+    // user.
+    const std::string dirPath = TfGetPathName(socketPath);
+    if (stat(dirPath.empty() ? "." : dirPath.c_str(), &st) != 0) {
+        *whyNot = strerror(errno);
+        return false;
+    }
+    if ((st.st_uid != uid && st.st_uid != 0) ||
+        ((st.st_mode & (S_IWGRP | S_IWOTH)) != 0 &&
+         (st.st_mode & S_ISVTX) == 0)) {
+        *whyNot = "other users may replace it in its directory";
+        return false;
+    }
+    return true;
+}
+
+// Return true if the process at the other end of \p fd runs as the user.
+bool
+_IsPeerOfUser(int fd)
+{
+    ucred credentials;
+    socklen_t size = sizeof(credentials);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) == 0 &&
+        size == sizeof(credentials) &&
+        credentials.uid == getuid();
+}
+#endif
+
+} // anonymous
+
+ReplaceResolverDaemonClient::ReplaceResolverDaemonClient(
+    const std::string& socketPath,
+    const ReplaceResolverFingerprint& environment,
+    double timeout)
+    : _socketPath(socketPath)
+    , _environment(environment)
+    , _timeout(timeout)
+    , _retryTime(0)
+    , _warned(false)
+    , _numRequests(0)
+    , _numFailedRequests(0)
+{
+}
+
+ReplaceResolverDaemonClient::~ReplaceResolverDaemonClient()
+{
+#ifdef __linux__
+    for (int fd : _idle) {
+        close(fd);
+    }
+#endif
+}
+
+int
+ReplaceResolverDaemonClient::_Connect()
+{
+#ifdef __linux__
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (_socketPath.size() >= sizeof(address.sun_path)) {
+        TF_DEBUG(REPLACERESOLVER_DAEMON).Msg(
+            "Daemon socket path \"%s\" is too long\n", _socketPath.c_str());
+        return -1;
+    }
+    memcpy(address.sun_path, _socketPath.c_str(), _socketPath.size());
+
+    // Resolved paths are trusted as the daemon answers them, only a daemon
+    // of the user is asked.
+    std::string whyNot;
+    if (!_IsSocketPathPrivate(_socketPath, &whyNot)) {
+        if (!_warned.exchange(true)) {
+            TF_WARN("Not using the resolver daemon at '%s', %s",
+                    _socketPath.c_str(), whyNot.c_str());
+        }
+        return -1;
+    }
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address),
+                sizeof(address)) != 0) {
+        TF_DEBUG(REPLACERESOLVER_DAEMON).Msg(
+            "Could not connect to the daemon at \"%s\": %s\n",
+            _socketPath.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if (!_IsPeerOfUser(fd)) {
+        if (!_warned.exchange(true)) {
+            TF_WARN("Not using the resolver daemon at '%s', it runs as "
+                    "another user", _socketPath.c_str());
+        }
+        close(fd);
+        return -1;
+    }
+
+    // A hung daemon must not hang the resolves.
+    if (_timeout > 0.0) {
+        timeval tv;
+        tv.tv_sec = static_cast<time_t>(_timeout);
+        tv.tv_usec = static_cast<suseconds_t>(
+            (_timeout - static_cast<double>(tv.tv_sec)) * 1e6);
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+
+    _Protocol::Writer hello;
+    hello.WriteVarint(_Protocol::Version);
+    _Protocol::MessageType type;
+    std::string reply;
+    std::string errMsg;
+    if (!_Protocol::Send(fd, _Protocol::Hello, hello.GetPayload(), &errMsg) ||
+        !_Protocol::Receive(fd, &type, &reply, &errMsg)) {
+        TF_DEBUG(REPLACERESOLVER_DAEMON).Msg(
+            "Daemon at \"%s\" did not answer: %s\n",
+            _socketPath.c_str(), errMsg.c_str());
+        close(fd);
+        return -1;
+    }
+
+    _Protocol::Reader reader(reply);
+    uint64_t version = 0;
+    ReplaceResolverFingerprint environment;
+    if (type != _Protocol::Hello || !reader.ReadVarint(&version) ||
+        version != _Protocol::Version ||
+        !reader.ReadFingerprint(&environment) ||
+        environment != _environment) {
+        if (!_warned.exchange(true)) {
+            TF_WARN("Not using the resolver daemon at '%s', it runs another "
+                    "version or another configuration",
+                    _socketPath.c_str());
+        }
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+int
+ReplaceResolverDaemonClient::_Acquire(bool* isNew)
+{
+    if (_Now() < _retryTime.load(std::memory_order_relaxed)) {
+        return -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_idle.empty()) {
+            const int fd = _idle.back();
+            _idle.pop_back();
+            *isNew = false;
+            return fd;
+        }
+    }
+
+    const int fd = _Connect();
+    if (fd < 0) {
+        _SetUnavailable();
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_numConnections;
+    *isNew = true;
+    return fd;
+}
+
+void
+ReplaceResolverDaemonClient::_Release(int fd)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _idle.push_back(fd);
+}
+
+void
+ReplaceResolverDaemonClient::_SetUnavailable()
+{
+    _retryTime = _Now() +
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            _RetryDelay).count();
+    _CloseIdle();
+}
+
+void
+ReplaceResolverDaemonClient::_CloseIdle()
+{
+#ifdef __linux__
+    // Connections kept while the daemon restarted are closed.
+    std::vector<int> idle;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        idle.swap(_idle);
+        _numConnections -= std::min(_numConnections, idle.size());
+    }
+    for (int fd : idle) {
+        close(fd);
+    }
+#endif
+}
+
+bool
+ReplaceResolverDaemonClient::_Request(
+    _Protocol::MessageType type,
+    const ReplaceResolverContext* context,
+    const std::vector<const std::string*>& paths,
+    std::string* reply,
+    const ReplaceResolverFingerprint* previous)
+{
+    ++_numRequests;
+
+    ReplaceResolverFingerprint fingerprint;
+    bool sendContent = false;
+    if (context) {
+        fingerprint = context->GetFingerprint();
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_invalidContexts.count(fingerprint)) {
+            ++_numFailedRequests;
+            return false;
+        }
+        sendContent = !_knownContexts.count(fingerprint);
+    }
+
+    // A kept connection may have been closed by a daemon restarted since,
+    // the request is sent again once on a new connection.
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        bool isNew = false;
+        const int fd = _Acquire(&isNew);
+        if (fd < 0) {
+            break;
+        }
+
+        _Protocol::Writer request;
+        if (previous) {
+            request.WriteFingerprint(*previous);
+        }
+        request.WriteVarint(context ? (sendContent ? 2 : 1) : 0);
+        if (sendContent) {
+            request.WriteContext(_Protocol::GetContent(*context));
+        }
+        else if (context) {
+            request.WriteFingerprint(fingerprint);
+        }
+        request.WriteVarint(paths.size());
+        for (const std::string* path : paths) {
+            request.WriteString(*path);
+        }
+
+        _Protocol::MessageType replyType;
+        std::string errMsg;
+        bool isValid =
+            _Protocol::Send(fd, type, request.GetPayload(), &errMsg) &&
+            _Protocol::Receive(fd, &replyType, reply, &errMsg);
+        // An empty message means the daemon closed the connection.
+        const bool wasClosed = !isValid &&
+            (errMsg.empty() || errno == EPIPE || errno == ECONNRESET);
+        if (isValid && (replyType != type || reply->empty())) {
+            errMsg = "invalid reply";
+            isValid = false;
+        }
+        if (!isValid) {
+            TF_DEBUG(REPLACERESOLVER_DAEMON).Msg(
+                "Request to the daemon at \"%s\" failed: %s\n",
+                _socketPath.c_str(), errMsg.c_str());
+#ifdef __linux__
+            close(fd);
+#endif
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                --_numConnections;
+            }
+            // Timeouts and invalid replies are not retried.
+            if (isNew || !wasClosed) {
+                _SetUnavailable();
+                break;
+            }
+            _CloseIdle();
+            continue;
+        }
+        _Release(fd);
+
+        const _Protocol::Status status =
+            static_cast<_Protocol::Status>((*reply)[0]);
+        if (status == _Protocol::UnknownContext && !sendContent) {
+            sendContent = true;
+            continue;
+        }
+        if (status != _Protocol::Ok) {
+            TF_DEBUG(REPLACERESOLVER_DAEMON).Msg(
+                "Daemon at \"%s\" could not answer, status %d\n",
+                _socketPath.c_str(), static_cast<int>(status));
+            if (status == _Protocol::InvalidContext) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _invalidContexts.insert(fingerprint);
+            }
+            break;
+        }
+        if (sendContent) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _knownContexts.insert(fingerprint);
+        }
+        reply->erase(0, 1);
+        return true;
+    }
+
+    ++_numFailedRequests;
+    return false;
+}
+
+bool
+ReplaceResolverDaemonClient::Resolve(
+    const ReplaceResolverContext* context,
+    const std::vector<const std::string*>& paths,
+    std::vector<std::string>* resolvedPaths)
+{
+    std::string reply;
+    if (!_Request(_Protocol::Resolve, context, paths, &reply)) {
+        return false;
+    }
+
+    _Protocol::Reader reader(reply);
+    uint64_t size;
+    if (!reader.ReadVarint(&size) || size != paths.size()) {
+        ++_numFailedRequests;
+        return false;
+    }
+    resolvedPaths->resize(paths.size());
+    for (std::string& resolvedPath : *resolvedPaths) {
+        if (!reader.ReadString(&resolvedPath)) {
+            ++_numFailedRequests;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+ReplaceResolverDaemonClient::Refresh(const ReplaceResolverContext* context)
+{
+    std::string reply;
+    return _Request(_Protocol::Refresh, context,
+                    std::vector<const std::string*>(), &reply);
+}
+
+bool
+ReplaceResolverDaemonClient::RebaseContext(
+    const ReplaceResolverFingerprint& previous,
+    const ReplaceResolverContext* context)
+{
+    std::string reply;
+    return _Request(_Protocol::Rebase, context,
+                    std::vector<const std::string*>(), &reply, &previous);
+}
+
+bool
+ReplaceResolverDaemonClient::IsAvailable()
+{
+    bool isNew;
+    const int fd = _Acquire(&isNew);
+    if (fd < 0) {
+        return false;
+    }
+    _Release(fd);
+    return true;
+}
+
+ReplaceResolverDaemonClient::Counters
+ReplaceResolverDaemonClient::GetCounters() const
+{
+    Counters counters;
+    counters.requests = _numRequests;
+    counters.failedRequests = _numFailedRequests;
+    std::lock_guard<std::mutex> lock(_mutex);
+    counters.connections = _numConnections;
+    return counters;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
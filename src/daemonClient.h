@@ -0,0 +1,122 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_DAEMON_CLIENT_H
+#define USD_REPLACE_RESOLVER_DAEMON_CLIENT_H
+
+#include "daemonProtocol.h"
+#include "fingerprint.h"
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+class ReplaceResolverContext;
+
+/// \class ReplaceResolverDaemonClient
+///
+/// Resolve paths through the rdo-resolverd daemon of the session, which
+/// keeps its caches warm for all the processes of the user. See
+/// ReplaceResolverDaemonProtocol.
+///
+/// Connections are opened on demand and kept for the next requests, one
+/// per concurrent request. When the daemon cannot be reached, requests fail
+/// at once for a second before it is tried again, so that callers resolve
+/// in process at no extra cost.
+///
+/// The daemon resolves with its own fallback search path and settings, a
+/// daemon whose ReplaceResolver::GetEnvironmentFingerprint differs from
+/// \p environment is not used. Requests time out after \p timeout
+/// seconds, or never if it is zero.
+///
+class ReplaceResolverDaemonClient
+{
+public:
+    struct Counters
+    {
+        size_t requests = 0;
+        size_t failedRequests = 0;
+        size_t connections = 0;
+    };
+
+    AR_API ReplaceResolverDaemonClient(
+        const std::string& socketPath,
+        const ReplaceResolverFingerprint& environment,
+        double timeout);
+
+    AR_API ~ReplaceResolverDaemonClient();
+
+    ReplaceResolverDaemonClient(const ReplaceResolverDaemonClient&) = delete;
+    ReplaceResolverDaemonClient& operator=(
+        const ReplaceResolverDaemonClient&) = delete;
+
+    /// Resolve \p paths with \p context bound, or with no context if it is
+    /// null. Relative paths are only looked up in the search paths. Returns
+    /// false if the daemon could not answer.
+    AR_API bool Resolve(
+        const ReplaceResolverContext* context,
+        const std::vector<const std::string*>& paths,
+        std::vector<std::string>* resolvedPaths);
+
+    /// Have the daemon drop the paths it resolved with \p context.
+    AR_API bool Refresh(const ReplaceResolverContext* context);
+
+    /// Have the daemon carry the paths it resolved with the context having
+    /// the \p previous fingerprint over to \p context, whose rules changed
+    /// since, like ReplaceResolver::RebaseContext.
+    AR_API bool RebaseContext(
+        const ReplaceResolverFingerprint& previous,
+        const ReplaceResolverContext* context);
+
+    /// Return true if the daemon answers.
+    AR_API bool IsAvailable();
+
+    AR_API Counters GetCounters() const;
+
+    const std::string& GetSocketPath() const { return _socketPath; }
+
+private:
+    // Return an open connection, or -1.
+    int _Acquire(bool* isNew);
+    void _Release(int fd);
+    int _Connect();
+    void _SetUnavailable();
+    void _CloseIdle();
+
+    bool _Request(
+        ReplaceResolverDaemonProtocol::MessageType type,
+        const ReplaceResolverContext* context,
+        const std::vector<const std::string*>& paths,
+        std::string* reply,
+        const ReplaceResolverFingerprint* previous = nullptr);
+
+    const std::string _socketPath;
+    const ReplaceResolverFingerprint _environment;
+    const double _timeout;
+
+    // Connections are not tried again before this steady clock time, in
+    // nanoseconds.
+    std::atomic<int64_t> _retryTime;
+    std::atomic<bool> _warned;
+
+    mutable std::mutex _mutex;
+    std::vector<int> _idle;
+    size_t _numConnections = 0;
+    // Contexts the daemon knows, sent by fingerprint only.
+    std::set<ReplaceResolverFingerprint> _knownContexts;
+    // Contexts the daemon could not rebuild, resolved in process.
+    std::set<ReplaceResolverFingerprint> _invalidContexts;
+
+    std::atomic<size_t> _numRequests;
+    std::atomic<size_t> _numFailedRequests;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_DAEMON_CLIENT_H
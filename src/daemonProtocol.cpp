@@ -0,0 +1,357 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "daemonProtocol.h"
+#include "replaceResolverContext.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/tf/getenv.h>
+#include <pxr/base/tf/stringUtils.h>
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+constexpr uint32_t ReplaceResolverDaemonProtocol::Version;
+constexpr size_t ReplaceResolverDaemonProtocol::MaxPayloadSize;
+
+namespace {
+
+void
+_SetError(std::string* errMsg, const std::string& msg)
+{
+    if (errMsg) {
+        *errMsg = msg;
+    }
+}
+
+struct _Header
+{
+    uint32_t payloadSize;
+    uint8_t type;
+    uint8_t reserved[3];
+};
+
+#ifdef __linux__
+bool
+_SendAll(int fd, const char* data, size_t size)
+{
+    while (size > 0) {
+        // A daemon gone mid request must not kill the client with SIGPIPE.
+        const ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+// Returns 0 on success, 1 if the connection was closed before the first
+// byte and -1 on errors.
+int
+_ReceiveAll(int fd, char* data, size_t size)
+{
+    const size_t total = size;
+    while (size > 0) {
+        const ssize_t received = recv(fd, data, size, 0);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (received == 0) {
+            errno = 0;
+            return size == total ? 1 : -1;
+        }
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+    return 0;
+}
+#endif
+
+} // anonymous
+
+ReplaceResolverDaemonProtocol::Context
+ReplaceResolverDaemonProtocol::GetContent(const ReplaceResolverContext& context)
+{
+    Context content;
+    content.fingerprint = context.GetFingerprint();
+
+    content.searchPath = context.GetSearchPath();
+    for (const ReplaceResolverSearchIndexConstPtr& index :
+             context.GetSearchPathIndices()) {
+        content.searchIndices.push_back(
+            index ? index->GetFilePath() : std::string());
+    }
+
+    content.pairs = context.GetReplaceMap();
+    content.patterns = context.GetReplacePatterns();
+    if (const ReplaceTableFileConstPtr& table = context.GetReplaceTable()) {
+        content.replaceTable = table->GetFilePath();
+    }
+    return content;
+}
+
+bool
+ReplaceResolverDaemonProtocol::MakeContext(
+    const Context& content,
+    ReplaceResolverContext* context)
+{
+    ReplaceTableFileConstPtr table;
+    if (!content.replaceTable.empty()) {
+        table = ReplaceTableFile::Open(content.replaceTable);
+        if (!table) {
+            return false;
+        }
+    }
+
+    if (content.searchIndices.size() != content.searchPath.size()) {
+        return false;
+    }
+    ReplaceResolverContext::SearchIndexMap searchIndices;
+    for (size_t i = 0; i < content.searchPath.size(); ++i) {
+        if (!content.searchIndices[i].empty()) {
+            searchIndices[content.searchPath[i]] = content.searchIndices[i];
+        }
+    }
+
+    *context = ReplaceResolverContext(
+        content.searchPath,
+        std::make_shared<ReplaceRuleTable>(
+            content.pairs, content.patterns, table),
+        std::string(),
+        searchIndices);
+    return context->GetFingerprint() == content.fingerprint;
+}
+
+void
+ReplaceResolverDaemonProtocol::Writer::WriteVarint(uint64_t value)
+{
+    while (value >= 0x80) {
+        _payload.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    _payload.push_back(static_cast<char>(value));
+}
+
+void
+ReplaceResolverDaemonProtocol::Writer::WriteString(const std::string& str)
+{
+    WriteVarint(str.size());
+    _payload.append(str);
+}
+
+void
+ReplaceResolverDaemonProtocol::Writer::WriteFingerprint(
+    const ReplaceResolverFingerprint& value)
+{
+    _payload.append(reinterpret_cast<const char*>(&value.hi), sizeof(value.hi));
+    _payload.append(reinterpret_cast<const char*>(&value.lo), sizeof(value.lo));
+}
+
+void
+ReplaceResolverDaemonProtocol::Writer::WriteContext(const Context& context)
+{
+    WriteFingerprint(context.fingerprint);
+    WriteVarint(context.searchPath.size());
+    for (const std::string& path : context.searchPath) {
+        WriteString(path);
+    }
+    for (const std::string& path : context.searchIndices) {
+        WriteString(path);
+    }
+    WriteVarint(context.pairs.size());
+    for (const auto& pair : context.pairs) {
+        WriteString(pair.first);
+        WriteString(pair.second);
+    }
+    WriteVarint(context.patterns.size());
+    for (const auto& rule : context.patterns) {
+        WriteString(rule.first);
+        WriteString(rule.second);
+    }
+    WriteString(context.replaceTable);
+}
+
+bool
+ReplaceResolverDaemonProtocol::Reader::ReadVarint(uint64_t* value)
+{
+    *value = 0;
+    for (unsigned shift = 0; shift < 64 && _ptr != _end; shift += 7) {
+        const uint8_t byte = static_cast<uint8_t>(*_ptr++);
+        *value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+ReplaceResolverDaemonProtocol::Reader::ReadString(std::string* str)
+{
+    uint64_t size;
+    if (!ReadVarint(&size) || size > static_cast<uint64_t>(_end - _ptr)) {
+        return false;
+    }
+    str->assign(_ptr, static_cast<size_t>(size));
+    _ptr += size;
+    return true;
+}
+
+bool
+ReplaceResolverDaemonProtocol::Reader::ReadFingerprint(
+    ReplaceResolverFingerprint* value)
+{
+    if (_end - _ptr < static_cast<ptrdiff_t>(sizeof(value->hi) * 2)) {
+        return false;
+    }
+    memcpy(&value->hi, _ptr, sizeof(value->hi));
+    memcpy(&value->lo, _ptr + sizeof(value->hi), sizeof(value->lo));
+    _ptr += sizeof(value->hi) * 2;
+    return true;
+}
+
+bool
+ReplaceResolverDaemonProtocol::Reader::ReadContext(Context* context)
+{
+    uint64_t size;
+    if (!ReadFingerprint(&context->fingerprint) || !ReadVarint(&size)) {
+        return false;
+    }
+    // Each element takes at least one byte, a corrupted count cannot make
+    // the vectors grow past the payload.
+    for (uint64_t i = 0; i < size; ++i) {
+        std::string path;
+        if (!ReadString(&path)) {
+            return false;
+        }
+        context->searchPath.push_back(std::move(path));
+    }
+    for (uint64_t i = 0; i < size; ++i) {
+        std::string path;
+        if (!ReadString(&path)) {
+            return false;
+        }
+        context->searchIndices.push_back(std::move(path));
+    }
+    if (!ReadVarint(&size)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < size; ++i) {
+        std::string oldStr, newStr;
+        if (!ReadString(&oldStr) || !ReadString(&newStr)) {
+            return false;
+        }
+        context->pairs.emplace(std::move(oldStr), std::move(newStr));
+    }
+    if (!ReadVarint(&size)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < size; ++i) {
+        std::string pattern, replacement;
+        if (!ReadString(&pattern) || !ReadString(&replacement)) {
+            return false;
+        }
+        context->patterns.emplace_back(
+            std::move(pattern), std::move(replacement));
+    }
+    return ReadString(&context->replaceTable);
+}
+
+bool
+ReplaceResolverDaemonProtocol::Send(
+    int fd,
+    MessageType type,
+    const std::string& payload,
+    std::string* errMsg)
+{
+#ifdef __linux__
+    if (payload.size() > MaxPayloadSize) {
+        _SetError(errMsg, TfStringPrintf(
+            "Message of %zu bytes is too large", payload.size()));
+        return false;
+    }
+
+    _Header header = {static_cast<uint32_t>(payload.size()), type, {0, 0, 0}};
+    if (!_SendAll(fd, reinterpret_cast<const char*>(&header), sizeof(header)) ||
+        !_SendAll(fd, payload.data(), payload.size())) {
+        _SetError(errMsg, TfStringPrintf(
+            "Could not send to the daemon socket: %s", strerror(errno)));
+        return false;
+    }
+    return true;
+#else
+    _SetError(errMsg, "The resolver daemon is only supported on Linux");
+    return false;
+#endif
+}
+
+bool
+ReplaceResolverDaemonProtocol::Receive(
+    int fd,
+    MessageType* type,
+    std::string* payload,
+    std::string* errMsg)
+{
+#ifdef __linux__
+    _Header header;
+    const int status =
+        _ReceiveAll(fd, reinterpret_cast<char*>(&header), sizeof(header));
+    if (status != 0) {
+        _SetError(errMsg, status > 0 ? std::string() : TfStringPrintf(
+            "Could not receive from the daemon socket: %s",
+            errno ? strerror(errno) : "connection closed"));
+        return false;
+    }
+    if (header.payloadSize > MaxPayloadSize) {
+        _SetError(errMsg, TfStringPrintf(
+            "Invalid message of %u bytes", header.payloadSize));
+        return false;
+    }
+
+    *type = static_cast<MessageType>(header.type);
+    payload->resize(header.payloadSize);
+    if (header.payloadSize > 0 &&
+        _ReceiveAll(fd, &(*payload)[0], payload->size()) != 0) {
+        _SetError(errMsg, "Could not receive from the daemon socket: "
+                  "message truncated");
+        return false;
+    }
+    return true;
+#else
+    _SetError(errMsg, "The resolver daemon is only supported on Linux");
+    return false;
+#endif
+}
+
+std::string
+ReplaceResolverDaemonProtocol::GetDefaultSocketPath()
+{
+    const std::string runtimeDir = TfGetenv("XDG_RUNTIME_DIR");
+    if (!runtimeDir.empty()) {
+        return TfStringCatPaths(runtimeDir, "rdo-resolverd.sock");
+    }
+#ifdef __linux__
+    return TfStringCatPaths(ArchGetTmpDir(), TfStringPrintf(
+        "rdo-resolverd.%u.sock", static_cast<unsigned>(getuid())));
+#else
+    return TfStringCatPaths(ArchGetTmpDir(), "rdo-resolverd.sock");
+#endif
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,152 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_DAEMON_PROTOCOL_H
+#define USD_REPLACE_RESOLVER_DAEMON_PROTOCOL_H
+
+#include "fingerprint.h"
+#include "replaceRuleTable.h"
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+class ReplaceResolverContext;
+
+/// \class ReplaceResolverDaemonProtocol
+///
+/// Messages exchanged by ReplaceResolverDaemonClient and the rdo-resolverd
+/// daemon over a Unix domain socket.
+///
+/// A message is a header holding the size and type of its payload, then
+/// the payload, made of LEB128 integers and length prefixed strings. Both
+/// ends run on the same host, the header is in native byte order.
+///
+/// A connection starts with a Hello exchange, in which the daemon returns
+/// ReplaceResolver::GetEnvironmentFingerprint of its resolver, so that the
+/// client only uses a daemon resolving like itself. The client then sends
+/// requests one at a time and reads their reply:
+///   - Resolve: a context and a batch of paths, replied with a status and
+///     the resolved paths in the same order.
+///   - Refresh: a context whose resolved paths the daemon drops.
+///   - Rebase: the fingerprint of a context and a context with other
+///     rules, to which the daemon carries over the paths both rules
+///     replace the same way.
+///
+/// Contexts are sent by fingerprint, with their content the first time or
+/// when the daemon replies UnknownContext.
+///
+class ReplaceResolverDaemonProtocol
+{
+public:
+    static constexpr uint32_t Version = 3;
+
+    /// Payloads larger than this are rejected.
+    static constexpr size_t MaxPayloadSize = size_t(256) << 20;
+
+    enum MessageType : uint8_t
+    {
+        Hello = 1,
+        Resolve,
+        Refresh,
+        Rebase,
+    };
+
+    enum Status : uint8_t
+    {
+        Ok = 0,
+        /// The daemon does not know the context, send its content.
+        UnknownContext,
+        /// The context rebuilt by the daemon has another fingerprint, its
+        /// replace table or search indices differ on the daemon side.
+        InvalidContext,
+        InvalidRequest,
+    };
+
+    /// Content of a context, from which the daemon rebuilds it.
+    struct Context
+    {
+        ReplaceResolverFingerprint fingerprint;
+        std::vector<std::string> searchPath;
+        /// Search index file of each search path element, empty for the
+        /// elements without one.
+        std::vector<std::string> searchIndices;
+        ReplaceRuleTable::PairMap pairs;
+        ReplaceRuleTable::PatternList patterns;
+        std::string replaceTable;
+    };
+
+    /// Return the content of \p context.
+    AR_API static Context GetContent(const ReplaceResolverContext& context);
+
+    /// Build the context of \p content. Returns false if its fingerprint
+    /// differs from the one of \p content.
+    AR_API static bool MakeContext(
+        const Context& content,
+        ReplaceResolverContext* context);
+
+    /// Append the values of a payload to a buffer.
+    class Writer
+    {
+    public:
+        AR_API void WriteVarint(uint64_t value);
+        AR_API void WriteString(const std::string& str);
+        AR_API void WriteFingerprint(const ReplaceResolverFingerprint& value);
+        AR_API void WriteContext(const Context& context);
+
+        const std::string& GetPayload() const { return _payload; }
+
+    private:
+        std::string _payload;
+    };
+
+    /// Read the values of a payload. Reads past the end of the payload
+    /// return false.
+    class Reader
+    {
+    public:
+        explicit Reader(const std::string& payload)
+            : _ptr(payload.data())
+            , _end(payload.data() + payload.size())
+        {
+        }
+
+        AR_API bool ReadVarint(uint64_t* value);
+        AR_API bool ReadString(std::string* str);
+        AR_API bool ReadFingerprint(ReplaceResolverFingerprint* value);
+        AR_API bool ReadContext(Context* context);
+
+        bool IsAtEnd() const { return _ptr == _end; }
+
+    private:
+        const char* _ptr;
+        const char* _end;
+    };
+
+    /// Send a message on the socket \p fd.
+    AR_API static bool Send(
+        int fd,
+        MessageType type,
+        const std::string& payload,
+        std::string* errMsg = nullptr);
+
+    /// Receive a message from the socket \p fd. Returns false with an
+    /// empty \p errMsg when the peer closed the connection.
+    AR_API static bool Receive(
+        int fd,
+        MessageType* type,
+        std::string* payload,
+        std::string* errMsg = nullptr);
+
+    /// Return the socket of the daemon of the user, in XDG_RUNTIME_DIR
+    /// when it is set.
+    AR_API static std::string GetDefaultSocketPath();
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_DAEMON_PROTOCOL_H
@@ -13,6 +13,7 @@ TF_REGISTRY_FUNCTION(TfDebug)
     TF_DEBUG_ENVIRONMENT_SYMBOL(REPLACERESOLVER_PATH, "Print debug output during path resolution");
     TF_DEBUG_ENVIRONMENT_SYMBOL(REPLACERESOLVER_REPLACE, "Print debug output during replace operation");
     TF_DEBUG_ENVIRONMENT_SYMBOL(REPLACERESOLVER_CURRENTCONTEXT, "Print debug output on current context");
+    TF_DEBUG_ENVIRONMENT_SYMBOL(REPLACERESOLVER_DAEMON, "Print debug output on requests to the resolver daemon");
 }
 
 PXR_NAMESPACE_CLOSE_SCOPE
@@ -11,7 +11,8 @@ PXR_NAMESPACE_OPEN_SCOPE
 TF_DEBUG_CODES(
     REPLACERESOLVER_PATH,
     REPLACERESOLVER_REPLACE,
-    REPLACERESOLVER_CURRENTCONTEXT
+    REPLACERESOLVER_CURRENTCONTEXT,
+    REPLACERESOLVER_DAEMON
 );
 
 
@@ -0,0 +1,230 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "directoryCache.h"
+#include "pathBuffer.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+bool
+ReplaceResolverDirectoryCache::_Listing::Contains(
+    const char* name,
+    size_t size) const
+{
+    const auto it = std::lower_bound(
+        entries.begin(), entries.end(), name,
+        [size](const std::string& entry, const char* name) {
+            return entry.compare(0, std::string::npos, name, size) < 0;
+        });
+    return it != entries.end() &&
+        it->compare(0, std::string::npos, name, size) == 0;
+}
+
+ReplaceResolverDirectoryCache::ReplaceResolverDirectoryCache(double timeToLive)
+    : _timeToLive(std::chrono::duration_cast<_Clock::duration>(
+        std::chrono::duration<double>(timeToLive)))
+    , _statsAvoided(0)
+    , _statsFallback(0)
+    , _directoryReads(0)
+    , _revalidations(0)
+{
+}
+
+constexpr size_t ReplaceResolverDirectoryCache::_NumShards;
+
+ReplaceResolverDirectoryCache::_Shard&
+ReplaceResolverDirectoryCache::_GetShard(const std::string& dirPath)
+{
+    // The low bits of the hash select the map buckets, use the high ones.
+    const size_t hash = std::hash<std::string>()(dirPath);
+    return _shards[(hash >> (sizeof(size_t) * 8 - 8)) % _NumShards];
+}
+
+ReplaceResolverDirectoryCache::_ListingPtr
+ReplaceResolverDirectoryCache::_ReadListing(const std::string& dirPath)
+{
+    ++_directoryReads;
+
+    std::shared_ptr<_Listing> listing = std::make_shared<_Listing>();
+
+    // Get the modification time first, a change made while the directory
+    // is being read is then caught by the next revalidation.
+    if (!ArchGetModificationTime(dirPath.c_str(), &listing->modificationTime)) {
+        return listing;
+    }
+
+    std::vector<std::string> dirnames, filenames, symlinknames;
+    if (TfReadDir(dirPath, &dirnames, &filenames, &symlinknames)) {
+        listing->isDirectory = true;
+        listing->entries.reserve(
+            dirnames.size() + filenames.size() + symlinknames.size());
+        listing->entries.insert(
+            listing->entries.end(), dirnames.begin(), dirnames.end());
+        listing->entries.insert(
+            listing->entries.end(), filenames.begin(), filenames.end());
+        listing->entries.insert(
+            listing->entries.end(), symlinknames.begin(), symlinknames.end());
+        std::sort(listing->entries.begin(), listing->entries.end());
+    }
+    return listing;
+}
+
+ReplaceResolverDirectoryCache::_ListingPtr
+ReplaceResolverDirectoryCache::_GetListing(
+    const std::string& dirPath,
+    bool* fromMemory)
+{
+    const _Clock::time_point now = _Clock::now();
+    _Shard& shard = _GetShard(dirPath);
+
+    _ListingPtr listing;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.listings.find(dirPath);
+        if (it != shard.listings.end()) {
+            if (now - it->second.validatedAt < _timeToLive) {
+                return it->second.listing;
+            }
+            listing = it->second.listing;
+        }
+    }
+    *fromMemory = false;
+
+    // Directories are listed outside of the lock. Concurrent threads may
+    // list the same directory, the last listing wins.
+    if (listing && listing->isDirectory) {
+        ++_revalidations;
+        double modificationTime = 0.0;
+        if (!ArchGetModificationTime(dirPath.c_str(), &modificationTime) ||
+            modificationTime != listing->modificationTime) {
+            listing = _ReadListing(dirPath);
+        }
+    }
+    else {
+        listing = _ReadListing(dirPath);
+    }
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    _Entry& entry = shard.listings[dirPath];
+    entry.listing = listing;
+    entry.validatedAt = now;
+    return listing;
+}
+
+bool
+ReplaceResolverDirectoryCache::Exists(
+    const char* root, size_t rootSize,
+    const std::string& relativePath)
+{
+    // Only plain relative paths are answered from the listings.
+    const char* data = relativePath.data();
+    const size_t size = relativePath.size();
+    bool isPlain = size > 0;
+    for (size_t begin = 0; isPlain && begin <= size; ) {
+        const char* separator = static_cast<const char*>(
+            memchr(data + begin, '/', size - begin));
+        const size_t end = separator ? separator - data : size;
+        const size_t length = end - begin;
+        isPlain = length > 0 &&
+            !(length == 1 && data[begin] == '.') &&
+            !(length == 2 && data[begin] == '.' && data[begin + 1] == '.');
+        begin = end + 1;
+    }
+    if (!isPlain) {
+        ++_statsFallback;
+        ReplaceResolverPathBuffer path;
+        path.AssignCatPaths(root, rootSize, data, size);
+        return path.Exists();
+    }
+
+    // The listings are keyed by directory, the key is built in a buffer
+    // reused by the thread. Queries that listed or revalidated a directory
+    // are only counted as such.
+    thread_local std::string dirPath;
+    dirPath.assign(root, rootSize);
+    bool fromMemory = true;
+    bool exists = true;
+    for (size_t begin = 0; begin < size; ) {
+        const char* separator = static_cast<const char*>(
+            memchr(data + begin, '/', size - begin));
+        const size_t end = separator ? separator - data : size;
+
+        const _ListingPtr listing = _GetListing(dirPath, &fromMemory);
+        if (!listing->isDirectory ||
+            !listing->Contains(data + begin, end - begin)) {
+            exists = false;
+            break;
+        }
+        if (dirPath.empty() || dirPath.back() != '/') {
+            dirPath += '/';
+        }
+        dirPath.append(data + begin, end - begin);
+        begin = end + 1;
+    }
+
+    if (fromMemory) {
+        ++_statsAvoided;
+    }
+    return exists;
+}
+
+void
+ReplaceResolverDirectoryCache::Invalidate(const std::string& path)
+{
+    // The listing of the parent directory names the path, the listings of
+    // the path and under it describe its content.
+    const std::string parentPath = TfStringTrimRight(TfGetPathName(path), "/");
+    const std::string prefix = path + "/";
+
+    for (_Shard& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto it = shard.listings.begin(); it != shard.listings.end(); ) {
+            const std::string dirPath = TfStringTrimRight(it->first, "/");
+            if (dirPath == path || dirPath == parentPath ||
+                TfStringStartsWith(dirPath, prefix)) {
+                it = shard.listings.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+}
+
+void
+ReplaceResolverDirectoryCache::Clear()
+{
+    for (_Shard& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.listings.clear();
+    }
+}
+
+ReplaceResolverDirectoryCache::Counters
+ReplaceResolverDirectoryCache::GetCounters() const
+{
+    Counters counters;
+    counters.statsAvoided = _statsAvoided.load();
+    counters.statsFallback = _statsFallback.load();
+    counters.directoryReads = _directoryReads.load();
+    counters.revalidations = _revalidations.load();
+    return counters;
+}
+
+void
+ReplaceResolverDirectoryCache::ResetCounters()
+{
+    _statsAvoided = 0;
+    _statsFallback = 0;
+    _directoryReads = 0;
+    _revalidations = 0;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
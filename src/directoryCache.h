@@ -0,0 +1,124 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_DIRECTORY_CACHE_H
+#define USD_REPLACE_RESOLVER_DIRECTORY_CACHE_H
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplaceResolverDirectoryCache
+///
+/// Answer file existence queries under search roots from directory
+/// listings instead of stat calls.
+///
+/// A directory is listed the first time a path below it is queried, then
+/// queries, including negative ones, are answered from memory. After
+/// \p timeToLive seconds, the directory modification time is checked and the
+/// directory is listed again if it changed.
+///
+/// The listings are split in shards by directory, each one with its own
+/// lock, so that threads resolving under different directories do not
+/// contend.
+///
+class ReplaceResolverDirectoryCache
+{
+public:
+    struct Counters
+    {
+        /// Existence queries answered from the listings in memory, without
+        /// listing or revalidating any directory.
+        size_t statsAvoided = 0;
+        /// Existence queries that had to fall back to a stat.
+        size_t statsFallback = 0;
+        /// Directories listed.
+        size_t directoryReads = 0;
+        /// Listings revalidated with a stat of their directory.
+        size_t revalidations = 0;
+    };
+
+    AR_API explicit ReplaceResolverDirectoryCache(double timeToLive);
+
+    ReplaceResolverDirectoryCache(const ReplaceResolverDirectoryCache&) = delete;
+    ReplaceResolverDirectoryCache& operator=(
+        const ReplaceResolverDirectoryCache&) = delete;
+
+    /// Return true if \p relativePath exists under the \p root directory.
+    /// Queries answered from the listings do not allocate.
+    AR_API bool Exists(
+        const char* root, size_t rootSize,
+        const std::string& relativePath);
+
+    bool Exists(const std::string& root, const std::string& relativePath)
+    {
+        return Exists(root.data(), root.size(), relativePath);
+    }
+
+    /// Forget the listings naming \p path or under it, after it changed.
+    AR_API void Invalidate(const std::string& path);
+
+    /// Forget all listings.
+    AR_API void Clear();
+
+    AR_API Counters GetCounters() const;
+
+    AR_API void ResetCounters();
+
+private:
+    using _Clock = std::chrono::steady_clock;
+
+    struct _Listing
+    {
+        // False if the path is missing or is not a directory.
+        bool isDirectory = false;
+        double modificationTime = 0.0;
+        // Sorted entry names.
+        std::vector<std::string> entries;
+
+        bool Contains(const char* name, size_t size) const;
+    };
+    using _ListingPtr = std::shared_ptr<const _Listing>;
+
+    struct _Entry
+    {
+        _ListingPtr listing;
+        _Clock::time_point validatedAt;
+    };
+
+    struct _Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, _Entry> listings;
+    };
+
+    static constexpr size_t _NumShards = 16;
+
+    _Shard& _GetShard(const std::string& dirPath);
+
+    // Return the listing of \p dirPath. \p fromMemory is set to false if
+    // the directory had to be listed or revalidated.
+    _ListingPtr _GetListing(const std::string& dirPath, bool* fromMemory);
+    _ListingPtr _ReadListing(const std::string& dirPath);
+
+    const _Clock::duration _timeToLive;
+
+    _Shard _shards[_NumShards];
+
+    std::atomic<size_t> _statsAvoided;
+    std::atomic<size_t> _statsFallback;
+    std::atomic<size_t> _directoryReads;
+    std::atomic<size_t> _revalidations;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_DIRECTORY_CACHE_H
@@ -0,0 +1,112 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "fingerprint.h"
+
+#include <pxr/pxr.h>
+
+#include <cstdio>
+#include <cstring>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+
+constexpr uint64_t _Prime1 = 0x9e3779b185ebca87ULL;
+constexpr uint64_t _Prime2 = 0xc2b2ae3d27d4eb4fULL;
+constexpr uint64_t _Prime3 = 0x165667b19e3779f9ULL;
+
+inline uint64_t
+_Rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// MurmurHash3 64 bits finalizer.
+inline uint64_t
+_Mix(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+} // anonymous
+
+std::string
+ReplaceResolverFingerprint::GetAsString() const
+{
+    char buffer[33];
+    snprintf(buffer, sizeof(buffer), "%016llx%016llx",
+             static_cast<unsigned long long>(hi),
+             static_cast<unsigned long long>(lo));
+    return buffer;
+}
+
+ReplaceResolverFingerprinter::ReplaceResolverFingerprinter()
+    : _hi(_Prime3)
+    , _lo(_Prime2)
+    , _size(0)
+{
+}
+
+void
+ReplaceResolverFingerprinter::_AppendBytes(const char* data, size_t size)
+{
+    _size += size;
+    while (size > 0) {
+        uint64_t word = 0;
+        const size_t n = size < sizeof(word) ? size : sizeof(word);
+        memcpy(&word, data, n);
+        if (n < sizeof(word)) {
+            word ^= static_cast<uint64_t>(n) << 56;
+        }
+        data += n;
+        size -= n;
+
+        _lo = _Rotl((_lo ^ _Mix(word)) * _Prime1, 27) + _hi;
+        _hi = _Rotl((_hi ^ _Mix(word + _Prime2)) * _Prime3, 31) + _lo;
+    }
+}
+
+void
+ReplaceResolverFingerprinter::Append(uint64_t value)
+{
+    _AppendBytes(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void
+ReplaceResolverFingerprinter::Append(const std::string& str)
+{
+    Append(static_cast<uint64_t>(str.size()));
+    _AppendBytes(str.data(), str.size());
+}
+
+void
+ReplaceResolverFingerprinter::Append(
+    const ReplaceResolverFingerprint& fingerprint)
+{
+    Append(fingerprint.hi);
+    Append(fingerprint.lo);
+}
+
+ReplaceResolverFingerprint
+ReplaceResolverFingerprinter::Get() const
+{
+    ReplaceResolverFingerprint result;
+    result.lo = _Mix(_lo ^ _size);
+    result.hi = _Mix(_hi + result.lo);
+    result.lo = _Mix(result.lo + _Rotl(result.hi, 17));
+    return result;
+}
+
+ReplaceResolverFingerprint
+ReplaceResolverFingerprinter::Compute(const std::string& str)
+{
+    ReplaceResolverFingerprinter fingerprinter;
+    fingerprinter.Append(str);
+    return fingerprinter.Get();
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,81 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_FINGERPRINT_H
+#define USD_REPLACE_RESOLVER_FINGERPRINT_H
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplaceResolverFingerprint
+///
+/// 128 bits content fingerprint, used to identify resolver contexts and
+/// replace rule tables without comparing their content.
+///
+struct ReplaceResolverFingerprint
+{
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+
+    bool operator==(const ReplaceResolverFingerprint& rhs) const
+    {
+        return hi == rhs.hi && lo == rhs.lo;
+    }
+
+    bool operator!=(const ReplaceResolverFingerprint& rhs) const
+    {
+        return !(*this == rhs);
+    }
+
+    bool operator<(const ReplaceResolverFingerprint& rhs) const
+    {
+        return hi < rhs.hi || (hi == rhs.hi && lo < rhs.lo);
+    }
+
+    /// Return a hash suitable for hash tables.
+    size_t GetHash() const
+    {
+        return static_cast<size_t>(lo ^ (hi * 0x9e3779b97f4a7c15ULL));
+    }
+
+    /// Return the fingerprint as 32 hexadecimal digits.
+    AR_API std::string GetAsString() const;
+};
+
+/// \class ReplaceResolverFingerprinter
+///
+/// Compute a ReplaceResolverFingerprint from a stream of strings.
+///
+/// Strings are length prefixed, so that ["ab", "c"] and ["a", "bc"] have
+/// different fingerprints.
+///
+class ReplaceResolverFingerprinter
+{
+public:
+    AR_API ReplaceResolverFingerprinter();
+
+    AR_API void Append(const std::string& str);
+    AR_API void Append(uint64_t value);
+    AR_API void Append(const ReplaceResolverFingerprint& fingerprint);
+
+    AR_API ReplaceResolverFingerprint Get() const;
+
+    /// Return the fingerprint of a single string.
+    AR_API static ReplaceResolverFingerprint
+    Compute(const std::string& str);
+
+private:
+    void _AppendBytes(const char* data, size_t size);
+
+    uint64_t _hi;
+    uint64_t _lo;
+    uint64_t _size;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_FINGERPRINT_H
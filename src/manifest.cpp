@@ -0,0 +1,265 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "manifest.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/tf/stringUtils.h>
+
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+
+const char _Magic[8] = {'R', 'R', 'M', 'A', 'N', 'I', 'F', 'T'};
+constexpr uint32_t _Version = 1;
+
+uint64_t
+_HashKey(const ReplaceResolverFingerprint& context, const std::string& path)
+{
+    ReplaceResolverFingerprinter fingerprinter;
+    fingerprinter.Append(context);
+    fingerprinter.Append(path);
+    return fingerprinter.Get().lo;
+}
+
+void
+_SetError(std::string* errMsg, const std::string& msg)
+{
+    if (errMsg) {
+        *errMsg = msg;
+    }
+}
+
+} // anonymous
+
+struct ReplaceResolverManifest::_Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t slotSize;
+    uint64_t numEntries;
+    // Always a power of two.
+    uint64_t numSlots;
+    uint64_t slotsOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+};
+
+struct ReplaceResolverManifest::_Slot
+{
+    uint64_t hash;
+    uint64_t contextHi;
+    uint64_t contextLo;
+    uint64_t pathOffset;
+    uint64_t resolvedPathOffset;
+    // Zero for empty slots, asset paths are never empty.
+    uint32_t pathLength;
+    uint32_t resolvedPathLength;
+};
+
+bool
+ReplaceResolverManifest::Write(
+    const std::string& filePath,
+    const std::vector<Entry>& entries,
+    std::string* errMsg)
+{
+    uint64_t numSlots = 16;
+    while (numSlots < entries.size() * 2) {
+        numSlots *= 2;
+    }
+
+    std::vector<_Slot> slots(numSlots);
+    memset(slots.data(), 0, slots.size() * sizeof(_Slot));
+
+    // Resolved paths are often shared by several keys.
+    std::string strings;
+    std::unordered_map<std::string, uint64_t> stringOffsets;
+    auto addString = [&](const std::string& str) {
+        auto inserted = stringOffsets.emplace(str, strings.size());
+        if (inserted.second) {
+            strings += str;
+        }
+        return inserted.first->second;
+    };
+
+    uint64_t numEntries = 0;
+    for (const Entry& entry : entries) {
+        if (entry.path.empty() || entry.path.size() > UINT32_MAX ||
+            entry.resolvedPath.size() > UINT32_MAX) {
+            continue;
+        }
+
+        const uint64_t hash = _HashKey(entry.context, entry.path);
+        uint64_t index = hash & (numSlots - 1);
+        bool duplicate = false;
+        while (slots[index].pathLength != 0) {
+            const _Slot& slot = slots[index];
+            if (slot.hash == hash &&
+                slot.contextHi == entry.context.hi &&
+                slot.contextLo == entry.context.lo &&
+                strings.compare(slot.pathOffset, slot.pathLength, entry.path) == 0) {
+                duplicate = true;
+                break;
+            }
+            index = (index + 1) & (numSlots - 1);
+        }
+        if (duplicate) {
+            continue;
+        }
+
+        _Slot& slot = slots[index];
+        slot.hash = hash;
+        slot.contextHi = entry.context.hi;
+        slot.contextLo = entry.context.lo;
+        slot.pathOffset = addString(entry.path);
+        slot.pathLength = static_cast<uint32_t>(entry.path.size());
+        slot.resolvedPathOffset = addString(entry.resolvedPath);
+        slot.resolvedPathLength = static_cast<uint32_t>(entry.resolvedPath.size());
+        ++numEntries;
+    }
+
+    _Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, _Magic, sizeof(_Magic));
+    header.version = _Version;
+    header.slotSize = sizeof(_Slot);
+    header.numEntries = numEntries;
+    header.numSlots = numSlots;
+    header.slotsOffset = sizeof(_Header);
+    header.stringsOffset = header.slotsOffset + numSlots * sizeof(_Slot);
+    header.stringsSize = strings.size();
+
+    // Write next to the destination and rename, so that readers never map
+    // a partially written manifest.
+    const std::string tmpFilePath = filePath + ".tmp";
+    FILE* file = ArchOpenFile(tmpFilePath.c_str(), "wb");
+    if (!file) {
+        _SetError(errMsg, TfStringPrintf(
+            "Could not open '%s' for writing", tmpFilePath.c_str()));
+        return false;
+    }
+
+    const bool written =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(slots.data(), sizeof(_Slot), slots.size(), file) == slots.size() &&
+        fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+    const bool closed = fclose(file) == 0;
+
+    if (!written || !closed || rename(tmpFilePath.c_str(), filePath.c_str()) != 0) {
+        remove(tmpFilePath.c_str());
+        _SetError(errMsg, TfStringPrintf(
+            "Could not write manifest '%s'", filePath.c_str()));
+        return false;
+    }
+    return true;
+}
+
+ReplaceResolverManifestConstPtr
+ReplaceResolverManifest::Open(const std::string& filePath, std::string* errMsg)
+{
+    FILE* file = ArchOpenFile(filePath.c_str(), "rb");
+    if (!file) {
+        _SetError(errMsg, TfStringPrintf(
+            "Could not open manifest '%s'", filePath.c_str()));
+        return nullptr;
+    }
+
+    std::string mapError;
+    ArchConstFileMapping mapping = ArchMapFileReadOnly(file, &mapError);
+    fclose(file);
+    if (!mapping) {
+        _SetError(errMsg, TfStringPrintf(
+            "Could not map manifest '%s': %s",
+            filePath.c_str(), mapError.c_str()));
+        return nullptr;
+    }
+
+    // Sizes are checked before they are multiplied or added, so that a
+    // corrupted header cannot wrap around and point past the mapping.
+    const uint64_t size = ArchGetFileMappingLength(mapping);
+    const _Header* header = reinterpret_cast<const _Header*>(mapping.get());
+    const bool isValid =
+        size >= sizeof(_Header) &&
+        memcmp(header->magic, _Magic, sizeof(_Magic)) == 0 &&
+        header->version == _Version &&
+        header->slotSize == sizeof(_Slot) &&
+        header->numSlots > 0 &&
+        (header->numSlots & (header->numSlots - 1)) == 0 &&
+        header->numSlots <= (size - sizeof(_Header)) / sizeof(_Slot) &&
+        header->slotsOffset == sizeof(_Header) &&
+        header->stringsOffset ==
+            header->slotsOffset + header->numSlots * sizeof(_Slot) &&
+        header->stringsOffset <= size &&
+        header->stringsSize == size - header->stringsOffset;
+    if (!isValid) {
+        _SetError(errMsg, TfStringPrintf(
+            "Invalid manifest '%s'", filePath.c_str()));
+        return nullptr;
+    }
+
+    std::shared_ptr<ReplaceResolverManifest> manifest(
+        new ReplaceResolverManifest());
+    manifest->_filePath = filePath;
+    manifest->_header = header;
+    manifest->_slots = reinterpret_cast<const _Slot*>(
+        mapping.get() + header->slotsOffset);
+    manifest->_strings = mapping.get() + header->stringsOffset;
+    manifest->_mapping = std::move(mapping);
+    return manifest;
+}
+
+bool
+ReplaceResolverManifest::Find(
+    const ReplaceResolverFingerprint& context,
+    const std::string& path,
+    std::string* resolvedPath) const
+{
+    if (path.empty()) {
+        return false;
+    }
+
+    const uint64_t mask = _header->numSlots - 1;
+    const uint64_t hash = _HashKey(context, path);
+    for (uint64_t index = hash & mask, probes = 0;
+         probes < _header->numSlots;
+         index = (index + 1) & mask, ++probes) {
+        const _Slot& slot = _slots[index];
+        if (slot.pathLength == 0) {
+            return false;
+        }
+
+        if (slot.hash != hash ||
+            slot.contextHi != context.hi ||
+            slot.contextLo != context.lo ||
+            slot.pathLength != path.size()) {
+            continue;
+        }
+
+        // Do not trust offsets read from disk, they may be large enough
+        // to wrap around.
+        const uint64_t stringsSize = _header->stringsSize;
+        if (slot.pathOffset > stringsSize ||
+            slot.pathLength > stringsSize - slot.pathOffset ||
+            slot.resolvedPathOffset > stringsSize ||
+            slot.resolvedPathLength > stringsSize - slot.resolvedPathOffset) {
+            return false;
+        }
+
+        if (memcmp(_strings + slot.pathOffset, path.data(), path.size()) == 0) {
+            resolvedPath->assign(
+                _strings + slot.resolvedPathOffset, slot.resolvedPathLength);
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t
+ReplaceResolverManifest::GetSize() const
+{
+    return static_cast<size_t>(_header->numEntries);
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
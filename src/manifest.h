@@ -0,0 +1,80 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_MANIFEST_H
+#define USD_REPLACE_RESOLVER_MANIFEST_H
+
+#include "fingerprint.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/usd/ar/api.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+class ReplaceResolverManifest;
+using ReplaceResolverManifestConstPtr =
+    std::shared_ptr<const ReplaceResolverManifest>;
+
+/// \class ReplaceResolverManifest
+///
+/// Precomputed resolutions, mapping a context fingerprint and an asset
+/// path to a resolved path.
+///
+/// The manifest file is a hash table laid out to be memory mapped and
+/// queried in place: a lookup hashes the key once and probes a few slots,
+/// without any filesystem access.
+///
+class ReplaceResolverManifest
+{
+public:
+    struct Entry
+    {
+        ReplaceResolverFingerprint context;
+        std::string path;
+        std::string resolvedPath;
+    };
+
+    /// Write \p entries to a manifest file at \p filePath.
+    AR_API static bool Write(
+        const std::string& filePath,
+        const std::vector<Entry>& entries,
+        std::string* errMsg = nullptr);
+
+    /// Map the manifest file at \p filePath. Returns null if the file
+    /// cannot be mapped or is not a valid manifest.
+    AR_API static ReplaceResolverManifestConstPtr Open(
+        const std::string& filePath,
+        std::string* errMsg = nullptr);
+
+    /// Return true and set \p resolvedPath if the manifest has an entry for
+    /// \p path resolved with the \p context fingerprint.
+    AR_API bool Find(
+        const ReplaceResolverFingerprint& context,
+        const std::string& path,
+        std::string* resolvedPath) const;
+
+    /// Return the number of entries.
+    AR_API size_t GetSize() const;
+
+    const std::string& GetFilePath() const { return _filePath; }
+
+private:
+    struct _Header;
+    struct _Slot;
+
+    ReplaceResolverManifest() = default;
+
+    std::string _filePath;
+    ArchConstFileMapping _mapping;
+    const _Header* _header = nullptr;
+    const _Slot* _slots = nullptr;
+    const char* _strings = nullptr;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_MANIFEST_H
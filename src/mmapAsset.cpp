@@ -0,0 +1,113 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "mmapAsset.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/arch/defines.h>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(ARCH_OS_LINUX) || defined(ARCH_OS_DARWIN)
+#include <sys/mman.h>
+#endif
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+
+void
+_Advise(const char* address, size_t size, ReplaceResolverMmapAsset::Advice advice)
+{
+#if defined(ARCH_OS_LINUX) || defined(ARCH_OS_DARWIN)
+    int posixAdvice = POSIX_MADV_NORMAL;
+    switch (advice) {
+    case ReplaceResolverMmapAsset::AdviceSequential:
+        posixAdvice = POSIX_MADV_SEQUENTIAL;
+        break;
+    case ReplaceResolverMmapAsset::AdviceRandom:
+        posixAdvice = POSIX_MADV_RANDOM;
+        break;
+    default:
+        return;
+    }
+
+    // Mappings are page aligned, the hint is only an optimization.
+    posix_madvise(const_cast<char*>(address), size, posixAdvice);
+#endif
+}
+
+} // anonymous
+
+std::shared_ptr<ReplaceResolverMmapAsset>
+ReplaceResolverMmapAsset::Open(const std::string& resolvedPath, Advice advice)
+{
+    FILE* file = ArchOpenFile(resolvedPath.c_str(), "rb");
+    if (!file) {
+        return nullptr;
+    }
+
+    // Empty files cannot be mapped.
+    const int64_t size = ArchGetFileLength(file);
+    if (size <= 0) {
+        fclose(file);
+        return nullptr;
+    }
+
+    ArchConstFileMapping mapping = ArchMapFileReadOnly(file);
+    if (!mapping) {
+        fclose(file);
+        return nullptr;
+    }
+
+    _Advise(mapping.get(), static_cast<size_t>(size), advice);
+
+    return std::shared_ptr<ReplaceResolverMmapAsset>(
+        new ReplaceResolverMmapAsset(file, std::move(mapping)));
+}
+
+ReplaceResolverMmapAsset::ReplaceResolverMmapAsset(
+    FILE* file,
+    ArchConstFileMapping&& mapping)
+    : _file(file)
+    , _size(ArchGetFileMappingLength(mapping))
+{
+    _mapping = std::make_shared<ArchConstFileMapping>(std::move(mapping));
+}
+
+ReplaceResolverMmapAsset::~ReplaceResolverMmapAsset()
+{
+    fclose(_file);
+}
+
+size_t
+ReplaceResolverMmapAsset::GetSize()
+{
+    return _size;
+}
+
+std::shared_ptr<const char>
+ReplaceResolverMmapAsset::GetBuffer()
+{
+    // The returned buffer keeps the mapping alive.
+    return std::shared_ptr<const char>(_mapping, _mapping->get());
+}
+
+size_t
+ReplaceResolverMmapAsset::Read(void* buffer, size_t count, size_t offset)
+{
+    if (offset >= _size) {
+        return 0;
+    }
+
+    const size_t numBytes = std::min(count, _size - offset);
+    memcpy(buffer, _mapping->get() + offset, numBytes);
+    return numBytes;
+}
+
+std::pair<FILE*, size_t>
+ReplaceResolverMmapAsset::GetFileUnsafe()
+{
+    return std::make_pair(_file, 0);
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
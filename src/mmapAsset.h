@@ -0,0 +1,67 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_MMAP_ASSET_H
+#define USD_REPLACE_RESOLVER_MMAP_ASSET_H
+
+#include <pxr/pxr.h>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/usd/ar/api.h>
+#include <pxr/usd/ar/asset.h>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplaceResolverMmapAsset
+///
+/// ArAsset reading a file through a read-only memory mapping.
+///
+/// GetBuffer returns the mapping itself instead of a copy, and Read copies
+/// straight from it. The file stays open for GetFileUnsafe, which some
+/// file formats use to map the file themselves.
+///
+class ReplaceResolverMmapAsset
+    : public ArAsset
+{
+public:
+    /// Access pattern hint given to the kernel for the mapping.
+    enum Advice {
+        AdviceNormal,
+        AdviceSequential,
+        AdviceRandom
+    };
+
+    /// Map the file at \p resolvedPath. Returns null if the file cannot be
+    /// opened or mapped, for example if it is empty.
+    AR_API static std::shared_ptr<ReplaceResolverMmapAsset> Open(
+        const std::string& resolvedPath,
+        Advice advice);
+
+    AR_API virtual ~ReplaceResolverMmapAsset();
+
+    AR_API virtual size_t GetSize() override;
+
+    AR_API virtual std::shared_ptr<const char> GetBuffer() override;
+
+    AR_API virtual size_t Read(
+        void* buffer,
+        size_t count,
+        size_t offset) override;
+
+    AR_API virtual std::pair<FILE*, size_t> GetFileUnsafe() override;
+
+private:
+    ReplaceResolverMmapAsset(FILE* file, ArchConstFileMapping&& mapping);
+
+    FILE* _file;
+    // Shared with the buffers returned by GetBuffer, which may outlive the
+    // asset.
+    std::shared_ptr<ArchConstFileMapping> _mapping;
+    size_t _size;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_MMAP_ASSET_H
@@ -8,5 +8,6 @@ TF_WRAP_MODULE
 {
     TF_WRAP(ReplaceResolver);
     TF_WRAP(ReplaceResolverContext);
+    TF_WRAP(ReplaceResolverNotice);
 	TF_WRAP(ReplaceResolverTokens);
 }
@@ -0,0 +1,28 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "notice.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/tf/registryManager.h>
+#include <pxr/base/tf/type.h>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+TF_REGISTRY_FUNCTION(TfType)
+{
+    TfType::Define<
+        ReplaceResolverFilesChangedNotice, TfType::Bases<TfNotice>>();
+}
+
+ReplaceResolverFilesChangedNotice::ReplaceResolverFilesChangedNotice(
+    const std::vector<std::string>& changedPaths,
+    bool all)
+    : _changedPaths(changedPaths)
+    , _all(all)
+{
+}
+
+ReplaceResolverFilesChangedNotice::~ReplaceResolverFilesChangedNotice()
+{
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,50 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_NOTICE_H
+#define USD_REPLACE_RESOLVER_NOTICE_H
+
+#include <pxr/pxr.h>
+#include <pxr/base/tf/notice.h>
+#include <pxr/usd/ar/api.h>
+
+#include <string>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplaceResolverFilesChangedNotice
+///
+/// Sent when the resolver watcher saw files change under the search paths
+/// or next to the sidecar files, after the paths resolved from them were
+/// dropped from the caches.
+///
+/// Like after RefreshContext, resolving again gives the new paths, and
+/// contexts created again read the new sidecar files. The notice is sent
+/// from the thread of the watcher.
+///
+class ReplaceResolverFilesChangedNotice : public TfNotice
+{
+public:
+    AR_API ReplaceResolverFilesChangedNotice(
+        const std::vector<std::string>& changedPaths,
+        bool all);
+
+    AR_API virtual ~ReplaceResolverFilesChangedNotice();
+
+    /// Return the paths created, deleted, moved or written.
+    const std::vector<std::string>& GetChangedPaths() const
+    {
+        return _changedPaths;
+    }
+
+    /// Return true if changes were lost and all the cached paths were
+    /// dropped.
+    bool AffectsAll() const { return _all; }
+
+private:
+    std::vector<std::string> _changedPaths;
+    bool _all;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_NOTICE_H
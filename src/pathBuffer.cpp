@@ -0,0 +1,164 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "pathBuffer.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/arch/defines.h>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/pathUtils.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if !defined(ARCH_OS_WINDOWS)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+void
+ReplaceResolverPathBuffer::_Reserve(size_t capacity)
+{
+    if (capacity <= _capacity) {
+        return;
+    }
+    capacity = std::max(capacity, 2 * _capacity);
+    std::unique_ptr<char[]> heap(new char[capacity + 1]);
+    memcpy(heap.get(), _data, _size + 1);
+    _heap = std::move(heap);
+    _data = _heap.get();
+    _capacity = capacity;
+}
+
+void
+ReplaceResolverPathBuffer::Append(const char* data, size_t size)
+{
+    _Reserve(_size + size);
+    memcpy(_data + _size, data, size);
+    _Resize(_size + size);
+}
+
+void
+ReplaceResolverPathBuffer::Normalize()
+{
+    if (_size == 0) {
+        Assign(".", 1);
+        return;
+    }
+
+#if defined(ARCH_OS_WINDOWS)
+    // Drive letters and back slashes are left to Tf.
+    const bool delegate = true;
+#else
+    // POSIX lets a leading "//" mean something else, left to Tf too.
+    const bool delegate = _size > 1 && _data[0] == '/' && _data[1] == '/';
+#endif
+    if (delegate) {
+        Assign(TfNormPath(GetString()));
+        return;
+    }
+
+    // Components are copied down in place, the output never overtakes the
+    // input. Leading ".." of relative paths cannot be removed, they are
+    // kept below floor.
+    const bool isAbsolute = _data[0] == '/';
+    const size_t root = isAbsolute ? 1 : 0;
+    size_t out = root;
+    size_t floor = root;
+    size_t in = root;
+    while (in < _size) {
+        if (_data[in] == '/') {
+            ++in;
+            continue;
+        }
+
+        const char* separator = static_cast<const char*>(
+            memchr(_data + in, '/', _size - in));
+        const size_t end = separator ? separator - _data : _size;
+        const size_t length = end - in;
+
+        if (length == 1 && _data[in] == '.') {
+            in = end;
+            continue;
+        }
+
+        if (length == 2 && _data[in] == '.' && _data[in + 1] == '.') {
+            if (out > floor) {
+                // Drop the last component and its separator.
+                size_t start = out;
+                while (start > floor && _data[start - 1] != '/') {
+                    --start;
+                }
+                out = start > floor ? start - 1 : start;
+            }
+            else if (!isAbsolute) {
+                if (out > 0) {
+                    _data[out++] = '/';
+                }
+                _data[out++] = '.';
+                _data[out++] = '.';
+                floor = out;
+            }
+            in = end;
+            continue;
+        }
+
+        if (out > root) {
+            _data[out++] = '/';
+        }
+        memmove(_data + out, _data + in, length);
+        out += length;
+        in = end;
+    }
+
+    if (out == 0) {
+        _data[out++] = '.';
+    }
+    _Resize(out);
+}
+
+void
+ReplaceResolverPathBuffer::AssignCatPaths(
+    const char* prefix, size_t prefixSize,
+    const char* suffix, size_t suffixSize)
+{
+    _Reserve(prefixSize + 1 + suffixSize);
+    memcpy(_data, prefix, prefixSize);
+    _data[prefixSize] = '/';
+    memcpy(_data + prefixSize + 1, suffix, suffixSize);
+    _Resize(prefixSize + 1 + suffixSize);
+    Normalize();
+}
+
+void
+ReplaceResolverPathBuffer::AssignCwd()
+{
+#if defined(ARCH_OS_WINDOWS)
+    Assign(ArchGetCwd());
+#else
+    while (!getcwd(_data, _capacity + 1)) {
+        if (errno != ERANGE) {
+            Assign(".", 1);
+            return;
+        }
+        _size = 0;
+        _Reserve(2 * _capacity);
+    }
+    _size = strlen(_data);
+#endif
+}
+
+bool
+ReplaceResolverPathBuffer::Exists() const
+{
+#if defined(ARCH_OS_WINDOWS)
+    return TfPathExists(GetString());
+#else
+    struct stat st;
+    return lstat(_data, &st) == 0;
+#endif
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
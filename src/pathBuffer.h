@@ -0,0 +1,118 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_PATH_BUFFER_H
+#define USD_REPLACE_RESOLVER_PATH_BUFFER_H
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplaceResolverPathBuffer
+///
+/// Path scratch buffer for the resolve hot path, kept on the stack.
+///
+/// Paths shorter than InlineCapacity never allocate. Joining and
+/// normalizing are done in place in a single pass, with the semantics of
+/// TfStringCatPaths and TfNormPath, so that a resolve only allocates the
+/// string it returns.
+///
+class ReplaceResolverPathBuffer
+{
+public:
+    static constexpr size_t InlineCapacity = 1024;
+
+    ReplaceResolverPathBuffer()
+        : _data(_inline)
+        , _size(0)
+        , _capacity(InlineCapacity)
+    {
+        _inline[0] = '\0';
+    }
+
+    ReplaceResolverPathBuffer(const ReplaceResolverPathBuffer&) = delete;
+    ReplaceResolverPathBuffer& operator=(
+        const ReplaceResolverPathBuffer&) = delete;
+
+    /// Return the path, always null terminated.
+    const char* GetData() const { return _data; }
+
+    size_t GetSize() const { return _size; }
+
+    bool IsEmpty() const { return _size == 0; }
+
+    /// Return a copy of the path.
+    std::string GetString() const { return std::string(_data, _size); }
+
+    /// Copy the path to \p result, reusing its capacity.
+    void CopyTo(std::string* result) const { result->assign(_data, _size); }
+
+    void Clear() { _Resize(0); }
+
+    void Assign(const char* data, size_t size)
+    {
+        _Resize(0);
+        Append(data, size);
+    }
+
+    void Assign(const std::string& str) { Assign(str.data(), str.size()); }
+
+    AR_API void Append(const char* data, size_t size);
+
+    void Append(const std::string& str) { Append(str.data(), str.size()); }
+
+    /// Replace every \p from character by \p to.
+    void Replace(char from, char to)
+    {
+        for (size_t i = 0; i < _size; ++i) {
+            if (_data[i] == from) {
+                _data[i] = to;
+            }
+        }
+    }
+
+    /// Normalize the path in place, like TfNormPath.
+    AR_API void Normalize();
+
+    /// Set the path to \p prefix and \p suffix joined and normalized, like
+    /// TfStringCatPaths.
+    AR_API void AssignCatPaths(
+        const char* prefix, size_t prefixSize,
+        const char* suffix, size_t suffixSize);
+
+    void AssignCatPaths(const std::string& prefix, const std::string& suffix)
+    {
+        AssignCatPaths(prefix.data(), prefix.size(),
+                       suffix.data(), suffix.size());
+    }
+
+    /// Set the path to the current working directory, like ArchGetCwd.
+    AR_API void AssignCwd();
+
+    /// Return true if the path exists, like TfPathExists without
+    /// resolving symbolic links.
+    AR_API bool Exists() const;
+
+private:
+    void _Reserve(size_t capacity);
+
+    void _Resize(size_t size)
+    {
+        _size = size;
+        _data[_size] = '\0';
+    }
+
+    char* _data;
+    size_t _size;
+    // Not counting the null terminator.
+    size_t _capacity;
+    std::unique_ptr<char[]> _heap;
+    char _inline[InlineCapacity + 1];
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_PATH_BUFFER_H
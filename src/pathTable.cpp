@@ -0,0 +1,201 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "pathTable.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/tf/diagnostic.h>
+
+#include <cstring>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+constexpr ReplaceResolverPathTable::Id ReplaceResolverPathTable::InvalidId;
+constexpr size_t ReplaceResolverPathTable::_NumShardBits;
+constexpr size_t ReplaceResolverPathTable::_NumShards;
+constexpr size_t ReplaceResolverPathTable::_ChunkBits;
+constexpr size_t ReplaceResolverPathTable::_ChunkSize;
+constexpr size_t ReplaceResolverPathTable::_MaxChunks;
+constexpr size_t ReplaceResolverPathTable::_ArenaBlockSize;
+
+namespace {
+
+// Approximate cost of an interned path besides its characters: map node
+// and entry.
+constexpr size_t _EntryOverhead = 48;
+
+} // anonymous
+
+bool
+ReplaceResolverPathTable::_Key::operator==(const _Key& rhs) const
+{
+    return size == rhs.size && memcmp(data, rhs.data, size) == 0;
+}
+
+ReplaceResolverPathTable::_Shard::_Shard()
+{
+    for (auto& chunk : chunks) {
+        chunk.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+ReplaceResolverPathTable::_Shard::~_Shard()
+{
+    for (auto& chunk : chunks) {
+        delete[] chunk.load(std::memory_order_relaxed);
+    }
+}
+
+const char*
+ReplaceResolverPathTable::_Shard::Store(
+    const std::string& path,
+    std::atomic<size_t>* bytes)
+{
+    // Long paths get a block of their own, the current block keeps
+    // serving the short ones.
+    if (path.size() > _ArenaBlockSize / 4) {
+        arena.emplace_back(new char[path.size()]);
+        *bytes += path.size();
+        memcpy(arena.back().get(), path.data(), path.size());
+        return arena.back().get();
+    }
+
+    if (!block || arenaUsed + path.size() > _ArenaBlockSize) {
+        arena.emplace_back(new char[_ArenaBlockSize]);
+        block = arena.back().get();
+        arenaUsed = 0;
+        *bytes += _ArenaBlockSize;
+    }
+    char* data = block + arenaUsed;
+    memcpy(data, path.data(), path.size());
+    arenaUsed += path.size();
+    return data;
+}
+
+ReplaceResolverPathTable&
+ReplaceResolverPathTable::GetInstance()
+{
+    // Never destroyed, ids may be used until the very end of the process.
+    static ReplaceResolverPathTable* instance = new ReplaceResolverPathTable();
+    return *instance;
+}
+
+ReplaceResolverPathTable::_Shard&
+ReplaceResolverPathTable::_GetShard(size_t hash, size_t* shardIndex)
+{
+    // The low bits of the hash select the map buckets, use the high ones.
+    *shardIndex =
+        (hash >> (sizeof(size_t) * 8 - _NumShardBits)) & (_NumShards - 1);
+    return _shards[*shardIndex];
+}
+
+const ReplaceResolverPathTable::_Shard&
+ReplaceResolverPathTable::_GetShard(size_t hash) const
+{
+    return _shards[
+        (hash >> (sizeof(size_t) * 8 - _NumShardBits)) & (_NumShards - 1)];
+}
+
+ReplaceResolverPathTable::Id
+ReplaceResolverPathTable::_Find(const _Shard& shard, const _Key& key)
+{
+    auto it = shard.ids.find(key);
+    return it != shard.ids.end() ? it->second : InvalidId;
+}
+
+ReplaceResolverPathTable::Id
+ReplaceResolverPathTable::_Insert(
+    _Shard& shard,
+    size_t shardIndex,
+    const std::string& path,
+    size_t hash)
+{
+    const size_t index = shard.size.load(std::memory_order_relaxed);
+    const size_t chunkIndex = index >> _ChunkBits;
+    if (chunkIndex >= _MaxChunks) {
+        // Hundreds of millions of paths, memory ran out long before.
+        TF_FATAL_ERROR("Too many interned asset paths");
+    }
+
+    _Entry* chunk = shard.chunks[chunkIndex].load(std::memory_order_relaxed);
+    if (!chunk) {
+        chunk = new _Entry[_ChunkSize];
+        shard.chunks[chunkIndex].store(chunk, std::memory_order_release);
+        _bytes += _ChunkSize * sizeof(_Entry);
+    }
+
+    const char* data = shard.Store(path, &_bytes);
+    chunk[index & (_ChunkSize - 1)] = _Entry{data, path.size()};
+    shard.size.store(index + 1, std::memory_order_release);
+
+    const Id id = static_cast<Id>((index << _NumShardBits) | shardIndex);
+    shard.ids.emplace(_Key{data, path.size(), hash}, id);
+    _bytes += _EntryOverhead;
+    return id;
+}
+
+ReplaceResolverPathTable::Id
+ReplaceResolverPathTable::Intern(const std::string& path)
+{
+    const size_t hash = std::hash<std::string>()(path);
+    size_t shardIndex;
+    _Shard& shard = _GetShard(hash, &shardIndex);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const Id id = _Find(shard, _Key{path.data(), path.size(), hash});
+    if (id != InvalidId) {
+        return id;
+    }
+    return _Insert(shard, shardIndex, path, hash);
+}
+
+ReplaceResolverPathTable::Id
+ReplaceResolverPathTable::Intern(const std::string& path, size_t budget)
+{
+    const size_t hash = std::hash<std::string>()(path);
+    size_t shardIndex;
+    _Shard& shard = _GetShard(hash, &shardIndex);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const Id id = _Find(shard, _Key{path.data(), path.size(), hash});
+    if (id != InvalidId ||
+        _bytes.load(std::memory_order_relaxed) >= budget) {
+        return id;
+    }
+    return _Insert(shard, shardIndex, path, hash);
+}
+
+ReplaceResolverPathTable::Id
+ReplaceResolverPathTable::Find(const std::string& path) const
+{
+    const size_t hash = std::hash<std::string>()(path);
+    const _Shard& shard = _GetShard(hash);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return _Find(shard, _Key{path.data(), path.size(), hash});
+}
+
+std::string
+ReplaceResolverPathTable::GetString(Id id) const
+{
+    if (id == InvalidId) {
+        return std::string();
+    }
+
+    const _Shard& shard = _shards[id & (_NumShards - 1)];
+    const size_t index = id >> _NumShardBits;
+    const _Entry* chunk =
+        shard.chunks[index >> _ChunkBits].load(std::memory_order_acquire);
+    const _Entry& entry = chunk[index & (_ChunkSize - 1)];
+    return std::string(entry.data, entry.size);
+}
+
+size_t
+ReplaceResolverPathTable::GetSize() const
+{
+    size_t size = 0;
+    for (const _Shard& shard : _shards) {
+        size += shard.size.load();
+    }
+    return size;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,136 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_PATH_TABLE_H
+#define USD_REPLACE_RESOLVER_PATH_TABLE_H
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplaceResolverPathTable
+///
+/// Process wide table of interned asset paths.
+///
+/// Each distinct path is stored once in an arena and given a stable 32 bits
+/// id, so that the resolver caches hold pairs of small integers instead of
+/// copies of long paths. Like TfToken, interned paths are never released.
+///
+/// Interning locks one of several shards, reading back the string of an id
+/// does not lock. Since nothing is released, callers bound the table with
+/// the budgeted Intern, and look paths up with Find before they know they
+/// are worth keeping.
+///
+class ReplaceResolverPathTable
+{
+public:
+    using Id = uint32_t;
+
+    /// Id of no path, never returned by Intern.
+    static constexpr Id InvalidId = UINT32_MAX;
+
+    AR_API static ReplaceResolverPathTable& GetInstance();
+
+    /// Return the id of \p path, adding it to the table if needed.
+    AR_API Id Intern(const std::string& path);
+
+    /// Like Intern, but return InvalidId instead of adding \p path if the
+    /// table already uses \p budget bytes or more.
+    AR_API Id Intern(const std::string& path, size_t budget);
+
+    /// Return the id of \p path, or InvalidId if it was never interned.
+    AR_API Id Find(const std::string& path) const;
+
+    /// Return the path interned with \p id, or an empty string for
+    /// InvalidId.
+    AR_API std::string GetString(Id id) const;
+
+    /// Return the number of interned paths.
+    AR_API size_t GetSize() const;
+
+    /// Return the approximate memory used by the table in bytes. Does not
+    /// lock.
+    size_t GetMemoryUsage() const
+    {
+        return _bytes.load(std::memory_order_relaxed);
+    }
+
+private:
+    ReplaceResolverPathTable() = default;
+
+    static constexpr size_t _NumShardBits = 4;
+    static constexpr size_t _NumShards = size_t(1) << _NumShardBits;
+    static constexpr size_t _ChunkBits = 12;
+    static constexpr size_t _ChunkSize = size_t(1) << _ChunkBits;
+    static constexpr size_t _MaxChunks = size_t(1) << 12;
+    static constexpr size_t _ArenaBlockSize = 64 * 1024;
+
+    struct _Entry
+    {
+        const char* data;
+        size_t size;
+    };
+
+    // Map key referring to a string that is either interned or being
+    // looked up, with its hash computed once.
+    struct _Key
+    {
+        const char* data;
+        size_t size;
+        size_t hash;
+
+        bool operator==(const _Key& rhs) const;
+    };
+
+    struct _KeyHash
+    {
+        size_t operator()(const _Key& key) const { return key.hash; }
+    };
+
+    struct _Shard
+    {
+        mutable std::mutex mutex;
+        std::unordered_map<_Key, Id, _KeyHash> ids;
+
+        // Entries by local index, in fixed size chunks that never move so
+        // that they can be read without locking.
+        std::atomic<_Entry*> chunks[_MaxChunks];
+        std::atomic<size_t> size{0};
+
+        std::vector<std::unique_ptr<char[]>> arena;
+        char* block = nullptr;
+        size_t arenaUsed = 0;
+
+        _Shard();
+        ~_Shard();
+        // Copy \p path in the arena, adding the bytes allocated to
+        // \p bytes.
+        const char* Store(const std::string& path, std::atomic<size_t>* bytes);
+    };
+
+    _Shard& _GetShard(size_t hash, size_t* shardIndex);
+    const _Shard& _GetShard(size_t hash) const;
+
+    // Return the id of the path looked up by \p key, or InvalidId. The
+    // shard must be locked.
+    static Id _Find(const _Shard& shard, const _Key& key);
+
+    // Add \p path to the locked \p shard.
+    Id _Insert(_Shard& shard, size_t shardIndex,
+               const std::string& path, size_t hash);
+
+    _Shard _shards[_NumShards];
+    std::atomic<size_t> _bytes{0};
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_PATH_TABLE_H
@@ -0,0 +1,435 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "prober.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/tf/fileUtils.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef REPLACE_RESOLVER_HAVE_IO_URING
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+
+#ifdef REPLACE_RESOLVER_HAVE_IO_URING
+
+// Number of stat calls in flight per thread.
+constexpr unsigned _QueueDepth = 64;
+
+// Attempts of a ring submission failing with a transient error before the
+// ring is given up.
+constexpr unsigned _MaxRetries = 1000;
+
+// Minimal io_uring submission and completion rings, set up with raw system
+// calls so that liburing is not required.
+class _IoUring
+{
+public:
+    _IoUring() = default;
+    ~_IoUring() { _Close(); }
+
+    _IoUring(const _IoUring&) = delete;
+    _IoUring& operator=(const _IoUring&) = delete;
+
+    // Return false if the kernel does not provide io_uring, or forbids it.
+    bool Init(unsigned entries);
+
+    unsigned GetSize() const { return _entries; }
+
+    // Set exists[i] for paths [begin, end), at most GetSize() of them.
+    // Return false if the kernel does not support statx through io_uring,
+    // in which case \p exists is left unspecified.
+    bool Stat(
+        const std::vector<std::string>& paths,
+        size_t begin,
+        size_t end,
+        uint8_t* exists);
+
+private:
+    void _Close();
+    unsigned _Reap(size_t begin, uint8_t* exists, bool* unsupported);
+
+    int _fd = -1;
+    unsigned _entries = 0;
+
+    void* _sqRing = nullptr;
+    size_t _sqRingSize = 0;
+    void* _cqRing = nullptr;
+    size_t _cqRingSize = 0;
+    io_uring_sqe* _sqes = nullptr;
+    size_t _sqesSize = 0;
+
+    unsigned* _sqTail = nullptr;
+    unsigned* _sqMask = nullptr;
+    unsigned* _sqArray = nullptr;
+    unsigned* _cqHead = nullptr;
+    unsigned* _cqTail = nullptr;
+    unsigned* _cqMask = nullptr;
+    io_uring_cqe* _cqes = nullptr;
+
+    std::vector<struct statx> _buffers;
+};
+
+bool
+_IoUring::Init(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    _fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (_fd < 0) {
+        return false;
+    }
+
+    _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cqRingSize = params.cq_off.cqes +
+        params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+        _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+    }
+
+    _sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_sqRing == MAP_FAILED) {
+        _sqRing = nullptr;
+        _Close();
+        return false;
+    }
+    if (singleMmap) {
+        _cqRing = _sqRing;
+    }
+    else {
+        _cqRing = mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+        if (_cqRing == MAP_FAILED) {
+            _cqRing = nullptr;
+            _Close();
+            return false;
+        }
+    }
+
+    _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        _Close();
+        return false;
+    }
+    _sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(_sqRing);
+    _sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    _sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    _sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(_cqRing);
+    _cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    _cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    _cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    _entries = params.sq_entries;
+    _buffers.resize(_entries);
+    return true;
+}
+
+void
+_IoUring::_Close()
+{
+    if (_sqes) {
+        munmap(_sqes, _sqesSize);
+        _sqes = nullptr;
+    }
+    if (_cqRing && _cqRing != _sqRing) {
+        munmap(_cqRing, _cqRingSize);
+    }
+    _cqRing = nullptr;
+    if (_sqRing) {
+        munmap(_sqRing, _sqRingSize);
+        _sqRing = nullptr;
+    }
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+    _entries = 0;
+}
+
+unsigned
+_IoUring::_Reap(
+    size_t begin,
+    uint8_t* exists,
+    bool* unsupported)
+{
+    unsigned head = *_cqHead;
+    const unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+    unsigned count = 0;
+    for (; head != tail; ++head, ++count) {
+        const io_uring_cqe& cqe = _cqes[head & *_cqMask];
+        const int res = cqe.res;
+        // Kernels before 5.6 know io_uring but not its statx.
+        if (res == -EINVAL || res == -EOPNOTSUPP) {
+            *unsupported = true;
+        }
+        exists[begin + cqe.user_data] = res >= 0 ? 1 : 0;
+    }
+    __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+bool
+_IoUring::Stat(
+    const std::vector<std::string>& paths,
+    size_t begin,
+    size_t end,
+    uint8_t* exists)
+{
+    const unsigned count = static_cast<unsigned>(end - begin);
+    struct statx* buffers = _buffers.data();
+
+    // Statx blocks on network filesystems, IOSQE_ASYNC hands each one to a
+    // kernel worker right away so that they all run concurrently.
+    unsigned tail = *_sqTail;
+    for (unsigned i = 0; i < count; ++i, ++tail) {
+        const unsigned index = tail & *_sqMask;
+        io_uring_sqe& sqe = _sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_STATX;
+        sqe.flags = IOSQE_ASYNC;
+        sqe.fd = AT_FDCWD;
+        sqe.addr = reinterpret_cast<uintptr_t>(paths[begin + i].c_str());
+        sqe.len = STATX_TYPE;
+        sqe.off = reinterpret_cast<uintptr_t>(&buffers[i]);
+        sqe.statx_flags = AT_SYMLINK_NOFOLLOW;
+        sqe.user_data = i;
+        _sqArray[index] = index;
+    }
+    __atomic_store_n(_sqTail, tail, __ATOMIC_RELEASE);
+
+    // After a persistent error, or too many transient ones, nothing more
+    // is submitted. The calls in flight reference the buffers and the
+    // paths, they are waited for before the ring is given up and the
+    // caller falls back to threads.
+    unsigned submitted = 0;
+    unsigned completed = 0;
+    unsigned retries = 0;
+    bool failed = false;
+    bool unsupported = false;
+    while (completed < (failed ? submitted : count)) {
+        const unsigned toSubmit = failed ? 0 : count - submitted;
+        const unsigned minComplete =
+            (failed ? submitted : count) - completed;
+        const int ret = static_cast<int>(syscall(
+            __NR_io_uring_enter, _fd, toSubmit, minComplete,
+            IORING_ENTER_GETEVENTS, nullptr, 0));
+        if (ret < 0) {
+            const bool transient =
+                errno == EINTR || errno == EAGAIN || errno == EBUSY;
+            if (!transient || ++retries > _MaxRetries) {
+                if (failed) {
+                    // Waiting fails too, closing the ring cancels the
+                    // calls left.
+                    break;
+                }
+                failed = true;
+                retries = 0;
+            }
+        }
+        else {
+            submitted += static_cast<unsigned>(ret);
+        }
+        completed += _Reap(begin, exists, &unsupported);
+    }
+
+    if (failed) {
+        _Close();
+        return false;
+    }
+    return !unsupported;
+}
+
+#endif // REPLACE_RESOLVER_HAVE_IO_URING
+
+} // anonymous
+
+ReplaceResolverProber::ReplaceResolverProber(
+    size_t numThreads,
+    bool useIoUring)
+    : _numThreads(std::max<size_t>(numThreads, 1))
+#ifdef REPLACE_RESOLVER_HAVE_IO_URING
+    , _useIoUring(useIoUring)
+#else
+    , _useIoUring(false)
+#endif
+{
+}
+
+ReplaceResolverProber::~ReplaceResolverProber()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _condition.notify_all();
+    for (std::thread& thread : _threads) {
+        thread.join();
+    }
+}
+
+const char*
+ReplaceResolverProber::GetBackendName() const
+{
+    return _useIoUring.load(std::memory_order_relaxed) ? "io_uring" : "threads";
+}
+
+void
+ReplaceResolverProber::Exists(
+    const std::vector<std::string>& paths,
+    std::vector<uint8_t>* exists)
+{
+    exists->assign(paths.size(), 0);
+    if (paths.size() == 1) {
+        (*exists)[0] = TfPathExists(paths[0]) ? 1 : 0;
+        return;
+    }
+    if (paths.empty()) {
+        return;
+    }
+
+    if (_useIoUring.load(std::memory_order_relaxed) &&
+        _ExistsWithIoUring(paths, exists->data())) {
+        return;
+    }
+    _ExistsWithThreads(paths, exists->data());
+}
+
+bool
+ReplaceResolverProber::_ExistsWithIoUring(
+    const std::vector<std::string>& paths,
+    uint8_t* exists)
+{
+#ifdef REPLACE_RESOLVER_HAVE_IO_URING
+    // A ring per thread, submissions need no locking.
+    thread_local std::unique_ptr<_IoUring> ring;
+    if (!ring) {
+        ring.reset(new _IoUring());
+        if (!ring->Init(_QueueDepth)) {
+            // Missing, or forbidden by a seccomp policy. It will not
+            // become available later, stop trying.
+            _useIoUring.store(false, std::memory_order_relaxed);
+            ring.reset();
+            return false;
+        }
+    }
+
+    for (size_t begin = 0; begin < paths.size(); begin += ring->GetSize()) {
+        const size_t end = std::min(paths.size(), begin + ring->GetSize());
+        if (!ring->Stat(paths, begin, end, exists)) {
+            _useIoUring.store(false, std::memory_order_relaxed);
+            ring.reset();
+            return false;
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void
+ReplaceResolverProber::_ExistsWithThreads(
+    const std::vector<std::string>& paths,
+    uint8_t* exists)
+{
+    std::call_once(_threadsStarted, [this]() { _StartThreads(); });
+
+    // Workers keep the batch alive while they look at it, the paths are
+    // only touched until the last one is done.
+    _BatchPtr batch = std::make_shared<_Batch>();
+    batch->paths = &paths;
+    batch->exists = exists;
+    batch->size = paths.size();
+    batch->remaining.store(paths.size(), std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _batches.push_back(batch);
+    }
+    _condition.notify_all();
+
+    _Run(*batch);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = std::find(_batches.begin(), _batches.end(), batch);
+        if (it != _batches.end()) {
+            _batches.erase(it);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->done.wait(lock, [&batch]() {
+        return batch->remaining.load(std::memory_order_acquire) == 0;
+    });
+}
+
+void
+ReplaceResolverProber::_Run(_Batch& batch)
+{
+    for (;;) {
+        const size_t i = batch.next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= batch.size) {
+            return;
+        }
+        batch.exists[i] = TfPathExists((*batch.paths)[i]) ? 1 : 0;
+        if (batch.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(batch.mutex);
+            batch.done.notify_all();
+        }
+    }
+}
+
+void
+ReplaceResolverProber::_StartThreads()
+{
+    // The calling thread helps, it counts as one.
+    for (size_t i = 1; i < _numThreads; ++i) {
+        _threads.emplace_back(&ReplaceResolverProber::_WorkerLoop, this);
+    }
+}
+
+void
+ReplaceResolverProber::_WorkerLoop()
+{
+    for (;;) {
+        _BatchPtr batch;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this]() {
+                return _stop || !_batches.empty();
+            });
+            if (_stop) {
+                return;
+            }
+            batch = _batches.front();
+            if (batch->next.load(std::memory_order_relaxed) >= batch->size) {
+                // Every path is taken, its submitter will be done soon.
+                _batches.pop_front();
+                continue;
+            }
+        }
+
+        _Run(*batch);
+    }
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
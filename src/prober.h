@@ -0,0 +1,85 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_PROBER_H
+#define USD_REPLACE_RESOLVER_PROBER_H
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplaceResolverProber
+///
+/// Check the existence of many paths at once, so that the latency of a
+/// batch is the one of its slowest stat call instead of their sum.
+///
+/// On Linux the stat calls are submitted together through io_uring when the
+/// kernel supports it. Otherwise, or when \p useIoUring is false, they are
+/// spread over a pool of \p numThreads threads, the calling thread helping.
+///
+class ReplaceResolverProber
+{
+public:
+    AR_API ReplaceResolverProber(size_t numThreads, bool useIoUring);
+    AR_API ~ReplaceResolverProber();
+
+    ReplaceResolverProber(const ReplaceResolverProber&) = delete;
+    ReplaceResolverProber& operator=(const ReplaceResolverProber&) = delete;
+
+    /// Set \p exists[i] to 1 if \p paths[i] exists, to 0 otherwise. Like
+    /// TfPathExists, symbolic links are not followed.
+    AR_API void Exists(
+        const std::vector<std::string>& paths,
+        std::vector<uint8_t>* exists);
+
+    /// Return "io_uring" or "threads".
+    AR_API const char* GetBackendName() const;
+
+private:
+    struct _Batch
+    {
+        const std::vector<std::string>* paths;
+        uint8_t* exists;
+        size_t size;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> remaining{0};
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    using _BatchPtr = std::shared_ptr<_Batch>;
+
+    bool _ExistsWithIoUring(
+        const std::vector<std::string>& paths,
+        uint8_t* exists);
+    void _ExistsWithThreads(
+        const std::vector<std::string>& paths,
+        uint8_t* exists);
+
+    void _StartThreads();
+    void _WorkerLoop();
+    static void _Run(_Batch& batch);
+
+    const size_t _numThreads;
+    std::atomic<bool> _useIoUring;
+
+    std::once_flag _threadsStarted;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<_BatchPtr> _batches;
+    bool _stop = false;
+    std::vector<std::thread> _threads;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_PROBER_H
@@ -0,0 +1,198 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "replaceMatcher.h"
+
+#include <pxr/pxr.h>
+
+#include <algorithm>
+#include <utility>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+constexpr uint32_t ReplaceMatcher::_None;
+
+ReplaceMatcher::ReplaceMatcher()
+    : _maxPatternLength(0)
+{
+}
+
+ReplaceMatcher::ReplaceMatcher(
+    const std::map<std::string, std::string>& pairs)
+    : _maxPatternLength(0)
+{
+    // Build a plain trie of the old strings first.
+    using _Edges = std::vector<std::pair<unsigned char, uint32_t>>;
+    std::vector<_Edges> trie(1);
+    std::vector<uint32_t> trieOutput(1, _None);
+
+    for (const auto& pair : pairs) {
+        const std::string& oldStr = pair.first;
+        if (oldStr.empty()) {
+            continue;
+        }
+
+        uint32_t state = 0;
+        for (const char ch : oldStr) {
+            const unsigned char c = static_cast<unsigned char>(ch);
+            uint32_t next = _None;
+            for (const auto& edge : trie[state]) {
+                if (edge.first == c) {
+                    next = edge.second;
+                    break;
+                }
+            }
+            if (next == _None) {
+                next = static_cast<uint32_t>(trie.size());
+                trie[state].emplace_back(c, next);
+                trie.emplace_back();
+                trieOutput.push_back(_None);
+            }
+            state = next;
+        }
+
+        trieOutput[state] = static_cast<uint32_t>(_patternLengths.size());
+        _patternLengths.push_back(static_cast<uint32_t>(oldStr.size()));
+        _replacements.push_back(pair.second);
+        _maxPatternLength = std::max(_maxPatternLength, oldStr.size());
+    }
+
+    // Renumber the states in depth first order and flatten the edges into
+    // sorted arrays. The unique tail of each pattern, where most of the
+    // states are, then ends up contiguous in memory.
+    std::vector<uint32_t> order;
+    order.reserve(trie.size());
+    std::vector<uint32_t> newIds(trie.size(), 0);
+    std::vector<uint32_t> stack(1, 0);
+    while (!stack.empty()) {
+        const uint32_t state = stack.back();
+        stack.pop_back();
+        newIds[state] = static_cast<uint32_t>(order.size());
+        order.push_back(state);
+
+        _Edges& edges = trie[state];
+        std::sort(edges.begin(), edges.end());
+        for (auto it = edges.rbegin(); it != edges.rend(); ++it) {
+            stack.push_back(it->second);
+        }
+    }
+
+    _nodes.resize(order.size());
+    _edgeChars.reserve(trie.size() - 1);
+    _edgeTargets.reserve(trie.size() - 1);
+    for (size_t i = 0; i < order.size(); ++i) {
+        const _Edges& edges = trie[order[i]];
+        _Node& node = _nodes[i];
+        node.firstEdge = static_cast<uint32_t>(_edgeChars.size());
+        node.numEdges = static_cast<uint32_t>(edges.size());
+        node.output = trieOutput[order[i]];
+        for (const auto& edge : edges) {
+            _edgeChars.push_back(edge.first);
+            _edgeTargets.push_back(newIds[edge.second]);
+        }
+    }
+    trie = std::vector<_Edges>();
+
+    _rootGoto.assign(256, 0);
+    const _Node& root = _nodes[0];
+    for (uint32_t e = root.firstEdge; e < root.firstEdge + root.numEdges; ++e) {
+        _rootGoto[_edgeChars[e]] = _edgeTargets[e];
+    }
+
+    // Failure and dictionary links, computed in breadth first order so
+    // that the failure state of a parent is always known.
+    std::vector<uint32_t> queue(1, 0);
+    for (size_t i = 0; i < queue.size(); ++i) {
+        const uint32_t u = queue[i];
+        const uint32_t firstEdge = _nodes[u].firstEdge;
+        const uint32_t lastEdge = firstEdge + _nodes[u].numEdges;
+        for (uint32_t e = firstEdge; e < lastEdge; ++e) {
+            const uint32_t v = _edgeTargets[e];
+            const uint32_t fail =
+                u == 0 ? 0 : _Goto(_nodes[u].fail, _edgeChars[e]);
+            _nodes[v].fail = fail;
+            _nodes[v].dictLink = _nodes[fail].output != _None
+                ? fail : _nodes[fail].dictLink;
+            queue.push_back(v);
+        }
+    }
+}
+
+uint32_t
+ReplaceMatcher::_Goto(uint32_t state, unsigned char c) const
+{
+    while (state != 0) {
+        const _Node& node = _nodes[state];
+        const unsigned char* first = _edgeChars.data() + node.firstEdge;
+        const unsigned char* last = first + node.numEdges;
+        const unsigned char* it = std::lower_bound(first, last, c);
+        if (it != last && *it == c) {
+            return _edgeTargets[node.firstEdge + (it - first)];
+        }
+        state = node.fail;
+    }
+    return _rootGoto[c];
+}
+
+bool
+ReplaceMatcher::Find(
+    const std::string& text,
+    size_t* pos,
+    size_t* patternIndex) const
+{
+    if (IsEmpty()) {
+        return false;
+    }
+
+    size_t bestStart = std::string::npos;
+    size_t bestLength = 0;
+    uint32_t bestPattern = _None;
+
+    uint32_t state = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        // No match longer than the longest pattern can still start at or
+        // before the current best one.
+        if (bestPattern != _None && i - bestStart >= _maxPatternLength) {
+            break;
+        }
+
+        state = _Goto(state, static_cast<unsigned char>(text[i]));
+
+        uint32_t out =
+            _nodes[state].output != _None ? state : _nodes[state].dictLink;
+        for (; out != _None; out = _nodes[out].dictLink) {
+            const uint32_t p = _nodes[out].output;
+            const size_t length = _patternLengths[p];
+            const size_t start = i + 1 - length;
+            if (start < bestStart ||
+                (start == bestStart && length > bestLength)) {
+                bestStart = start;
+                bestLength = length;
+                bestPattern = p;
+            }
+        }
+    }
+
+    if (bestPattern == _None) {
+        return false;
+    }
+
+    *pos = bestStart;
+    *patternIndex = bestPattern;
+    return true;
+}
+
+bool
+ReplaceMatcher::Replace(const std::string& text, std::string* result) const
+{
+    size_t pos = 0;
+    size_t patternIndex = 0;
+    if (!Find(text, &pos, &patternIndex)) {
+        return false;
+    }
+
+    *result = text;
+    result->replace(
+        pos, _patternLengths[patternIndex], _replacements[patternIndex]);
+    return true;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,98 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_MATCHER_H
+#define USD_REPLACE_MATCHER_H
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplaceMatcher
+///
+/// Multi-pattern substring matcher compiled from old/new string pairs.
+///
+/// The pairs are compiled once into an Aho-Corasick automaton so that
+/// finding a replacement scans the input a single time, whatever the number
+/// of pairs.
+///
+/// Match semantics:
+///     - the leftmost occurrence of any old string wins,
+///     - if several old strings start at that position, the longest wins,
+///     - only that single occurrence is replaced.
+/// Empty old strings are ignored.
+///
+class ReplaceMatcher
+{
+public:
+    /// Construct an empty matcher that never matches.
+    AR_API ReplaceMatcher();
+
+    /// Compile the old/new string pairs of \p pairs.
+    AR_API explicit ReplaceMatcher(
+        const std::map<std::string, std::string>& pairs);
+
+    /// Return true if no pattern was compiled.
+    bool IsEmpty() const { return _patternLengths.empty(); }
+
+    /// Return the number of compiled patterns.
+    size_t GetNumPatterns() const { return _patternLengths.size(); }
+
+    /// Find the match in \p text following the semantics described above.
+    /// On success, \p pos is the match offset and \p patternIndex the
+    /// index of the matched pair.
+    AR_API bool Find(
+        const std::string& text,
+        size_t* pos,
+        size_t* patternIndex) const;
+
+    /// Return the length of the old string of the pattern at
+    /// \p patternIndex.
+    size_t GetPatternLength(size_t patternIndex) const
+    {
+        return _patternLengths[patternIndex];
+    }
+
+    /// Return the new string of the pattern at \p patternIndex.
+    const std::string& GetReplacement(size_t patternIndex) const
+    {
+        return _replacements[patternIndex];
+    }
+
+    /// Replace the match in \p text, if any, and store the result in
+    /// \p result. Returns false and leaves \p result untouched otherwise.
+    AR_API bool Replace(const std::string& text, std::string* result) const;
+
+private:
+    static constexpr uint32_t _None = UINT32_MAX;
+
+    struct _Node {
+        uint32_t firstEdge = 0;
+        uint32_t numEdges = 0;
+        uint32_t fail = 0;
+        // Pattern ending at this node, or _None.
+        uint32_t output = _None;
+        // Closest node on the failure chain having an output, or _None.
+        uint32_t dictLink = _None;
+    };
+
+    uint32_t _Goto(uint32_t state, unsigned char c) const;
+
+    std::vector<_Node> _nodes;
+    std::vector<unsigned char> _edgeChars;
+    std::vector<uint32_t> _edgeTargets;
+    // Direct transitions from the root, the most visited state.
+    std::vector<uint32_t> _rootGoto;
+
+    std::vector<uint32_t> _patternLengths;
+    std::vector<std::string> _replacements;
+    size_t _maxPatternLength;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_MATCHER_H
@@ -0,0 +1,360 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "replacePatternMatcher.h"
+
+#include <pxr/pxr.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+constexpr uint32_t ReplacePatternMatcher::_Dead;
+
+namespace {
+
+void
+_SetWhyNot(std::string* whyNot, const char* msg)
+{
+    if (whyNot) {
+        *whyNot = msg;
+    }
+}
+
+// Path components are looked up by pointer and length, without copies.
+int
+_Compare(const std::string& lhs, const char* name, size_t length)
+{
+    return lhs.compare(0, std::string::npos, name, length);
+}
+
+} // anonymous
+
+ReplacePatternMatcher::ReplacePatternMatcher()
+{
+}
+
+bool
+ReplacePatternMatcher::_Parse(
+    const std::string& pattern,
+    const std::string& replacement,
+    _Pattern* parsed,
+    std::vector<std::string>* components,
+    std::string* whyNot)
+{
+    size_t begin = 0;
+    size_t end = pattern.size();
+    parsed->anchored = begin < end && pattern[begin] == '/';
+    if (parsed->anchored) {
+        ++begin;
+    }
+    parsed->directory = begin < end && pattern[end - 1] == '/';
+    if (parsed->directory) {
+        --end;
+    }
+    if (begin >= end) {
+        _SetWhyNot(whyNot, "the pattern has no component");
+        return false;
+    }
+
+    components->clear();
+    parsed->wildcards.clear();
+    while (begin <= end) {
+        size_t slash = pattern.find('/', begin);
+        if (slash == std::string::npos || slash > end) {
+            slash = end;
+        }
+        const std::string component = pattern.substr(begin, slash - begin);
+        if (component.empty()) {
+            _SetWhyNot(whyNot, "the pattern has an empty component");
+            return false;
+        }
+        if (component == "*") {
+            parsed->wildcards.push_back(
+                static_cast<uint32_t>(components->size()));
+        }
+        else if (component.find('*') != std::string::npos) {
+            _SetWhyNot(whyNot, "wildcards must be whole components");
+            return false;
+        }
+        components->push_back(component);
+        begin = slash + 1;
+    }
+    parsed->numComponents = components->size();
+
+    // The slashes around the pattern are not part of the matched text,
+    // drop the ones of the replacement as well.
+    size_t replacementBegin = 0;
+    size_t replacementEnd = replacement.size();
+    if (parsed->anchored && replacementBegin < replacementEnd &&
+        replacement[replacementBegin] == '/') {
+        ++replacementBegin;
+    }
+    if (parsed->directory && replacementBegin < replacementEnd &&
+        replacement[replacementEnd - 1] == '/') {
+        --replacementEnd;
+    }
+
+    parsed->pieces.clear();
+    std::string literal;
+    for (size_t i = replacementBegin; i < replacementEnd; ++i) {
+        const char c = replacement[i];
+        const char next = i + 1 < replacementEnd ? replacement[i + 1] : 0;
+        if (c != '$') {
+            literal += c;
+        }
+        else if (next == '$') {
+            literal += '$';
+            ++i;
+        }
+        else if (next >= '1' && next <= '9') {
+            const uint32_t capture = static_cast<uint32_t>(next - '1');
+            if (capture >= parsed->wildcards.size()) {
+                _SetWhyNot(whyNot,
+                           "the replacement refers to a missing wildcard");
+                return false;
+            }
+            parsed->pieces.emplace_back(std::move(literal), capture);
+            literal.clear();
+            ++i;
+        }
+        else {
+            literal += c;
+        }
+    }
+    parsed->pieces.emplace_back(std::move(literal), _Dead);
+    return true;
+}
+
+bool
+ReplacePatternMatcher::IsValid(
+    const std::string& pattern,
+    const std::string& replacement,
+    std::string* whyNot)
+{
+    _Pattern parsed;
+    std::vector<std::string> components;
+    return _Parse(pattern, replacement, &parsed, &components, whyNot);
+}
+
+ReplacePatternMatcher::ReplacePatternMatcher(const PatternList& patterns)
+{
+    // Build a trie of the pattern components first, wildcards being a
+    // distinct edge.
+    struct _TrieNode
+    {
+        std::map<std::string, uint32_t> literals;
+        uint32_t wildcard = _Dead;
+        std::vector<uint32_t> accepts;
+    };
+    std::vector<_TrieNode> trie(1);
+
+    std::vector<std::string> components;
+    for (const auto& rule : patterns) {
+        _Pattern parsed;
+        if (!_Parse(rule.first, rule.second, &parsed, &components, nullptr)) {
+            continue;
+        }
+
+        uint32_t node = 0;
+        for (const std::string& component : components) {
+            uint32_t next = _Dead;
+            if (component == "*") {
+                next = trie[node].wildcard;
+            }
+            else {
+                auto it = trie[node].literals.find(component);
+                if (it != trie[node].literals.end()) {
+                    next = it->second;
+                }
+            }
+            if (next == _Dead) {
+                next = static_cast<uint32_t>(trie.size());
+                if (component == "*") {
+                    trie[node].wildcard = next;
+                }
+                else {
+                    trie[node].literals.emplace(component, next);
+                }
+                trie.emplace_back();
+            }
+            node = next;
+        }
+
+        trie[node].accepts.push_back(static_cast<uint32_t>(_patterns.size()));
+        _patterns.push_back(std::move(parsed));
+    }
+
+    if (_patterns.empty()) {
+        return;
+    }
+
+    // Subset construction: a DFA state is the set of trie nodes reachable
+    // by the components read so far.
+    using _NodeSet = std::vector<uint32_t>;
+    std::map<_NodeSet, uint32_t> stateIds;
+    std::deque<_NodeSet> pending;
+    auto getState = [&](_NodeSet nodes) {
+        if (nodes.empty()) {
+            return _Dead;
+        }
+        std::sort(nodes.begin(), nodes.end());
+        nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+        auto inserted = stateIds.emplace(
+            nodes, static_cast<uint32_t>(stateIds.size()));
+        if (inserted.second) {
+            pending.push_back(std::move(nodes));
+            _states.emplace_back();
+        }
+        return inserted.first->second;
+    };
+
+    getState(_NodeSet(1, 0));
+    for (uint32_t id = 0; !pending.empty(); ++id) {
+        const _NodeSet nodes = std::move(pending.front());
+        pending.pop_front();
+
+        _NodeSet wildcards;
+        std::set<std::string> names;
+        std::vector<uint32_t> accepts;
+        for (const uint32_t node : nodes) {
+            if (trie[node].wildcard != _Dead) {
+                wildcards.push_back(trie[node].wildcard);
+            }
+            for (const auto& literal : trie[node].literals) {
+                names.insert(literal.first);
+            }
+            accepts.insert(accepts.end(),
+                           trie[node].accepts.begin(), trie[node].accepts.end());
+        }
+        std::sort(accepts.begin(), accepts.end());
+
+        // A literal component also matches the wildcards of the set.
+        std::vector<std::pair<std::string, uint32_t>> literals;
+        for (const std::string& name : names) {
+            _NodeSet next = wildcards;
+            for (const uint32_t node : nodes) {
+                auto it = trie[node].literals.find(name);
+                if (it != trie[node].literals.end()) {
+                    next.push_back(it->second);
+                }
+            }
+            literals.emplace_back(name, getState(std::move(next)));
+        }
+        const uint32_t other = getState(std::move(wildcards));
+
+        // _states may have grown, only index it now.
+        _State& state = _states[id];
+        state.literals = std::move(literals);
+        state.other = other;
+        state.accepts = std::move(accepts);
+    }
+}
+
+uint32_t
+ReplacePatternMatcher::_Step(
+    uint32_t state,
+    const char* name,
+    size_t length) const
+{
+    if (length == 0) {
+        return _Dead;
+    }
+
+    const _State& s = _states[state];
+    auto it = std::lower_bound(
+        s.literals.begin(), s.literals.end(), name,
+        [length](const std::pair<std::string, uint32_t>& literal,
+                 const char* n) {
+            return _Compare(literal.first, n, length) < 0;
+        });
+    if (it != s.literals.end() && _Compare(it->first, name, length) == 0) {
+        return it->second;
+    }
+    return s.other;
+}
+
+bool
+ReplacePatternMatcher::Replace(
+    const std::string& text,
+    std::string* result) const
+{
+    if (_patterns.empty() || text.empty()) {
+        return false;
+    }
+
+    // Component offsets, on the stack for all but unusually deep paths.
+    using _Span = std::pair<size_t, size_t>;
+    _Span localSpans[64];
+    std::vector<_Span> heapSpans;
+    _Span* spans = localSpans;
+    size_t numSpans = 0;
+
+    const size_t first = text[0] == '/' ? 1 : 0;
+    size_t numComponents = 1;
+    for (size_t i = first; i < text.size(); ++i) {
+        numComponents += text[i] == '/' ? 1 : 0;
+    }
+    if (numComponents > sizeof(localSpans) / sizeof(localSpans[0])) {
+        heapSpans.resize(numComponents);
+        spans = heapSpans.data();
+    }
+    for (size_t begin = first; ; ) {
+        size_t end = text.find('/', begin);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        spans[numSpans++] = _Span(begin, end);
+        if (end == text.size()) {
+            break;
+        }
+        begin = end + 1;
+    }
+
+    const char* data = text.data();
+    for (size_t i = 0; i < numSpans; ++i) {
+        uint32_t matched = _Dead;
+        size_t matchedEnd = 0;
+
+        uint32_t state = 0;
+        for (size_t j = i; j < numSpans; ++j) {
+            state = _Step(state, data + spans[j].first,
+                          spans[j].second - spans[j].first);
+            if (state == _Dead) {
+                break;
+            }
+            // Accepts are sorted by priority, deeper matches are longer.
+            for (const uint32_t index : _states[state].accepts) {
+                const _Pattern& pattern = _patterns[index];
+                if ((pattern.anchored && i != 0) ||
+                    (pattern.directory && j + 1 >= numSpans)) {
+                    continue;
+                }
+                matched = index;
+                matchedEnd = j;
+                break;
+            }
+        }
+
+        if (matched == _Dead) {
+            continue;
+        }
+
+        const _Pattern& pattern = _patterns[matched];
+        std::string replaced(text, 0, spans[i].first);
+        for (const auto& piece : pattern.pieces) {
+            replaced += piece.first;
+            if (piece.second != _Dead) {
+                const _Span& span = spans[i + pattern.wildcards[piece.second]];
+                replaced.append(text, span.first, span.second - span.first);
+            }
+        }
+        replaced.append(text, spans[matchedEnd].second, std::string::npos);
+        *result = std::move(replaced);
+        return true;
+    }
+    return false;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
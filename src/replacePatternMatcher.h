@@ -0,0 +1,106 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_PATTERN_MATCHER_H
+#define USD_REPLACE_PATTERN_MATCHER_H
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplacePatternMatcher
+///
+/// Wildcard replace rules compiled into a deterministic automaton.
+///
+/// A pattern is a '/' separated list of path components, each one either a
+/// literal name or a "*" wildcard matching any single non empty component:
+///     - pattern:     assets/*/v1/
+///     - replacement: assets/$1/v2/
+/// replaces "show/assets/foo/v1/foo.usda" by "show/assets/foo/v2/foo.usda".
+///
+/// "$1" to "$9" in the replacement are the components matched by the
+/// wildcards, in order, and "$$" is a literal '$'. A leading '/' anchors
+/// the pattern at the start of the path, a trailing '/' requires the match
+/// to be followed by another component.
+///
+/// All the patterns are compiled into a single DFA over path components,
+/// so matching never backtracks: from each component boundary the path is
+/// walked at most as deep as the longest pattern.
+///
+/// Match semantics follow ReplaceMatcher: the leftmost match wins, then the
+/// longest one, then the pattern added first. Only that match is replaced.
+///
+class ReplacePatternMatcher
+{
+public:
+    using PatternList = std::vector<std::pair<std::string, std::string>>;
+
+    /// Construct an empty matcher that never matches.
+    AR_API ReplacePatternMatcher();
+
+    /// Compile the pattern/replacement pairs of \p patterns, in priority
+    /// order. Invalid patterns are skipped.
+    AR_API explicit ReplacePatternMatcher(const PatternList& patterns);
+
+    /// Return true if \p pattern and \p replacement form a valid rule,
+    /// otherwise set \p whyNot.
+    AR_API static bool IsValid(
+        const std::string& pattern,
+        const std::string& replacement,
+        std::string* whyNot = nullptr);
+
+    /// Return true if no pattern was compiled.
+    bool IsEmpty() const { return _patterns.empty(); }
+
+    /// Return the number of compiled patterns.
+    size_t GetNumPatterns() const { return _patterns.size(); }
+
+    /// Replace the match in \p text, if any, and store the result in
+    /// \p result. Returns false and leaves \p result untouched otherwise.
+    AR_API bool Replace(const std::string& text, std::string* result) const;
+
+private:
+    static constexpr uint32_t _Dead = UINT32_MAX;
+
+    struct _Pattern
+    {
+        size_t numComponents = 0;
+        bool anchored = false;
+        bool directory = false;
+        // Pattern component index of each wildcard.
+        std::vector<uint32_t> wildcards;
+        // Replacement pieces: literal text followed by a capture, or
+        // _Dead for the last piece.
+        std::vector<std::pair<std::string, uint32_t>> pieces;
+    };
+
+    struct _State
+    {
+        // Transitions on literal components, sorted by name.
+        std::vector<std::pair<std::string, uint32_t>> literals;
+        // Transition on any other non empty component.
+        uint32_t other = _Dead;
+        // Patterns ending in this state, by priority.
+        std::vector<uint32_t> accepts;
+    };
+
+    static bool _Parse(
+        const std::string& pattern,
+        const std::string& replacement,
+        _Pattern* parsed,
+        std::vector<std::string>* components,
+        std::string* whyNot);
+
+    uint32_t _Step(uint32_t state, const char* name, size_t length) const;
+
+    std::vector<_Pattern> _patterns;
+    std::vector<_State> _states;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_PATTERN_MATCHER_H
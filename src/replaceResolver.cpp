@@ -1,12 +1,17 @@
 // Copyright 2019 Rodeo FX.  All rights reserved.
+#include "concurrentCache.h"
 #include "debugCodes.h"
+#include "mmapAsset.h"
+#include "notice.h"
+#include "pathBuffer.h"
 #include "replaceResolver.h"
 #include "replaceResolverContext.h"
+#include "stats.h"
 #include "tokens.h"
 
 #include <pxr/base/arch/fileSystem.h>
 #include <pxr/base/arch/systemInfo.h>
-#include <pxr/base/js/json.h>
+#include <pxr/base/js/converter.h>
 #include <pxr/base/tf/fileUtils.h>
 #include <pxr/base/tf/getenv.h>
 #include <pxr/base/tf/pathUtils.h>
@@ -17,10 +22,25 @@
 #include <pxr/usd/ar/defineResolver.h>
 #include <pxr/usd/ar/filesystemAsset.h>
 #include <pxr/usd/ar/resolverContext.h>
+#include <pxr/usd/sdf/assetPath.h>
 #include <pxr/usd/sdf/layer.h>
-
-#include <tbb/concurrent_hash_map.h>
-#include <fstream>
+#include <pxr/usd/sdf/layerUtils.h>
+#include <pxr/usd/sdf/listOp.h>
+#include <pxr/usd/sdf/payload.h>
+#include <pxr/usd/sdf/reference.h>
+#include <pxr/usd/sdf/schema.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_do.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
 PXR_NAMESPACE_OPEN_SCOPE
 
@@ -29,10 +49,41 @@ AR_DEFINE_RESOLVER(ReplaceResolver, ArResolver);
 
 namespace {
 
-bool _GetReplacePairsFromUsdFile(const std::string& filePath, ReplaceResolverContext& context)
+// Return a layer holding at least the layer metadata of \p filePath.
+SdfLayerRefPtr _OpenLayerMetadata(const std::string& filePath)
+{
+    // Nothing to read if the layer is already opened.
+    SdfLayerRefPtr layer = SdfLayer::Find(filePath);
+    if (layer) {
+        return layer;
+    }
+
+    ReplaceResolverStats& stats = ReplaceResolverStats::GetInstance();
+    stats.Increment(ReplaceResolverStats::MetadataReads);
+
+    // Only read the layer metadata: the usda parser stops after the header
+    // block and the usdc reader does not load any field value besides the
+    // pseudo-root ones.
+    layer = SdfLayer::OpenAsAnonymous(filePath, /* metadataOnly = */ true);
+    if (layer) {
+        return layer;
+    }
+
+    TF_DEBUG(REPLACERESOLVER_REPLACE).Msg("Could not read metadata only of "
+                                        "\"%s\", opening the whole layer\n",
+                                        filePath.c_str());
+    stats.Increment(ReplaceResolverStats::FullLayerReads);
+    return SdfLayer::FindOrOpen(filePath);
+}
+
+bool _GetReplacePairsFromUsdFile(
+    const std::string& filePath,
+    ReplaceRuleTable::PairMap& pairs,
+    ReplaceRuleTable::PatternList& patterns,
+    std::string& tableFilePath)
 {
     bool found = false;
-    auto layer = SdfLayer::FindOrOpen(TfAbsPath(filePath));
+    auto layer = _OpenLayerMetadata(TfAbsPath(filePath));
     if (layer) {
         auto layerMetaData = layer->GetMetadata();
         auto rootId = SdfAbstractDataSpecId(&SdfPath::AbsoluteRootPath());
@@ -50,61 +101,218 @@ bool _GetReplacePairsFromUsdFile(const std::string& filePath, ReplaceResolverCon
                 if(allPairs.size() > 0)
                 {
                     found = true;
-                    for (size_t i = 0; i < allPairs.size(); i+=2) {
-                        context.AddReplacePair(allPairs[i], allPairs[i+1]);
+                    for (size_t i = 0; i + 1 < allPairs.size(); i+=2) {
+                        pairs.emplace(allPairs[i], allPairs[i+1]);
                     }
                 }
             }
+
+            it = dic.find(ReplaceResolverTokens->replacePatterns);
+            if (it != dic.end() && it->second.IsHolding<VtStringArray>()) {
+                const VtStringArray& allPatterns =
+                    it->second.UncheckedGet<VtStringArray>();
+                for (size_t i = 0; i + 1 < allPatterns.size(); i += 2) {
+                    std::string whyNot;
+                    if (!ReplacePatternMatcher::IsValid(
+                            allPatterns[i], allPatterns[i + 1], &whyNot)) {
+                        TF_WARN("Invalid replace pattern '%s' in '%s': %s",
+                                allPatterns[i].c_str(), filePath.c_str(),
+                                whyNot.c_str());
+                        continue;
+                    }
+                    found = true;
+                    patterns.emplace_back(allPatterns[i], allPatterns[i + 1]);
+                }
+            }
+
+            // Binary replace table, relative to the layer.
+            it = dic.find(ReplaceResolverTokens->replaceTable);
+            if (it != dic.end() && it->second.IsHolding<std::string>()) {
+                const std::string& tablePath =
+                    it->second.UncheckedGet<std::string>();
+                if (!tablePath.empty()) {
+                    found = true;
+                    tableFilePath = TfIsRelativePath(tablePath)
+                        ? TfNormPath(TfStringCatPaths(
+                              TfGetPathName(TfAbsPath(filePath)), tablePath))
+                        : tablePath;
+                }
+            }
         }
     }
     return found;
 }
 
-bool _GetReplacePairsFromJsonFile(const std::string& filePath, ReplaceResolverContext& context)
+// Asset paths authored in a layer, anchored to it.
+struct _LayerAssetPaths
 {
-    bool found = false;
-    // Check if there is a "replace file" in the directory
-    std::string assetDir = TfGetPathName(TfAbsPath(filePath));
-    std::string replaceFilePath = TfNormPath(
-        TfStringCatPaths(assetDir, ReplaceResolverTokens->replaceFileName));
-    
-    std::ifstream ifs(replaceFilePath);
-
-    // Try to find replace pairs in json file
-    if (ifs) {
-        TF_DEBUG(REPLACERESOLVER_REPLACE).Msg("Replace file found: \"%s\"\n", 
-                                            replaceFilePath.c_str());
-
-        JsParseError error;
-        const JsValue value = JsParseStream(ifs, &error);
-        ifs.close();
-
-        if (!value.IsNull() && value.IsArray()) {
-            if (value.GetJsArray().size() > 0) {
-                found = true;
-                for(const auto& pair : value.GetJsArray()) {
-                    if(pair.IsArray()) {
-                        context.AddReplacePair(
-                            pair.GetJsArray()[0].GetString(), pair.GetJsArray()[1].GetString());
-                    }
-                }
-            }
+    // Sublayers, references and payloads.
+    std::vector<std::string> layers;
+    // Values of asset valued attributes.
+    std::vector<std::string> assets;
+};
+
+template <class T>
+std::vector<T> _GetListOpItems(const VtValue& value)
+{
+    std::vector<T> items;
+    if (value.IsHolding<SdfListOp<T>>()) {
+        value.UncheckedGet<SdfListOp<T>>().ApplyOperations(&items);
+    }
+    return items;
+}
+
+void _GetLayerAssetPaths(const SdfLayerHandle& layer, _LayerAssetPaths* paths)
+{
+    // Anchored like composition and attribute values anchor them, so that
+    // the same paths are resolved when the stage opens.
+    auto addPath = [&layer](
+        const std::string& assetPath, std::vector<std::string>* result) {
+        if (!assetPath.empty()) {
+            result->push_back(
+                SdfComputeAssetPathRelativeToLayer(layer, assetPath));
         }
-        else {
-            fprintf(stderr, "Error: parse error at %s:%d:%d: %s\n",
-                replaceFilePath.c_str(), error.line, error.column, error.reason.c_str());
+    };
+    auto addValue = [&addPath, paths](const VtValue& value) {
+        if (value.IsHolding<SdfAssetPath>()) {
+            addPath(value.UncheckedGet<SdfAssetPath>().GetAssetPath(),
+                    &paths->assets);
         }
+        else if (value.IsHolding<VtArray<SdfAssetPath>>()) {
+            for (const SdfAssetPath& assetPath :
+                     value.UncheckedGet<VtArray<SdfAssetPath>>()) {
+                addPath(assetPath.GetAssetPath(), &paths->assets);
+            }
+        }
+    };
+
+    for (const std::string& subLayerPath : layer->GetSubLayerPaths()) {
+        addPath(subLayerPath, &paths->layers);
     }
 
-    return found;  
+    layer->Traverse(SdfPath::AbsoluteRootPath(),
+        [&](const SdfPath& path) {
+            VtValue value;
+            if (path.IsPrimPath() || path.IsPrimVariantSelectionPath()) {
+                if (layer->HasField(path, SdfFieldKeys->References, &value)) {
+                    for (const SdfReference& reference :
+                             _GetListOpItems<SdfReference>(value)) {
+                        addPath(reference.GetAssetPath(), &paths->layers);
+                    }
+                }
+                if (layer->HasField(path, SdfFieldKeys->Payload, &value)) {
+                    for (const SdfPayload& payload :
+                             _GetListOpItems<SdfPayload>(value)) {
+                        addPath(payload.GetAssetPath(), &paths->layers);
+                    }
+                }
+            }
+            else if (path.IsPropertyPath()) {
+                if (layer->HasField(path, SdfFieldKeys->Default, &value)) {
+                    addValue(value);
+                }
+                for (const double time : layer->ListTimeSamplesForPath(path)) {
+                    if (layer->QueryTimeSample(path, time, &value)) {
+                        addValue(value);
+                    }
+                }
+            }
+        });
+
+    // Textures are often shared by many prims.
+    std::sort(paths->assets.begin(), paths->assets.end());
+    paths->assets.erase(
+        std::unique(paths->assets.begin(), paths->assets.end()),
+        paths->assets.end());
 }
 
 bool _IsFileRelative(const std::string& path) {
-    return path.find("./") == 0 || path.find("../") == 0;
+    return path.compare(0, 2, "./") == 0 || path.compare(0, 3, "../") == 0;
 }
 
 TfStaticData<std::vector<std::string>> _SearchPath;
 
+// Record the latency of a resolve when going out of scope.
+class _ResolveTimer
+{
+public:
+    explicit _ResolveTimer(const std::string& path)
+        : _path(path)
+        , _start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~_ResolveTimer()
+    {
+        ReplaceResolverStats::GetInstance().AddResolve(
+            _path, std::chrono::steady_clock::now() - _start);
+    }
+
+private:
+    const std::string& _path;
+    std::chrono::steady_clock::time_point _start;
+};
+
+// Record a call in the trace when going out of scope, when recording.
+class _TraceScope
+{
+public:
+    _TraceScope(
+        std::shared_ptr<ReplaceResolverTraceRecorder> recorder,
+        ReplaceResolverTrace::EventType type,
+        const ReplaceResolverContext* context,
+        const std::string* path = nullptr,
+        const std::string* argument = nullptr)
+        : _recorder(std::move(recorder))
+        , _type(type)
+        , _context(context)
+        , _path(path)
+        , _argument(argument)
+    {
+        if (_recorder) {
+            _start = ReplaceResolverTraceRecorder::Now();
+        }
+    }
+
+    ~_TraceScope()
+    {
+        if (_recorder) {
+            const std::string empty;
+            _recorder->Record(
+                _type, _start, _context, _path ? *_path : empty,
+                _argument ? *_argument : empty, _result);
+        }
+    }
+
+    // Set the context created by the call, it may not outlive the scope.
+    void SetContext(const ReplaceResolverContext& context)
+    {
+        if (_recorder) {
+            _createdContext.reset(new ReplaceResolverContext(context));
+            _context = _createdContext.get();
+        }
+    }
+
+    // Return \p result, recording it.
+    std::string Return(std::string result)
+    {
+        if (_recorder) {
+            _result = result;
+        }
+        return result;
+    }
+
+private:
+    std::shared_ptr<ReplaceResolverTraceRecorder> _recorder;
+    ReplaceResolverTrace::EventType _type;
+    const ReplaceResolverContext* _context;
+    const std::string* _path;
+    const std::string* _argument;
+    std::unique_ptr<ReplaceResolverContext> _createdContext;
+    std::string _result;
+    std::chrono::steady_clock::time_point _start;
+};
+
 } // end anonymous namespace
 
 std::vector<std::string> _GetSearchPaths() 
@@ -122,20 +330,115 @@ std::vector<std::string> _GetSearchPaths()
     return searchPath;
 }
 
+// Return the search index files of the default search roots, read once
+// from REPLACE_RESOLVER_SEARCH_INDICES, a list alternating search roots and
+// their index file.
+static const ReplaceResolverContext::SearchIndexMap&
+_GetSearchIndices()
+{
+    static const ReplaceResolverContext::SearchIndexMap searchIndices = []() {
+        ReplaceResolverContext::SearchIndexMap result;
+        const std::vector<std::string> elements = TfStringTokenize(
+            TfGetenv("REPLACE_RESOLVER_SEARCH_INDICES"), ARCH_PATH_LIST_SEP);
+        if (elements.size() % 2 != 0) {
+            TF_WARN("Ignoring the search root '%s' without an index file in "
+                    "REPLACE_RESOLVER_SEARCH_INDICES",
+                    elements.back().c_str());
+        }
+        for (size_t i = 0; i + 1 < elements.size(); i += 2) {
+            result[elements[i]] = elements[i + 1];
+        }
+        return result;
+    }();
+    return searchIndices;
+}
+
 struct ReplaceResolver::_Cache
 {
-    using _PathToResolvedPathMap = 
-        tbb::concurrent_hash_map<std::string, std::string>;
-    _PathToResolvedPathMap _pathToResolvedPathMap;
+    ReplaceResolverConcurrentCache _pathToResolvedPathMap;
+
+    // Paths that were not interned, because they did not resolve or the
+    // resolve cache is full, are kept by the scope only.
+    std::mutex _uninternedMutex;
+    std::unordered_map<std::string, std::string> _uninternedPaths;
 };
 
+static size_t
+_GetResolveCacheBudgetFromEnv()
+{
+    const int budgetMb = TfGetenvInt("REPLACE_RESOLVER_CACHE_BUDGET_MB", 64);
+    return budgetMb > 0 ? static_cast<size_t>(budgetMb) << 20 : 0;
+}
+
 ReplaceResolver::ReplaceResolver()
+    : _resolveCache(_GetResolveCacheBudgetFromEnv())
+    , _resolveCacheGeneration(1)
+    , _recordingManifest(false)
+    , _recordingTrace(false)
 {
-    _fallbackContext = ReplaceResolverContext(_GetSearchPaths());
+    _fallbackContext = ReplaceResolverContext(
+        _GetSearchPaths(), ReplaceRuleTable::GetEmpty(), std::string(),
+        _GetSearchIndices());
+
+    _mmapAssets = TfGetenvBool("REPLACE_RESOLVER_MMAP_ASSETS", true);
+    _searchIndexFallback =
+        TfGetenvBool("REPLACE_RESOLVER_SEARCH_INDEX_FALLBACK", true);
+
+    ReplaceResolverFingerprinter environment;
+    environment.Append(_fallbackContext.GetFingerprint());
+    environment.Append(static_cast<uint64_t>(_searchIndexFallback));
+    _environmentFingerprint = environment.Get();
+
+    _manifestStrict = TfGetenvBool("REPLACE_RESOLVER_MANIFEST_STRICT", false);
+    const std::string manifestPath = TfGetenv("REPLACE_RESOLVER_MANIFEST");
+    if (!manifestPath.empty()) {
+        LoadManifest(manifestPath);
+    }
+
+    if (TfGetenvBool("REPLACE_RESOLVER_DIRECTORY_CACHE", false)) {
+        _directoryCache.reset(new ReplaceResolverDirectoryCache(
+            TfGetenvDouble("REPLACE_RESOLVER_DIRECTORY_CACHE_TTL", 30.0)));
+    }
+    else if (TfGetenvBool("REPLACE_RESOLVER_PARALLEL_PROBE", false)) {
+        // Listings already answer from memory, probing in parallel only
+        // helps when stat calls are made.
+        _prober.reset(new ReplaceResolverProber(
+            std::max(TfGetenvInt("REPLACE_RESOLVER_PROBE_THREADS", 16), 1),
+            TfGetenvBool("REPLACE_RESOLVER_PROBE_IO_URING", true)));
+    }
+
+    if (TfGetenvBool("REPLACE_RESOLVER_WATCH", false)) {
+        StartWatching();
+    }
+
+    const std::string sharedCacheName =
+        TfGetenv("REPLACE_RESOLVER_SHARED_CACHE");
+    if (!sharedCacheName.empty() && sharedCacheName != "0") {
+        SetSharedCache(
+            sharedCacheName == "1"
+                ? ReplaceResolverSharedCache::GetDefaultName()
+                : sharedCacheName,
+            static_cast<size_t>(std::max(
+                TfGetenvInt("REPLACE_RESOLVER_SHARED_CACHE_MB", 64), 1)) << 20);
+    }
+
+    const std::string daemonSocketPath = TfGetenv("REPLACE_RESOLVER_DAEMON");
+    if (!daemonSocketPath.empty() && daemonSocketPath != "0") {
+        SetDaemon(daemonSocketPath == "1"
+            ? ReplaceResolverDaemonProtocol::GetDefaultSocketPath()
+            : daemonSocketPath);
+    }
+
+    const std::string tracePath = TfGetenv("REPLACE_RESOLVER_TRACE");
+    if (!tracePath.empty()) {
+        StartTraceRecording(tracePath);
+    }
 }
 
 ReplaceResolver::~ReplaceResolver()
 {
+    StopWatching();
+    StopTraceRecording();
 }
 
 void
@@ -145,6 +448,292 @@ ReplaceResolver::SetDefaultSearchPath(
     *_SearchPath = searchPath;
 }
 
+void
+ReplaceResolver::SetResolveCacheBudget(size_t budget)
+{
+    _resolveCache.SetBudget(budget);
+    _resolveCacheGeneration.fetch_add(1, std::memory_order_release);
+}
+
+size_t
+ReplaceResolver::GetResolveCacheBudget() const
+{
+    return _resolveCache.GetBudget();
+}
+
+bool
+ReplaceResolver::LoadManifest(const std::string& filePath)
+{
+    ReplaceResolverManifestConstPtr manifest;
+    if (!filePath.empty()) {
+        std::string errMsg;
+        manifest = ReplaceResolverManifest::Open(filePath, &errMsg);
+        if (!manifest) {
+            TF_WARN("%s", errMsg.c_str());
+            return false;
+        }
+    }
+
+    std::atomic_store(&_manifest, manifest);
+    return true;
+}
+
+void
+ReplaceResolver::StartManifestRecording()
+{
+    std::lock_guard<std::mutex> lock(_manifestRecordMutex);
+    _manifestRecord.clear();
+    _recordingManifest = true;
+}
+
+bool
+ReplaceResolver::StopManifestRecording(const std::string& filePath)
+{
+    const ReplaceResolverPathTable& pathTable =
+        ReplaceResolverPathTable::GetInstance();
+    std::vector<ReplaceResolverManifest::Entry> entries;
+    {
+        std::lock_guard<std::mutex> lock(_manifestRecordMutex);
+        _recordingManifest = false;
+        entries.reserve(_manifestRecord.size());
+        for (const auto& record : _manifestRecord) {
+            ReplaceResolverManifest::Entry entry;
+            entry.context = record.first.context;
+            entry.path = pathTable.GetString(record.first.path);
+            entry.resolvedPath = pathTable.GetString(record.second);
+            entries.push_back(std::move(entry));
+        }
+        _manifestRecord.clear();
+    }
+
+    std::string errMsg;
+    if (!ReplaceResolverManifest::Write(filePath, entries, &errMsg)) {
+        TF_RUNTIME_ERROR("%s", errMsg.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool
+ReplaceResolver::SetSharedCache(const std::string& name, size_t capacity)
+{
+    std::shared_ptr<ReplaceResolverSharedCache> sharedCache;
+    if (!name.empty()) {
+        sharedCache = std::make_shared<ReplaceResolverSharedCache>(
+            name, capacity);
+        if (!sharedCache->IsValid()) {
+            return false;
+        }
+    }
+
+    std::atomic_store(&_sharedCache, sharedCache);
+    return true;
+}
+
+bool
+ReplaceResolver::SetDaemon(const std::string& socketPath)
+{
+    std::shared_ptr<ReplaceResolverDaemonClient> daemonClient;
+    if (!socketPath.empty()) {
+        daemonClient = std::make_shared<ReplaceResolverDaemonClient>(
+            socketPath, _environmentFingerprint,
+            TfGetenvDouble("REPLACE_RESOLVER_DAEMON_TIMEOUT", 10.0));
+    }
+
+    std::atomic_store(&_daemonClient, daemonClient);
+    return !daemonClient || daemonClient->IsAvailable();
+}
+
+const ReplaceResolverFingerprint&
+ReplaceResolver::GetEnvironmentFingerprint() const
+{
+    return _environmentFingerprint;
+}
+
+bool
+ReplaceResolver::StartTraceRecording(const std::string& filePath)
+{
+    std::string errMsg;
+    std::shared_ptr<ReplaceResolverTraceRecorder> recorder =
+        ReplaceResolverTraceRecorder::Create(filePath, &errMsg);
+    if (!recorder) {
+        TF_WARN("%s", errMsg.c_str());
+        return false;
+    }
+
+    // A previous trace is closed once its last calls are recorded.
+    std::atomic_store(&_traceRecorder, recorder);
+    _recordingTrace = true;
+    return true;
+}
+
+void
+ReplaceResolver::StopTraceRecording()
+{
+    _recordingTrace = false;
+    std::atomic_store(
+        &_traceRecorder, std::shared_ptr<ReplaceResolverTraceRecorder>());
+}
+
+std::shared_ptr<ReplaceResolverTraceRecorder>
+ReplaceResolver::_GetTraceRecorder() const
+{
+    if (!_recordingTrace.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return std::atomic_load(&_traceRecorder);
+}
+
+bool
+ReplaceResolver::StartWatching()
+{
+    if (std::atomic_load(&_watcher)) {
+        return true;
+    }
+
+    std::shared_ptr<ReplaceResolverWatcher> watcher =
+        std::make_shared<ReplaceResolverWatcher>(
+            [this](const std::vector<std::string>& changedPaths,
+                   const std::vector<std::string>& roots,
+                   bool all) {
+                _OnWatchedPathsChanged(changedPaths, roots, all);
+            },
+            TfGetenvDouble("REPLACE_RESOLVER_WATCH_DELAY", 0.2));
+    if (!watcher->IsValid()) {
+        return false;
+    }
+
+    std::shared_ptr<ReplaceResolverWatcher> expected;
+    if (std::atomic_compare_exchange_strong(&_watcher, &expected, watcher)) {
+        // Paths resolved until now are in directories nobody watches.
+        _resolveCache.Clear();
+        _resolveCacheGeneration.fetch_add(1, std::memory_order_release);
+    }
+    return true;
+}
+
+void
+ReplaceResolver::StopWatching()
+{
+    std::atomic_store(&_watcher, std::shared_ptr<ReplaceResolverWatcher>());
+}
+
+bool
+ReplaceResolver::BuildSearchIndex(
+    const std::string& rootDir,
+    const std::string& filePath)
+{
+    std::string errMsg;
+    if (!ReplaceResolverSearchIndex::Build(
+            TfAbsPath(rootDir), filePath, &errMsg)) {
+        TF_RUNTIME_ERROR("%s", errMsg.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool
+ReplaceResolver::ConvertReplaceTable(
+    const std::string& jsonFilePath,
+    const std::string& tableFilePath)
+{
+    ReplaceRuleTable::PairMap pairs;
+    std::string errMsg;
+    if (!ReplaceResolverSidecarCache::ReadPairs(jsonFilePath, &pairs, &errMsg) ||
+        !ReplaceTableFile::Write(tableFilePath, pairs, &errMsg)) {
+        TF_RUNTIME_ERROR("%s", errMsg.c_str());
+        return false;
+    }
+    return true;
+}
+
+void
+ReplaceResolver::_RecordManifestEntry(
+    const ReplaceResolverCacheKey& key,
+    ReplaceResolverPathTable::Id resolvedPath)
+{
+    std::lock_guard<std::mutex> lock(_manifestRecordMutex);
+    if (_recordingManifest) {
+        _manifestRecord.emplace(key, resolvedPath);
+    }
+}
+
+VtDictionary
+ReplaceResolver::GetStats() const
+{
+    const JsValue json(ReplaceResolverStats::GetInstance().GetAsJson());
+    VtDictionary stats =
+        JsConvertToContainerType<VtValue, VtDictionary>(json)
+            .Get<VtDictionary>();
+
+    if (_directoryCache) {
+        const ReplaceResolverDirectoryCache::Counters counters =
+            _directoryCache->GetCounters();
+        VtDictionary directoryCache;
+        directoryCache["statsAvoided"] = VtValue(counters.statsAvoided);
+        directoryCache["statsFallback"] = VtValue(counters.statsFallback);
+        directoryCache["directoryReads"] = VtValue(counters.directoryReads);
+        directoryCache["revalidations"] = VtValue(counters.revalidations);
+        stats["directoryCache"] = VtValue(directoryCache);
+    }
+
+    const ReplaceResolverPathTable& pathTable =
+        ReplaceResolverPathTable::GetInstance();
+    VtDictionary paths;
+    paths["size"] = VtValue(static_cast<uint64_t>(pathTable.GetSize()));
+    paths["memoryUsage"] =
+        VtValue(static_cast<uint64_t>(pathTable.GetMemoryUsage()));
+    stats["internedPaths"] = VtValue(paths);
+
+    if (std::shared_ptr<ReplaceResolverSharedCache> sharedCache =
+            std::atomic_load(&_sharedCache)) {
+        const ReplaceResolverSharedCache::Counters counters =
+            sharedCache->GetCounters();
+        VtDictionary shared;
+        shared["name"] = VtValue(sharedCache->GetName());
+        shared["capacity"] = VtValue(static_cast<uint64_t>(counters.capacity));
+        shared["entries"] = VtValue(static_cast<uint64_t>(counters.entries));
+        shared["bytesUsed"] = VtValue(static_cast<uint64_t>(counters.bytesUsed));
+        shared["failedInserts"] =
+            VtValue(static_cast<uint64_t>(counters.failedInserts));
+        stats["sharedCache"] = VtValue(shared);
+    }
+
+    if (std::shared_ptr<ReplaceResolverDaemonClient> daemonClient =
+            std::atomic_load(&_daemonClient)) {
+        const ReplaceResolverDaemonClient::Counters counters =
+            daemonClient->GetCounters();
+        VtDictionary daemon;
+        daemon["socketPath"] = VtValue(daemonClient->GetSocketPath());
+        daemon["requests"] = VtValue(static_cast<uint64_t>(counters.requests));
+        daemon["failedRequests"] =
+            VtValue(static_cast<uint64_t>(counters.failedRequests));
+        daemon["connections"] =
+            VtValue(static_cast<uint64_t>(counters.connections));
+        stats["daemon"] = VtValue(daemon);
+    }
+
+    if (_prober) {
+        stats["parallelProbe"] = VtValue(std::string(_prober->GetBackendName()));
+    }
+
+    if (std::shared_ptr<ReplaceResolverWatcher> watcher =
+            std::atomic_load(&_watcher)) {
+        stats["watchedDirectories"] =
+            VtValue(static_cast<uint64_t>(watcher->GetNumWatches()));
+    }
+    return stats;
+}
+
+void
+ReplaceResolver::ResetStats()
+{
+    ReplaceResolverStats::GetInstance().Reset();
+    if (_directoryCache) {
+        _directoryCache->ResetCounters();
+    }
+}
+
 void
 ReplaceResolver::ConfigureResolverForAsset(const std::string& path)
 {
@@ -168,137 +757,827 @@ ReplaceResolver::AnchorRelativePath(
     const std::string& anchorPath, 
     const std::string& path)
 {
+    _TraceScope trace(
+        _GetTraceRecorder(), ReplaceResolverTrace::AnchorRelativePath,
+        _GetCurrentContext(), &anchorPath, &path);
+
     if (TfIsRelativePath(anchorPath) ||
         !IsRelativePath(path)) {
-        return path;
+        return trace.Return(path);
     }
 
+    // If anchorPath does not end with a '/', we assume it is specifying
+    // a file, strip off the last component, and anchor the path to that
+    // directory.
+    const size_t separator = anchorPath.find_last_of("/\\");
+    ReplaceResolverPathBuffer anchoredPath;
+    anchoredPath.Assign(
+        anchorPath.data(),
+        separator != std::string::npos ? separator : anchorPath.size());
+
     // Ensure we are using forward slashes and not back slashes.
-    std::string forwardPath = anchorPath;
-    std::replace(forwardPath.begin(), forwardPath.end(), '\\', '/');
+    anchoredPath.Replace('\\', '/');
+
+    anchoredPath.Append("/", 1);
+    anchoredPath.Append(path);
+    anchoredPath.Normalize();
+    return trace.Return(anchoredPath.GetString());
+}
+
+bool
+ReplaceResolver::IsSearchPath(const std::string& path)
+{
+    return IsRelativePath(path) && !_IsFileRelative(path);
+}
+
+std::string
+ReplaceResolver::GetExtension(const std::string& path)
+{
+    return TfGetExtension(path);
+}
+
+std::string
+ReplaceResolver::ComputeNormalizedPath(const std::string& path)
+{
+    return TfNormPath(path);
+}
+
+std::string
+ReplaceResolver::ComputeRepositoryPath(const std::string& path)
+{
+    return std::string();
+}
+
+// Return the position of \p resolvedPath relative to \p root, or npos if
+// it is not under it.
+static size_t
+_GetRelativeOffset(
+    const char* root, size_t rootSize,
+    const char* resolvedPath, size_t resolvedPathSize)
+{
+    if (rootSize == 0 || resolvedPathSize < rootSize ||
+        memcmp(resolvedPath, root, rootSize) != 0) {
+        return std::string::npos;
+    }
+    if (root[rootSize - 1] == '/') {
+        return rootSize;
+    }
+    return resolvedPathSize > rootSize + 1 && resolvedPath[rootSize] == '/'
+        ? rootSize + 1 : std::string::npos;
+}
+
+static size_t
+_GetRelativeOffset(const std::string& root, const std::string& resolvedPath)
+{
+    return _GetRelativeOffset(
+        root.data(), root.size(), resolvedPath.data(), resolvedPath.size());
+}
+
+// Answer the existence of \p resolvedPath from the \p index of the
+// \p root search path. Return false if the index does not know the path
+// and the filesystem must be probed, otherwise set \p exists.
+static bool
+_FindInSearchIndex(
+    const ReplaceResolverSearchIndex* index,
+    bool indexFallback,
+    const char* root, size_t rootSize,
+    const char* resolvedPath, size_t resolvedPathSize,
+    bool* exists)
+{
+    if (!index) {
+        return false;
+    }
+
+    // Paths escaping the root with ".." are not covered by its index.
+    const size_t offset = _GetRelativeOffset(
+        root, rootSize, resolvedPath, resolvedPathSize);
+    if (offset == std::string::npos) {
+        return false;
+    }
+
+    ReplaceResolverStats& stats = ReplaceResolverStats::GetInstance();
+    if (index->Contains(resolvedPath + offset, resolvedPathSize - offset)) {
+        stats.Increment(ReplaceResolverStats::SearchIndexHits);
+        *exists = true;
+        return true;
+    }
+    stats.Increment(ReplaceResolverStats::SearchIndexMisses);
+    *exists = false;
+    return !indexFallback;
+}
+
+static bool
+_FindInSearchIndex(
+    const ReplaceResolverSearchIndex* index,
+    bool indexFallback,
+    const std::string& root,
+    const std::string& resolvedPath,
+    bool* exists)
+{
+    return _FindInSearchIndex(
+        index, indexFallback, root.data(), root.size(),
+        resolvedPath.data(), resolvedPath.size(), exists);
+}
+
+// Return true if \p path exists under \p anchorPath, and set
+// \p resolvedPath to them joined. Unless a directory listing must be
+// read, nothing is allocated, only \p resolvedPath is set on success.
+static bool
+_Resolve(
+    const char* anchorPath, size_t anchorPathSize,
+    const std::string& path,
+    ReplaceResolverDirectoryCache* directoryCache,
+    std::string* resolvedPath,
+    const ReplaceResolverSearchIndex* index = nullptr,
+    bool indexFallback = true)
+{
+    ReplaceResolverPathBuffer buffer;
+    if (anchorPathSize == 0) {
+        buffer.Assign(path);
+    }
+    else {
+        // XXX - CLEANUP:
+        // It's tempting to use AnchorRelativePath to combine the two
+        // paths here, but that function's file-relative anchoring
+        // causes consumers to break. 
+        // 
+        // Ultimately what we should do is specify whether anchorPath 
+        // in both Resolve and AnchorRelativePath can be files or directories 
+        // and fix up all the callers to accommodate this.
+        buffer.AssignCatPaths(anchorPath, anchorPathSize, path.data(), path.size());
+
+        bool exists = false;
+        if (_FindInSearchIndex(
+                index, indexFallback, anchorPath, anchorPathSize,
+                buffer.GetData(), buffer.GetSize(), &exists)) {
+            if (exists) {
+                buffer.CopyTo(resolvedPath);
+            }
+            return exists;
+        }
+
+        if (directoryCache) {
+            if (!directoryCache->Exists(anchorPath, anchorPathSize, path)) {
+                return false;
+            }
+            buffer.CopyTo(resolvedPath);
+            return true;
+        }
+    }
+
+    thread_local std::string statRoot;
+    statRoot.assign(anchorPath, anchorPathSize);
+    ReplaceResolverStats::GetInstance().AddStatCall(statRoot);
+    if (!buffer.Exists()) {
+        return false;
+    }
+    buffer.CopyTo(resolvedPath);
+    return true;
+}
+
+// Return \p path with the rules of \p ctx applied. The replaced path is
+// stored in \p scratch, whose capacity is reused across resolves.
+const std::string&
+_ReplaceFromContext(
+    const ReplaceResolverContext& ctx,
+    const std::string& path,
+    std::string* scratch)
+{
+    if (ctx.GetReplaceRules()->Replace(path, scratch)) {
+        ReplaceResolverStats::GetInstance().Increment(
+            ReplaceResolverStats::ReplaceHits);
+        TF_DEBUG(REPLACERESOLVER_REPLACE).Msg("Replaced \"%s\" by \"%s\"\n",
+                                            path.c_str(), scratch->c_str());
+        return *scratch;
+    }
+
+    return path;
+}
+
+// Return the interned current directory if \p path is relative, since it
+// is first looked up there, otherwise InvalidId. The directory rarely
+// changes, the id of the last one is kept per thread.
+static ReplaceResolverPathTable::Id
+_GetCacheCwd(const std::string& path)
+{
+    if (path.empty() || !TfIsRelativePath(path)) {
+        return ReplaceResolverPathTable::InvalidId;
+    }
+
+    thread_local std::string lastCwd;
+    thread_local ReplaceResolverPathTable::Id lastCwdId =
+        ReplaceResolverPathTable::InvalidId;
+    ReplaceResolverPathBuffer cwd;
+    cwd.AssignCwd();
+    if (lastCwdId == ReplaceResolverPathTable::InvalidId ||
+        lastCwd.compare(0, std::string::npos,
+                        cwd.GetData(), cwd.GetSize()) != 0) {
+        lastCwd.assign(cwd.GetData(), cwd.GetSize());
+        lastCwdId = ReplaceResolverPathTable::GetInstance().Intern(lastCwd);
+    }
+    return lastCwdId;
+}
+
+std::string
+ReplaceResolver::_ResolveNoCache(const std::string& path)
+{
+    if (path.empty()) {
+        return path;
+    }
+
+    if (_prober) {
+        return _ResolveWithProber(path);
+    }
+
+    std::string resolvedPath;
+    if (IsRelativePath(path)) {
+        // First try to resolve relative paths against the current
+        // working directory.
+        if (_ResolveInCwd(path, &resolvedPath)) {
+            return resolvedPath;
+        }
+
+        // If that fails and the path is a search path, try to resolve
+        // against each directory in the specified search paths.
+        if (IsSearchPath(path)) {
+            auto currentContext = _GetCurrentContext();
+            if(currentContext) {
+                TF_DEBUG(REPLACERESOLVER_CURRENTCONTEXT).Msg(
+                    "ReplaceResolverContext: \"%s\"\n",
+                    ArResolverContext(*currentContext).GetDebugString().c_str());
+            }
+            // Resolves do not nest, the thread reuses the same buffer.
+            thread_local std::string scratch;
+            const ReplaceResolverContext* contexts[2] =
+                {currentContext, &_fallbackContext};
+            for (const ReplaceResolverContext* ctx : contexts) {
+                if (ctx) {
+                    // Replace sub strings from context old/new pairs.
+                    const std::string& replacedPath =
+                        _ReplaceFromContext(*ctx, path, &scratch);
+
+                    const std::vector<std::string>& searchPaths =
+                        ctx->GetSearchPath();
+                    const std::vector<ReplaceResolverSearchIndexConstPtr>&
+                        indices = ctx->GetSearchPathIndices();
+                    for (size_t i = 0; i < searchPaths.size(); ++i) {
+                        if (_Resolve(searchPaths[i].data(), searchPaths[i].size(),
+                                     replacedPath, _directoryCache.get(),
+                                     &resolvedPath, indices[i].get(),
+                                     _searchIndexFallback)) {
+                            return resolvedPath;
+                        }
+                    }
+                }
+            }
+        }
+
+        return std::string();
+    }
+
+    _Resolve("", 0, path, _directoryCache.get(), &resolvedPath);
+    return resolvedPath;
+}
+
+bool
+ReplaceResolver::_ResolveInCwd(
+    const std::string& path,
+    std::string* resolvedPath)
+{
+    ReplaceResolverPathBuffer cwd;
+    cwd.AssignCwd();
+    return _Resolve(cwd.GetData(), cwd.GetSize(), path,
+                    _directoryCache.get(), resolvedPath);
+}
+
+void
+ReplaceResolver::_GetProbeCandidates(
+    const std::string& path,
+    _ProbeCandidates* candidates)
+{
+    // Same order as the sequential probes of _ResolveNoCache.
+    if (!IsRelativePath(path)) {
+        candidates->push_back({std::string(), path, false});
+        return;
+    }
+
+    ReplaceResolverPathBuffer buffer;
+    buffer.AssignCwd();
+    std::string cwd = buffer.GetString();
+    buffer.AssignCatPaths(cwd, path);
+    candidates->push_back({std::move(cwd), buffer.GetString(), false});
+
+    if (IsSearchPath(path)) {
+        thread_local std::string scratch;
+        const ReplaceResolverContext* contexts[2] =
+            {_GetCurrentContext(), &_fallbackContext};
+        for (const ReplaceResolverContext* ctx : contexts) {
+            if (!ctx) {
+                continue;
+            }
+
+            const std::string& replacedPath =
+                _ReplaceFromContext(*ctx, path, &scratch);
+            const std::vector<std::string>& searchPaths = ctx->GetSearchPath();
+            const std::vector<ReplaceResolverSearchIndexConstPtr>& indices =
+                ctx->GetSearchPathIndices();
+            for (size_t i = 0; i < searchPaths.size(); ++i) {
+                buffer.AssignCatPaths(searchPaths[i], replacedPath);
+                _ProbeCandidate candidate = {
+                    searchPaths[i], buffer.GetString(), false};
+
+                // Candidates known from a search index are not probed, and
+                // the first one that exists ends the list.
+                bool exists = false;
+                if (_FindInSearchIndex(
+                        indices[i].get(), _searchIndexFallback,
+                        candidate.searchPath, candidate.path, &exists)) {
+                    if (exists) {
+                        candidate.exists = true;
+                        candidates->push_back(std::move(candidate));
+                        return;
+                    }
+                    continue;
+                }
+                candidates->push_back(std::move(candidate));
+            }
+        }
+    }
+}
+
+std::string
+ReplaceResolver::_ResolveWithProber(const std::string& path)
+{
+    const std::unordered_map<std::string, std::string>& prefetched =
+        _threadData.local().prefetchedResolves;
+    auto it = prefetched.find(path);
+    if (it != prefetched.end()) {
+        return it->second;
+    }
+
+    _ProbeCandidates candidates;
+    _GetProbeCandidates(path, &candidates);
+
+    // All the candidates are probed at once, including the ones a
+    // sequential resolve would not have reached.
+    std::vector<std::string> paths;
+    paths.reserve(candidates.size());
+    ReplaceResolverStats& stats = ReplaceResolverStats::GetInstance();
+    for (const _ProbeCandidate& candidate : candidates) {
+        if (!candidate.exists) {
+            stats.AddStatCall(candidate.searchPath);
+            paths.push_back(candidate.path);
+        }
+    }
+
+    std::vector<uint8_t> exists;
+    _prober->Exists(paths, &exists);
+    for (size_t i = 0, j = 0; i < candidates.size(); ++i) {
+        if (candidates[i].exists || exists[j++]) {
+            return candidates[i].path;
+        }
+    }
+    return std::string();
+}
+
+void
+ReplaceResolver::_GetPathsToPrefetch(
+    const std::vector<const std::string*>& paths,
+    std::vector<const std::string*>* toResolve)
+{
+    ReplaceResolverCacheKey key;
+    if (const ReplaceResolverContext* ctx = _GetCurrentContext()) {
+        key.context = ctx->GetFingerprint();
+    }
+    const ReplaceResolverManifestConstPtr manifest =
+        std::atomic_load(&_manifest);
+    ReplaceResolverPathTable& pathTable = ReplaceResolverPathTable::GetInstance();
+
+    // Paths already known are skipped, their resolve probes nothing.
+    for (const std::string* path : paths) {
+        std::string resolvedPath;
+        if (path->empty() ||
+            (manifest && manifest->Find(key.context, *path, &resolvedPath))) {
+            continue;
+        }
+        ReplaceResolverPathTable::Id resolvedId;
+        key.path = pathTable.Find(*path);
+        key.cwd = _GetCacheCwd(*path);
+        if (key.path != ReplaceResolverPathTable::InvalidId &&
+            _resolveCache.Find(key, &resolvedId)) {
+            continue;
+        }
+        toResolve->push_back(path);
+    }
+}
+
+void
+ReplaceResolver::_PrefetchProbes(const std::vector<const std::string*>& paths)
+{
+    std::vector<const std::string*> toResolve;
+    _GetPathsToPrefetch(paths, &toResolve);
+
+    std::vector<size_t> firstCandidates;
+    _ProbeCandidates candidates;
+    for (const std::string* path : toResolve) {
+        firstCandidates.push_back(candidates.size());
+        _GetProbeCandidates(*path, &candidates);
+    }
+    firstCandidates.push_back(candidates.size());
+
+    // Paths often share candidates, each one is probed once.
+    std::unordered_map<std::string, size_t> probeIndices;
+    std::vector<std::string> toProbe;
+    std::vector<size_t> candidateProbes;
+    candidateProbes.reserve(candidates.size());
+    ReplaceResolverStats& stats = ReplaceResolverStats::GetInstance();
+    for (const _ProbeCandidate& candidate : candidates) {
+        if (candidate.exists) {
+            candidateProbes.push_back(std::string::npos);
+            continue;
+        }
+        auto inserted = probeIndices.emplace(candidate.path, toProbe.size());
+        if (inserted.second) {
+            stats.AddStatCall(candidate.searchPath);
+            toProbe.push_back(candidate.path);
+        }
+        candidateProbes.push_back(inserted.first->second);
+    }
 
-    // If anchorPath does not end with a '/', we assume it is specifying
-    // a file, strip off the last component, and anchor the path to that
-    // directory.
-    const std::string anchoredPath = TfStringCatPaths(
-        TfStringGetBeforeSuffix(forwardPath, '/'), path);
-    return TfNormPath(anchoredPath);
+    std::vector<uint8_t> exists;
+    _prober->Exists(toProbe, &exists);
+
+    std::unordered_map<std::string, std::string>& prefetched =
+        _threadData.local().prefetchedResolves;
+    for (size_t i = 0; i < toResolve.size(); ++i) {
+        std::string& resolvedPath = prefetched[*toResolve[i]];
+        for (size_t c = firstCandidates[i]; c < firstCandidates[i + 1]; ++c) {
+            if (candidates[c].exists || exists[candidateProbes[c]]) {
+                resolvedPath = candidates[c].path;
+                break;
+            }
+        }
+    }
 }
 
 bool
-ReplaceResolver::IsSearchPath(const std::string& path)
+ReplaceResolver::_PrefetchFromDaemon(
+    ReplaceResolverDaemonClient& daemon,
+    const std::vector<const std::string*>& paths)
 {
-    return IsRelativePath(path) && !_IsFileRelative(path);
+    std::vector<const std::string*> toResolve;
+    _GetPathsToPrefetch(paths, &toResolve);
+
+    // The current directory of this process is looked up here, the daemon
+    // only resolves the rest.
+    std::unordered_map<std::string, std::string>& prefetched =
+        _threadData.local().prefetchedResolves;
+    std::vector<const std::string*> toRequest;
+    for (const std::string* path : toResolve) {
+        if (IsRelativePath(*path)) {
+            std::string resolvedPath;
+            if (_ResolveInCwd(*path, &resolvedPath) || !IsSearchPath(*path)) {
+                prefetched[*path] = std::move(resolvedPath);
+                continue;
+            }
+        }
+        toRequest.push_back(path);
+    }
+
+    if (toRequest.empty()) {
+        return true;
+    }
+
+    std::vector<std::string> resolvedPaths;
+    if (!daemon.Resolve(_GetCurrentContext(), toRequest, &resolvedPaths)) {
+        return false;
+    }
+    ReplaceResolverStats::GetInstance().Increment(
+        ReplaceResolverStats::DaemonResolves, toRequest.size());
+    for (size_t i = 0; i < toRequest.size(); ++i) {
+        prefetched[*toRequest[i]] = std::move(resolvedPaths[i]);
+    }
+    return true;
 }
 
 std::string
-ReplaceResolver::GetExtension(const std::string& path)
+ReplaceResolver::_ResolveWithDaemon(const std::string& path)
 {
-    return TfGetExtension(path);
+    const std::shared_ptr<ReplaceResolverDaemonClient> daemon =
+        std::atomic_load(&_daemonClient);
+    if (!daemon) {
+        return _ResolveNoCache(path);
+    }
+
+    const std::unordered_map<std::string, std::string>& prefetched =
+        _threadData.local().prefetchedResolves;
+    auto it = prefetched.find(path);
+    if (it != prefetched.end()) {
+        return it->second;
+    }
+
+    std::string resolvedPath;
+    if (IsRelativePath(path) &&
+        (_ResolveInCwd(path, &resolvedPath) || !IsSearchPath(path))) {
+        return resolvedPath;
+    }
+
+    ReplaceResolverStats& stats = ReplaceResolverStats::GetInstance();
+    std::vector<std::string> resolvedPaths;
+    if (daemon->Resolve(_GetCurrentContext(),
+                        std::vector<const std::string*>(1, &path),
+                        &resolvedPaths)) {
+        stats.Increment(ReplaceResolverStats::DaemonResolves);
+        return std::move(resolvedPaths[0]);
+    }
+
+    // The daemon is not running or could not answer.
+    stats.Increment(ReplaceResolverStats::DaemonFallbacks);
+    return _ResolveNoCache(path);
 }
 
 std::string
-ReplaceResolver::ComputeNormalizedPath(const std::string& path)
+ReplaceResolver::Resolve(const std::string& path)
 {
-    return TfNormPath(path);
+    return ResolveWithAssetInfo(path, /* assetInfo = */ nullptr);
 }
 
 std::string
-ReplaceResolver::ComputeRepositoryPath(const std::string& path)
+ReplaceResolver::_ResolveWithSharedCache(
+    const ReplaceResolverFingerprint& context,
+    const std::string& path)
 {
-    return std::string();
+    const std::shared_ptr<ReplaceResolverSharedCache> sharedCache =
+        std::atomic_load(&_sharedCache);
+    if (!sharedCache) {
+        return _ResolveWithDaemon(path);
+    }
+
+    // Other processes may have another fallback search path, and relative
+    // paths are first looked up in the current directory, which they may
+    // not share either.
+    ReplaceResolverFingerprinter fingerprinter;
+    fingerprinter.Append(context);
+    fingerprinter.Append(sharedCache->GetEpoch(context));
+    fingerprinter.Append(_environmentFingerprint);
+    if (IsRelativePath(path)) {
+        ReplaceResolverPathBuffer cwd;
+        cwd.AssignCwd();
+        fingerprinter.Append(cwd.GetString());
+    }
+    const ReplaceResolverFingerprint sharedContext = fingerprinter.Get();
+
+    ReplaceResolverStats& stats = ReplaceResolverStats::GetInstance();
+    std::string resolvedPath;
+    if (sharedCache->Find(sharedContext, path, &resolvedPath)) {
+        stats.Increment(ReplaceResolverStats::SharedCacheHits);
+        return resolvedPath;
+    }
+    stats.Increment(ReplaceResolverStats::SharedCacheMisses);
+
+    resolvedPath = _ResolveWithDaemon(path);
+    if (!resolvedPath.empty()) {
+        sharedCache->Insert(sharedContext, path, resolvedPath);
+    }
+    return resolvedPath;
 }
 
-static std::string
-_Resolve(
-    const std::string& anchorPath,
-    const std::string& path)
+ReplaceResolverPathTable::Id
+ReplaceResolver::_ResolveWithResolveCache(
+    ReplaceResolverCacheKey* key,
+    const std::string& path,
+    std::string* resolvedPath)
 {
-    std::string resolvedPath = path;
-    if (!anchorPath.empty()) {
-        // XXX - CLEANUP:
-        // It's tempting to use AnchorRelativePath to combine the two
-        // paths here, but that function's file-relative anchoring
-        // causes consumers to break. 
-        // 
-        // Ultimately what we should do is specify whether anchorPath 
-        // in both Resolve and AnchorRelativePath can be files or directories 
-        // and fix up all the callers to accommodate this.
-        resolvedPath = TfStringCatPaths(anchorPath, path);
+    ReplaceResolverStats& stats = ReplaceResolverStats::GetInstance();
+
+    ReplaceResolverPathTable::Id resolvedId;
+    if (key->path != ReplaceResolverPathTable::InvalidId &&
+        _resolveCache.Find(*key, &resolvedId)) {
+        stats.Increment(ReplaceResolverStats::ResolveCacheHits);
+        return resolvedId;
     }
-    return TfPathExists(resolvedPath) ? resolvedPath : std::string();
-}
+    stats.Increment(ReplaceResolverStats::ResolveCacheMisses);
+
+    std::string resolved = _ResolveWithSharedCache(key->context, path);
+    if (resolved.empty()) {
+        // Unresolved paths are neither interned nor cached, an asset
+        // published later in the session must be found.
+        return ReplaceResolverPathTable::InvalidId;
+    }
+
+    // Interned paths are never released, they may take up to half of the
+    // budget and the cache entries get the rest. Past it, resolved paths
+    // are returned as strings and not cached.
+    ReplaceResolverPathTable& pathTable = ReplaceResolverPathTable::GetInstance();
+    const size_t budget = _resolveCache.GetBudget();
+    if (key->path == ReplaceResolverPathTable::InvalidId && budget > 0) {
+        key->path = pathTable.Intern(path, budget / 2);
+    }
+    resolvedId = key->path != ReplaceResolverPathTable::InvalidId
+        ? pathTable.Intern(resolved, budget / 2)
+        : ReplaceResolverPathTable::InvalidId;
+    if (resolvedId == ReplaceResolverPathTable::InvalidId) {
+        *resolvedPath = std::move(resolved);
+        return ReplaceResolverPathTable::InvalidId;
+    }
+
+    _resolveCache.Insert(*key, resolvedId);
 
-std::string _ReplaceFromContext(const ReplaceResolverContext& ctx, const std::string& path)
+    if (std::shared_ptr<ReplaceResolverWatcher> watcher =
+            std::atomic_load(&_watcher)) {
+        _WatchResolvedPath(*watcher, resolved);
+    }
+    return resolvedId;
+}
 
+ReplaceResolverPathTable::Id
+ReplaceResolver::_ResolveWithScopeCache(
+    _Cache& cache,
+    ReplaceResolverCacheKey* key,
+    const std::string& path,
+    std::string* resolvedPath,
+    bool* hit)
 {
-    std::string result = path;
+    ReplaceResolverStats& stats = ReplaceResolverStats::GetInstance();
+
+    if (key->path != ReplaceResolverPathTable::InvalidId) {
+        // Hits do not lock, concurrent misses on a path resolve it once.
+        // A resolved path the path table had no room for is kept by the
+        // scope before the result is published.
+        const ReplaceResolverPathTable::Id resolvedId =
+            cache._pathToResolvedPathMap.FindOrCompute(
+                *key,
+                [this, &cache, key, &path, resolvedPath]() {
+                    const ReplaceResolverPathTable::Id id =
+                        _ResolveWithResolveCache(key, path, resolvedPath);
+                    if (id == ReplaceResolverPathTable::InvalidId &&
+                        !resolvedPath->empty()) {
+                        std::lock_guard<std::mutex> lock(
+                            cache._uninternedMutex);
+                        cache._uninternedPaths.emplace(path, *resolvedPath);
+                    }
+                    return id;
+                },
+                hit);
+        if (*hit) {
+            stats.Increment(ReplaceResolverStats::ScopedCacheHits);
+            if (resolvedId == ReplaceResolverPathTable::InvalidId) {
+                std::lock_guard<std::mutex> lock(cache._uninternedMutex);
+                auto it = cache._uninternedPaths.find(path);
+                if (it != cache._uninternedPaths.end()) {
+                    *resolvedPath = it->second;
+                }
+            }
+        }
+        return resolvedId;
+    }
 
-    auto oldAndNewStrings = ctx.GetReplaceMap();
-    for (auto it = oldAndNewStrings.begin(); it != oldAndNewStrings.end(); ++it)
     {
-
-        std::size_t found = path.find(it->first);
-        if(found != std::string::npos) {
-            result.replace(found, it->first.size(), it->second);
-            break;
+        std::lock_guard<std::mutex> lock(cache._uninternedMutex);
+        auto it = cache._uninternedPaths.find(path);
+        if (it != cache._uninternedPaths.end()) {
+            *hit = true;
+            stats.Increment(ReplaceResolverStats::ScopedCacheHits);
+            *resolvedPath = it->second;
+            return ReplaceResolverPathTable::InvalidId;
         }
     }
 
-    return result;
+    const ReplaceResolverPathTable::Id resolvedId =
+        _ResolveWithResolveCache(key, path, resolvedPath);
+    if (resolvedId != ReplaceResolverPathTable::InvalidId) {
+        cache._pathToResolvedPathMap.FindOrCompute(
+            *key, [resolvedId]() { return resolvedId; });
+    }
+    else {
+        std::lock_guard<std::mutex> lock(cache._uninternedMutex);
+        cache._uninternedPaths.emplace(path, *resolvedPath);
+    }
+    return resolvedId;
 }
 
-std::string
-ReplaceResolver::_ResolveNoCache(const std::string& path)
+void
+ReplaceResolver::_WatchResolvedPath(
+    ReplaceResolverWatcher& watcher,
+    const std::string& resolvedPath)
 {
-    if (path.empty()) {
-        return path;
+    const std::string directory =
+        TfStringTrimRight(TfGetPathName(resolvedPath), "/");
+
+    // Watch from the search path the path resolved under, so that a
+    // publish creating the directories in between is seen. The same
+    // relative directory is watched under the other roots of the search
+    // path, a path published there may hide the resolved one.
+    const ReplaceResolverContext* contexts[2] =
+        {_GetCurrentContext(), &_fallbackContext};
+    for (const ReplaceResolverContext* ctx : contexts) {
+        if (!ctx) {
+            continue;
+        }
+        const std::vector<std::string>& searchPath = ctx->GetSearchPath();
+        for (const std::string& root : searchPath) {
+            const size_t offset = _GetRelativeOffset(root, resolvedPath);
+            if (offset == std::string::npos) {
+                continue;
+            }
+            const std::string relativeDirectory = TfStringTrimRight(
+                TfGetPathName(resolvedPath.substr(offset)), "/");
+            for (const std::string& otherRoot : searchPath) {
+                const std::string trimmedRoot =
+                    TfStringTrimRight(otherRoot, "/");
+                watcher.Watch(trimmedRoot, relativeDirectory.empty()
+                    ? trimmedRoot
+                    : trimmedRoot + "/" + relativeDirectory);
+            }
+            return;
+        }
     }
+    watcher.Watch(std::string(), directory);
+}
 
-    if (IsRelativePath(path)) {
-        // First try to resolve relative paths against the current
-        // working directory.
-        std::string resolvedPath = _Resolve(ArchGetCwd(), path);
-        if (!resolvedPath.empty()) {
-            return resolvedPath;
+void
+ReplaceResolver::_OnWatchedPathsChanged(
+    const std::vector<std::string>& changedPaths,
+    const std::vector<std::string>& roots,
+    bool all)
+{
+    ReplaceResolverStats::GetInstance().Increment(
+        ReplaceResolverStats::WatchedChanges, all ? 1 : changedPaths.size());
+
+    std::set<ReplaceResolverFingerprint> affectedContexts;
+    if (all) {
+        _resolveCache.Clear();
+        if (_directoryCache) {
+            _directoryCache->Clear();
         }
+        _sidecarCache.Clear();
+    }
+    else {
+        // A path created under a search root may hide the same relative
+        // path under another one, the paths resolved there are dropped
+        // too.
+        std::vector<std::string> affectedPaths;
+        for (const std::string& changedPath : changedPaths) {
+            affectedPaths.push_back(changedPath);
+            for (const std::string& root : roots) {
+                const size_t offset = _GetRelativeOffset(root, changedPath);
+                if (offset == std::string::npos) {
+                    continue;
+                }
+                const std::string relativePath = changedPath.substr(offset);
+                for (const std::string& otherRoot : roots) {
+                    if (otherRoot != root) {
+                        affectedPaths.push_back(
+                            TfStringCatPaths(otherRoot, relativePath));
+                    }
+                }
+            }
 
-        // If that fails and the path is a search path, try to resolve
-        // against each directory in the specified search paths.
-        if (IsSearchPath(path)) {
-            auto currentContext = _GetCurrentContext();
-            if(currentContext) {
-                TF_DEBUG(REPLACERESOLVER_CURRENTCONTEXT).Msg(
-                    "ReplaceResolverContext: \"%s\"\n",
-                    ArResolverContext(*currentContext).GetDebugString().c_str());
+            if (_directoryCache) {
+                _directoryCache->Invalidate(changedPath);
             }
-            const ReplaceResolverContext* contexts[2] =
-                {currentContext, &_fallbackContext};
-            for (const ReplaceResolverContext* ctx : contexts) {
-                if (ctx) {
-                    // Replace sub strings from context old/new pairs.
-                    std::string replacedPath = _ReplaceFromContext(*ctx, path);
+            const std::string baseName = TfGetBaseName(changedPath);
+            if (baseName == ReplaceResolverTokens->replaceFileName.GetString() ||
+                baseName ==
+                    ReplaceResolverTokens->replaceTableFileName.GetString()) {
+                _sidecarCache.Invalidate(TfGetPathName(changedPath));
+            }
+        }
 
-                    for (const auto& searchPath : ctx->GetSearchPath()) {
-                        resolvedPath = _Resolve(searchPath, replacedPath);
-                        if (!resolvedPath.empty()) {
-                            return resolvedPath;
-                        }
+        const ReplaceResolverPathTable& pathTable =
+            ReplaceResolverPathTable::GetInstance();
+        _resolveCache.InvalidateResolvedPaths(
+            [&pathTable, &affectedPaths](ReplaceResolverPathTable::Id id) {
+                const std::string resolvedPath = pathTable.GetString(id);
+                for (const std::string& affectedPath : affectedPaths) {
+                    if (TfStringStartsWith(resolvedPath, affectedPath) &&
+                        (resolvedPath.size() == affectedPath.size() ||
+                         resolvedPath[affectedPath.size()] == '/')) {
+                        return true;
                     }
                 }
+                return false;
+            },
+            &affectedContexts);
+    }
+    _resolveCacheGeneration.fetch_add(1, std::memory_order_release);
+
+    // The shared entries of the contexts that resolved changed paths here
+    // are dropped. Without a resolve cache to tell them, or when changes
+    // were lost, all of them are.
+    if (std::shared_ptr<ReplaceResolverSharedCache> sharedCache =
+            std::atomic_load(&_sharedCache)) {
+        if (all || _resolveCache.GetBudget() == 0) {
+            sharedCache->Clear();
+        }
+        else {
+            for (const ReplaceResolverFingerprint& context : affectedContexts) {
+                sharedCache->Invalidate(context);
             }
         }
-
-        return std::string();
     }
 
-    return _Resolve(std::string(), path);
-}
-
-std::string
-ReplaceResolver::Resolve(const std::string& path)
-{
-    return ResolveWithAssetInfo(path, /* assetInfo = */ nullptr);
+    ReplaceResolverFilesChangedNotice(changedPaths, all).Send();
 }
 
 std::string
@@ -313,23 +1592,237 @@ ReplaceResolver::ResolveWithAssetInfo(
         return path;
     }
 
+    const _ResolveTimer timer(path);
+    ReplaceResolverStats& stats = ReplaceResolverStats::GetInstance();
+
+    _ThreadData& threadData = _threadData.local();
+
+    // Resolved paths depend on the bound context.
+    const ReplaceResolverContext* ctx = threadData.contextStack.empty() ||
+        !threadData.contextStack.back().context
+        ? nullptr : &threadData.contextStack.back().current;
+    ReplaceResolverCacheKey key;
+    if (ctx) {
+        key.context = ctx->GetFingerprint();
+    }
+
     std::string resolvedPath;
-    if (_CachePtr currentCache = _GetCurrentCache()) {
-        _Cache::_PathToResolvedPathMap::accessor accessor;
-        if (currentCache->_pathToResolvedPathMap.insert(
-                accessor, std::make_pair(path, std::string()))) {
-            accessor->second = _ResolveNoCache(path);
+    _TraceScope trace(
+        _GetTraceRecorder(), ReplaceResolverTrace::Resolve, ctx, &path);
+    if (ReplaceResolverManifestConstPtr manifest = std::atomic_load(&_manifest)) {
+        if (manifest->Find(key.context, path, &resolvedPath) ||
+            _manifestStrict) {
+            stats.Increment(ReplaceResolverStats::ManifestHits);
+            TF_DEBUG(REPLACERESOLVER_PATH).Msg("Resolved path from manifest "
+                                              "\"%s\"\n",
+                                              resolvedPath.c_str());
+            return trace.Return(std::move(resolvedPath));
+        }
+    }
+
+    // Paths the thread resolved recently are answered without touching
+    // any shared cache. The generation is read first, so that a path
+    // resolved while the caches are refreshed is not kept.
+    const uint64_t generation =
+        _resolveCacheGeneration.load(std::memory_order_acquire);
+    const size_t pathHash = std::hash<std::string>()(path);
+
+    // The caches hold interned path ids, only the result is copied out.
+    ReplaceResolverPathTable& pathTable = ReplaceResolverPathTable::GetInstance();
+
+    // Relative paths resolved in the current directory are only valid
+    // while it does not change.
+    key.cwd = _GetCacheCwd(path);
+
+    ReplaceResolverPathTable::Id resolvedId;
+    if (threadData.resolveCache.Find(
+            key.context, key.cwd, path, pathHash, generation, &resolvedId)) {
+        stats.Increment(ReplaceResolverStats::ThreadCacheHits);
+    }
+    else {
+        // Looking paths up does not intern them, only the ones worth
+        // caching are.
+        key.path = pathTable.Find(path);
+
+        // Scope hits may predate a refresh, only fresh results are kept
+        // in the thread cache.
+        bool hit = false;
+        if (_CachePtr currentCache = _GetCurrentCache()) {
+            resolvedId = _ResolveWithScopeCache(
+                *currentCache, &key, path, &resolvedPath, &hit);
+        }
+        else {
+            resolvedId = _ResolveWithResolveCache(&key, path, &resolvedPath);
+        }
+
+        // Like the shared cache, unresolved paths are not kept.
+        if (!hit && resolvedId != ReplaceResolverPathTable::InvalidId &&
+            _resolveCache.GetBudget() > 0) {
+            threadData.resolveCache.Insert(
+                key.context, key.cwd, path, pathHash, generation,
+                resolvedId);
         }
-        resolvedPath = accessor->second;
+    }
+    if (resolvedId != ReplaceResolverPathTable::InvalidId) {
+        resolvedPath = pathTable.GetString(resolvedId);
     }
 
-    if (resolvedPath.empty()) {
-        resolvedPath = _ResolveNoCache(path);
+    // Recorded paths are interned whatever the budget: the recording is
+    // an explicit session, bounded by the paths it resolves, and its
+    // entries are written to the manifest by id when it stops.
+    if (_recordingManifest.load(std::memory_order_relaxed) &&
+        !resolvedPath.empty()) {
+        if (key.path == ReplaceResolverPathTable::InvalidId) {
+            key.path = pathTable.Intern(path);
+        }
+        if (resolvedId == ReplaceResolverPathTable::InvalidId) {
+            resolvedId = pathTable.Intern(resolvedPath);
+        }
+        // Manifests are read without a current directory, the entries are
+        // those of the directory of the recording session.
+        key.cwd = ReplaceResolverPathTable::InvalidId;
+        _RecordManifestEntry(key, resolvedId);
     }
 
     TF_DEBUG(REPLACERESOLVER_PATH).Msg("Resolved path \"%s\"\n",
                                       resolvedPath.c_str());
-    return resolvedPath;
+    return trace.Return(std::move(resolvedPath));
+}
+
+std::vector<std::string>
+ReplaceResolver::ResolveMany(
+    const std::vector<std::string>& paths,
+    const ArResolverContext& context)
+{
+    const ReplaceResolverContext* ctx = context.Get<ReplaceResolverContext>();
+    if (context.IsEmpty()) {
+        ctx = _GetCurrentContext();
+    }
+    else if (!ctx) {
+        TF_CODING_ERROR(
+            "Unknown resolver context object: %s", 
+            context.GetDebugString().c_str());
+    }
+
+    // Pipeline tools often query the same paths many times.
+    std::unordered_map<std::string, size_t> uniqueIndices;
+    std::vector<const std::string*> uniquePaths;
+    std::vector<size_t> indices;
+    indices.reserve(paths.size());
+    for (const std::string& path : paths) {
+        auto inserted = uniqueIndices.emplace(path, uniquePaths.size());
+        if (inserted.second) {
+            uniquePaths.push_back(&inserted.first->first);
+        }
+        indices.push_back(inserted.first->second);
+    }
+
+    // Contexts are bound per thread, bind it on each worker.
+    std::vector<std::string> uniqueResults(uniquePaths.size());
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, uniquePaths.size(), 16),
+        [&](const tbb::blocked_range<size_t>& range) {
+            _ThreadData& threadData = _threadData.local();
+            _PushContext(ctx);
+
+            // The paths of the whole range are sent to the daemon in one
+            // request, or their candidates probed in one batch.
+            const std::vector<const std::string*> rangePaths(
+                uniquePaths.begin() + range.begin(),
+                uniquePaths.begin() + range.end());
+            const std::shared_ptr<ReplaceResolverDaemonClient> daemon =
+                std::atomic_load(&_daemonClient);
+            if ((!daemon || !_PrefetchFromDaemon(*daemon, rangePaths)) &&
+                _prober) {
+                _PrefetchProbes(rangePaths);
+            }
+
+            for (size_t i = range.begin(); i != range.end(); ++i) {
+                uniqueResults[i] = ResolveWithAssetInfo(
+                    *uniquePaths[i], /* assetInfo = */ nullptr);
+            }
+
+            threadData.prefetchedResolves.clear();
+            threadData.contextStack.pop_back();
+        });
+
+    std::vector<std::string> results;
+    results.reserve(paths.size());
+    for (const size_t index : indices) {
+        results.push_back(uniqueResults[index]);
+    }
+    return results;
+}
+
+std::vector<SdfLayerRefPtr>
+ReplaceResolver::Prewarm(
+    const std::string& rootLayerPath,
+    const ArResolverContext& context)
+{
+    // Usd.Stage.Open binds the same context for the root layer, so that
+    // the paths are cached under the fingerprint the stage uses.
+    const ArResolverContext prewarmContext = context.IsEmpty()
+        ? CreateDefaultContextForAsset(rootLayerPath) : context;
+    const ReplaceResolverContext* ctx =
+        prewarmContext.Get<ReplaceResolverContext>();
+    if (!prewarmContext.IsEmpty() && !ctx) {
+        TF_CODING_ERROR(
+            "Unknown resolver context object: %s",
+            prewarmContext.GetDebugString().c_str());
+    }
+
+    std::mutex mutex;
+    std::unordered_set<std::string> visited;
+    std::vector<SdfLayerRefPtr> layers;
+
+    // Composition finds layers one level after the other, here each layer
+    // is read as soon as it is found, while the paths of the others are
+    // resolved.
+    const std::vector<std::string> rootLayerPaths(1, rootLayerPath);
+    tbb::parallel_do(rootLayerPaths.begin(), rootLayerPaths.end(),
+        [&](const std::string& layerPath,
+            tbb::parallel_do_feeder<std::string>& feeder) {
+            // Contexts are bound per thread, bind it on each worker.
+            _PushContext(ctx);
+
+            SdfLayerRefPtr layer;
+            _LayerAssetPaths paths;
+            const std::string resolvedPath =
+                ResolveWithAssetInfo(layerPath, /* assetInfo = */ nullptr);
+            bool isNew = false;
+            if (!resolvedPath.empty()) {
+                std::lock_guard<std::mutex> lock(mutex);
+                isNew = visited.insert(resolvedPath).second;
+            }
+            if (isNew) {
+                layer = SdfLayer::FindOrOpen(layerPath);
+            }
+            if (layer) {
+                _GetLayerAssetPaths(layer, &paths);
+            }
+
+            // Reading the layer may have run other tasks on this thread,
+            // they left the stack as they found it.
+            _threadData.local().contextStack.pop_back();
+
+            if (!layer) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                layers.push_back(layer);
+            }
+            for (std::string& path : paths.layers) {
+                feeder.add(std::move(path));
+            }
+            if (!paths.assets.empty()) {
+                ResolveMany(paths.assets, prewarmContext);
+            }
+        });
+
+    TF_DEBUG(REPLACERESOLVER_PATH).Msg("Prewarmed %zu layers from \"%s\"\n",
+                                      layers.size(), rootLayerPath.c_str());
+    return layers;
 }
 
 std::string
@@ -383,6 +1876,18 @@ std::shared_ptr<ArAsset>
 ReplaceResolver::OpenAsset(
     const std::string& resolvedPath)
 {
+    if (_mmapAssets) {
+        // Crate files are read at random, other formats front to back.
+        const ReplaceResolverMmapAsset::Advice advice =
+            TfGetExtension(resolvedPath) == "usdc"
+                ? ReplaceResolverMmapAsset::AdviceRandom
+                : ReplaceResolverMmapAsset::AdviceSequential;
+        if (std::shared_ptr<ArAsset> asset =
+                ReplaceResolverMmapAsset::Open(resolvedPath, advice)) {
+            return asset;
+        }
+    }
+
     FILE* f = ArchOpenFile(resolvedPath.c_str(), "rb");
     if (!f) {
         return nullptr;
@@ -413,32 +1918,259 @@ ReplaceResolver::CreateDefaultContext()
     return _defaultContext;
 }
 
-ArResolverContext 
-ReplaceResolver::CreateDefaultContextForAsset(
-    const std::string& filePath)
+ReplaceRuleTableConstPtr
+ReplaceResolver::_LoadRulesForAsset(const std::string& filePath)
 {
-    if (filePath.empty()){
-        return ArResolverContext(ReplaceResolverContext());
-    }
-
-    auto context = ReplaceResolverContext(_GetSearchPaths());
-    
     // Find replace pairs in SdfLayer metadata of this filePath
+    ReplaceRuleTable::PairMap pairs;
+    ReplaceRuleTable::PatternList patterns;
+    std::string tableFilePath;
     std::string extension = TfGetExtension(filePath);
     if(extension == "usd" || extension == "usda" || extension == "usdc") {
-        _GetReplacePairsFromUsdFile(filePath, context);
+        _GetReplacePairsFromUsdFile(filePath, pairs, patterns, tableFilePath);
     }
 
     // If the is a json file at the same location we allow adding 
     // or overriding replace pairs.
-    _GetReplacePairsFromJsonFile(filePath, context);
+    const std::string directory = TfGetPathName(TfAbsPath(filePath));
+    const ReplaceRuleTableConstPtr sidecarRules = _sidecarCache.Get(directory);
+    if (std::shared_ptr<ReplaceResolverWatcher> watcher =
+            std::atomic_load(&_watcher)) {
+        // Edited sidecars are seen, whether the layer has one yet or not.
+        watcher->Watch(std::string(), TfStringTrimRight(directory, "/"));
+    }
+
+    // The table of the layer replaces the one next to it.
+    ReplaceTableFileConstPtr table;
+    if (!tableFilePath.empty()) {
+        std::string errMsg;
+        table = ReplaceTableFile::Open(tableFilePath, &errMsg);
+        if (!table) {
+            TF_WARN("Ignoring replace table of '%s': %s",
+                    filePath.c_str(), errMsg.c_str());
+        }
+    }
 
+    // Share the compiled sidecar rules when the layer has no rules.
+    ReplaceRuleTableConstPtr rules = sidecarRules;
+    if (!pairs.empty() || !patterns.empty() || table) {
+        if (sidecarRules) {
+            for (const auto& pair : sidecarRules->GetPairs()) {
+                pairs.emplace(pair.first, pair.second);
+            }
+            patterns.insert(patterns.end(),
+                            sidecarRules->GetPatterns().begin(),
+                            sidecarRules->GetPatterns().end());
+            if (!table) {
+                table = sidecarRules->GetPairsFile();
+            }
+        }
+        rules = std::make_shared<const ReplaceRuleTable>(
+            std::move(pairs), std::move(patterns), std::move(table));
+    }
+    return rules;
+}
+
+bool
+ReplaceResolver::_UpdateContextRules(
+    const ReplaceResolverContext& context,
+    const ReplaceRuleTableConstPtr& rules,
+    ReplaceResolverFingerprint* oldFingerprint)
+{
+    ReplaceRuleTableConstPtr oldRules;
+    ReplaceResolverFingerprint newFingerprint;
+    if (!context._SetSourceRules(
+            rules, &oldRules, oldFingerprint, &newFingerprint)) {
+        return false;
+    }
+
+    const ReplaceRuleTableConstPtr newRules =
+        context._GetCurrent().GetReplaceRules();
+    TF_DEBUG(REPLACERESOLVER_REPLACE).Msg(
+        "Rules of \"%s\" changed, %zu pairs and %zu patterns\n",
+        context.GetAssetPath().c_str(),
+        newRules->GetPairs().size(), newRules->GetPatterns().size());
+    _CarryEntries(*oldFingerprint, oldRules, newFingerprint, newRules);
+
+    // The entries of the old fingerprint stay valid for the contexts with
+    // the old rules. Once no other asset has them, they are dropped, the
+    // copies bound before the change resolve their paths again.
+    if (*oldFingerprint != _fallbackContext.GetFingerprint() &&
+        !context._IsContentInUse(*oldFingerprint)) {
+        _resolveCache.Invalidate(*oldFingerprint);
+    }
+    return true;
+}
+
+void
+ReplaceResolver::_CarryEntries(
+    const ReplaceResolverFingerprint& oldFingerprint,
+    const ReplaceRuleTableConstPtr& oldRules,
+    const ReplaceResolverFingerprint& newFingerprint,
+    const ReplaceRuleTableConstPtr& newRules)
+{
+    // Diff the rules. A pair only applies to paths containing its old
+    // string, so when the patterns are unchanged, only the paths
+    // containing the old string of an added, removed or changed pair may
+    // be replaced differently.
+    ReplaceRuleTable::PairMap changedPairs;
+    for (const auto& pair : oldRules->GetPairs()) {
+        const auto it = newRules->GetPairs().find(pair.first);
+        if (it == newRules->GetPairs().end() || it->second != pair.second) {
+            changedPairs.insert(pair);
+        }
+    }
+    for (const auto& pair : newRules->GetPairs()) {
+        if (!oldRules->GetPairs().count(pair.first)) {
+            changedPairs.insert(pair);
+        }
+    }
+    // The pairs of a replace table are not diffed, a new table is handled
+    // like new patterns.
+    const bool patternsChanged =
+        oldRules->GetPatterns() != newRules->GetPatterns() ||
+        oldRules->GetPairsFile() != newRules->GetPairsFile();
+    const ReplaceMatcher changedMatcher(changedPairs);
+
+    // Paths the old and new rules replace the same way resolve the same,
+    // they are carried over to the new fingerprint. Only the paths a
+    // changed rule applies to are resolved again.
+    const ReplaceResolverPathTable& pathTable =
+        ReplaceResolverPathTable::GetInstance();
+    size_t numChanged = 0;
+    _resolveCache.CopyEntries(
+        oldFingerprint, newFingerprint,
+        [&](ReplaceResolverPathTable::Id pathId) {
+            const std::string path = pathTable.GetString(pathId);
+            size_t pos, pairIndex;
+            if (!patternsChanged &&
+                !changedMatcher.Find(path, &pos, &pairIndex)) {
+                return true;
+            }
+
+            std::string oldResult, newResult;
+            const bool oldReplaced = oldRules->Replace(path, &oldResult);
+            const bool newReplaced = newRules->Replace(path, &newResult);
+            if (oldReplaced == newReplaced &&
+                (!oldReplaced || oldResult == newResult)) {
+                return true;
+            }
+            ++numChanged;
+            return false;
+        });
+
+    TF_DEBUG(REPLACERESOLVER_REPLACE).Msg(
+        "%zu cached paths are resolved again with the new rules\n",
+        numChanged);
+}
+
+ArResolverContext 
+ReplaceResolver::CreateDefaultContextForAsset(
+    const std::string& filePath)
+{
+    _TraceScope trace(
+        _GetTraceRecorder(), ReplaceResolverTrace::CreateDefaultContextForAsset,
+        nullptr, &filePath);
+
+    if (filePath.empty()){
+        return ArResolverContext(ReplaceResolverContext());
+    }
+
+    // A context created after the rules changed has them, the contexts
+    // created before keep theirs until they are refreshed.
+    const ReplaceResolverContext context(
+        _GetSearchPaths(), _LoadRulesForAsset(filePath), TfAbsPath(filePath),
+        _GetSearchIndices());
+    trace.SetContext(context);
     return ArResolverContext(context);
 }
 
 void 
 ReplaceResolver::RefreshContext(const ArResolverContext& context)
 {
+    // Paths resolved without any bound context use a null fingerprint.
+    ReplaceResolverContext current;
+    ReplaceResolverFingerprint oldFingerprint;
+    bool rulesChanged = false;
+    const ReplaceResolverContext* ctx = context.Get<ReplaceResolverContext>();
+    if (ctx) {
+        // Reload the rules of a context created for an asset. When they
+        // changed, only the paths they replace differently are dropped.
+        const std::string& assetPath = ctx->GetAssetPath();
+        if (!assetPath.empty()) {
+            _sidecarCache.Invalidate(TfGetPathName(assetPath));
+            rulesChanged = _UpdateContextRules(
+                *ctx, _LoadRulesForAsset(assetPath), &oldFingerprint);
+        }
+        current = ctx->_GetCurrent();
+    }
+    else if (!context.IsEmpty()) {
+        return;
+    }
+
+    const ReplaceResolverFingerprint fingerprint =
+        ctx ? current.GetFingerprint() : ReplaceResolverFingerprint();
+    if (!rulesChanged) {
+        _resolveCache.Invalidate(fingerprint);
+        _resolveCacheGeneration.fetch_add(1, std::memory_order_release);
+    }
+    _RefreshFileCaches();
+
+    // The files changed for the other processes too. The entries they
+    // resolved with new rules are kept, like the ones carried over.
+    if (!rulesChanged) {
+        if (std::shared_ptr<ReplaceResolverSharedCache> sharedCache =
+                std::atomic_load(&_sharedCache)) {
+            sharedCache->Invalidate(fingerprint);
+        }
+    }
+
+    // The daemon would answer the same paths again, or carries them over
+    // to the new rules like this resolver.
+    if (std::shared_ptr<ReplaceResolverDaemonClient> daemonClient =
+            std::atomic_load(&_daemonClient)) {
+        if (rulesChanged) {
+            daemonClient->RebaseContext(oldFingerprint, &current);
+        }
+        else {
+            daemonClient->Refresh(ctx ? &current : nullptr);
+        }
+    }
+}
+
+void
+ReplaceResolver::RebaseContext(
+    const ArResolverContext& previous,
+    const ArResolverContext& context)
+{
+    const ReplaceResolverContext* previousCtx =
+        previous.Get<ReplaceResolverContext>();
+    const ReplaceResolverContext* ctx = context.Get<ReplaceResolverContext>();
+    if (!previousCtx || !ctx) {
+        return;
+    }
+
+    const ReplaceResolverContext previousCurrent = previousCtx->_GetCurrent();
+    const ReplaceResolverContext current = ctx->_GetCurrent();
+    if (previousCurrent._Get().searchPathFingerprint !=
+        current._Get().searchPathFingerprint) {
+        TF_CODING_ERROR("Cannot rebase a context on one with another "
+                        "search path");
+        return;
+    }
+    _CarryEntries(previousCurrent.GetFingerprint(),
+                  previousCurrent.GetReplaceRules(),
+                  current.GetFingerprint(), current.GetReplaceRules());
+    _RefreshFileCaches();
+}
+
+void
+ReplaceResolver::_RefreshFileCaches()
+{
+    if (_directoryCache) {
+        _directoryCache->Clear();
+    }
+    _sidecarCache.Clear();
 }
 
 ArResolverContext
@@ -475,6 +2207,8 @@ ReplaceResolver::BindContext(
 {
     const ReplaceResolverContext* ctx = 
         context.Get<ReplaceResolverContext>();
+    const _TraceScope trace(
+        _GetTraceRecorder(), ReplaceResolverTrace::BindContext, ctx);
 
     if (!context.IsEmpty() && !ctx) {
         TF_CODING_ERROR(
@@ -482,8 +2216,7 @@ ReplaceResolver::BindContext(
             context.GetDebugString().c_str());
     }
 
-    _ContextStack& contextStack = _threadContextStack.local();
-    contextStack.push_back(ctx);
+    _PushContext(ctx);
 }
 
 void 
@@ -491,9 +2224,13 @@ ReplaceResolver::UnbindContext(
     const ArResolverContext& context,
     VtValue* bindingData)
 {
-    _ContextStack& contextStack = _threadContextStack.local();
+    const _TraceScope trace(
+        _GetTraceRecorder(), ReplaceResolverTrace::UnbindContext,
+        context.Get<ReplaceResolverContext>());
+
+    _ContextStack& contextStack = _threadData.local().contextStack;
     if (contextStack.empty() ||
-        contextStack.back() != context.Get<ReplaceResolverContext>()) {
+        contextStack.back().context != context.Get<ReplaceResolverContext>()) {
         TF_CODING_ERROR(
             "Unbinding resolver context in unexpected order: %s",
             context.GetDebugString().c_str());
@@ -507,8 +2244,18 @@ ReplaceResolver::UnbindContext(
 const ReplaceResolverContext* 
 ReplaceResolver::_GetCurrentContext()
 {
-    _ContextStack& contextStack = _threadContextStack.local();
-    return contextStack.empty() ? nullptr : contextStack.back();
+    _ContextStack& contextStack = _threadData.local().contextStack;
+    return contextStack.empty() || !contextStack.back().context
+        ? nullptr : &contextStack.back().current;
+}
+
+void
+ReplaceResolver::_PushContext(const ReplaceResolverContext* ctx)
+{
+    // Contexts created for an asset are bound with the rules last loaded
+    // by RefreshContext, copies made before see them too.
+    _threadData.local().contextStack.push_back(
+        _BoundContext{ctx, ctx ? ctx->_GetCurrent() : ReplaceResolverContext()});
 }
 
 PXR_NAMESPACE_CLOSE_SCOPE
@@ -2,23 +2,41 @@
 #ifndef USD_REPLACE_RESOLVER_H
 #define USD_REPLACE_RESOLVER_H
 
+#include "daemonClient.h"
+#include "directoryCache.h"
+#include "manifest.h"
+#include "prober.h"
 #include "replaceResolverContext.h"
+#include "resolveCache.h"
+#include "sharedCache.h"
+#include "sidecarCache.h"
+#include "threadCache.h"
+#include "trace.h"
+#include "watcher.h"
 
 #include <pxr/pxr.h>
 #include <pxr/usd/ar/api.h>
 #include <pxr/usd/ar/resolver.h>
 #include <pxr/usd/ar/threadLocalScopedCache.h>
+#include <pxr/usd/sdf/declareHandles.h>
+#include <pxr/base/vt/dictionary.h>
 
 #include <tbb/enumerable_thread_specific.h>
 
+#include <atomic>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 
 
 PXR_NAMESPACE_OPEN_SCOPE
 
+SDF_DECLARE_HANDLES(SdfLayer);
+
 /// \class ReplaceResolver
 ///
 /// Add a "replace substring" scheme.
@@ -52,6 +70,137 @@ public:
     static void SetDefaultSearchPath(
         const std::vector<std::string>& searchPath);
 
+    /// Set the memory budget in bytes of the process wide resolve cache.
+    /// A budget of zero disables it. The initial budget is read from the
+    /// REPLACE_RESOLVER_CACHE_BUDGET_MB environment variable.
+    AR_API
+    void SetResolveCacheBudget(size_t budget);
+
+    /// Return the memory budget in bytes of the process wide resolve cache.
+    AR_API
+    size_t GetResolveCacheBudget() const;
+
+    /// Return the resolver stats: resolve and cache counters, stat calls
+    /// per search path, the resolve latency histogram and the slowest
+    /// resolves. The directory listing cache counters are under the
+    /// "directoryCache" key when it is enabled.
+    AR_API
+    VtDictionary GetStats() const;
+
+    /// Reset all the resolver stats.
+    AR_API
+    void ResetStats();
+
+    /// Resolve all \p paths with \p context bound, or with the context
+    /// currently bound on the calling thread if \p context is empty.
+    ///
+    /// Duplicated paths are resolved once and unique paths are resolved
+    /// in parallel. Results are returned in the order of \p paths.
+    AR_API
+    std::vector<std::string> ResolveMany(
+        const std::vector<std::string>& paths,
+        const ArResolverContext& context = ArResolverContext());
+
+    /// Resolve the asset paths of the layer at \p rootLayerPath and of the
+    /// layers it brings in, recursively, before its stage is opened:
+    /// sublayers, references, payloads and asset valued attributes. Layers
+    /// are read and their paths resolved in parallel, filling the resolve
+    /// cache. Paths are resolved in \p context or, when it is empty, in the
+    /// default context for \p rootLayerPath, as Usd.Stage.Open creates it.
+    ///
+    /// Returns the layers read. Holding them while the stage opens keeps
+    /// them from being read again.
+    AR_API
+    std::vector<SdfLayerRefPtr> Prewarm(
+        const std::string& rootLayerPath,
+        const ArResolverContext& context = ArResolverContext());
+
+    /// Answer resolves from the manifest at \p filePath before looking up
+    /// the filesystem. An empty \p filePath unloads the current manifest.
+    /// The initial manifest is read from the REPLACE_RESOLVER_MANIFEST
+    /// environment variable. When REPLACE_RESOLVER_MANIFEST_STRICT is set,
+    /// paths missing from the manifest are not resolved at all.
+    AR_API
+    bool LoadManifest(const std::string& filePath);
+
+    /// Start recording every path resolved, for a manifest.
+    AR_API
+    void StartManifestRecording();
+
+    /// Stop recording and write the paths resolved since
+    /// StartManifestRecording to a manifest at \p filePath.
+    AR_API
+    bool StopManifestRecording(const std::string& filePath);
+
+    /// Share resolved paths with the other processes of the host through
+    /// the shared memory segment \p name, created with \p capacity bytes
+    /// if it does not exist yet. An empty \p name stops sharing. Sharing
+    /// starts with the resolver when REPLACE_RESOLVER_SHARED_CACHE names a
+    /// segment, or is set to 1 for the default segment of the user, with
+    /// the capacity read from REPLACE_RESOLVER_SHARED_CACHE_MB. See
+    /// ReplaceResolverSharedCache.
+    AR_API
+    bool SetSharedCache(const std::string& name, size_t capacity = 64 << 20);
+
+    /// Resolve the paths missing from the caches through the rdo-resolverd
+    /// daemon listening on \p socketPath, whose caches stay warm across
+    /// sessions. An empty \p socketPath stops using it. The daemon is used
+    /// from the start when REPLACE_RESOLVER_DAEMON names its socket, or is
+    /// set to 1 for the default socket of the user. Paths are resolved in
+    /// process while the daemon cannot be reached. Returns false if it
+    /// cannot be reached now.
+    AR_API
+    bool SetDaemon(const std::string& socketPath);
+
+    /// Return the fingerprint of the settings resolves depend on besides
+    /// the bound context: the fallback search path and whether paths
+    /// missing from search indices are probed. Processes with the same
+    /// fingerprint resolve paths the same way.
+    AR_API
+    const ReplaceResolverFingerprint& GetEnvironmentFingerprint() const;
+
+    /// Record the calls made to the resolver, with their thread, time and
+    /// bound context, to a trace at \p filePath. Recording starts with the
+    /// resolver when REPLACE_RESOLVER_TRACE is set to a file path. The
+    /// trace is replayed by replayTraceBench, see ReplaceResolverTrace.
+    AR_API
+    bool StartTraceRecording(const std::string& filePath);
+
+    /// Stop recording and close the trace.
+    AR_API
+    void StopTraceRecording();
+
+    /// Start watching the directories paths are resolved in and the
+    /// directories of the sidecar files with inotify. When files are
+    /// created, deleted or moved there, the paths resolved from them are
+    /// dropped from the caches and a ReplaceResolverFilesChangedNotice is
+    /// sent. Watching starts with the resolver when REPLACE_RESOLVER_WATCH
+    /// is set. Returns false if watching is not supported.
+    AR_API
+    bool StartWatching();
+
+    /// Stop watching, the caches are no longer invalidated.
+    AR_API
+    void StopWatching();
+
+    /// Write the search index of the \p rootDir search root to
+    /// \p filePath. Attach it to the root with
+    /// ReplaceResolverContext::SetSearchIndex or
+    /// REPLACE_RESOLVER_SEARCH_INDICES, so that paths under the root are
+    /// resolved without stat calls. See ReplaceResolverSearchIndex.
+    AR_API
+    static bool BuildSearchIndex(
+        const std::string& rootDir,
+        const std::string& filePath);
+
+    /// Convert the replace pairs of the JSON sidecar \p jsonFilePath to
+    /// the binary replace table \p tableFilePath, memory mapped instead of
+    /// parsed. See ReplaceTableFile.
+    AR_API
+    static bool ConvertReplaceTable(
+        const std::string& jsonFilePath,
+        const std::string& tableFilePath);
+
     // ArResolver overrides
 
     /// Sets the resolver's default context (returned by CreateDefaultContext())
@@ -140,9 +289,29 @@ public:
     virtual ArResolverContext CreateDefaultContextForAsset(
         const std::string& filePath) override;
 
+    /// Reload the rules of \p context when it was created for an asset,
+    /// from the layer metadata and the sidecar file. If they changed, only
+    /// the cached paths the changed rules replace differently are resolved
+    /// again, for all the contexts of the asset. Otherwise, drop the
+    /// resolved paths cached for \p context, so that they are looked up
+    /// on the filesystem again.
+    ///
+    /// The directory listings and sidecar files read so far are read
+    /// again in both cases.
     AR_API
     virtual void RefreshContext(const ArResolverContext& context) override;
 
+    /// Refresh \p context, whose rules changed since \p previous, which
+    /// has the same search path: the cached paths both rules replace the
+    /// same way are carried over to \p context, the others are resolved
+    /// again. This is what RefreshContext does for the contexts of an
+    /// asset whose rules changed, for contexts rebuilt from their content
+    /// like the ones of rdo-resolverd.
+    AR_API
+    void RebaseContext(
+        const ArResolverContext& previous,
+        const ArResolverContext& context);
+
     AR_API
     virtual ArResolverContext GetCurrentContext() override;
 
@@ -172,18 +341,144 @@ private:
 
     const ReplaceResolverContext* _GetCurrentContext();
 
+    // Bind \p ctx on this thread, or no context if it is null.
+    void _PushContext(const ReplaceResolverContext* ctx);
+
+    std::shared_ptr<ReplaceResolverTraceRecorder> _GetTraceRecorder() const;
+
     std::string _ResolveNoCache(const std::string& path);
+    bool _ResolveInCwd(const std::string& path, std::string* resolvedPath);
+
+    // Candidate resolved path, with the search path it is under.
+    struct _ProbeCandidate
+    {
+        std::string searchPath;
+        std::string path;
+        // Known to exist from a search index, no probe is needed.
+        bool exists;
+    };
+    // Candidates of a path in priority order.
+    using _ProbeCandidates = std::vector<_ProbeCandidate>;
+    void _GetProbeCandidates(
+        const std::string& path,
+        _ProbeCandidates* candidates);
+    std::string _ResolveWithProber(const std::string& path);
+    void _GetPathsToPrefetch(
+        const std::vector<const std::string*>& paths,
+        std::vector<const std::string*>* toResolve);
+    void _PrefetchProbes(const std::vector<const std::string*>& paths);
+    bool _PrefetchFromDaemon(
+        ReplaceResolverDaemonClient& daemon,
+        const std::vector<const std::string*>& paths);
+
+    std::string _ResolveWithDaemon(const std::string& path);
+
+    std::string _ResolveWithSharedCache(
+        const ReplaceResolverFingerprint& context,
+        const std::string& path);
+
+    // Return the id of the resolved path, interning \p path in \p key if
+    // it resolved and the cache has room for it. Otherwise return
+    // InvalidId, with the resolved path, if any, in \p resolvedPath.
+    ReplaceResolverPathTable::Id _ResolveWithResolveCache(
+        ReplaceResolverCacheKey* key,
+        const std::string& path,
+        std::string* resolvedPath);
+
+    // Like _ResolveWithResolveCache, but first look \p path up in the
+    // cache of the current scope.
+    ReplaceResolverPathTable::Id _ResolveWithScopeCache(
+        _Cache& cache,
+        ReplaceResolverCacheKey* key,
+        const std::string& path,
+        std::string* resolvedPath,
+        bool* hit);
+
+    void _RecordManifestEntry(
+        const ReplaceResolverCacheKey& key,
+        ReplaceResolverPathTable::Id resolvedPath);
+
+    ReplaceRuleTableConstPtr _LoadRulesForAsset(const std::string& filePath);
+    bool _UpdateContextRules(
+        const ReplaceResolverContext& context,
+        const ReplaceRuleTableConstPtr& rules,
+        ReplaceResolverFingerprint* oldFingerprint);
+    void _CarryEntries(
+        const ReplaceResolverFingerprint& oldFingerprint,
+        const ReplaceRuleTableConstPtr& oldRules,
+        const ReplaceResolverFingerprint& newFingerprint,
+        const ReplaceRuleTableConstPtr& newRules);
+    // Drop the directory listings and sidecar files read so far.
+    void _RefreshFileCaches();
+
+    void _WatchResolvedPath(
+        ReplaceResolverWatcher& watcher,
+        const std::string& resolvedPath);
+    void _OnWatchedPathsChanged(
+        const std::vector<std::string>& changedPaths,
+        const std::vector<std::string>& roots,
+        bool all);
 
 private:
     ReplaceResolverContext _fallbackContext;
     ArResolverContext _defaultContext;
 
     _PerThreadCache _threadCache;
-
-    using _ContextStack = std::vector<const ReplaceResolverContext*>;
-    using _PerThreadContextStack = 
-        tbb::enumerable_thread_specific<_ContextStack>;
-    _PerThreadContextStack _threadContextStack;
+    ReplaceResolverCache _resolveCache;
+    // Bumped whenever cached resolved paths may be stale, invalidating the
+    // thread caches.
+    std::atomic<uint64_t> _resolveCacheGeneration;
+    std::unique_ptr<ReplaceResolverDirectoryCache> _directoryCache;
+    std::unique_ptr<ReplaceResolverProber> _prober;
+    ReplaceResolverSidecarCache _sidecarCache;
+    bool _mmapAssets;
+    bool _searchIndexFallback;
+    ReplaceResolverFingerprint _environmentFingerprint;
+
+    // Only accessed through std::atomic_load/std::atomic_store.
+    ReplaceResolverManifestConstPtr _manifest;
+    bool _manifestStrict;
+
+    std::atomic<bool> _recordingManifest;
+    std::mutex _manifestRecordMutex;
+    std::unordered_map<ReplaceResolverCacheKey, ReplaceResolverPathTable::Id,
+                       ReplaceResolverCacheKey::Hash> _manifestRecord;
+
+    // Only accessed through std::atomic_load/std::atomic_store.
+    std::shared_ptr<ReplaceResolverSharedCache> _sharedCache;
+
+    // Only accessed through std::atomic_load/std::atomic_store.
+    std::shared_ptr<ReplaceResolverDaemonClient> _daemonClient;
+
+    // Only accessed through std::atomic_load/std::atomic_store, the flag
+    // keeps calls from loading it when not recording.
+    std::atomic<bool> _recordingTrace;
+    std::shared_ptr<ReplaceResolverTraceRecorder> _traceRecorder;
+
+    // A bound context, with the rules last loaded for its source when it
+    // was bound, kept alive while it is bound.
+    struct _BoundContext
+    {
+        const ReplaceResolverContext* context;
+        ReplaceResolverContext current;
+    };
+    // References to the bound contexts stay valid while others are bound.
+    using _ContextStack = std::deque<_BoundContext>;
+    struct _ThreadData
+    {
+        _ContextStack contextStack;
+        ReplaceResolverThreadCache resolveCache;
+        // Paths resolved ahead by ResolveMany, in one batch of probes or
+        // of requests to the daemon.
+        std::unordered_map<std::string, std::string> prefetchedResolves;
+    };
+    using _PerThreadData = tbb::enumerable_thread_specific<_ThreadData>;
+    _PerThreadData _threadData;
+
+    // Only accessed through std::atomic_load/std::atomic_store. Declared
+    // last, so that its thread stops before the caches it invalidates are
+    // destroyed.
+    std::shared_ptr<ReplaceResolverWatcher> _watcher;
 
 };
 
@@ -1,23 +1,81 @@
 // Copyright 2019 Rodeo FX.  All rights reserved.
 #include "replaceResolverContext.h"
 
-#include "boost_include_wrapper.h"
-
 #include <pxr/pxr.h>
 #include <pxr/base/tf/diagnostic.h>
-#include <pxr/base/tf/hash.h>
-#include <pxr/base/tf/ostreamMethods.h>
 #include <pxr/base/tf/pathUtils.h>
 #include <pxr/base/tf/stringUtils.h>
 
-#include BOOST_INCLUDE(functional/hash.hpp)
+#include <algorithm>
+#include <map>
+#include <utility>
 
 PXR_NAMESPACE_OPEN_SCOPE
 
-ReplaceResolverContext::ReplaceResolverContext(
-    const std::vector<std::string>& searchPath)
+namespace
+{
+
+// Return the search index file at \p indexFilePath for the search root
+// \p root, or null with a warning.
+ReplaceResolverSearchIndexConstPtr
+_OpenSearchIndex(const std::string& root, const std::string& indexFilePath)
+{
+    std::string errMsg;
+    ReplaceResolverSearchIndexConstPtr index =
+        ReplaceResolverSearchIndex::Open(TfAbsPath(indexFilePath), &errMsg);
+    if (!index) {
+        TF_WARN("Ignoring search index of '%s': %s",
+                root.c_str(), errMsg.c_str());
+    }
+    return index;
+}
+
+} // anonymous
+
+void
+ReplaceResolverContext::_Data::UpdateSearchPathFingerprint()
+{
+    ReplaceResolverFingerprinter fingerprinter;
+    fingerprinter.Append(static_cast<uint64_t>(searchPath.size()));
+    for (const std::string& element : searchPath) {
+        fingerprinter.Append(element);
+    }
+
+    // Contexts without any index keep the fingerprint they always had,
+    // manifests recorded with them stay valid.
+    const bool hasIndex = std::any_of(
+        searchPathIndices.begin(), searchPathIndices.end(),
+        [](const ReplaceResolverSearchIndexConstPtr& index) {
+            return static_cast<bool>(index);
+        });
+    if (hasIndex) {
+        fingerprinter.Append(std::string("indices"));
+        for (const ReplaceResolverSearchIndexConstPtr& index :
+                 searchPathIndices) {
+            fingerprinter.Append(index ? index->GetFilePath() : std::string());
+        }
+    }
+    searchPathFingerprint = fingerprinter.Get();
+}
+
+void
+ReplaceResolverContext::_Data::UpdateFingerprint()
 {
-    _searchPath.reserve(searchPath.size());
+    ReplaceResolverFingerprinter fingerprinter;
+    fingerprinter.Append(searchPathFingerprint);
+    fingerprinter.Append(rules->GetFingerprint());
+    fingerprint = fingerprinter.Get();
+}
+
+std::shared_ptr<const ReplaceResolverContext::_Data>
+ReplaceResolverContext::_MakeData(
+    const std::vector<std::string>& searchPath,
+    const SearchIndexMap& searchIndices,
+    const ReplaceRuleTableConstPtr& rules)
+{
+    std::shared_ptr<_Data> data = std::make_shared<_Data>();
+    data->searchPath.reserve(searchPath.size());
+
     for (const std::string& p : searchPath) {
         if (p.empty()) {
             continue;
@@ -30,40 +88,322 @@ ReplaceResolverContext::ReplaceResolverContext(
                 "'%s'", p.c_str());
             continue;
         }
+        data->searchPath.push_back(absPath);
+    }
+    data->searchPathIndices.resize(data->searchPath.size());
+
+    for (const auto& entry : searchIndices) {
+        const std::string absRoot = TfAbsPath(entry.first);
+        if (std::find(data->searchPath.begin(), data->searchPath.end(),
+                      absRoot) == data->searchPath.end()) {
+            continue;
+        }
+        const ReplaceResolverSearchIndexConstPtr index =
+            _OpenSearchIndex(absRoot, entry.second);
+        for (size_t i = 0; i < data->searchPath.size(); ++i) {
+            if (data->searchPath[i] == absRoot) {
+                data->searchPathIndices[i] = index;
+            }
+        }
+    }
+    data->UpdateSearchPathFingerprint();
+
+    data->rules = rules ? rules : ReplaceRuleTable::GetEmpty();
+    data->UpdateFingerprint();
+    return data;
+}
+
+struct ReplaceResolverContext::_SourceRegistry
+{
+    std::mutex mutex;
+    uint64_t numSources = 0;
+    std::map<ReplaceResolverFingerprint,
+             std::vector<std::weak_ptr<_Source>>> sources;
+};
+
+ReplaceResolverContext::_SourceRegistry&
+ReplaceResolverContext::_GetSourceRegistry()
+{
+    static _SourceRegistry registry;
+    return registry;
+}
+
+ReplaceResolverContext::ReplaceResolverContext()
+{
+    static const std::shared_ptr<const _Data> empty =
+        _MakeData(std::vector<std::string>(), SearchIndexMap(),
+                  ReplaceRuleTable::GetEmpty());
+    _data = empty;
+}
+
+ReplaceResolverContext::ReplaceResolverContext(
+    const std::vector<std::string>& searchPath)
+    : _data(_MakeData(
+        searchPath, SearchIndexMap(), ReplaceRuleTable::GetEmpty()))
+{
+}
+
+ReplaceResolverContext::ReplaceResolverContext(
+    const std::vector<std::string>& searchPath,
+    const ReplaceRuleTableConstPtr& rules)
+    : _data(_MakeData(searchPath, SearchIndexMap(), rules))
+{
+}
+
+ReplaceResolverContext::ReplaceResolverContext(
+    const std::vector<std::string>& searchPath,
+    const ReplaceRuleTableConstPtr& rules,
+    const std::string& assetPath,
+    const SearchIndexMap& searchIndices)
+{
+    _data = _MakeData(searchPath, searchIndices, rules);
+    if (assetPath.empty()) {
+        return;
+    }
+
+    ReplaceResolverFingerprinter fingerprinter;
+    fingerprinter.Append(std::string("asset"));
+    fingerprinter.Append(_data->searchPathFingerprint);
+    fingerprinter.Append(assetPath);
+    const ReplaceResolverFingerprint key = fingerprinter.Get();
+
+    // Contexts of the same asset share their source while one of them
+    // lives and their rules are the same, so that refreshing any of them
+    // refreshes all. Contexts of the asset with other rules, created
+    // before its rules changed, keep them.
+    _SourceRegistry& registry = _GetSourceRegistry();
+    auto& sources = registry.sources;
+
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const std::weak_ptr<_Source>& weakSource : sources[key]) {
+        std::shared_ptr<_Source> source = weakSource.lock();
+        if (!source) {
+            continue;
+        }
+        std::shared_ptr<const _Data> current =
+            std::atomic_load(&source->data);
+        if (current->fingerprint == _data->fingerprint) {
+            _data = std::move(current);
+            _source = std::move(source);
+            return;
+        }
+    }
+
+    for (auto it = sources.begin(); it != sources.end(); ) {
+        std::vector<std::weak_ptr<_Source>>& keySources = it->second;
+        keySources.erase(
+            std::remove_if(keySources.begin(), keySources.end(),
+                           [](const std::weak_ptr<_Source>& source) {
+                               return source.expired();
+                           }),
+            keySources.end());
+        if (keySources.empty() && it->first != key) {
+            it = sources.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    // The identity of a new source differs from the ones of the older
+    // sources of the asset, whose rules differ.
+    fingerprinter.Append(++registry.numSources);
+
+    _source = std::make_shared<_Source>();
+    _source->assetPath = assetPath;
+    _source->identity = fingerprinter.Get();
+    std::atomic_store(&_source->data, _data);
+    sources[key].push_back(_source);
+}
+
+ReplaceResolverContext
+ReplaceResolverContext::_GetCurrent() const
+{
+    ReplaceResolverContext current(*this);
+    if (_source) {
+        current._data = std::atomic_load(&_source->data);
+    }
+    return current;
+}
+
+const std::string&
+ReplaceResolverContext::GetAssetPath() const
+{
+    static const std::string empty;
+    return _source ? _source->assetPath : empty;
+}
+
+bool
+ReplaceResolverContext::_SetSourceRules(
+    const ReplaceRuleTableConstPtr& rules,
+    ReplaceRuleTableConstPtr* oldRules,
+    ReplaceResolverFingerprint* oldFingerprint,
+    ReplaceResolverFingerprint* newFingerprint) const
+{
+    if (!_source) {
+        return false;
+    }
+
+    const ReplaceRuleTableConstPtr& newRules =
+        rules ? rules : ReplaceRuleTable::GetEmpty();
+
+    std::lock_guard<std::mutex> lock(_source->mutex);
+    const std::shared_ptr<const _Data> current =
+        std::atomic_load(&_source->data);
+    if (current->rules->GetFingerprint() == newRules->GetFingerprint()) {
+        return false;
+    }
+
+    std::shared_ptr<_Data> data = std::make_shared<_Data>(*current);
+    data->rules = newRules;
+    data->UpdateFingerprint();
+
+    *oldRules = current->rules;
+    *oldFingerprint = current->fingerprint;
+    *newFingerprint = data->fingerprint;
+
+    // The previous version is released with the last copy using it.
+    std::atomic_store(&_source->data, std::shared_ptr<const _Data>(data));
+    return true;
+}
+
+bool
+ReplaceResolverContext::_IsContentInUse(
+    const ReplaceResolverFingerprint& fingerprint) const
+{
+    // The assets of a directory usually have the same rules, and so the
+    // same content.
+    _SourceRegistry& registry = _GetSourceRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const auto& entry : registry.sources) {
+        for (const std::weak_ptr<_Source>& weakSource : entry.second) {
+            const std::shared_ptr<_Source> source = weakSource.lock();
+            if (source && source != _source &&
+                std::atomic_load(&source->data)->fingerprint == fingerprint) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+std::shared_ptr<ReplaceResolverContext::_Data>
+ReplaceResolverContext::_DetachData()
+{
+    // Editing a context created for an asset makes it a context of its
+    // own, the other contexts of the asset are left unchanged.
+    _source.reset();
 
-        _searchPath.push_back(absPath);
+    // Copy on write: the content may be shared with other copies of this
+    // context, possibly bound on other threads.
+    std::shared_ptr<_Data> data;
+    if (_data.use_count() == 1) {
+        data = std::const_pointer_cast<_Data>(_data);
+        _data.reset();
+    }
+    else {
+        data = std::make_shared<_Data>(*_data);
     }
+    return data;
 }
 
 void ReplaceResolverContext::AddReplacePair(const std::string& oldStr, const std::string& newStr)
 {
-    _oldAndNewStrings.emplace(std::piecewise_construct,
-        std::forward_as_tuple(oldStr),
-        std::forward_as_tuple(newStr));
+    std::shared_ptr<_Data> data = _DetachData();
+    data->rules = ReplaceRuleTable::AddPair(
+        std::move(data->rules), oldStr, newStr);
+    data->UpdateFingerprint();
+    _data = std::move(data);
+}
+
+void
+ReplaceResolverContext::AddReplacePattern(
+    const std::string& pattern,
+    const std::string& replacement)
+{
+    std::string whyNot;
+    if (!ReplacePatternMatcher::IsValid(pattern, replacement, &whyNot)) {
+        TF_CODING_ERROR("Invalid replace pattern '%s' -> '%s': %s",
+                        pattern.c_str(), replacement.c_str(), whyNot.c_str());
+        return;
+    }
+
+    std::shared_ptr<_Data> data = _DetachData();
+    data->rules = ReplaceRuleTable::AddPattern(
+        std::move(data->rules), pattern, replacement);
+    data->UpdateFingerprint();
+    _data = std::move(data);
 }
 
 bool
-ReplaceResolverContext::operator<(const ReplaceResolverContext& rhs) const
+ReplaceResolverContext::SetReplaceTable(const std::string& filePath)
+{
+    ReplaceTableFileConstPtr table;
+    if (!filePath.empty()) {
+        std::string errMsg;
+        table = ReplaceTableFile::Open(TfAbsPath(filePath), &errMsg);
+        if (!table) {
+            TF_WARN("Ignoring replace table: %s", errMsg.c_str());
+            return false;
+        }
+    }
+
+    std::shared_ptr<_Data> data = _DetachData();
+    data->rules = ReplaceRuleTable::SetPairsFile(std::move(data->rules), table);
+    data->UpdateFingerprint();
+    _data = std::move(data);
+    return true;
+}
+
+bool
+ReplaceResolverContext::SetSearchIndex(
+    const std::string& root,
+    const std::string& indexFilePath)
 {
-    bool result = _searchPath < rhs._searchPath;
+    const std::string absRoot = TfAbsPath(root);
+    const std::vector<std::string>& searchPath = GetSearchPath();
+    const auto it = std::find(searchPath.begin(), searchPath.end(), absRoot);
+    if (absRoot.empty() || it == searchPath.end()) {
+        TF_WARN("Ignoring search index of '%s': not in the search path",
+                root.c_str());
+        return false;
+    }
 
-    if (result == true) {
-        result = _oldAndNewStrings.size() < rhs._oldAndNewStrings.size();
+    ReplaceResolverSearchIndexConstPtr index;
+    if (!indexFilePath.empty()) {
+        index = _OpenSearchIndex(absRoot, indexFilePath);
+        if (!index) {
+            return false;
+        }
     }
 
-    return result;
+    // The same root may appear more than once in the search path, all its
+    // elements use the index.
+    std::shared_ptr<_Data> data = _DetachData();
+    for (size_t i = 0; i < data->searchPath.size(); ++i) {
+        if (data->searchPath[i] == absRoot) {
+            data->searchPathIndices[i] = index;
+        }
+    }
+    data->UpdateSearchPathFingerprint();
+    data->UpdateFingerprint();
+    _data = std::move(data);
+    return true;
+}
+
+bool
+ReplaceResolverContext::operator<(const ReplaceResolverContext& rhs) const
+{
+    return GetIdentity() < rhs.GetIdentity();
 }
 
 bool 
 ReplaceResolverContext::operator==(const ReplaceResolverContext& rhs) const
 {
-    bool result = _searchPath == rhs._searchPath;
-
-    if(result == true) {
-        result = _oldAndNewStrings.size() == rhs._oldAndNewStrings.size();
+    if (_source || rhs._source) {
+        return _source == rhs._source || GetIdentity() == rhs.GetIdentity();
     }
-
-    return result;
+    return _data == rhs._data || _data->fingerprint == rhs._data->fingerprint;
 }
 
 bool 
@@ -75,44 +415,63 @@ ReplaceResolverContext::operator!=(const ReplaceResolverContext& rhs) const
 std::string 
 ReplaceResolverContext::GetAsString() const
 {
-    std::string result = "Search path: ";
-    if (_searchPath.empty()) {
+    const std::vector<std::string>& searchPath = GetSearchPath();
+    const std::vector<ReplaceResolverSearchIndexConstPtr>& indices =
+        GetSearchPathIndices();
+    const std::map<std::string, std::string>& replaceMap = GetReplaceMap();
+
+    std::string result;
+    if (_source) {
+        result += "Asset: " + _source->assetPath + "\n";
+    }
+
+    result += "Search path: ";
+    if (searchPath.empty()) {
         result += "[ ]";
     }
     else {
-        result += "[\n    ";
-        result += TfStringJoin(_searchPath, "\n    ");
+        result += "[";
+        for (size_t i = 0; i < searchPath.size(); ++i) {
+            result += "\n    " + searchPath[i];
+            if (indices[i]) {
+                result += " (index: " + indices[i]->GetFilePath() + ")";
+            }
+        }
         result += "\n]";
     }
 
-    if( _oldAndNewStrings.size() > 0) {
+    if( replaceMap.size() > 0) {
         result += "\nOld to new token: ";
         result += "[";
-        for (auto it = _oldAndNewStrings.begin(); it != _oldAndNewStrings.end(); ++it) 
+        for (auto it = replaceMap.begin(); it != replaceMap.end(); ++it) 
         {
             result += "\n    " + it->first + ": ";
             result += it->second;
         }
         result += "\n]";
     }
+
+    if (const ReplaceTableFileConstPtr& table = GetReplaceTable()) {
+        result += TfStringPrintf("\nReplace table: %s (%zu pairs)",
+                                 table->GetFilePath().c_str(),
+                                 table->GetSize());
+    }
+
+    const ReplaceRuleTable::PatternList& patterns = GetReplacePatterns();
+    if (!patterns.empty()) {
+        result += "\nPatterns: [";
+        for (const auto& rule : patterns) {
+            result += "\n    " + rule.first + ": " + rule.second;
+        }
+        result += "\n]";
+    }
     return result;
 }
 
 size_t 
 hash_value(const ReplaceResolverContext& context)
 {
-    size_t hash = 0;
-    for (const std::string& p : context.GetSearchPath()) {
-        BOOST_NAMESPACE::hash_combine(hash, TfHash()(p));
-    }
-
-    auto replaceMap = context.GetReplaceMap();
-    for (auto it = replaceMap.begin(); it != replaceMap.end(); ++it) 
-    {
-        BOOST_NAMESPACE::hash_combine(hash, TfHash()(it->first));
-        BOOST_NAMESPACE::hash_combine(hash, TfHash()(it->second));
-    }
-    return hash;
+    return context.GetIdentity().GetHash();
 }
 
 PXR_NAMESPACE_CLOSE_SCOPE
@@ -6,27 +6,134 @@
 #include <pxr/usd/ar/api.h>
 #include <pxr/usd/ar/defineResolverContext.h>
 
+#include "fingerprint.h"
+#include "replaceRuleTable.h"
+#include "searchIndex.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
-#include <map>
 
 PXR_NAMESPACE_OPEN_SCOPE
 
 
+/// \class ReplaceResolverContext
+///
+/// Search path, replace pairs and replace patterns used by the
+/// ReplaceResolver.
+///
+/// The content is frozen in a reference counted block shared by all the
+/// copies of a context, and copied on write by AddReplacePair,
+/// AddReplacePattern and SetReplaceTable. The content
+/// fingerprint is computed when the context is built, so copying, hashing
+/// and comparing contexts are constant time.
+///
+/// A context created for an asset shares its source with the contexts
+/// created for the same asset and search path while they have the same
+/// rules, and ReplaceResolver::RefreshContext reloads the rules of the
+/// source. Such contexts keep their identity when their rules change. A
+/// copy keeps the content it was made with, the resolver binds the rules
+/// last loaded for the source.
+///
 class ReplaceResolverContext
 {
 public:
     /// Default construct a context with no search path.
-    ReplaceResolverContext() = default;        
+    AR_API ReplaceResolverContext();
 
     /// Construct a context with the given \p searchPath.
     /// Elements in \p searchPath should be absolute paths. If they are not,
     /// they will be anchored to the current working directory.
     AR_API ReplaceResolverContext(const std::vector<std::string>& searchPath);
 
+    /// Construct a context with the given \p searchPath sharing the
+    /// \p rules table.
+    AR_API ReplaceResolverContext(
+        const std::vector<std::string>& searchPath,
+        const ReplaceRuleTableConstPtr& rules);
+
+    /// Search index files by search root, see SetSearchIndex.
+    using SearchIndexMap = std::map<std::string, std::string>;
+
+    /// Construct a context for the asset at \p assetPath, with the given
+    /// \p searchPath, \p searchIndices and the \p rules read from the
+    /// asset. While a context for the same asset and search path with the
+    /// same rules exists, the new one shares its source. Other contexts are
+    /// left unchanged.
+    AR_API ReplaceResolverContext(
+        const std::vector<std::string>& searchPath,
+        const ReplaceRuleTableConstPtr& rules,
+        const std::string& assetPath,
+        const SearchIndexMap& searchIndices = SearchIndexMap());
+
     AR_API void AddReplacePair(const std::string& oldStr, const std::string& newStr);
 
-    const std::map<std::string, std::string>& GetReplaceMap() const { return _oldAndNewStrings; }
+    /// Add a wildcard rule replacing \p pattern by \p replacement, such as
+    /// "assets/*/v1/" by "assets/$1/v2/". Patterns apply to paths no replace
+    /// pair matched, in the order they were added. See
+    /// ReplacePatternMatcher for the syntax.
+    AR_API void AddReplacePattern(
+        const std::string& pattern,
+        const std::string& replacement);
+
+    /// Use the pairs of the binary replace table at \p filePath, see
+    /// ReplaceTableFile, in addition to the pairs added with
+    /// AddReplacePair. The file is memory mapped, not parsed. An empty
+    /// \p filePath removes the table. Returns false and leaves the context
+    /// unchanged if the file is not a valid table.
+    AR_API bool SetReplaceTable(const std::string& filePath);
+
+    /// Attach the search index file at \p indexFilePath to the element
+    /// \p root of the search path, see ReplaceResolverSearchIndex. An empty
+    /// \p indexFilePath detaches the index. Returns false and leaves the
+    /// context unchanged if \p root is not in the search path or the file
+    /// is not a valid index.
+    AR_API bool SetSearchIndex(
+        const std::string& root,
+        const std::string& indexFilePath);
+
+    /// Return the binary replace table, or null.
+    const ReplaceTableFileConstPtr& GetReplaceTable() const
+    {
+        return _Get().rules->GetPairsFile();
+    }
+
+    /// Return the wildcard rules, in priority order.
+    const ReplaceRuleTable::PatternList& GetReplacePatterns() const
+    {
+        return _Get().rules->GetPatterns();
+    }
+
+    const std::map<std::string, std::string>& GetReplaceMap() const
+    {
+        return _Get().rules->GetPairs();
+    }
+
+    /// Return the frozen table of replace pairs.
+    const ReplaceRuleTableConstPtr& GetReplaceRules() const
+    {
+        return _Get().rules;
+    }
+
+    /// Return the content fingerprint of this context.
+    const ReplaceResolverFingerprint& GetFingerprint() const
+    {
+        return _Get().fingerprint;
+    }
+
+    /// Return the fingerprint identifying this context in comparisons and
+    /// hashing. It is the content fingerprint, except for contexts created
+    /// for an asset, which keep their identity when their rules are
+    /// reloaded.
+    const ReplaceResolverFingerprint& GetIdentity() const
+    {
+        return _source ? _source->identity : _data->fingerprint;
+    }
+
+    /// Return the asset this context was created for, or an empty string.
+    AR_API const std::string& GetAssetPath() const;
 
     AR_API bool operator<(const ReplaceResolverContext& rhs) const;
     AR_API bool operator==(const ReplaceResolverContext& rhs) const;
@@ -35,21 +142,92 @@ public:
     /// Return this context's search path.
     const std::vector<std::string>& GetSearchPath() const
     {
-        return _searchPath;
+        return _Get().searchPath;
+    }
+
+    /// Return the search index of each element of the search path, null
+    /// for the elements without one.
+    const std::vector<ReplaceResolverSearchIndexConstPtr>&
+    GetSearchPathIndices() const
+    {
+        return _Get().searchPathIndices;
     }
 
     /// Return a string representation of this context for debugging.
     AR_API std::string GetAsString() const;
 
 private:
-    std::vector<std::string> _searchPath;
-    std::map<std::string, std::string> _oldAndNewStrings;
+    friend class ReplaceResolver;
+
+    struct _Data
+    {
+        std::vector<std::string> searchPath;
+        std::vector<ReplaceResolverSearchIndexConstPtr> searchPathIndices;
+        ReplaceResolverFingerprint searchPathFingerprint;
+        ReplaceRuleTableConstPtr rules;
+        ReplaceResolverFingerprint fingerprint;
+
+        void UpdateSearchPathFingerprint();
+        void UpdateFingerprint();
+    };
+
+    // Content of the contexts created for an asset, shared by all of them.
+    struct _Source
+    {
+        std::string assetPath;
+        ReplaceResolverFingerprint identity;
+
+        // Only accessed through std::atomic_load/std::atomic_store. Older
+        // versions live as long as the copies made with them.
+        std::shared_ptr<const _Data> data;
+        std::mutex mutex;
+    };
+
+    // Sources of the contexts created for an asset, by asset.
+    struct _SourceRegistry;
+    static _SourceRegistry& _GetSourceRegistry();
+
+    const _Data& _Get() const
+    {
+        return *_data;
+    }
+
+    // Return this context with the rules last loaded for its source.
+    AR_API ReplaceResolverContext _GetCurrent() const;
+
+    // Replace the rules of the source of this context, for all the
+    // contexts sharing it. Return false if the rules did not change,
+    // otherwise set the previous rules and the previous and new content
+    // fingerprints.
+    bool _SetSourceRules(
+        const ReplaceRuleTableConstPtr& rules,
+        ReplaceRuleTableConstPtr* oldRules,
+        ReplaceResolverFingerprint* oldFingerprint,
+        ReplaceResolverFingerprint* newFingerprint) const;
+
+    // Return true if the source of another context created for an asset
+    // has the content with \p fingerprint.
+    bool _IsContentInUse(const ReplaceResolverFingerprint& fingerprint) const;
+
+    // Build the content from search path elements and the search index
+    // files of some of them.
+    static std::shared_ptr<const _Data> _MakeData(
+        const std::vector<std::string>& searchPath,
+        const SearchIndexMap& searchIndices,
+        const ReplaceRuleTableConstPtr& rules);
+
+    std::shared_ptr<_Data> _DetachData();
+
+    // The content this context was made with, and for contexts created
+    // for an asset, their source.
+    std::shared_ptr<const _Data> _data;
+    std::shared_ptr<_Source> _source;
 };
 
-AR_API size_t 
+AR_API size_t
 hash_value(const ReplaceResolverContext& context);
 
-inline std::string 
+inline std::string
 ArGetDebugString(const ReplaceResolverContext& context)
 {
     return context.GetAsString();
@@ -0,0 +1,265 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "replaceRuleTable.h"
+
+#include <pxr/pxr.h>
+
+#include <utility>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+
+ReplaceResolverFingerprint
+_ChainPattern(
+    const ReplaceResolverFingerprint& fingerprint,
+    const std::string& pattern,
+    const std::string& replacement)
+{
+    ReplaceResolverFingerprinter fingerprinter;
+    fingerprinter.Append(fingerprint);
+    fingerprinter.Append(pattern);
+    fingerprinter.Append(replacement);
+    return fingerprinter.Get();
+}
+
+} // anonymous
+
+ReplaceRuleTable::ReplaceRuleTable(
+    PairMap pairs,
+    PatternList patterns,
+    ReplaceTableFileConstPtr pairsFile)
+    : _pairs(std::move(pairs))
+    , _pairsFile(std::move(pairsFile))
+    , _pairsSumHi(0)
+    , _pairsSumLo(0)
+{
+    for (const auto& pair : _pairs) {
+        ReplaceResolverFingerprinter fingerprinter;
+        fingerprinter.Append(pair.first);
+        fingerprinter.Append(pair.second);
+        const ReplaceResolverFingerprint pairFingerprint = fingerprinter.Get();
+        _pairsSumHi += pairFingerprint.hi;
+        _pairsSumLo += pairFingerprint.lo;
+    }
+    for (const auto& rule : patterns) {
+        _InsertPattern(rule.first, rule.second);
+    }
+    _UpdateFingerprint();
+}
+
+ReplaceRuleTableConstPtr
+ReplaceRuleTable::AddPair(
+    ReplaceRuleTableConstPtr table,
+    const std::string& oldStr,
+    const std::string& newStr)
+{
+    if (!table) {
+        table = GetEmpty();
+    }
+
+    // The first pair added for an old string wins.
+    if (table->_pairs.find(oldStr) != table->_pairs.end()) {
+        return table;
+    }
+
+    if (table.use_count() == 1) {
+        // Nobody else can observe the table, it is safe to extend it.
+        const_cast<ReplaceRuleTable*>(table.get())->_Insert(oldStr, newStr);
+        return table;
+    }
+
+    std::shared_ptr<ReplaceRuleTable> copy =
+        std::make_shared<ReplaceRuleTable>(
+            table->_pairs, table->_patterns, table->_pairsFile);
+    copy->_Insert(oldStr, newStr);
+    return copy;
+}
+
+ReplaceRuleTableConstPtr
+ReplaceRuleTable::AddPattern(
+    ReplaceRuleTableConstPtr table,
+    const std::string& pattern,
+    const std::string& replacement)
+{
+    if (!table) {
+        table = GetEmpty();
+    }
+
+    // The first rule added for a pattern wins.
+    for (const auto& rule : table->_patterns) {
+        if (rule.first == pattern) {
+            return table;
+        }
+    }
+
+    if (table.use_count() == 1) {
+        const_cast<ReplaceRuleTable*>(table.get())->_InsertPattern(
+            pattern, replacement);
+        return table;
+    }
+
+    std::shared_ptr<ReplaceRuleTable> copy =
+        std::make_shared<ReplaceRuleTable>(
+            table->_pairs, table->_patterns, table->_pairsFile);
+    copy->_InsertPattern(pattern, replacement);
+    return copy;
+}
+
+ReplaceRuleTableConstPtr
+ReplaceRuleTable::SetPairsFile(
+    ReplaceRuleTableConstPtr table,
+    const ReplaceTableFileConstPtr& pairsFile)
+{
+    if (!table) {
+        table = GetEmpty();
+    }
+    if (table->_pairsFile == pairsFile) {
+        return table;
+    }
+
+    if (table.use_count() == 1) {
+        ReplaceRuleTable* mutableTable = const_cast<ReplaceRuleTable*>(table.get());
+        mutableTable->_pairsFile = pairsFile;
+        mutableTable->_UpdateFingerprint();
+        return table;
+    }
+
+    return std::make_shared<ReplaceRuleTable>(
+        table->_pairs, table->_patterns, pairsFile);
+}
+
+const ReplaceRuleTableConstPtr&
+ReplaceRuleTable::GetEmpty()
+{
+    static const ReplaceRuleTableConstPtr empty =
+        std::make_shared<ReplaceRuleTable>();
+    return empty;
+}
+
+void
+ReplaceRuleTable::_Insert(const std::string& oldStr, const std::string& newStr)
+{
+    _pairs.emplace(oldStr, newStr);
+
+    ReplaceResolverFingerprinter fingerprinter;
+    fingerprinter.Append(oldStr);
+    fingerprinter.Append(newStr);
+    const ReplaceResolverFingerprint pairFingerprint = fingerprinter.Get();
+    _pairsSumHi += pairFingerprint.hi;
+    _pairsSumLo += pairFingerprint.lo;
+    _UpdateFingerprint();
+
+    std::atomic_store(&_matcher, std::shared_ptr<const ReplaceMatcher>());
+}
+
+void
+ReplaceRuleTable::_InsertPattern(
+    const std::string& pattern,
+    const std::string& replacement)
+{
+    // Duplicated patterns would never match, skip them.
+    for (const auto& rule : _patterns) {
+        if (rule.first == pattern) {
+            return;
+        }
+    }
+
+    _patterns.emplace_back(pattern, replacement);
+    _patternsFingerprint =
+        _ChainPattern(_patternsFingerprint, pattern, replacement);
+    _UpdateFingerprint();
+
+    std::atomic_store(
+        &_patternMatcher, std::shared_ptr<const ReplacePatternMatcher>());
+}
+
+void
+ReplaceRuleTable::_UpdateFingerprint()
+{
+    ReplaceResolverFingerprinter fingerprinter;
+    fingerprinter.Append(static_cast<uint64_t>(_pairs.size()));
+    fingerprinter.Append(_pairsSumHi);
+    fingerprinter.Append(_pairsSumLo);
+    if (!_patterns.empty()) {
+        fingerprinter.Append(static_cast<uint64_t>(_patterns.size()));
+        fingerprinter.Append(_patternsFingerprint);
+    }
+    if (_pairsFile) {
+        // The fingerprint written with the file, it is not hashed again.
+        fingerprinter.Append(std::string("file"));
+        fingerprinter.Append(_pairsFile->GetFingerprint());
+    }
+    _fingerprint = fingerprinter.Get();
+}
+
+const ReplaceMatcher&
+ReplaceRuleTable::GetMatcher() const
+{
+    std::shared_ptr<const ReplaceMatcher> matcher = std::atomic_load(&_matcher);
+    if (!matcher) {
+        // Concurrent callers may compile the same pairs twice, both
+        // results are identical and only one of them is kept.
+        std::shared_ptr<const ReplaceMatcher> compiled =
+            std::make_shared<const ReplaceMatcher>(_pairs);
+        if (std::atomic_compare_exchange_strong(&_matcher, &matcher, compiled)) {
+            matcher = compiled;
+        }
+    }
+
+    // The table keeps the matcher alive as long as it is not extended,
+    // which only happens while nobody else references the table.
+    return *matcher;
+}
+
+const ReplacePatternMatcher&
+ReplaceRuleTable::GetPatternMatcher() const
+{
+    std::shared_ptr<const ReplacePatternMatcher> matcher =
+        std::atomic_load(&_patternMatcher);
+    if (!matcher) {
+        std::shared_ptr<const ReplacePatternMatcher> compiled =
+            std::make_shared<const ReplacePatternMatcher>(_patterns);
+        if (std::atomic_compare_exchange_strong(
+                &_patternMatcher, &matcher, compiled)) {
+            matcher = compiled;
+        }
+    }
+    return *matcher;
+}
+
+bool
+ReplaceRuleTable::Replace(const std::string& path, std::string* result) const
+{
+    if (IsEmpty()) {
+        return false;
+    }
+    if (!_pairsFile) {
+        return GetMatcher().Replace(path, result) ||
+            GetPatternMatcher().Replace(path, result);
+    }
+
+    const ReplaceMatcher& matcher = GetMatcher();
+    size_t pos = 0;
+    size_t index = 0;
+    const bool found = matcher.Find(path, &pos, &index);
+
+    size_t filePos = 0;
+    size_t fileIndex = 0;
+    if (_pairsFile->Find(path, &filePos, &fileIndex) &&
+        (!found || filePos < pos ||
+         (filePos == pos &&
+          _pairsFile->GetOldLength(fileIndex) > matcher.GetPatternLength(index)))) {
+        _pairsFile->Replace(path, filePos, fileIndex, result);
+        return true;
+    }
+
+    if (found) {
+        *result = path;
+        result->replace(
+            pos, matcher.GetPatternLength(index), matcher.GetReplacement(index));
+        return true;
+    }
+    return GetPatternMatcher().Replace(path, result);
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
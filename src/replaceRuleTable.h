@@ -0,0 +1,137 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RULE_TABLE_H
+#define USD_REPLACE_RULE_TABLE_H
+
+#include "fingerprint.h"
+#include "replaceMatcher.h"
+#include "replacePatternMatcher.h"
+#include "replaceTableFile.h"
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+class ReplaceRuleTable;
+using ReplaceRuleTableConstPtr = std::shared_ptr<const ReplaceRuleTable>;
+
+/// \class ReplaceRuleTable
+///
+/// Frozen set of old/new string pairs and of wildcard patterns.
+///
+/// Large version pins may also come from a memory mapped ReplaceTableFile,
+/// its pairs are matched in place together with the pairs in memory.
+///
+/// A table is shared between contexts through a ReplaceRuleTableConstPtr
+/// and never changes once shared. Its fingerprint is computed when the
+/// table is built, its matchers are compiled on first use.
+///
+class ReplaceRuleTable
+{
+public:
+    using PairMap = std::map<std::string, std::string>;
+    using PatternList = ReplacePatternMatcher::PatternList;
+
+    /// Build a table from \p pairs, \p patterns, the latter in priority
+    /// order, and the pairs of \p pairsFile.
+    AR_API explicit ReplaceRuleTable(
+        PairMap pairs = PairMap(),
+        PatternList patterns = PatternList(),
+        ReplaceTableFileConstPtr pairsFile = nullptr);
+
+    /// Return a table made of the pairs of \p table and the \p oldStr /
+    /// \p newStr pair. If \p oldStr already has a pair, \p table is
+    /// returned unchanged.
+    ///
+    /// \p table is extended in place when the caller holds its only
+    /// reference, otherwise it is copied.
+    AR_API static ReplaceRuleTableConstPtr AddPair(
+        ReplaceRuleTableConstPtr table,
+        const std::string& oldStr,
+        const std::string& newStr);
+
+    /// Return a table made of the rules of \p table and the \p pattern /
+    /// \p replacement wildcard rule, with the lowest priority. If
+    /// \p pattern already has a rule, \p table is returned unchanged.
+    /// See ReplacePatternMatcher for the pattern syntax.
+    AR_API static ReplaceRuleTableConstPtr AddPattern(
+        ReplaceRuleTableConstPtr table,
+        const std::string& pattern,
+        const std::string& replacement);
+
+    /// Return a table made of the rules of \p table and the pairs of
+    /// \p pairsFile, replacing the file \p table may already use.
+    AR_API static ReplaceRuleTableConstPtr SetPairsFile(
+        ReplaceRuleTableConstPtr table,
+        const ReplaceTableFileConstPtr& pairsFile);
+
+    /// Return a shared empty table.
+    AR_API static const ReplaceRuleTableConstPtr& GetEmpty();
+
+    const PairMap& GetPairs() const { return _pairs; }
+
+    const PatternList& GetPatterns() const { return _patterns; }
+
+    /// Return the file of pairs, or null.
+    const ReplaceTableFileConstPtr& GetPairsFile() const { return _pairsFile; }
+
+    bool IsEmpty() const
+    {
+        return _pairs.empty() && _patterns.empty() &&
+            (!_pairsFile || _pairsFile->GetSize() == 0);
+    }
+
+    const ReplaceResolverFingerprint& GetFingerprint() const
+    {
+        return _fingerprint;
+    }
+
+    /// Return the matcher compiled from the pairs.
+    AR_API const ReplaceMatcher& GetMatcher() const;
+
+    /// Return the matcher compiled from the patterns.
+    AR_API const ReplacePatternMatcher& GetPatternMatcher() const;
+
+    /// Apply the rules to \p path: the pairs first, which pin exact paths,
+    /// then the patterns. The pairs in memory and in the file follow the
+    /// same leftmost longest semantics, the pair in memory wins when both
+    /// match the same string. Return false if no rule matched.
+    AR_API bool Replace(const std::string& path, std::string* result) const;
+
+private:
+    ReplaceRuleTable(const ReplaceRuleTable&) = delete;
+    ReplaceRuleTable& operator=(const ReplaceRuleTable&) = delete;
+
+    void _Insert(const std::string& oldStr, const std::string& newStr);
+    void _InsertPattern(
+        const std::string& pattern,
+        const std::string& replacement);
+    void _UpdateFingerprint();
+
+    PairMap _pairs;
+    PatternList _patterns;
+    ReplaceTableFileConstPtr _pairsFile;
+
+    // Order independent sum of the pair fingerprints, so that adding a pair
+    // does not require hashing all the others again.
+    uint64_t _pairsSumHi;
+    uint64_t _pairsSumLo;
+    // Patterns are ordered, they are chained instead.
+    ReplaceResolverFingerprint _patternsFingerprint;
+    ReplaceResolverFingerprint _fingerprint;
+
+    // Only accessed through std::atomic_load/std::atomic_store since it is
+    // lazily compiled from concurrent resolves.
+    mutable std::shared_ptr<const ReplaceMatcher> _matcher;
+    mutable std::shared_ptr<const ReplacePatternMatcher> _patternMatcher;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RULE_TABLE_H
@@ -0,0 +1,367 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "replaceTableFile.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/tf/stringUtils.h>
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+
+const char _Magic[8] = {'R', 'R', 'T', 'A', 'B', 'L', 'E', 'S'};
+constexpr uint32_t _Version = 1;
+
+void
+_SetError(std::string* errMsg, const std::string& msg)
+{
+    if (errMsg) {
+        *errMsg = msg;
+    }
+}
+
+} // anonymous
+
+struct ReplaceTableFile::_Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t entrySize;
+    uint64_t numEntries;
+    uint64_t entriesOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t fingerprintHi;
+    uint64_t fingerprintLo;
+    uint64_t firstBytes[4];
+};
+
+struct ReplaceTableFile::_Entry
+{
+    uint32_t oldOffset;
+    uint32_t oldLength;
+    uint32_t newOffset;
+    uint32_t newLength;
+};
+
+bool
+ReplaceTableFile::Write(
+    const std::string& filePath,
+    const std::map<std::string, std::string>& pairs,
+    std::string* errMsg)
+{
+    _Header header;
+    memset(&header, 0, sizeof(header));
+
+    // The map is already sorted like the lookups expect, bytes compared as
+    // unsigned.
+    std::vector<_Entry> entries;
+    entries.reserve(pairs.size());
+    std::string strings;
+    uint64_t sumHi = 0;
+    uint64_t sumLo = 0;
+    for (const auto& pair : pairs) {
+        // Empty old strings would match everywhere, the matchers ignore
+        // them.
+        if (pair.first.empty()) {
+            continue;
+        }
+        if (strings.size() + pair.first.size() + pair.second.size() >
+                UINT32_MAX) {
+            _SetError(errMsg, TfStringPrintf(
+                "Too many pairs for replace table '%s'", filePath.c_str()));
+            return false;
+        }
+
+        _Entry entry;
+        entry.oldOffset = static_cast<uint32_t>(strings.size());
+        entry.oldLength = static_cast<uint32_t>(pair.first.size());
+        strings += pair.first;
+        entry.newOffset = static_cast<uint32_t>(strings.size());
+        entry.newLength = static_cast<uint32_t>(pair.second.size());
+        strings += pair.second;
+        entries.push_back(entry);
+
+        const unsigned char firstByte = pair.first[0];
+        header.firstBytes[firstByte / 64] |= uint64_t(1) << (firstByte % 64);
+
+        // Same fingerprint as the pairs of a ReplaceRuleTable.
+        ReplaceResolverFingerprinter fingerprinter;
+        fingerprinter.Append(pair.first);
+        fingerprinter.Append(pair.second);
+        const ReplaceResolverFingerprint pairFingerprint = fingerprinter.Get();
+        sumHi += pairFingerprint.hi;
+        sumLo += pairFingerprint.lo;
+    }
+
+    ReplaceResolverFingerprinter fingerprinter;
+    fingerprinter.Append(static_cast<uint64_t>(entries.size()));
+    fingerprinter.Append(sumHi);
+    fingerprinter.Append(sumLo);
+    const ReplaceResolverFingerprint fingerprint = fingerprinter.Get();
+
+    memcpy(header.magic, _Magic, sizeof(_Magic));
+    header.version = _Version;
+    header.entrySize = sizeof(_Entry);
+    header.numEntries = entries.size();
+    header.entriesOffset = sizeof(_Header);
+    header.stringsOffset =
+        header.entriesOffset + entries.size() * sizeof(_Entry);
+    header.stringsSize = strings.size();
+    header.fingerprintHi = fingerprint.hi;
+    header.fingerprintLo = fingerprint.lo;
+
+    // Write next to the destination and rename, so that readers never map
+    // a partially written table.
+    const std::string tmpFilePath = filePath + ".tmp";
+    FILE* file = ArchOpenFile(tmpFilePath.c_str(), "wb");
+    if (!file) {
+        _SetError(errMsg, TfStringPrintf(
+            "Could not open '%s' for writing", tmpFilePath.c_str()));
+        return false;
+    }
+
+    const bool written =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(entries.data(), sizeof(_Entry), entries.size(), file) ==
+            entries.size() &&
+        fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+    const bool closed = fclose(file) == 0;
+
+    if (!written || !closed || rename(tmpFilePath.c_str(), filePath.c_str()) != 0) {
+        remove(tmpFilePath.c_str());
+        _SetError(errMsg, TfStringPrintf(
+            "Could not write replace table '%s'", filePath.c_str()));
+        return false;
+    }
+    return true;
+}
+
+ReplaceTableFileConstPtr
+ReplaceTableFile::Open(const std::string& filePath, std::string* errMsg)
+{
+    // Every context of a shot points at the same table, map each file once
+    // while it is unchanged.
+    static std::mutex mutex;
+    static std::unordered_map<std::string,
+        std::weak_ptr<const ReplaceTableFile>> openTables;
+
+    double modificationTime = 0.0;
+    if (!ArchGetModificationTime(filePath.c_str(), &modificationTime)) {
+        _SetError(errMsg, TfStringPrintf(
+            "Could not open replace table '%s'", filePath.c_str()));
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ReplaceTableFileConstPtr table = openTables[filePath].lock();
+    if (table && table->_modificationTime == modificationTime) {
+        return table;
+    }
+
+    FILE* file = ArchOpenFile(filePath.c_str(), "rb");
+    if (!file) {
+        _SetError(errMsg, TfStringPrintf(
+            "Could not open replace table '%s'", filePath.c_str()));
+        return nullptr;
+    }
+
+    std::string mapError;
+    ArchConstFileMapping mapping = ArchMapFileReadOnly(file, &mapError);
+    fclose(file);
+    if (!mapping) {
+        _SetError(errMsg, TfStringPrintf(
+            "Could not map replace table '%s': %s",
+            filePath.c_str(), mapError.c_str()));
+        return nullptr;
+    }
+
+    // Sizes are checked before they are added, so that a corrupted header
+    // cannot wrap around and point past the mapping.
+    const uint64_t size = ArchGetFileMappingLength(mapping);
+    const _Header* header = reinterpret_cast<const _Header*>(mapping.get());
+    const bool isValid =
+        size >= sizeof(_Header) &&
+        memcmp(header->magic, _Magic, sizeof(_Magic)) == 0 &&
+        header->version == _Version &&
+        header->entrySize == sizeof(_Entry) &&
+        header->entriesOffset == sizeof(_Header) &&
+        header->numEntries <= (size - sizeof(_Header)) / sizeof(_Entry) &&
+        header->stringsOffset ==
+            header->entriesOffset + header->numEntries * sizeof(_Entry) &&
+        header->stringsOffset <= size &&
+        header->stringsSize == size - header->stringsOffset;
+    if (!isValid) {
+        _SetError(errMsg, TfStringPrintf(
+            "Invalid replace table '%s'", filePath.c_str()));
+        return nullptr;
+    }
+
+    // Do not trust offsets read from disk, check them once here so that
+    // lookups do not have to.
+    const _Entry* entries = reinterpret_cast<const _Entry*>(
+        mapping.get() + header->entriesOffset);
+    for (uint64_t i = 0; i < header->numEntries; ++i) {
+        const _Entry& entry = entries[i];
+        if (uint64_t(entry.oldOffset) + entry.oldLength > header->stringsSize ||
+            uint64_t(entry.newOffset) + entry.newLength > header->stringsSize) {
+            _SetError(errMsg, TfStringPrintf(
+                "Invalid replace table '%s'", filePath.c_str()));
+            return nullptr;
+        }
+    }
+
+    std::shared_ptr<ReplaceTableFile> newTable(new ReplaceTableFile());
+    newTable->_filePath = filePath;
+    newTable->_modificationTime = modificationTime;
+    newTable->_fingerprint.hi = header->fingerprintHi;
+    newTable->_fingerprint.lo = header->fingerprintLo;
+    newTable->_header = header;
+    newTable->_entries = entries;
+    newTable->_strings = mapping.get() + header->stringsOffset;
+    memcpy(newTable->_firstBytes, header->firstBytes,
+           sizeof(newTable->_firstBytes));
+    newTable->_mapping = std::move(mapping);
+
+    openTables[filePath] = newTable;
+    return newTable;
+}
+
+bool
+ReplaceTableFile::Find(
+    const std::string& text,
+    size_t* pos,
+    size_t* pairIndex) const
+{
+    const size_t numEntries = GetSize();
+    if (numEntries == 0) {
+        return false;
+    }
+
+    const unsigned char* data =
+        reinterpret_cast<const unsigned char*>(text.data());
+    for (size_t start = 0; start < text.size(); ++start) {
+        const unsigned char firstByte = data[start];
+        if (!(_firstBytes[firstByte / 64] & (uint64_t(1) << (firstByte % 64)))) {
+            continue;
+        }
+
+        // Narrow the range of the old strings starting with the text at
+        // start, one byte at a time. An old string ending at depth sorts
+        // before the longer ones sharing its bytes, the last one found is
+        // the longest.
+        size_t begin = 0;
+        size_t end = numEntries;
+        size_t found = numEntries;
+        for (size_t depth = 0; start + depth < text.size(); ++depth) {
+            const unsigned char c = data[start + depth];
+
+            // Skip the old string ending before depth.
+            if (_entries[begin].oldLength == depth) {
+                ++begin;
+            }
+
+            size_t low = begin;
+            size_t high = end;
+            while (low < high) {
+                const size_t middle = low + (high - low) / 2;
+                const unsigned char m = static_cast<unsigned char>(
+                    _strings[_entries[middle].oldOffset + depth]);
+                if (m < c) {
+                    low = middle + 1;
+                }
+                else {
+                    high = middle;
+                }
+            }
+            begin = low;
+
+            high = end;
+            while (low < high) {
+                const size_t middle = low + (high - low) / 2;
+                const unsigned char m = static_cast<unsigned char>(
+                    _strings[_entries[middle].oldOffset + depth]);
+                if (m <= c) {
+                    low = middle + 1;
+                }
+                else {
+                    high = middle;
+                }
+            }
+            end = low;
+
+            if (begin == end) {
+                break;
+            }
+            if (_entries[begin].oldLength == depth + 1) {
+                found = begin;
+            }
+        }
+
+        if (found != numEntries) {
+            *pos = start;
+            *pairIndex = found;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+ReplaceTableFile::Replace(const std::string& text, std::string* result) const
+{
+    size_t pos = 0;
+    size_t pairIndex = 0;
+    if (!Find(text, &pos, &pairIndex)) {
+        return false;
+    }
+
+    Replace(text, pos, pairIndex, result);
+    return true;
+}
+
+void
+ReplaceTableFile::Replace(
+    const std::string& text,
+    size_t pos,
+    size_t pairIndex,
+    std::string* result) const
+{
+    const _Entry& entry = _entries[pairIndex];
+    *result = text;
+    result->replace(
+        pos, entry.oldLength, _strings + entry.newOffset, entry.newLength);
+}
+
+std::string
+ReplaceTableFile::GetOld(size_t pairIndex) const
+{
+    const _Entry& entry = _entries[pairIndex];
+    return std::string(_strings + entry.oldOffset, entry.oldLength);
+}
+
+std::string
+ReplaceTableFile::GetNew(size_t pairIndex) const
+{
+    const _Entry& entry = _entries[pairIndex];
+    return std::string(_strings + entry.newOffset, entry.newLength);
+}
+
+size_t
+ReplaceTableFile::GetOldLength(size_t pairIndex) const
+{
+    return _entries[pairIndex].oldLength;
+}
+
+size_t
+ReplaceTableFile::GetSize() const
+{
+    return static_cast<size_t>(_header->numEntries);
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,109 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_TABLE_FILE_H
+#define USD_REPLACE_TABLE_FILE_H
+
+#include "fingerprint.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/usd/ar/api.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+class ReplaceTableFile;
+using ReplaceTableFileConstPtr = std::shared_ptr<const ReplaceTableFile>;
+
+/// \class ReplaceTableFile
+///
+/// Binary table of old/new string pairs, memory mapped, for version pins
+/// too large to be parsed from JSON or layer metadata in every session.
+///
+/// Pairs are sorted by old string, their strings stored in a single blob.
+/// Opening a table does not parse nor copy anything, matches are found
+/// with binary searches in place, following the semantics of
+/// ReplaceMatcher.
+///
+class ReplaceTableFile
+{
+public:
+    /// Write the table of \p pairs to \p filePath.
+    AR_API static bool Write(
+        const std::string& filePath,
+        const std::map<std::string, std::string>& pairs,
+        std::string* errMsg = nullptr);
+
+    /// Map the table file at \p filePath. Rule tables using the same
+    /// unchanged file share the mapping. Returns null if the file cannot
+    /// be mapped or is not a valid table.
+    AR_API static ReplaceTableFileConstPtr Open(
+        const std::string& filePath,
+        std::string* errMsg = nullptr);
+
+    /// Find the leftmost occurrence in \p text of an old string, the
+    /// longest one if several start there. On success, \p pos is the match
+    /// offset and \p pairIndex the index of the matched pair.
+    AR_API bool Find(
+        const std::string& text,
+        size_t* pos,
+        size_t* pairIndex) const;
+
+    /// Replace the match in \p text, if any, and store the result in
+    /// \p result. Returns false and leaves \p result untouched otherwise.
+    AR_API bool Replace(const std::string& text, std::string* result) const;
+
+    /// Replace the old string of the pair at \p pairIndex, found at \p pos
+    /// in \p text, and store the result in \p result.
+    AR_API void Replace(
+        const std::string& text,
+        size_t pos,
+        size_t pairIndex,
+        std::string* result) const;
+
+    /// Return the old string of the pair at \p pairIndex.
+    AR_API std::string GetOld(size_t pairIndex) const;
+
+    /// Return the new string of the pair at \p pairIndex.
+    AR_API std::string GetNew(size_t pairIndex) const;
+
+    /// Return the length of the old string of the pair at \p pairIndex.
+    AR_API size_t GetOldLength(size_t pairIndex) const;
+
+    /// Return the number of pairs.
+    AR_API size_t GetSize() const;
+
+    /// Return the fingerprint of the pairs, computed when the file was
+    /// written.
+    const ReplaceResolverFingerprint& GetFingerprint() const
+    {
+        return _fingerprint;
+    }
+
+    const std::string& GetFilePath() const { return _filePath; }
+
+private:
+    struct _Header;
+    struct _Entry;
+
+    ReplaceTableFile() = default;
+
+    std::string _filePath;
+    double _modificationTime = 0.0;
+    ReplaceResolverFingerprint _fingerprint;
+    ArchConstFileMapping _mapping;
+    const _Header* _header = nullptr;
+    const _Entry* _entries = nullptr;
+    const char* _strings = nullptr;
+    // Bit set of the first bytes of the old strings, positions of the text
+    // starting with another byte are skipped.
+    uint64_t _firstBytes[4] = {0, 0, 0, 0};
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_TABLE_FILE_H
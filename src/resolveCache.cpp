@@ -0,0 +1,224 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "resolveCache.h"
+
+#include <pxr/pxr.h>
+
+#include <iterator>
+#include <utility>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+constexpr size_t ReplaceResolverCache::_NumShards;
+
+namespace {
+
+// Approximate cost of an entry: map node, list node and bookkeeping. The
+// paths themselves are accounted by the path table.
+constexpr size_t _EntryBytes = 96;
+
+// Return the part of \p budget left to the entries of one shard. The paths
+// of the entries are never released, the interned paths count against the
+// budget.
+size_t
+_GetShardBudget(size_t budget, size_t numShards)
+{
+    const size_t tableBytes =
+        ReplaceResolverPathTable::GetInstance().GetMemoryUsage();
+    return (budget > tableBytes ? budget - tableBytes : 0) / numShards;
+}
+
+} // anonymous
+
+ReplaceResolverCache::ReplaceResolverCache(size_t budget)
+    : _budget(budget)
+{
+}
+
+ReplaceResolverCache::_Shard&
+ReplaceResolverCache::_GetShard(const ReplaceResolverCacheKey& key)
+{
+    // The low bits of the hash select the map buckets, use the high ones.
+    const size_t hash = key.GetHash();
+    return _shards[(hash >> (sizeof(size_t) * 8 - 8)) % _NumShards];
+}
+
+bool
+ReplaceResolverCache::Find(
+    const ReplaceResolverCacheKey& key,
+    ReplaceResolverPathTable::Id* resolvedPath)
+{
+    if (_budget.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+
+    _Shard& shard = _GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+        return false;
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lruIt);
+    *resolvedPath = it->second.resolvedPath;
+    return true;
+}
+
+void
+ReplaceResolverCache::Insert(
+    const ReplaceResolverCacheKey& key,
+    ReplaceResolverPathTable::Id resolvedPath)
+{
+    const size_t budget = _budget.load(std::memory_order_relaxed);
+    if (budget == 0) {
+        return;
+    }
+
+    _Shard& shard = _GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto inserted = shard.map.emplace(key, _Value());
+    _Value& value = inserted.first->second;
+    if (inserted.second) {
+        shard.lru.push_front(&inserted.first->first);
+        value.lruIt = shard.lru.begin();
+        shard.bytes += _EntryBytes;
+    }
+    else {
+        shard.lru.splice(shard.lru.begin(), shard.lru, value.lruIt);
+    }
+    value.resolvedPath = resolvedPath;
+
+    _Evict(shard, _GetShardBudget(budget, _NumShards));
+}
+
+void
+ReplaceResolverCache::_Erase(_Shard& shard, _Map::iterator it)
+{
+    shard.bytes -= _EntryBytes;
+    shard.lru.erase(it->second.lruIt);
+    shard.map.erase(it);
+}
+
+void
+ReplaceResolverCache::_Evict(_Shard& shard, size_t shardBudget)
+{
+    while (shard.bytes > shardBudget && !shard.lru.empty()) {
+        _Erase(shard, shard.map.find(*shard.lru.back()));
+    }
+}
+
+void
+ReplaceResolverCache::Invalidate(const ReplaceResolverFingerprint& fingerprint)
+{
+    for (_Shard& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto it = shard.map.begin(); it != shard.map.end(); ) {
+            auto next = std::next(it);
+            if (it->first.context == fingerprint) {
+                _Erase(shard, it);
+            }
+            it = next;
+        }
+    }
+}
+
+void
+ReplaceResolverCache::CopyEntries(
+    const ReplaceResolverFingerprint& from,
+    const ReplaceResolverFingerprint& to,
+    const std::function<bool(ReplaceResolverPathTable::Id)>& predicate)
+{
+    if (from == to) {
+        return;
+    }
+
+    // The candidates are collected under the shard locks, the predicate
+    // may be slow and the copies usually belong to other shards, they are
+    // filtered and inserted once no shard is locked.
+    std::vector<std::pair<ReplaceResolverCacheKey,
+                          ReplaceResolverPathTable::Id>> copies;
+    for (_Shard& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const auto& entry : shard.map) {
+            if (entry.first.context == from) {
+                ReplaceResolverCacheKey key;
+                key.context = to;
+                key.path = entry.first.path;
+                key.cwd = entry.first.cwd;
+                copies.emplace_back(key, entry.second.resolvedPath);
+            }
+        }
+    }
+
+    for (const auto& copy : copies) {
+        if (predicate(copy.first.path)) {
+            Insert(copy.first, copy.second);
+        }
+    }
+}
+
+void
+ReplaceResolverCache::InvalidateResolvedPaths(
+    const std::function<bool(ReplaceResolverPathTable::Id)>& predicate,
+    std::set<ReplaceResolverFingerprint>* contexts)
+{
+    for (_Shard& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto it = shard.map.begin(); it != shard.map.end(); ) {
+            auto next = std::next(it);
+            if (predicate(it->second.resolvedPath)) {
+                if (contexts) {
+                    contexts->insert(it->first.context);
+                }
+                _Erase(shard, it);
+            }
+            it = next;
+        }
+    }
+}
+
+void
+ReplaceResolverCache::Clear()
+{
+    for (_Shard& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.lru.clear();
+        shard.map.clear();
+        shard.bytes = 0;
+    }
+}
+
+void
+ReplaceResolverCache::SetBudget(size_t budget)
+{
+    _budget.store(budget);
+    const size_t shardBudget = _GetShardBudget(budget, _NumShards);
+    for (_Shard& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        _Evict(shard, shardBudget);
+    }
+}
+
+size_t
+ReplaceResolverCache::GetMemoryUsage() const
+{
+    size_t bytes = 0;
+    for (const _Shard& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        bytes += shard.bytes;
+    }
+    return bytes;
+}
+
+size_t
+ReplaceResolverCache::GetSize() const
+{
+    size_t size = 0;
+    for (const _Shard& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size += shard.map.size();
+    }
+    return size;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,156 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_RESOLVE_CACHE_H
+#define USD_REPLACE_RESOLVER_RESOLVE_CACHE_H
+
+#include "fingerprint.h"
+#include "pathTable.h"
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplaceResolverCacheKey
+///
+/// Key of the resolve caches: an asset path, interned in the
+/// ReplaceResolverPathTable, resolved with the context having the given
+/// fingerprint bound.
+///
+/// Relative paths are first looked up in the current directory, their key
+/// also holds the interned current directory. It is invalid for the other
+/// paths.
+///
+struct ReplaceResolverCacheKey
+{
+    ReplaceResolverFingerprint context;
+    ReplaceResolverPathTable::Id path = ReplaceResolverPathTable::InvalidId;
+    ReplaceResolverPathTable::Id cwd = ReplaceResolverPathTable::InvalidId;
+
+    bool operator==(const ReplaceResolverCacheKey& rhs) const
+    {
+        return context == rhs.context && path == rhs.path && cwd == rhs.cwd;
+    }
+
+    size_t GetHash() const
+    {
+        // Ids are unique, spreading their bits is enough.
+        const uint64_t ids = (static_cast<uint64_t>(cwd) << 32) | path;
+        return context.GetHash() ^
+            static_cast<size_t>(ids * 0x9E3779B97F4A7C15ULL);
+    }
+
+    /// Hasher for std containers.
+    struct Hash {
+        size_t operator()(const ReplaceResolverCacheKey& key) const
+        {
+            return key.GetHash();
+        }
+    };
+};
+
+/// \class ReplaceResolverCache
+///
+/// Process wide cache of resolved paths, kept across cache scopes.
+///
+/// Entries are interned path ids, the strings live in the
+/// ReplaceResolverPathTable.
+///
+/// The cache is split in shards, each one evicting its least recently used
+/// entries when it exceeds its part of the memory budget. The interned
+/// paths are never released, the memory they use is taken off the budget
+/// first. A budget of zero disables the cache.
+///
+class ReplaceResolverCache
+{
+public:
+    AR_API explicit ReplaceResolverCache(size_t budget);
+
+    ReplaceResolverCache(const ReplaceResolverCache&) = delete;
+    ReplaceResolverCache& operator=(const ReplaceResolverCache&) = delete;
+
+    /// Return true and set \p resolvedPath if \p key is cached.
+    AR_API bool Find(
+        const ReplaceResolverCacheKey& key,
+        ReplaceResolverPathTable::Id* resolvedPath);
+
+    AR_API void Insert(
+        const ReplaceResolverCacheKey& key,
+        ReplaceResolverPathTable::Id resolvedPath);
+
+    /// Drop all the entries resolved with the context having the given
+    /// \p fingerprint.
+    AR_API void Invalidate(const ReplaceResolverFingerprint& fingerprint);
+
+    /// Copy the entries resolved with the context having the \p from
+    /// fingerprint to the \p to fingerprint, for the asset paths matching
+    /// \p predicate. The predicate is called with no shard locked.
+    AR_API void CopyEntries(
+        const ReplaceResolverFingerprint& from,
+        const ReplaceResolverFingerprint& to,
+        const std::function<bool(ReplaceResolverPathTable::Id)>& predicate);
+
+    /// Drop all the entries whose resolved path matches \p predicate, and
+    /// add the fingerprints of their contexts to \p contexts if not null.
+    /// The predicate is called with the shard locked.
+    AR_API void InvalidateResolvedPaths(
+        const std::function<bool(ReplaceResolverPathTable::Id)>& predicate,
+        std::set<ReplaceResolverFingerprint>* contexts = nullptr);
+
+    /// Drop all entries.
+    AR_API void Clear();
+
+    /// Set the memory budget in bytes, evicting entries if needed.
+    AR_API void SetBudget(size_t budget);
+
+    size_t GetBudget() const { return _budget.load(); }
+
+    /// Return the approximate memory used by the entries in bytes.
+    AR_API size_t GetMemoryUsage() const;
+
+    /// Return the number of entries.
+    AR_API size_t GetSize() const;
+
+private:
+    struct _Value;
+    using _Map = std::unordered_map<
+        ReplaceResolverCacheKey, _Value, ReplaceResolverCacheKey::Hash>;
+    // Most recently used first. Keys point into _Map nodes, which are
+    // stable.
+    using _LruList = std::list<const ReplaceResolverCacheKey*>;
+
+    struct _Value
+    {
+        ReplaceResolverPathTable::Id resolvedPath;
+        _LruList::iterator lruIt;
+    };
+
+    struct _Shard
+    {
+        mutable std::mutex mutex;
+        _Map map;
+        _LruList lru;
+        size_t bytes = 0;
+    };
+
+    static constexpr size_t _NumShards = 16;
+
+    _Shard& _GetShard(const ReplaceResolverCacheKey& key);
+    void _Erase(_Shard& shard, _Map::iterator it);
+    void _Evict(_Shard& shard, size_t shardBudget);
+
+    _Shard _shards[_NumShards];
+    std::atomic<size_t> _budget;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_RESOLVE_CACHE_H
@@ -0,0 +1,276 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "searchIndex.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+
+const char _Magic[8] = {'R', 'R', 'S', 'I', 'N', 'D', 'E', 'X'};
+constexpr uint32_t _Version = 1;
+
+void
+_SetError(std::string* errMsg, const std::string& msg)
+{
+    if (errMsg) {
+        *errMsg = msg;
+    }
+}
+
+// Compare like std::string, that is as unsigned bytes.
+int
+_Compare(const char* lhs, size_t lhsSize, const char* rhs, size_t rhsSize)
+{
+    const int result = memcmp(lhs, rhs, std::min(lhsSize, rhsSize));
+    if (result != 0) {
+        return result;
+    }
+    return lhsSize < rhsSize ? -1 : (lhsSize > rhsSize ? 1 : 0);
+}
+
+} // anonymous
+
+struct ReplaceResolverSearchIndex::_Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t entrySize;
+    uint64_t numEntries;
+    uint64_t entriesOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+};
+
+struct ReplaceResolverSearchIndex::_Entry
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+bool
+ReplaceResolverSearchIndex::Write(
+    const std::string& filePath,
+    std::vector<std::string> relativePaths,
+    std::string* errMsg)
+{
+    std::sort(relativePaths.begin(), relativePaths.end());
+    relativePaths.erase(
+        std::unique(relativePaths.begin(), relativePaths.end()),
+        relativePaths.end());
+
+    std::vector<_Entry> entries;
+    entries.reserve(relativePaths.size());
+    std::string strings;
+    for (const std::string& relativePath : relativePaths) {
+        if (relativePath.empty()) {
+            continue;
+        }
+        if (strings.size() + relativePath.size() > UINT32_MAX) {
+            _SetError(errMsg, TfStringPrintf(
+                "Too many paths for search index '%s'", filePath.c_str()));
+            return false;
+        }
+        _Entry entry;
+        entry.offset = static_cast<uint32_t>(strings.size());
+        entry.length = static_cast<uint32_t>(relativePath.size());
+        entries.push_back(entry);
+        strings += relativePath;
+    }
+
+    _Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, _Magic, sizeof(_Magic));
+    header.version = _Version;
+    header.entrySize = sizeof(_Entry);
+    header.numEntries = entries.size();
+    header.entriesOffset = sizeof(_Header);
+    header.stringsOffset =
+        header.entriesOffset + entries.size() * sizeof(_Entry);
+    header.stringsSize = strings.size();
+
+    // Write next to the destination and rename, so that readers never map
+    // a partially written index.
+    const std::string tmpFilePath = filePath + ".tmp";
+    FILE* file = ArchOpenFile(tmpFilePath.c_str(), "wb");
+    if (!file) {
+        _SetError(errMsg, TfStringPrintf(
+            "Could not open '%s' for writing", tmpFilePath.c_str()));
+        return false;
+    }
+
+    const bool written =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(entries.data(), sizeof(_Entry), entries.size(), file) ==
+            entries.size() &&
+        fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+    const bool closed = fclose(file) == 0;
+
+    if (!written || !closed || rename(tmpFilePath.c_str(), filePath.c_str()) != 0) {
+        remove(tmpFilePath.c_str());
+        _SetError(errMsg, TfStringPrintf(
+            "Could not write search index '%s'", filePath.c_str()));
+        return false;
+    }
+    return true;
+}
+
+bool
+ReplaceResolverSearchIndex::Build(
+    const std::string& rootDir,
+    const std::string& filePath,
+    std::string* errMsg)
+{
+    if (!TfIsDir(rootDir)) {
+        _SetError(errMsg, TfStringPrintf(
+            "Search root '%s' is not a directory", rootDir.c_str()));
+        return false;
+    }
+
+    std::vector<std::string> relativePaths;
+    std::vector<std::string> pending(1, std::string());
+    while (!pending.empty()) {
+        const std::string relativeDir = std::move(pending.back());
+        pending.pop_back();
+
+        std::vector<std::string> dirNames, fileNames, linkNames;
+        std::string readError;
+        if (!TfReadDir(TfStringCatPaths(rootDir, relativeDir),
+                       &dirNames, &fileNames, &linkNames, &readError)) {
+            _SetError(errMsg, readError);
+            return false;
+        }
+
+        for (const std::string& name : dirNames) {
+            relativePaths.push_back(TfStringCatPaths(relativeDir, name));
+            pending.push_back(relativePaths.back());
+        }
+        for (const std::string& name : fileNames) {
+            relativePaths.push_back(TfStringCatPaths(relativeDir, name));
+        }
+        for (const std::string& name : linkNames) {
+            relativePaths.push_back(TfStringCatPaths(relativeDir, name));
+        }
+    }
+
+    return Write(filePath, std::move(relativePaths), errMsg);
+}
+
+ReplaceResolverSearchIndexConstPtr
+ReplaceResolverSearchIndex::Open(const std::string& filePath, std::string* errMsg)
+{
+    // Many contexts use the same few indices, map each file once while it
+    // is unchanged.
+    static std::mutex mutex;
+    static std::unordered_map<std::string,
+        std::weak_ptr<const ReplaceResolverSearchIndex>> openIndices;
+
+    double modificationTime = 0.0;
+    if (!ArchGetModificationTime(filePath.c_str(), &modificationTime)) {
+        _SetError(errMsg, TfStringPrintf(
+            "Could not open search index '%s'", filePath.c_str()));
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ReplaceResolverSearchIndexConstPtr index = openIndices[filePath].lock();
+    if (index && index->_modificationTime == modificationTime) {
+        return index;
+    }
+
+    FILE* file = ArchOpenFile(filePath.c_str(), "rb");
+    if (!file) {
+        _SetError(errMsg, TfStringPrintf(
+            "Could not open search index '%s'", filePath.c_str()));
+        return nullptr;
+    }
+
+    std::string mapError;
+    ArchConstFileMapping mapping = ArchMapFileReadOnly(file, &mapError);
+    fclose(file);
+    if (!mapping) {
+        _SetError(errMsg, TfStringPrintf(
+            "Could not map search index '%s': %s",
+            filePath.c_str(), mapError.c_str()));
+        return nullptr;
+    }
+
+    // Sizes are checked before they are multiplied or added, so that a
+    // corrupted header cannot wrap around and point past the mapping.
+    const uint64_t size = ArchGetFileMappingLength(mapping);
+    const _Header* header = reinterpret_cast<const _Header*>(mapping.get());
+    const bool isValid =
+        size >= sizeof(_Header) &&
+        memcmp(header->magic, _Magic, sizeof(_Magic)) == 0 &&
+        header->version == _Version &&
+        header->entrySize == sizeof(_Entry) &&
+        header->entriesOffset == sizeof(_Header) &&
+        header->numEntries <= (size - sizeof(_Header)) / sizeof(_Entry) &&
+        header->stringsOffset ==
+            header->entriesOffset + header->numEntries * sizeof(_Entry) &&
+        header->stringsOffset <= size &&
+        header->stringsSize == size - header->stringsOffset;
+    if (!isValid) {
+        _SetError(errMsg, TfStringPrintf(
+            "Invalid search index '%s'", filePath.c_str()));
+        return nullptr;
+    }
+
+    std::shared_ptr<ReplaceResolverSearchIndex> newIndex(
+        new ReplaceResolverSearchIndex());
+    newIndex->_filePath = filePath;
+    newIndex->_modificationTime = modificationTime;
+    newIndex->_header = header;
+    newIndex->_entries = reinterpret_cast<const _Entry*>(
+        mapping.get() + header->entriesOffset);
+    newIndex->_strings = mapping.get() + header->stringsOffset;
+    newIndex->_mapping = std::move(mapping);
+
+    openIndices[filePath] = newIndex;
+    return newIndex;
+}
+
+bool
+ReplaceResolverSearchIndex::Contains(const char* relativePath, size_t size) const
+{
+    size_t begin = 0;
+    size_t end = static_cast<size_t>(_header->numEntries);
+    while (begin < end) {
+        const size_t middle = begin + (end - begin) / 2;
+        const _Entry& entry = _entries[middle];
+
+        // Do not trust offsets read from disk.
+        if (uint64_t(entry.offset) + entry.length > _header->stringsSize) {
+            return false;
+        }
+
+        const int result = _Compare(
+            _strings + entry.offset, entry.length, relativePath, size);
+        if (result == 0) {
+            return true;
+        }
+        if (result < 0) {
+            begin = middle + 1;
+        }
+        else {
+            end = middle;
+        }
+    }
+    return false;
+}
+
+size_t
+ReplaceResolverSearchIndex::GetSize() const
+{
+    return static_cast<size_t>(_header->numEntries);
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,82 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_SEARCH_INDEX_H
+#define USD_REPLACE_RESOLVER_SEARCH_INDEX_H
+
+#include <pxr/pxr.h>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/usd/ar/api.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+class ReplaceResolverSearchIndex;
+using ReplaceResolverSearchIndexConstPtr =
+    std::shared_ptr<const ReplaceResolverSearchIndex>;
+
+/// \class ReplaceResolverSearchIndex
+///
+/// Sorted list of the paths found under a search root, relative to it,
+/// answering existence queries without any filesystem access.
+///
+/// The index file is built offline, typically by the publish tool, and
+/// memory mapped: a query is a binary search in place.
+///
+class ReplaceResolverSearchIndex
+{
+public:
+    /// Write the index of \p relativePaths to \p filePath.
+    AR_API static bool Write(
+        const std::string& filePath,
+        std::vector<std::string> relativePaths,
+        std::string* errMsg = nullptr);
+
+    /// Scan the files, directories and symbolic links under \p rootDir
+    /// and write their index to \p filePath. Symbolic links to
+    /// directories are not followed.
+    AR_API static bool Build(
+        const std::string& rootDir,
+        const std::string& filePath,
+        std::string* errMsg = nullptr);
+
+    /// Map the index file at \p filePath. Contexts using the same
+    /// unchanged file share the mapping. Returns null if the file cannot
+    /// be mapped or is not a valid index.
+    AR_API static ReplaceResolverSearchIndexConstPtr Open(
+        const std::string& filePath,
+        std::string* errMsg = nullptr);
+
+    /// Return true if the normalized \p relativePath is in the index.
+    AR_API bool Contains(const char* relativePath, size_t size) const;
+
+    bool Contains(const std::string& relativePath) const
+    {
+        return Contains(relativePath.data(), relativePath.size());
+    }
+
+    /// Return the number of paths.
+    AR_API size_t GetSize() const;
+
+    const std::string& GetFilePath() const { return _filePath; }
+
+private:
+    struct _Header;
+    struct _Entry;
+
+    ReplaceResolverSearchIndex() = default;
+
+    std::string _filePath;
+    double _modificationTime = 0.0;
+    ArchConstFileMapping _mapping;
+    const _Header* _header = nullptr;
+    const _Entry* _entries = nullptr;
+    const char* _strings = nullptr;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_SEARCH_INDEX_H
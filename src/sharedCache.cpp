@@ -0,0 +1,501 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "sharedCache.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/tf/diagnostic.h>
+#include <pxr/base/tf/stringUtils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "Atomics shared between processes must be lock free");
+
+const char _Magic[8] = {'R', 'R', 'S', 'C', 'A', 'C', 'H', 'E'};
+constexpr uint32_t _Version = 2;
+
+// Slot states, in the low bits of the slot tag. Dead slots were claimed
+// by a writer that could not fill them and may be claimed again.
+constexpr uint64_t _Empty = 0;
+constexpr uint64_t _Writing = 1;
+constexpr uint64_t _Ready = 2;
+constexpr uint64_t _Dead = 3;
+constexpr uint64_t _StateMask = 3;
+
+// Inserts give up after as many occupied slots.
+constexpr size_t _MaxProbes = 32;
+
+// Budget of a slot and its strings, to split the capacity.
+constexpr size_t _BytesPerEntry = 256;
+
+// Invalidation epochs, contexts are spread over them by fingerprint.
+constexpr size_t _NumEpochs = 256;
+
+// Time given to the creator of a segment to initialize it.
+constexpr std::chrono::milliseconds _InitTimeout(1000);
+
+struct _Header
+{
+    char magic[8];
+    uint32_t version;
+    std::atomic<uint32_t> ready;
+    std::atomic<uint32_t> retired;
+    uint32_t reserved;
+    uint64_t size;
+    uint64_t numSlots;
+    uint64_t slotsOffset;
+    uint64_t arenaOffset;
+    uint64_t arenaSize;
+    std::atomic<uint64_t> arenaUsed;
+    std::atomic<uint64_t> numEntries;
+    std::atomic<uint64_t> numFailedInserts;
+    std::atomic<uint64_t> epochs[_NumEpochs];
+};
+
+// The fields are written before the tag is published and never change
+// afterwards.
+struct _Slot
+{
+    std::atomic<uint64_t> tag;
+    uint64_t contextHi;
+    uint64_t contextLo;
+    uint64_t offset;
+    uint32_t pathSize;
+    uint32_t resolvedPathSize;
+};
+
+} // anonymous
+
+class ReplaceResolverSharedCache::_Segment
+{
+public:
+    _Segment(void* data, size_t size)
+        : _data(data)
+        , _size(size)
+        , _header(static_cast<_Header*>(data))
+        , _slots(reinterpret_cast<_Slot*>(
+              static_cast<char*>(data) + _header->slotsOffset))
+        , _arena(static_cast<char*>(data) + _header->arenaOffset)
+        , _mask(_header->numSlots - 1)
+    {
+    }
+
+    ~_Segment()
+    {
+#ifdef __linux__
+        munmap(_data, _size);
+#endif
+    }
+
+    _Header& GetHeader() { return *_header; }
+
+    std::atomic<uint64_t>& GetEpoch(const ReplaceResolverFingerprint& context)
+    {
+        return _header->epochs[context.GetHash() & (_NumEpochs - 1)];
+    }
+
+    bool Find(
+        const ReplaceResolverFingerprint& context,
+        const std::string& path,
+        const ReplaceResolverFingerprint& key,
+        std::string* resolvedPath) const;
+
+    bool Insert(
+        const ReplaceResolverFingerprint& context,
+        const std::string& path,
+        const std::string& resolvedPath,
+        const ReplaceResolverFingerprint& key);
+
+private:
+    bool _Matches(
+        const _Slot& slot,
+        const ReplaceResolverFingerprint& context,
+        const std::string& path) const;
+
+    void* _data;
+    size_t _size;
+    _Header* _header;
+    _Slot* _slots;
+    char* _arena;
+    uint64_t _mask;
+};
+
+namespace {
+
+ReplaceResolverFingerprint
+_GetKey(const ReplaceResolverFingerprint& context, const std::string& path)
+{
+    ReplaceResolverFingerprinter fingerprinter;
+    fingerprinter.Append(context);
+    fingerprinter.Append(path);
+    return fingerprinter.Get();
+}
+
+uint64_t
+_GetTag(const ReplaceResolverFingerprint& key, uint64_t state)
+{
+    // A tag is never empty, whatever the key.
+    return ((key.lo & ~_StateMask) | (_StateMask + 1)) | state;
+}
+
+} // anonymous
+
+bool
+ReplaceResolverSharedCache::_Segment::_Matches(
+    const _Slot& slot,
+    const ReplaceResolverFingerprint& context,
+    const std::string& path) const
+{
+    // Do not trust offsets read from memory other processes write.
+    return slot.contextHi == context.hi &&
+        slot.contextLo == context.lo &&
+        slot.pathSize == path.size() &&
+        slot.offset <= _header->arenaSize &&
+        slot.offset + slot.pathSize + slot.resolvedPathSize <=
+            _header->arenaSize &&
+        memcmp(_arena + slot.offset, path.data(), path.size()) == 0;
+}
+
+bool
+ReplaceResolverSharedCache::_Segment::Find(
+    const ReplaceResolverFingerprint& context,
+    const std::string& path,
+    const ReplaceResolverFingerprint& key,
+    std::string* resolvedPath) const
+{
+    const uint64_t readyTag = _GetTag(key, _Ready);
+    for (uint64_t i = 0; i < _MaxProbes && i <= _mask; ++i) {
+        const _Slot& slot = _slots[(key.hi + i) & _mask];
+        const uint64_t tag = slot.tag.load(std::memory_order_acquire);
+        if (tag == _Empty) {
+            return false;
+        }
+        if (tag == readyTag && _Matches(slot, context, path)) {
+            resolvedPath->assign(
+                _arena + slot.offset + slot.pathSize, slot.resolvedPathSize);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+ReplaceResolverSharedCache::_Segment::Insert(
+    const ReplaceResolverFingerprint& context,
+    const std::string& path,
+    const std::string& resolvedPath,
+    const ReplaceResolverFingerprint& key)
+{
+    const uint64_t writingTag = _GetTag(key, _Writing);
+    const uint64_t readyTag = _GetTag(key, _Ready);
+
+    _Slot* claimed = nullptr;
+    for (uint64_t i = 0; i < _MaxProbes && i <= _mask && !claimed; ) {
+        _Slot& slot = _slots[(key.hi + i) & _mask];
+        uint64_t tag = slot.tag.load(std::memory_order_acquire);
+        if (tag == readyTag && _Matches(slot, context, path)) {
+            // Another process resolved it meanwhile.
+            return true;
+        }
+        if (tag == _Empty || (tag & _StateMask) == _Dead) {
+            if (slot.tag.compare_exchange_strong(
+                    tag, writingTag, std::memory_order_acquire)) {
+                claimed = &slot;
+            }
+            // Look at the slot again if another writer took it.
+            continue;
+        }
+        ++i;
+    }
+    if (!claimed) {
+        _header->numFailedInserts.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // The arena only grows, published strings are never overwritten.
+    const uint64_t size = path.size() + resolvedPath.size();
+    const uint64_t offset =
+        _header->arenaUsed.fetch_add(size, std::memory_order_relaxed);
+    if (path.size() > UINT32_MAX || resolvedPath.size() > UINT32_MAX ||
+        offset + size > _header->arenaSize) {
+        claimed->tag.store(_GetTag(key, _Dead), std::memory_order_release);
+        _header->numFailedInserts.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    memcpy(_arena + offset, path.data(), path.size());
+    memcpy(_arena + offset + path.size(), resolvedPath.data(),
+           resolvedPath.size());
+    claimed->contextHi = context.hi;
+    claimed->contextLo = context.lo;
+    claimed->offset = offset;
+    claimed->pathSize = static_cast<uint32_t>(path.size());
+    claimed->resolvedPathSize = static_cast<uint32_t>(resolvedPath.size());
+    claimed->tag.store(readyTag, std::memory_order_release);
+
+    _header->numEntries.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+ReplaceResolverSharedCache::ReplaceResolverSharedCache(
+    const std::string& name,
+    size_t capacity)
+    : _name(TfStringStartsWith(name, "/") ? name : "/" + name)
+    , _capacity(capacity)
+{
+    std::atomic_store(&_segment, _OpenSegment());
+}
+
+ReplaceResolverSharedCache::~ReplaceResolverSharedCache() = default;
+
+std::string
+ReplaceResolverSharedCache::GetDefaultName()
+{
+#ifdef __linux__
+    return TfStringPrintf("/rdoReplaceResolver.%u", getuid());
+#else
+    return "/rdoReplaceResolver";
+#endif
+}
+
+ReplaceResolverSharedCache::_SegmentPtr
+ReplaceResolverSharedCache::_OpenSegment()
+{
+#ifdef __linux__
+    // Slots are a power of two, the rest of the capacity holds the
+    // strings.
+    uint64_t numSlots = 1024;
+    while (numSlots * 2 * _BytesPerEntry <= _capacity) {
+        numSlots *= 2;
+    }
+    const uint64_t slotsOffset = (sizeof(_Header) + 63) & ~uint64_t(63);
+    const uint64_t arenaOffset = slotsOffset + numSlots * sizeof(_Slot);
+    const uint64_t size = std::max<uint64_t>(
+        _capacity, arenaOffset + numSlots * (_BytesPerEntry - sizeof(_Slot)));
+
+    // The creator may have died before initializing the segment, it is
+    // then replaced once.
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        int fd = shm_open(_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0) {
+            void* data = MAP_FAILED;
+            if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+                data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, fd, 0);
+            }
+            close(fd);
+            if (data == MAP_FAILED) {
+                TF_WARN("Could not create the shared resolve cache '%s': %s",
+                        _name.c_str(), strerror(errno));
+                shm_unlink(_name.c_str());
+                return nullptr;
+            }
+
+            // The segment is zero filled, all slots are empty.
+            _Header* header = new (data) _Header();
+            memcpy(header->magic, _Magic, sizeof(_Magic));
+            header->version = _Version;
+            header->size = size;
+            header->numSlots = numSlots;
+            header->slotsOffset = slotsOffset;
+            header->arenaOffset = arenaOffset;
+            header->arenaSize = size - arenaOffset;
+            header->ready.store(1, std::memory_order_release);
+            return std::make_shared<_Segment>(data, size);
+        }
+        if (errno != EEXIST) {
+            break;
+        }
+
+        fd = shm_open(_name.c_str(), O_RDWR, 0);
+        if (fd < 0) {
+            if (errno == ENOENT) {
+                // Retired meanwhile.
+                continue;
+            }
+            break;
+        }
+
+        // Resolved paths are trusted as they are read, only a segment
+        // the user alone can write is used.
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_uid != geteuid() ||
+            (st.st_mode & (S_IRWXG | S_IRWXO)) != 0) {
+            close(fd);
+            TF_WARN("The shared resolve cache '%s' is not private to the "
+                    "user, it is not used", _name.c_str());
+            return nullptr;
+        }
+
+        // Wait for the creator to size and initialize the segment.
+        const auto deadline = std::chrono::steady_clock::now() + _InitTimeout;
+        void* data = MAP_FAILED;
+        size_t mappedSize = 0;
+        bool ready = false;
+        while (std::chrono::steady_clock::now() < deadline) {
+            if (data == MAP_FAILED) {
+                if (fstat(fd, &st) == 0 &&
+                    static_cast<size_t>(st.st_size) >= sizeof(_Header)) {
+                    mappedSize = static_cast<size_t>(st.st_size);
+                    data = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE,
+                                MAP_SHARED, fd, 0);
+                }
+            }
+            if (data != MAP_FAILED &&
+                static_cast<_Header*>(data)->ready.load(
+                    std::memory_order_acquire)) {
+                ready = true;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        close(fd);
+
+        if (!ready) {
+            if (data != MAP_FAILED) {
+                munmap(data, mappedSize);
+            }
+            shm_unlink(_name.c_str());
+            continue;
+        }
+
+        const _Header* header = static_cast<const _Header*>(data);
+        const bool isValid =
+            memcmp(header->magic, _Magic, sizeof(_Magic)) == 0 &&
+            header->version == _Version &&
+            header->size == mappedSize &&
+            header->numSlots > 0 &&
+            (header->numSlots & (header->numSlots - 1)) == 0 &&
+            header->slotsOffset >= sizeof(_Header) &&
+            header->arenaOffset ==
+                header->slotsOffset + header->numSlots * sizeof(_Slot) &&
+            header->arenaOffset + header->arenaSize == mappedSize;
+        if (!isValid) {
+            munmap(data, mappedSize);
+            TF_WARN("The shared resolve cache '%s' was created by another "
+                    "version of the resolver", _name.c_str());
+            return nullptr;
+        }
+        return std::make_shared<_Segment>(data, mappedSize);
+    }
+
+    TF_WARN("Could not open the shared resolve cache '%s': %s",
+            _name.c_str(), strerror(errno));
+#endif
+    return nullptr;
+}
+
+ReplaceResolverSharedCache::_SegmentPtr
+ReplaceResolverSharedCache::_GetSegment()
+{
+    _SegmentPtr segment = std::atomic_load(&_segment);
+    if (!segment ||
+        !segment->GetHeader().retired.load(std::memory_order_acquire)) {
+        return segment;
+    }
+
+    std::lock_guard<std::mutex> lock(_openMutex);
+    segment = std::atomic_load(&_segment);
+    if (segment && segment->GetHeader().retired.load(std::memory_order_acquire)) {
+        segment = _OpenSegment();
+        std::atomic_store(&_segment, segment);
+    }
+    return segment;
+}
+
+bool
+ReplaceResolverSharedCache::IsValid() const
+{
+    return static_cast<bool>(std::atomic_load(&_segment));
+}
+
+bool
+ReplaceResolverSharedCache::Find(
+    const ReplaceResolverFingerprint& context,
+    const std::string& path,
+    std::string* resolvedPath)
+{
+    const _SegmentPtr segment = _GetSegment();
+    return segment &&
+        segment->Find(context, path, _GetKey(context, path), resolvedPath);
+}
+
+void
+ReplaceResolverSharedCache::Insert(
+    const ReplaceResolverFingerprint& context,
+    const std::string& path,
+    const std::string& resolvedPath)
+{
+    if (const _SegmentPtr segment = _GetSegment()) {
+        segment->Insert(context, path, resolvedPath, _GetKey(context, path));
+    }
+}
+
+uint64_t
+ReplaceResolverSharedCache::GetEpoch(const ReplaceResolverFingerprint& context)
+{
+    const _SegmentPtr segment = _GetSegment();
+    return segment
+        ? segment->GetEpoch(context).load(std::memory_order_acquire) : 0;
+}
+
+void
+ReplaceResolverSharedCache::Invalidate(
+    const ReplaceResolverFingerprint& context)
+{
+    if (const _SegmentPtr segment = _GetSegment()) {
+        segment->GetEpoch(context).fetch_add(1, std::memory_order_release);
+    }
+}
+
+void
+ReplaceResolverSharedCache::Clear()
+{
+#ifdef __linux__
+    const _SegmentPtr segment = _GetSegment();
+    if (!segment) {
+        return;
+    }
+
+    // Only the process retiring the segment unlinks it, so that a segment
+    // created meanwhile by another one is kept.
+    uint32_t retired = 0;
+    if (segment->GetHeader().retired.compare_exchange_strong(retired, 1)) {
+        shm_unlink(_name.c_str());
+    }
+#endif
+}
+
+ReplaceResolverSharedCache::Counters
+ReplaceResolverSharedCache::GetCounters()
+{
+    Counters counters;
+    if (const _SegmentPtr segment = _GetSegment()) {
+        _Header& header = segment->GetHeader();
+        counters.capacity = static_cast<size_t>(header.size);
+        counters.entries = static_cast<size_t>(header.numEntries.load());
+        counters.bytesUsed = static_cast<size_t>(std::min(
+            header.arenaUsed.load(), header.arenaSize));
+        counters.failedInserts =
+            static_cast<size_t>(header.numFailedInserts.load());
+    }
+    return counters;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
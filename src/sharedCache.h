@@ -0,0 +1,120 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_SHARED_CACHE_H
+#define USD_REPLACE_RESOLVER_SHARED_CACHE_H
+
+#include "fingerprint.h"
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplaceResolverSharedCache
+///
+/// Cache of resolved paths shared by the processes of a host through a
+/// POSIX shared memory segment, so that the first process resolving a path
+/// pays for the stat calls and the others find it.
+///
+/// The segment holds an open addressed table keyed by context fingerprint
+/// and asset path, and an arena for the strings. Entries are claimed and
+/// published with atomic operations on their slot and are never modified
+/// afterwards: readers do not lock, and an entry whose writer died before
+/// publishing it is skipped.
+///
+/// Clear retires the segment and unlinks it: every process moves to a new
+/// empty segment the next time it uses the cache, and the old one is
+/// released once unmapped everywhere. A segment whose arena is full stops
+/// taking entries until it is cleared.
+///
+/// The entries of a context are dropped by bumping its epoch in the
+/// segment, which callers fold in the fingerprint they look entries up
+/// with. Their slots and strings are only reclaimed by Clear.
+///
+/// A segment is only attached if it is owned by the effective user and
+/// nobody else may access it.
+///
+/// Shared memory is only supported on Linux, elsewhere IsValid returns
+/// false.
+///
+class ReplaceResolverSharedCache
+{
+public:
+    struct Counters
+    {
+        size_t capacity = 0;
+        size_t entries = 0;
+        size_t bytesUsed = 0;
+        // Entries not inserted because the table or the arena was full.
+        size_t failedInserts = 0;
+    };
+
+    /// Open the segment \p name, creating it with \p capacity bytes if it
+    /// does not exist. A segment created by another process keeps its own
+    /// capacity.
+    AR_API ReplaceResolverSharedCache(const std::string& name, size_t capacity);
+
+    AR_API ~ReplaceResolverSharedCache();
+
+    ReplaceResolverSharedCache(const ReplaceResolverSharedCache&) = delete;
+    ReplaceResolverSharedCache& operator=(
+        const ReplaceResolverSharedCache&) = delete;
+
+    /// Return false if the segment could not be opened.
+    AR_API bool IsValid() const;
+
+    /// Return true and set \p resolvedPath if \p path was resolved with
+    /// the context having the \p context fingerprint.
+    AR_API bool Find(
+        const ReplaceResolverFingerprint& context,
+        const std::string& path,
+        std::string* resolvedPath);
+
+    AR_API void Insert(
+        const ReplaceResolverFingerprint& context,
+        const std::string& path,
+        const std::string& resolvedPath);
+
+    /// Return the epoch of the entries resolved with the context having
+    /// the \p context fingerprint.
+    AR_API uint64_t GetEpoch(const ReplaceResolverFingerprint& context);
+
+    /// Drop the entries resolved with the context having the \p context
+    /// fingerprint, for all the processes. The entries of a few other
+    /// contexts may be dropped too.
+    AR_API void Invalidate(const ReplaceResolverFingerprint& context);
+
+    /// Drop all entries, for all the processes.
+    AR_API void Clear();
+
+    AR_API Counters GetCounters();
+
+    const std::string& GetName() const { return _name; }
+
+    /// Return the default segment name, private to the user.
+    AR_API static std::string GetDefaultName();
+
+private:
+    class _Segment;
+    using _SegmentPtr = std::shared_ptr<_Segment>;
+
+    // Return the current segment, moving to a new one when it was retired.
+    _SegmentPtr _GetSegment();
+    _SegmentPtr _OpenSegment();
+
+    const std::string _name;
+    const size_t _capacity;
+
+    // Only accessed through std::atomic_load/std::atomic_store.
+    _SegmentPtr _segment;
+    std::mutex _openMutex;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_SHARED_CACHE_H
@@ -0,0 +1,164 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "debugCodes.h"
+#include "sidecarCache.h"
+#include "stats.h"
+#include "tokens.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/js/json.h>
+#include <pxr/base/tf/diagnostic.h>
+#include <pxr/base/tf/pathUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <utility>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+bool
+ReplaceResolverSidecarCache::ReadPairs(
+    const std::string& filePath,
+    ReplaceRuleTable::PairMap* pairs,
+    std::string* errMsg)
+{
+    std::ifstream ifs(filePath);
+    if (!ifs) {
+        if (errMsg) {
+            *errMsg = TfStringPrintf("Could not open '%s'", filePath.c_str());
+        }
+        return false;
+    }
+
+    JsParseError error;
+    const JsValue value = JsParseStream(ifs, &error);
+    ifs.close();
+
+    if (value.IsNull() || !value.IsArray()) {
+        if (errMsg) {
+            *errMsg = TfStringPrintf(
+                "parse error at %s:%d:%d: %s", filePath.c_str(),
+                error.line, error.column, error.reason.c_str());
+        }
+        return false;
+    }
+
+    // The first pair of an old string wins, as with AddReplacePair.
+    for (const auto& pair : value.GetJsArray()) {
+        if (pair.IsArray() && pair.GetJsArray().size() >= 2) {
+            pairs->emplace(
+                pair.GetJsArray()[0].GetString(),
+                pair.GetJsArray()[1].GetString());
+        }
+    }
+    return true;
+}
+
+ReplaceResolverSidecarCache::_Stamp
+ReplaceResolverSidecarCache::_GetStamp(const std::string& filePath)
+{
+    _Stamp stamp;
+    stamp.exists =
+        ArchGetModificationTime(filePath.c_str(), &stamp.modificationTime);
+    if (stamp.exists) {
+        stamp.size = ArchGetFileLength(filePath.c_str());
+    }
+    return stamp;
+}
+
+ReplaceRuleTableConstPtr
+ReplaceResolverSidecarCache::_Parse(const std::string& filePath)
+{
+    TF_DEBUG(REPLACERESOLVER_REPLACE).Msg("Replace file found: \"%s\"\n",
+                                        filePath.c_str());
+
+    ReplaceRuleTable::PairMap pairs;
+    std::string errMsg;
+    if (!ReadPairs(filePath, &pairs, &errMsg)) {
+        fprintf(stderr, "Error: %s\n", errMsg.c_str());
+        return nullptr;
+    }
+
+    if (pairs.empty()) {
+        return nullptr;
+    }
+    return std::make_shared<const ReplaceRuleTable>(std::move(pairs));
+}
+
+ReplaceRuleTableConstPtr
+ReplaceResolverSidecarCache::Get(const std::string& directory)
+{
+    const std::string filePath = TfNormPath(
+        TfStringCatPaths(directory, ReplaceResolverTokens->replaceFileName));
+    const std::string tableFilePath = TfNormPath(
+        TfStringCatPaths(directory, ReplaceResolverTokens->replaceTableFileName));
+
+    _Entry current;
+    current.json = _GetStamp(filePath);
+    current.table = _GetStamp(tableFilePath);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _entries.find(directory);
+        if (it != _entries.end() &&
+            it->second.json == current.json &&
+            it->second.table == current.table) {
+            return it->second.rules;
+        }
+    }
+
+    // Parsed outside of the lock, concurrent callers may parse the same
+    // file, the last one wins.
+    if (current.json.exists) {
+        ReplaceResolverStats::GetInstance().Increment(
+            ReplaceResolverStats::SidecarParses);
+        current.rules = _Parse(filePath);
+    }
+
+    if (current.table.exists) {
+        TF_DEBUG(REPLACERESOLVER_REPLACE).Msg(
+            "Replace table found: \"%s\"\n", tableFilePath.c_str());
+        std::string errMsg;
+        const ReplaceTableFileConstPtr table =
+            ReplaceTableFile::Open(tableFilePath, &errMsg);
+        if (!table) {
+            TF_WARN("Ignoring replace table: %s", errMsg.c_str());
+        }
+        else if (table->GetSize() > 0) {
+            current.rules = ReplaceRuleTable::SetPairsFile(
+                std::move(current.rules), table);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries[directory] = current;
+    return current.rules;
+}
+
+void
+ReplaceResolverSidecarCache::Invalidate(const std::string& directory)
+{
+    // Directories are keyed as TfGetPathName returns them.
+    const std::string trimmed = TfStringTrimRight(directory, "/");
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto it = _entries.begin(); it != _entries.end(); ) {
+        if (TfStringTrimRight(it->first, "/") == trimmed) {
+            it = _entries.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void
+ReplaceResolverSidecarCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
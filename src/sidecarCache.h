@@ -0,0 +1,85 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_SIDECAR_CACHE_H
+#define USD_REPLACE_RESOLVER_SIDECAR_CACHE_H
+
+#include "replaceRuleTable.h"
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplaceResolverSidecarCache
+///
+/// Cache of the replace rules read from the "replace.json" sidecar files,
+/// keyed by directory.
+///
+/// A sidecar is parsed again only when its modification time or size
+/// changed, so opening many layers of a directory parses it once. A binary
+/// "replace.table" sidecar, see ReplaceTableFile, is mapped with it and its
+/// pairs used in addition to those of the JSON sidecar.
+///
+class ReplaceResolverSidecarCache
+{
+public:
+    ReplaceResolverSidecarCache() = default;
+
+    ReplaceResolverSidecarCache(const ReplaceResolverSidecarCache&) = delete;
+    ReplaceResolverSidecarCache& operator=(
+        const ReplaceResolverSidecarCache&) = delete;
+
+    /// Return the rules of the sidecar file in \p directory, or null if
+    /// there is no sidecar or it has no pairs.
+    AR_API ReplaceRuleTableConstPtr Get(const std::string& directory);
+
+    /// Read the pairs of the JSON sidecar file at \p filePath into
+    /// \p pairs. The first pair of an old string wins.
+    AR_API static bool ReadPairs(
+        const std::string& filePath,
+        ReplaceRuleTable::PairMap* pairs,
+        std::string* errMsg = nullptr);
+
+    /// Forget the sidecar of \p directory, after it changed.
+    AR_API void Invalidate(const std::string& directory);
+
+    /// Forget all sidecars.
+    AR_API void Clear();
+
+private:
+    struct _Stamp
+    {
+        bool exists = false;
+        double modificationTime = 0.0;
+        int64_t size = 0;
+
+        bool operator==(const _Stamp& rhs) const
+        {
+            return exists == rhs.exists &&
+                modificationTime == rhs.modificationTime &&
+                size == rhs.size;
+        }
+    };
+
+    struct _Entry
+    {
+        _Stamp json;
+        _Stamp table;
+        ReplaceRuleTableConstPtr rules;
+    };
+
+    static _Stamp _GetStamp(const std::string& filePath);
+    static ReplaceRuleTableConstPtr _Parse(const std::string& filePath);
+
+    std::mutex _mutex;
+    std::unordered_map<std::string, _Entry> _entries;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_SIDECAR_CACHE_H
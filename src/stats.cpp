@@ -0,0 +1,240 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "debugCodes.h"
+#include "stats.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/js/json.h>
+#include <pxr/base/tf/getenv.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+constexpr size_t ReplaceResolverStats::_NumBuckets;
+constexpr size_t ReplaceResolverStats::_MaxSlowResolves;
+
+namespace {
+
+const char* const _CounterNames[] = {
+    "resolves",
+    "threadCacheHits",
+    "scopedCacheHits",
+    "resolveCacheHits",
+    "resolveCacheMisses",
+    "sharedCacheHits",
+    "sharedCacheMisses",
+    "daemonResolves",
+    "daemonFallbacks",
+    "manifestHits",
+    "replaceHits",
+    "sidecarParses",
+    "metadataReads",
+    "fullLayerReads",
+    "searchIndexHits",
+    "searchIndexMisses",
+    "watchedChanges",
+    "slowResolves"
+};
+
+static_assert(sizeof(_CounterNames) / sizeof(_CounterNames[0]) ==
+              ReplaceResolverStats::NumCounters,
+              "Missing counter name");
+
+void
+_DumpAtExit()
+{
+    ReplaceResolverStats::GetInstance().Dump(
+        TfGetenv("REPLACE_RESOLVER_STATS_DUMP"));
+}
+
+} // anonymous
+
+ReplaceResolverStats&
+ReplaceResolverStats::GetInstance()
+{
+    // Never destroyed, so that it can be dumped at exit.
+    static ReplaceResolverStats* instance = []() {
+        ReplaceResolverStats* stats = new ReplaceResolverStats();
+        if (!TfGetenv("REPLACE_RESOLVER_STATS_DUMP").empty()) {
+            std::atexit(_DumpAtExit);
+        }
+        return stats;
+    }();
+    return *instance;
+}
+
+ReplaceResolverStats::ReplaceResolverStats()
+    : _latencyTotalNs(0)
+{
+    for (auto& counter : _counters) {
+        counter = 0;
+    }
+    for (auto& bucket : _latencyBuckets) {
+        bucket = 0;
+    }
+
+    const double slowThresholdMs =
+        TfGetenvDouble("REPLACE_RESOLVER_SLOW_RESOLVE_MS", 100.0);
+    _slowThreshold = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double, std::milli>(slowThresholdMs));
+}
+
+void
+ReplaceResolverStats::AddStatCall(const std::string& searchPath)
+{
+    // Each thread keeps the counters of the search paths it probed, only
+    // its first stat call under a search path locks.
+    thread_local std::unordered_map<std::string, std::atomic<uint64_t>*>
+        counters;
+    std::atomic<uint64_t>*& counter = counters[searchPath];
+    if (!counter) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        counter = &_statCalls[searchPath];
+    }
+    counter->fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+ReplaceResolverStats::AddResolve(
+    const std::string& path,
+    std::chrono::steady_clock::duration latency)
+{
+    Increment(Resolves);
+
+    const uint64_t ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+    size_t bucket = 0;
+    while (bucket + 1 < _NumBuckets && (ns >> (bucket + 1)) != 0) {
+        ++bucket;
+    }
+    _latencyBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    _latencyTotalNs.fetch_add(ns, std::memory_order_relaxed);
+
+    if (_slowThreshold.count() > 0 && latency >= _slowThreshold) {
+        Increment(SlowResolves);
+
+        const double ms = ns / 1.0e6;
+        TF_DEBUG(REPLACERESOLVER_PATH).Msg("Slow resolve of \"%s\": %.3f ms\n",
+                                          path.c_str(), ms);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _slowResolves.emplace_back(path, ms);
+        if (_slowResolves.size() > _MaxSlowResolves) {
+            _slowResolves.pop_front();
+        }
+    }
+}
+
+JsObject
+ReplaceResolverStats::GetAsJson() const
+{
+    JsObject result;
+    for (size_t i = 0; i < NumCounters; ++i) {
+        result[_CounterNames[i]] = JsValue(_counters[i].load());
+    }
+
+    // Latencies, with percentiles approximated by bucket upper bounds.
+    uint64_t buckets[_NumBuckets];
+    uint64_t total = 0;
+    for (size_t i = 0; i < _NumBuckets; ++i) {
+        buckets[i] = _latencyBuckets[i].load();
+        total += buckets[i];
+    }
+
+    JsObject latency;
+    JsArray histogram;
+    for (size_t i = 0; i < _NumBuckets; ++i) {
+        if (buckets[i] != 0) {
+            JsObject bucket;
+            bucket["maxNs"] = JsValue(uint64_t(1) << (i + 1));
+            bucket["count"] = JsValue(buckets[i]);
+            histogram.push_back(JsValue(bucket));
+        }
+    }
+    latency["histogram"] = JsValue(histogram);
+    latency["meanNs"] = JsValue(
+        total ? static_cast<double>(_latencyTotalNs.load()) / total : 0.0);
+
+    const std::pair<const char*, double> percentiles[] = {
+        {"p50Ns", 0.5}, {"p90Ns", 0.9}, {"p99Ns", 0.99}
+    };
+    for (const auto& percentile : percentiles) {
+        uint64_t count = 0;
+        uint64_t value = 0;
+        for (size_t i = 0; i < _NumBuckets && total != 0; ++i) {
+            count += buckets[i];
+            if (count >= percentile.second * total) {
+                value = uint64_t(1) << (i + 1);
+                break;
+            }
+        }
+        latency[percentile.first] = JsValue(value);
+    }
+    result["latency"] = JsValue(latency);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    JsObject statCalls;
+    for (const auto& statCall : _statCalls) {
+        const uint64_t count = statCall.second.load(std::memory_order_relaxed);
+        if (count > 0) {
+            statCalls[statCall.first.empty() ? "<absolute>" : statCall.first] =
+                JsValue(count);
+        }
+    }
+    result["statCalls"] = JsValue(statCalls);
+
+    JsArray slowResolves;
+    for (const auto& slowResolve : _slowResolves) {
+        JsObject entry;
+        entry["path"] = JsValue(slowResolve.first);
+        entry["ms"] = JsValue(slowResolve.second);
+        slowResolves.push_back(JsValue(entry));
+    }
+    result["slowResolves"] = JsValue(slowResolves);
+
+    return result;
+}
+
+void
+ReplaceResolverStats::Reset()
+{
+    for (auto& counter : _counters) {
+        counter = 0;
+    }
+    for (auto& bucket : _latencyBuckets) {
+        bucket = 0;
+    }
+    _latencyTotalNs = 0;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& statCall : _statCalls) {
+        statCall.second = 0;
+    }
+    _slowResolves.clear();
+}
+
+void
+ReplaceResolverStats::Dump(const std::string& filePath) const
+{
+    const JsValue stats(GetAsJson());
+
+    if (filePath.empty() || filePath == "1" || filePath == "stderr") {
+        JsWriteToStream(stats, std::cerr);
+        std::cerr << std::endl;
+        return;
+    }
+
+    std::ofstream ofs(filePath.c_str());
+    if (!ofs) {
+        fprintf(stderr, "Error: could not write resolver stats to %s\n",
+                filePath.c_str());
+        return;
+    }
+    JsWriteToStream(stats, ofs);
+    ofs << std::endl;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
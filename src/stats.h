@@ -0,0 +1,100 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_STATS_H
+#define USD_REPLACE_RESOLVER_STATS_H
+
+#include <pxr/pxr.h>
+#include <pxr/base/js/value.h>
+#include <pxr/usd/ar/api.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplaceResolverStats
+///
+/// Process wide, always on resolver counters and resolve latency histogram.
+///
+/// Counters are relaxed atomics, cheap enough to stay enabled in production.
+/// Resolves slower than REPLACE_RESOLVER_SLOW_RESOLVE_MS milliseconds are
+/// remembered. When REPLACE_RESOLVER_STATS_DUMP is set, the stats are
+/// written at exit to stderr, or to the file it names.
+///
+class ReplaceResolverStats
+{
+public:
+    enum Counter {
+        Resolves,
+        ThreadCacheHits,
+        ScopedCacheHits,
+        ResolveCacheHits,
+        ResolveCacheMisses,
+        SharedCacheHits,
+        SharedCacheMisses,
+        DaemonResolves,
+        DaemonFallbacks,
+        ManifestHits,
+        ReplaceHits,
+        SidecarParses,
+        MetadataReads,
+        FullLayerReads,
+        SearchIndexHits,
+        SearchIndexMisses,
+        WatchedChanges,
+        SlowResolves,
+        NumCounters
+    };
+
+    AR_API static ReplaceResolverStats& GetInstance();
+
+    void Increment(Counter counter, uint64_t count = 1)
+    {
+        _counters[counter].fetch_add(count, std::memory_order_relaxed);
+    }
+
+    /// Count a stat call made under the \p searchPath directory, or for an
+    /// absolute path if \p searchPath is empty.
+    AR_API void AddStatCall(const std::string& searchPath);
+
+    /// Record the latency of a resolve of \p path.
+    AR_API void AddResolve(
+        const std::string& path,
+        std::chrono::steady_clock::duration latency);
+
+    /// Return the stats as a JSON object.
+    AR_API JsObject GetAsJson() const;
+
+    AR_API void Reset();
+
+    /// Write the stats as JSON to stderr, or to the file at \p filePath.
+    AR_API void Dump(const std::string& filePath) const;
+
+private:
+    ReplaceResolverStats();
+
+    // Bucket i counts latencies in [2^i, 2^(i+1)) nanoseconds.
+    static constexpr size_t _NumBuckets = 40;
+    static constexpr size_t _MaxSlowResolves = 32;
+
+    std::atomic<uint64_t> _counters[NumCounters];
+    std::atomic<uint64_t> _latencyBuckets[_NumBuckets];
+    std::atomic<uint64_t> _latencyTotalNs;
+
+    std::chrono::steady_clock::duration _slowThreshold;
+
+    mutable std::mutex _mutex;
+    // Counters are never removed, threads keep pointers to them and count
+    // without locking. Map nodes do not move.
+    std::unordered_map<std::string, std::atomic<uint64_t>> _statCalls;
+    // Most recent last.
+    std::deque<std::pair<std::string, double>> _slowResolves;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_STATS_H
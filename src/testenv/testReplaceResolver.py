@@ -3,10 +3,15 @@
 import os
 import unittest
 import shutil
+import subprocess
+import sys
+import tempfile
+import time
 
 from pxr import Ar
 from pxr import Kind
 from pxr import Sdf
+from pxr import Tf
 from pxr import Usd
 from pxr import Vt
 
@@ -172,6 +177,26 @@ class TestReplaceResolver(unittest.TestCase):
             TestReplaceResolver.componentRepo,
         )
 
+    def test_ContextEquality(self):
+        """ Contexts with the same number of different pairs are different """
+        searchPath = [os.path.abspath(TestReplaceResolver.rootDir)]
+        context1 = ReplaceResolver.ReplaceResolverContext(searchPath)
+        context2 = ReplaceResolver.ReplaceResolverContext(searchPath)
+        self.assertEqual(context1, context2)
+        self.assertEqual(hash(context1), hash(context2))
+        self.assertEqual(context1.GetFingerprint(), context2.GetFingerprint())
+
+        context1.AddReplacePair("component/c/v1/c.usda", "component/c/v2/c.usda")
+        context2.AddReplacePair("assembly/b/v1/b.usda", "assembly/b/v2/b.usda")
+        self.assertNotEqual(context1, context2)
+        self.assertNotEqual(context1.GetFingerprint(), context2.GetFingerprint())
+
+        # Pairs are a set, the order they are added in does not matter
+        context1.AddReplacePair("assembly/b/v1/b.usda", "assembly/b/v2/b.usda")
+        context2.AddReplacePair("component/c/v1/c.usda", "component/c/v2/c.usda")
+        self.assertEqual(context1, context2)
+        self.assertEqual(hash(context1), hash(context2))
+
     def test_ResolveWithContext(self):
         context = ReplaceResolver.ReplaceResolverContext(
             [os.path.abspath(TestReplaceResolver.rootDir)]
@@ -195,6 +220,1251 @@ class TestReplaceResolver(unittest.TestCase):
                     TestReplaceResolver.rootDir, "assembly/b/v2/b.usda"))
             )
 
+    def test_RefreshContext(self):
+        """ Resolved paths are cached until the context is refreshed """
+        context = ReplaceResolver.ReplaceResolverContext(
+            [os.path.abspath(TestReplaceResolver.rootDir)]
+        )
+        filePath = os.path.abspath(
+            os.path.join(TestReplaceResolver.rootDir, "test_RefreshContext.txt")
+        )
+        with open(filePath, "w") as ofp:
+            ofp.write("Garbage")
+
+        resolver = Ar.GetResolver()
+        with Ar.ResolverContextBinder(context):
+            self.assertPathsEqual(resolver.Resolve("test_RefreshContext.txt"), filePath)
+
+            os.remove(filePath)
+            self.assertPathsEqual(resolver.Resolve("test_RefreshContext.txt"), filePath)
+
+            resolver.RefreshContext(context)
+            self.assertPathsEqual(resolver.Resolve("test_RefreshContext.txt"), "")
+
+    def test_RefreshContextRules(self):
+        """ Refreshing a context created for an asset reloads its rules """
+        import json
+
+        rootDir = os.path.abspath(TestReplaceResolver.rootDir)
+        assetDir = os.path.join(rootDir, "test_RefreshContextRules")
+        os.makedirs(assetDir)
+        layerPath = os.path.join(assetDir, "shot.usda")
+        Sdf.Layer.CreateNew(layerPath).Save()
+        jsonFilePath = os.path.join(assetDir, ReplaceResolver.Tokens.replaceFileName)
+        with open(jsonFilePath, "w") as outfile:
+            json.dump([["component/c/v1/c.usda", "component/c/v2/c.usda"]], outfile)
+
+        os.environ["PXR_AR_DEFAULT_SEARCH_PATH"] = rootDir
+        resolver = Ar.GetResolver()
+        replaceResolver = Ar.GetUnderlyingResolver()
+        context = resolver.CreateDefaultContextForAsset(layerPath)
+        self.assertEqual(context.GetAssetPath(), layerPath)
+
+        with Ar.ResolverContextBinder(context):
+            self.assertPathsEqual(
+                resolver.Resolve("component/c/v1/c.usda"),
+                os.path.join(rootDir, "component/c/v2/c.usda"),
+            )
+            self.assertPathsEqual(
+                resolver.Resolve("assembly/a/v1/a.usda"),
+                os.path.join(rootDir, "assembly/a/v1/a.usda"),
+            )
+
+        with open(jsonFilePath, "w") as outfile:
+            json.dump([["assembly/b/v1/b.usda", "assembly/b/v2/b.usda"]], outfile)
+
+        # A new context has the new rules, the existing ones keep theirs
+        # until they are refreshed.
+        newContext = resolver.CreateDefaultContextForAsset(layerPath)
+        self.assertNotEqual(newContext, context)
+        self.assertNotEqual(newContext.GetFingerprint(), context.GetFingerprint())
+        with Ar.ResolverContextBinder(context):
+            self.assertPathsEqual(
+                resolver.Resolve("assembly/b/v1/b.usda"),
+                os.path.join(rootDir, "assembly/b/v1/b.usda"),
+            )
+
+        resolver.RefreshContext(context)
+
+        # Contexts of the asset share the reloaded rules.
+        self.assertEqual(resolver.CreateDefaultContextForAsset(layerPath), context)
+
+        replaceResolver.ResetStats()
+        with Ar.ResolverContextBinder(context):
+            self.assertPathsEqual(
+                resolver.Resolve("component/c/v1/c.usda"),
+                os.path.join(rootDir, "component/c/v1/c.usda"),
+            )
+            self.assertPathsEqual(
+                resolver.Resolve("assembly/b/v1/b.usda"),
+                os.path.join(rootDir, "assembly/b/v2/b.usda"),
+            )
+            # Paths no changed rule applies to stay cached.
+            self.assertPathsEqual(
+                resolver.Resolve("assembly/a/v1/a.usda"),
+                os.path.join(rootDir, "assembly/a/v1/a.usda"),
+            )
+
+        stats = replaceResolver.GetStats()
+        self.assertEqual(stats["resolveCacheMisses"], 2)
+        self.assertEqual(stats["resolveCacheHits"], 1)
+
+    def test_RefreshContextRulesShared(self):
+        """ Paths cached with old rules stay while another asset has them """
+        import json
+
+        rootDir = os.path.abspath(TestReplaceResolver.rootDir)
+        assetDir = os.path.join(rootDir, "test_RefreshContextRulesShared")
+        os.makedirs(assetDir)
+        shotPath = os.path.join(assetDir, "shot.usda")
+        otherPath = os.path.join(assetDir, "other.usda")
+        Sdf.Layer.CreateNew(shotPath).Save()
+        Sdf.Layer.CreateNew(otherPath).Save()
+        jsonFilePath = os.path.join(assetDir, ReplaceResolver.Tokens.replaceFileName)
+        with open(jsonFilePath, "w") as outfile:
+            json.dump([["component/c/v1/c.usda", "component/c/v2/c.usda"]], outfile)
+
+        os.environ["PXR_AR_DEFAULT_SEARCH_PATH"] = rootDir
+        resolver = Ar.GetResolver()
+        replaceResolver = Ar.GetUnderlyingResolver()
+
+        # Both assets of the directory have the same rules.
+        shotContext = resolver.CreateDefaultContextForAsset(shotPath)
+        otherContext = resolver.CreateDefaultContextForAsset(otherPath)
+        self.assertEqual(shotContext.GetFingerprint(), otherContext.GetFingerprint())
+        with Ar.ResolverContextBinder(shotContext):
+            self.assertPathsEqual(
+                resolver.Resolve("component/c/v1/c.usda"),
+                os.path.join(rootDir, "component/c/v2/c.usda"),
+            )
+
+        with open(jsonFilePath, "w") as outfile:
+            json.dump([["assembly/b/v1/b.usda", "assembly/b/v2/b.usda"]], outfile)
+        resolver.RefreshContext(shotContext)
+        self.assertNotEqual(shotContext.GetFingerprint(), otherContext.GetFingerprint())
+
+        # The other asset still has the old rules, and their cached paths.
+        # A new thread starts with an empty thread cache.
+        import threading
+        resolvedPaths = []
+        def Resolve():
+            with Ar.ResolverContextBinder(otherContext):
+                resolvedPaths.append(resolver.Resolve("component/c/v1/c.usda"))
+
+        replaceResolver.ResetStats()
+        thread = threading.Thread(target=Resolve)
+        thread.start()
+        thread.join()
+        self.assertPathsEqual(
+            resolvedPaths[0], os.path.join(rootDir, "component/c/v2/c.usda"))
+        stats = replaceResolver.GetStats()
+        self.assertEqual(stats["resolveCacheMisses"], 0)
+        self.assertEqual(stats["resolveCacheHits"], 1)
+
+    def test_SidecarEdited(self):
+        """ Sidecars are parsed once, then again when their size or mtime change """
+        import json
+
+        rootDir = os.path.abspath(TestReplaceResolver.rootDir)
+        assetDir = os.path.join(rootDir, "test_SidecarEdited")
+        os.makedirs(assetDir)
+        layerPath = os.path.join(assetDir, "shot.usda")
+        Sdf.Layer.CreateNew(layerPath).Save()
+        jsonFilePath = os.path.join(assetDir, ReplaceResolver.Tokens.replaceFileName)
+
+        def WriteSidecar(pairs, modificationTime):
+            with open(jsonFilePath, "w") as outfile:
+                json.dump(pairs, outfile)
+            os.utime(jsonFilePath, (modificationTime, modificationTime))
+            return os.path.getsize(jsonFilePath)
+
+        def Resolve(path):
+            context = resolver.CreateDefaultContextForAsset(layerPath)
+            with Ar.ResolverContextBinder(context):
+                return resolver.Resolve(path)
+
+        os.environ["PXR_AR_DEFAULT_SEARCH_PATH"] = rootDir
+        resolver = Ar.GetResolver()
+        replaceResolver = Ar.GetUnderlyingResolver()
+        modificationTime = time.time() - 100
+        size = WriteSidecar(
+            [["component/c/v1/c.usda", "component/c/v2/c.usda"]], modificationTime
+        )
+
+        replaceResolver.ResetStats()
+        for i in range(3):
+            self.assertPathsEqual(
+                Resolve("component/c/v1/c.usda"),
+                os.path.join(rootDir, "component/c/v2/c.usda"),
+            )
+        self.assertEqual(replaceResolver.GetStats()["sidecarParses"], 1)
+
+        # Same size, later modification time.
+        self.assertEqual(
+            WriteSidecar(
+                [["component/c/v1/c.usda", "component/c/v1/c.usda"]],
+                modificationTime + 10,
+            ),
+            size,
+        )
+        self.assertPathsEqual(
+            Resolve("component/c/v1/c.usda"),
+            os.path.join(rootDir, "component/c/v1/c.usda"),
+        )
+        self.assertEqual(replaceResolver.GetStats()["sidecarParses"], 2)
+
+        # Same modification time, other size.
+        self.assertNotEqual(
+            WriteSidecar(
+                [["assembly/b/v1/b.usda", "assembly/b/v2/b.usda"]],
+                modificationTime + 10,
+            ),
+            size,
+        )
+        self.assertPathsEqual(
+            Resolve("assembly/b/v1/b.usda"),
+            os.path.join(rootDir, "assembly/b/v2/b.usda"),
+        )
+        self.assertEqual(replaceResolver.GetStats()["sidecarParses"], 3)
+
+    def test_LayerMetadataRules(self):
+        """ Rules are read from the layer metadata only, or from the opened layer """
+        rootDir = os.path.abspath(TestReplaceResolver.rootDir)
+        assetDir = os.path.join(rootDir, "test_LayerMetadataRules")
+        os.makedirs(assetDir)
+        os.environ["PXR_AR_DEFAULT_SEARCH_PATH"] = rootDir
+        resolver = Ar.GetResolver()
+        replaceResolver = Ar.GetUnderlyingResolver()
+
+        def Resolve(layerPath, path):
+            context = resolver.CreateDefaultContextForAsset(layerPath)
+            with Ar.ResolverContextBinder(context):
+                return resolver.Resolve(path)
+
+        for extension in ["usda", "usdc"]:
+            layerPath = os.path.join(assetDir, "shot." + extension)
+            layer = Sdf.Layer.CreateNew(layerPath)
+            layer.customLayerData = {
+                ReplaceResolver.Tokens.replacePairs: Vt.StringArray(
+                    ["component/c/v1/c.usda", "component/c/v2/c.usda"]
+                )
+            }
+            # Content after the header the metadata reader skips.
+            for i in range(100):
+                Sdf.CreatePrimInLayer(layer, "/prim%d" % i)
+            layer.Save()
+            del layer
+            self.assertFalse(Sdf.Layer.Find(layerPath))
+
+            # Layers that are not opened are only read up to their metadata,
+            # and are not added to the registry.
+            replaceResolver.ResetStats()
+            self.assertPathsEqual(
+                Resolve(layerPath, "component/c/v1/c.usda"),
+                os.path.join(rootDir, "component/c/v2/c.usda"),
+            )
+            stats = replaceResolver.GetStats()
+            self.assertEqual(stats["metadataReads"], 1)
+            self.assertEqual(stats["fullLayerReads"], 0)
+            self.assertFalse(Sdf.Layer.Find(layerPath))
+
+            # Opened layers are not read again, their unsaved edits are used.
+            layer = Sdf.Layer.FindOrOpen(layerPath)
+            layer.customLayerData = {
+                ReplaceResolver.Tokens.replacePairs: Vt.StringArray(
+                    ["assembly/b/v1/b.usda", "assembly/b/v2/b.usda"]
+                )
+            }
+            replaceResolver.ResetStats()
+            self.assertPathsEqual(
+                Resolve(layerPath, "assembly/b/v1/b.usda"),
+                os.path.join(rootDir, "assembly/b/v2/b.usda"),
+            )
+            self.assertPathsEqual(
+                Resolve(layerPath, "component/c/v1/c.usda"),
+                os.path.join(rootDir, "component/c/v1/c.usda"),
+            )
+            stats = replaceResolver.GetStats()
+            self.assertEqual(stats["metadataReads"], 0)
+            self.assertEqual(stats["fullLayerReads"], 0)
+            del layer
+
+    def test_ResolveInCwd(self):
+        """ Relative paths cached in a directory are not reused in another """
+        cwd = os.getcwd()
+        dirs = [
+            os.path.abspath(os.path.join(
+                TestReplaceResolver.rootDir, "test_ResolveInCwd", name))
+            for name in ("a", "b")
+        ]
+        for dirPath in dirs:
+            os.makedirs(dirPath)
+            with open(os.path.join(dirPath, "cwd.txt"), "w") as ofp:
+                ofp.write("Garbage")
+
+        context = ReplaceResolver.ReplaceResolverContext(
+            [os.path.abspath(TestReplaceResolver.rootDir)]
+        )
+        resolver = Ar.GetResolver()
+        try:
+            with Ar.ResolverContextBinder(context):
+                for _ in range(2):
+                    for dirPath in dirs:
+                        os.chdir(dirPath)
+                        self.assertPathsEqual(
+                            resolver.Resolve("cwd.txt"),
+                            os.path.join(dirPath, "cwd.txt"),
+                        )
+        finally:
+            os.chdir(cwd)
+
+    def test_NormalizedPaths(self):
+        """ Anchored and resolved paths are normalized like TfNormPath """
+        resolver = Ar.GetResolver()
+        longName = "d" * 600
+        cases = [
+            ("/a/b/f.usda", "../../../../x.usda"),
+            ("/a/b/f.usda", "c//d///e.usda"),
+            ("/a/b/f.usda", "c/d/"),
+            ("/a/b/f.usda", "./c/./d/."),
+            ("/a/b/f.usda", "c/.."),
+            ("//host/share/f.usda", "c/./d.usda"),
+            ("/%s/f.usda" % longName, "%s//e/../e.usda" % longName),
+            ("/%s/f.usda" % longName, "../" * 3 + longName + "/./e.usda"),
+        ]
+        for anchor, path in cases:
+            expected = resolver.ComputeNormalizedPath(
+                os.path.dirname(anchor) + "/" + path
+            )
+            self.assertEqual(resolver.AnchorRelativePath(anchor, path), expected)
+
+        # Search path elements joined with paths longer than the inline
+        # buffer of the resolver.
+        rootDir = os.path.abspath(TestReplaceResolver.rootDir)
+        longDir = os.path.join(*(["test_NormalizedPaths"] + ["e" * 250] * 5))
+        filePath = os.path.join(rootDir, longDir, "f.usda")
+        if not os.path.isdir(os.path.dirname(filePath)):
+            os.makedirs(os.path.dirname(filePath))
+        with open(filePath, "w") as ofp:
+            ofp.write("Garbage")
+
+        context = ReplaceResolver.ReplaceResolverContext([rootDir + "//"])
+        with Ar.ResolverContextBinder(context):
+            for path in [
+                longDir + "/f.usda",
+                longDir + "//./f.usda",
+                longDir + "/../" + os.path.basename(longDir) + "/f.usda",
+                "component/../" + longDir + "/f.usda",
+            ]:
+                self.assertPathsEqual(resolver.Resolve(path), filePath)
+
+    def test_ResolveMany(self):
+        """ ResolveMany returns the same paths as Resolve, in input order """
+        context = ReplaceResolver.ReplaceResolverContext(
+            [os.path.abspath(TestReplaceResolver.rootDir)]
+        )
+        context.AddReplacePair("component/c/v1/c.usda", "component/c/v2/c.usda")
+
+        paths = [
+            "component/c/v1/c.usda",
+            "assembly/b/v1/b.usda",
+            "missing/m/v1/m.usda",
+            "component/c/v1/c.usda",
+        ]
+
+        resolver = Ar.GetResolver()
+        with Ar.ResolverContextBinder(context):
+            expected = [resolver.Resolve(p) for p in paths]
+
+        results = Ar.GetUnderlyingResolver().ResolveMany(paths, context)
+        self.assertEqual(results, expected)
+        self.assertPathsEqual(
+            results[0],
+            os.path.abspath(os.path.join(
+                TestReplaceResolver.rootDir, "component/c/v2/c.usda"))
+        )
+        self.assertEqual(results[2], "")
+
+        # Without a context argument, the bound context is used
+        with Ar.ResolverContextBinder(context):
+            self.assertEqual(Ar.GetUnderlyingResolver().ResolveMany(paths), expected)
+
+    def test_ParallelProbe(self):
+        """ Parallel probes resolve a mixed batch like TfPathExists """
+        import json
+
+        # The prober is created with the resolver, it is tested in a new
+        # process.
+        script = """
+import json, os, sys
+from pxr import Ar
+from rdo import ReplaceResolver
+
+Ar.SetPreferredResolver("ReplaceResolver")
+searchPath = [str(path) for path in json.loads(sys.argv[1])]
+paths = [str(path) for path in json.loads(sys.argv[2])]
+os.chdir(sys.argv[3])
+resolver = Ar.GetResolver()
+replaceResolver = Ar.GetUnderlyingResolver()
+
+context = ReplaceResolver.ReplaceResolverContext(searchPath)
+many = list(replaceResolver.ResolveMany(paths, context))
+
+# Another context, so that the batch results are not cached for it.
+context.AddReplacePair("unused", "unused")
+with Ar.ResolverContextBinder(context):
+    single = [resolver.Resolve(path) for path in paths]
+
+print(json.dumps({
+    "backend": replaceResolver.GetStats()["parallelProbe"],
+    "many": many,
+    "single": single,
+}))
+"""
+        tmpDir = os.path.realpath(tempfile.mkdtemp())
+        try:
+            searchPath = [os.path.join(tmpDir, "r%d" % i) for i in range(3)]
+            cwd = os.path.join(tmpDir, "cwd")
+            for directory in searchPath + [cwd, os.path.join(searchPath[2], "c", "dir")]:
+                os.makedirs(directory)
+            for filePath in [
+                os.path.join(searchPath[0], "a.usda"),
+                os.path.join(searchPath[1], "a.usda"),
+                os.path.join(searchPath[1], "b.usda"),
+                os.path.join(searchPath[2], "c", "d.usda"),
+                os.path.join(cwd, "local.usda"),
+            ]:
+                open(filePath, "w").close()
+            # Dangling symbolic links exist for TfPathExists.
+            os.symlink("missing.usda", os.path.join(searchPath[1], "link.usda"))
+
+            paths = [
+                "a.usda",
+                "b.usda",
+                "c/d.usda",
+                "c/dir",
+                "link.usda",
+                "missing.usda",
+                "c/missing.usda",
+                "b.usda",
+                "./local.usda",
+                "./missing.usda",
+                "../r0/a.usda",
+                "local.usda",
+                os.path.join(searchPath[2], "c", "d.usda"),
+                os.path.join(searchPath[2], "missing.usda"),
+            ]
+
+            def Expected(path):
+                if os.path.isabs(path):
+                    return path if os.path.lexists(path) else ""
+                candidate = os.path.normpath(os.path.join(cwd, path))
+                if os.path.lexists(candidate):
+                    return candidate
+                if path.startswith("./") or path.startswith("../"):
+                    return ""
+                for root in searchPath:
+                    candidate = os.path.normpath(os.path.join(root, path))
+                    if os.path.lexists(candidate):
+                        return candidate
+                return ""
+
+            expected = [Expected(path) for path in paths]
+            self.assertIn(os.path.join(searchPath[1], "link.usda"), expected)
+
+            for ioUring in ["0", "1"]:
+                env = dict(os.environ)
+                env.pop("PXR_AR_DEFAULT_SEARCH_PATH", None)
+                env["REPLACE_RESOLVER_PARALLEL_PROBE"] = "1"
+                env["REPLACE_RESOLVER_PROBE_THREADS"] = "4"
+                env["REPLACE_RESOLVER_PROBE_IO_URING"] = ioUring
+                process = subprocess.Popen(
+                    [
+                        sys.executable, "-c", script,
+                        json.dumps(searchPath), json.dumps(paths), cwd,
+                    ],
+                    env=env,
+                    stdout=subprocess.PIPE,
+                    stderr=subprocess.PIPE,
+                )
+                output, errors = process.communicate()
+                self.assertEqual(process.returncode, 0, errors)
+                result = json.loads(output.decode().splitlines()[-1])
+                if ioUring == "0":
+                    self.assertEqual(result["backend"], "threads")
+                self.assertEqual(result["many"], expected, result["backend"])
+                self.assertEqual(result["single"], expected, result["backend"])
+        finally:
+            shutil.rmtree(tmpDir)
+
+    def test_Prewarm(self):
+        """ Layers brought in by a root layer are read and resolved ahead """
+        rootDir = os.path.abspath(TestReplaceResolver.rootDir)
+        context = ReplaceResolver.ReplaceResolverContext([rootDir])
+        context.AddReplacePair("component/c/v1/c.usda", "component/c/v2/c.usda")
+        context.AddReplacePair("assembly/b/v1/b.usda", "assembly/b/v2/b.usda")
+
+        texturePath = os.path.join(rootDir, "test_Prewarm.tex")
+        with open(texturePath, "w") as ofp:
+            ofp.write("texture")
+        layerPath = os.path.join(rootDir, "test_Prewarm.usda")
+        layer = Sdf.Layer.CreateNew(layerPath)
+        layer.subLayerPaths = ["assembly/a/v1/a.usda"]
+        prim = Sdf.PrimSpec(layer, "shader", Sdf.SpecifierDef)
+        attr = Sdf.AttributeSpec(prim, "texture", Sdf.ValueTypeNames.Asset)
+        attr.default = Sdf.AssetPath("./test_Prewarm.tex")
+        layer.Save()
+        del layer
+
+        replaceResolver = Ar.GetUnderlyingResolver()
+        replaceResolver.ResetStats()
+        layers = replaceResolver.Prewarm(layerPath, Ar.ResolverContext(context))
+        realPaths = sorted(
+            os.path.relpath(layer.realPath, rootDir).replace("\\", "/")
+            for layer in layers
+        )
+        self.assertEqual(
+            realPaths,
+            [
+                "assembly/a/v1/a.usda",
+                "assembly/b/v1/b.usda",
+                "assembly/b/v2/b.usda",
+                "component/c/v1/c.usda",
+                "component/c/v2/c.usda",
+                "test_Prewarm.usda",
+            ],
+        )
+        self.assertGreater(replaceResolver.GetStats()["resolveCacheMisses"], 0)
+
+        # The texture was resolved ahead too.
+        replaceResolver.ResetStats()
+        with Ar.ResolverContextBinder(context):
+            self.assertPathsEqual(
+                Ar.GetResolver().Resolve(os.path.join(rootDir, "test_Prewarm.tex")),
+                texturePath,
+            )
+        self.assertEqual(replaceResolver.GetStats()["resolveCacheMisses"], 0)
+
+    def test_ReplacePairsOverlapping(self):
+        """ The leftmost old string wins, then the longest one """
+        rootDir = os.path.abspath(TestReplaceResolver.rootDir)
+        expected = os.path.join(rootDir, "component/c/v2/c.usda")
+        resolver = Ar.GetResolver()
+
+        # One old string is a prefix of the other, both start at the same
+        # offset.
+        context = ReplaceResolver.ReplaceResolverContext([rootDir])
+        context.AddReplacePair("c/v1", "c/missing")
+        context.AddReplacePair("c/v1/c.usda", "c/v2/c.usda")
+        with Ar.ResolverContextBinder(context):
+            self.assertPathsEqual(resolver.Resolve("component/c/v1/c.usda"), expected)
+
+        # The old strings start at different offsets, the one found first
+        # while scanning ends before the leftmost one.
+        context = ReplaceResolver.ReplaceResolverContext([rootDir])
+        context.AddReplacePair("mponent/c/v1/c", "mponent/c/v2/c")
+        context.AddReplacePair("c/v1", "c/missing")
+        with Ar.ResolverContextBinder(context):
+            self.assertPathsEqual(resolver.Resolve("component/c/v1/c.usda"), expected)
+
+        # The leftmost old string wins over a longer one starting later.
+        context = ReplaceResolver.ReplaceResolverContext([rootDir])
+        context.AddReplacePair("nent/c/v1/", "nent/c/v2/")
+        context.AddReplacePair("c/v1/c.usda", "c/missing.usda")
+        with Ar.ResolverContextBinder(context):
+            self.assertPathsEqual(resolver.Resolve("component/c/v1/c.usda"), expected)
+
+    def test_ReplacePattern(self):
+        """ Wildcard patterns replace components, literal pairs win """
+        rootDir = os.path.abspath(TestReplaceResolver.rootDir)
+        context = ReplaceResolver.ReplaceResolverContext([rootDir])
+        context.AddReplacePattern("component/*/v1/", "component/$1/v2/")
+
+        resolver = Ar.GetResolver()
+        with Ar.ResolverContextBinder(context):
+            self.assertPathsEqual(
+                resolver.Resolve("component/c/v1/c.usda"),
+                os.path.join(rootDir, "component/c/v2/c.usda")
+            )
+
+        context.AddReplacePair("component/c/v1/c.usda", "component/c/v1/c.usda")
+        with Ar.ResolverContextBinder(context):
+            self.assertPathsEqual(
+                resolver.Resolve("component/c/v1/c.usda"),
+                os.path.join(rootDir, "component/c/v1/c.usda")
+            )
+
+    def test_Manifest(self):
+        """ Recorded resolutions are answered from the manifest """
+        context = ReplaceResolver.ReplaceResolverContext(
+            [os.path.abspath(TestReplaceResolver.rootDir)]
+        )
+        context.AddReplacePair("component/c/v1/c.usda", "component/c/v2/c.usda")
+        filePath = os.path.abspath(
+            os.path.join(TestReplaceResolver.rootDir, "test_Manifest.txt")
+        )
+        with open(filePath, "w") as ofp:
+            ofp.write("Garbage")
+        manifestPath = os.path.abspath(
+            os.path.join(TestReplaceResolver.rootDir, "test_Manifest.rrm")
+        )
+
+        resolver = Ar.GetResolver()
+        replaceResolver = Ar.GetUnderlyingResolver()
+        replaceResolver.StartManifestRecording()
+        with Ar.ResolverContextBinder(context):
+            expected = resolver.Resolve("component/c/v1/c.usda")
+            resolver.Resolve("test_Manifest.txt")
+        self.assertTrue(replaceResolver.StopManifestRecording(manifestPath))
+
+        os.remove(filePath)
+        resolver.RefreshContext(context)
+
+        self.assertTrue(replaceResolver.LoadManifest(manifestPath))
+        try:
+            with Ar.ResolverContextBinder(context):
+                self.assertPathsEqual(resolver.Resolve("component/c/v1/c.usda"), expected)
+                self.assertPathsEqual(resolver.Resolve("test_Manifest.txt"), filePath)
+        finally:
+            replaceResolver.LoadManifest("")
+
+        with Ar.ResolverContextBinder(context):
+            self.assertPathsEqual(resolver.Resolve("test_Manifest.txt"), "")
+
+    def test_ManifestCorrupted(self):
+        """ Corrupted manifests are not loaded """
+        import struct
+
+        context = ReplaceResolver.ReplaceResolverContext(
+            [os.path.abspath(TestReplaceResolver.rootDir)]
+        )
+        manifestPath = os.path.abspath(
+            os.path.join(TestReplaceResolver.rootDir, "test_ManifestCorrupted.rrm")
+        )
+
+        resolver = Ar.GetResolver()
+        replaceResolver = Ar.GetUnderlyingResolver()
+        replaceResolver.StartManifestRecording()
+        with Ar.ResolverContextBinder(context):
+            resolver.Resolve("component/c/v1/c.usda")
+        self.assertTrue(replaceResolver.StopManifestRecording(manifestPath))
+        with open(manifestPath, "rb") as infile:
+            data = bytearray(infile.read())
+
+        # A number of slots whose size wraps around to zero, numSlots,
+        # slotsOffset, stringsOffset and stringsSize follow the magic,
+        # version, slot size and number of entries.
+        headerSize = 56
+        struct.pack_into(
+            "=QQQQ", data, 24, 1 << 60, headerSize, headerSize,
+            len(data) - headerSize,
+        )
+        with open(manifestPath, "wb") as outfile:
+            outfile.write(bytes(data))
+        self.assertFalse(replaceResolver.LoadManifest(manifestPath))
+
+        # Truncated manifests neither.
+        with open(manifestPath, "wb") as outfile:
+            outfile.write(bytes(data[: len(data) // 2]))
+        self.assertFalse(replaceResolver.LoadManifest(manifestPath))
+
+    def test_Trace(self):
+        """ Calls made to the resolver are recorded to a trace """
+        rootDir = os.path.abspath(TestReplaceResolver.rootDir)
+        context = ReplaceResolver.ReplaceResolverContext([rootDir])
+        context.AddReplacePair("component/c/v1/c.usda", "component/c/v2/c.usda")
+        tracePath = os.path.join(rootDir, "test_Trace.rrt")
+
+        resolver = Ar.GetResolver()
+        replaceResolver = Ar.GetUnderlyingResolver()
+        self.assertTrue(replaceResolver.StartTraceRecording(tracePath))
+        try:
+            with Ar.ResolverContextBinder(context):
+                expected = resolver.Resolve("component/c/v1/c.usda")
+        finally:
+            replaceResolver.StopTraceRecording()
+
+        with open(tracePath, "rb") as infile:
+            data = infile.read()
+        self.assertTrue(data.startswith(b"RRTRACES"))
+        for string in ["component/c/v1/c.usda", "component/c/v2/c.usda", expected]:
+            self.assertIn(string.encode(), data)
+
+    def test_SearchIndex(self):
+        """ Paths under an indexed search root are resolved without stat calls """
+        rootDir = os.path.abspath(TestReplaceResolver.rootDir)
+        indexPath = os.path.join(rootDir, "test_SearchIndex.index")
+        self.assertTrue(
+            ReplaceResolver.ReplaceResolver.BuildSearchIndex(rootDir, indexPath)
+        )
+
+        context = ReplaceResolver.ReplaceResolverContext([rootDir])
+        fingerprint = context.GetFingerprint()
+        self.assertTrue(context.SetSearchIndex(rootDir, indexPath))
+        self.assertEqual(list(context.GetSearchPath()), [rootDir])
+        self.assertIn(indexPath, str(context))
+        self.assertNotEqual(context.GetFingerprint(), fingerprint)
+        self.assertFalse(context.SetSearchIndex("/notASearchRoot", indexPath))
+
+        resolver = Ar.GetResolver()
+        replaceResolver = Ar.GetUnderlyingResolver()
+        replaceResolver.ResetStats()
+        with Ar.ResolverContextBinder(context):
+            self.assertPathsEqual(
+                resolver.Resolve("component/c/v1/c.usda"),
+                os.path.join(rootDir, "component/c/v1/c.usda"),
+            )
+
+        stats = replaceResolver.GetStats()
+        self.assertEqual(stats["searchIndexHits"], 1)
+        self.assertNotIn(rootDir, stats["statCalls"])
+
+    def test_SearchIndexCorrupted(self):
+        """ Corrupted search indices are ignored """
+        import struct
+
+        rootDir = os.path.abspath(TestReplaceResolver.rootDir)
+        indexPath = os.path.join(rootDir, "test_SearchIndexCorrupted.index")
+        self.assertTrue(
+            ReplaceResolver.ReplaceResolver.BuildSearchIndex(rootDir, indexPath)
+        )
+        with open(indexPath, "rb") as infile:
+            data = bytearray(infile.read())
+
+        # A count of entries whose size wraps around, numEntries,
+        # entriesOffset, stringsOffset and stringsSize follow the magic,
+        # version and entry size.
+        headerSize = 48
+        numEntries = (1 << 61) + 1
+        stringsOffset = (headerSize + numEntries * 8) % (1 << 64)
+        struct.pack_into(
+            "=QQQQ", data, 16, numEntries, headerSize, stringsOffset,
+            (len(data) - stringsOffset) % (1 << 64),
+        )
+        with open(indexPath, "wb") as outfile:
+            outfile.write(bytes(data))
+
+        context = ReplaceResolver.ReplaceResolverContext([rootDir])
+        self.assertFalse(context.SetSearchIndex(rootDir, indexPath))
+        self.assertNotIn(indexPath, str(context))
+
+        resolver = Ar.GetResolver()
+        with Ar.ResolverContextBinder(context):
+            self.assertPathsEqual(
+                resolver.Resolve("component/c/v1/c.usda"),
+                os.path.join(rootDir, "component/c/v1/c.usda"),
+            )
+
+    def test_SearchPathWithEqualSign(self):
+        """ Search roots whose directory name contains '=' are kept whole """
+        tmpDir = tempfile.mkdtemp()
+        try:
+            rootDir = os.path.join(tmpDir, "a=b")
+            os.makedirs(os.path.join(rootDir, "component"))
+            filePath = os.path.join(rootDir, "component", "equal.usda")
+            with open(filePath, "w") as outfile:
+                outfile.write("#usda 1.0\n")
+
+            context = ReplaceResolver.ReplaceResolverContext([rootDir])
+            self.assertEqual(list(context.GetSearchPath()), [rootDir])
+
+            resolver = Ar.GetResolver()
+            with Ar.ResolverContextBinder(context):
+                self.assertPathsEqual(
+                    resolver.Resolve("component/equal.usda"), filePath
+                )
+
+            indexPath = os.path.join(tmpDir, "equal.index")
+            self.assertTrue(
+                ReplaceResolver.ReplaceResolver.BuildSearchIndex(rootDir, indexPath)
+            )
+            self.assertTrue(context.SetSearchIndex(rootDir, indexPath))
+            self.assertEqual(list(context.GetSearchPath()), [rootDir])
+
+            replaceResolver = Ar.GetUnderlyingResolver()
+            replaceResolver.ResetStats()
+            with Ar.ResolverContextBinder(context):
+                self.assertPathsEqual(
+                    resolver.Resolve("component/equal.usda"), filePath
+                )
+            self.assertEqual(replaceResolver.GetStats()["searchIndexHits"], 1)
+        finally:
+            shutil.rmtree(tmpDir)
+
+    def test_ReplaceTable(self):
+        """ Replace pairs are read from a binary table converted from JSON """
+        import json
+
+        rootDir = os.path.abspath(TestReplaceResolver.rootDir)
+        assetDir = os.path.join(rootDir, "test_ReplaceTable")
+        os.makedirs(assetDir)
+        jsonFilePath = os.path.join(assetDir, "pins.json")
+        with open(jsonFilePath, "w") as outfile:
+            json.dump([["component/c/v1/c.usda", "component/c/v2/c.usda"]], outfile)
+        tablePath = os.path.join(assetDir, "pins.table")
+        self.assertTrue(
+            ReplaceResolver.ReplaceResolver.ConvertReplaceTable(jsonFilePath, tablePath)
+        )
+
+        context = ReplaceResolver.ReplaceResolverContext([rootDir])
+        self.assertTrue(context.SetReplaceTable(tablePath))
+        self.assertIn(tablePath, str(context))
+        self.assertNotEqual(context, ReplaceResolver.ReplaceResolverContext([rootDir]))
+
+        resolver = Ar.GetResolver()
+        with Ar.ResolverContextBinder(context):
+            self.assertPathsEqual(
+                resolver.Resolve("component/c/v1/c.usda"),
+                os.path.join(rootDir, "component/c/v2/c.usda"),
+            )
+
+        # Layers point at their table, relative to them.
+        layerPath = os.path.join(assetDir, "shot.usda")
+        layer = Sdf.Layer.CreateNew(layerPath)
+        layer.customLayerData = {ReplaceResolver.Tokens.replaceTable: "pins.table"}
+        layer.Save()
+
+        os.environ["PXR_AR_DEFAULT_SEARCH_PATH"] = rootDir
+        with Ar.ResolverContextBinder(resolver.CreateDefaultContextForAsset(layerPath)):
+            self.assertPathsEqual(
+                resolver.Resolve("component/c/v1/c.usda"),
+                os.path.join(rootDir, "component/c/v2/c.usda"),
+            )
+
+    def test_ReplaceTableCorrupted(self):
+        """ Corrupted or truncated replace tables are rejected """
+        import json
+        import struct
+
+        rootDir = os.path.abspath(TestReplaceResolver.rootDir)
+        assetDir = os.path.join(rootDir, "test_ReplaceTableCorrupted")
+        os.makedirs(assetDir)
+        jsonFilePath = os.path.join(assetDir, "pins.json")
+        with open(jsonFilePath, "w") as outfile:
+            json.dump([["component/c/v1/c.usda", "component/c/v2/c.usda"]], outfile)
+        tablePath = os.path.join(assetDir, "pins.table")
+        self.assertTrue(
+            ReplaceResolver.ReplaceResolver.ConvertReplaceTable(jsonFilePath, tablePath)
+        )
+        with open(tablePath, "rb") as infile:
+            data = infile.read()
+
+        # numEntries, entriesOffset, stringsOffset and stringsSize follow the
+        # magic, version and entry size.
+        headerSize = 96
+        size = len(data)
+        numEntries = size // 16
+        stringsOffset = headerSize + numEntries * 16
+        wrapped = bytearray(data)
+        struct.pack_into(
+            "=QQQQ", wrapped, 16, numEntries, headerSize, stringsOffset,
+            (size - stringsOffset) % (1 << 64),
+        )
+        pastEnd = bytearray(data)
+        struct.pack_into("=QQ", pastEnd, 32, size + 1, (1 << 64) - 1)
+
+        context = ReplaceResolver.ReplaceResolverContext([rootDir])
+        for i, corrupted in enumerate([data[: size // 2], wrapped, pastEnd]):
+            corruptedPath = os.path.join(assetDir, "corrupted%d.table" % i)
+            with open(corruptedPath, "wb") as outfile:
+                outfile.write(bytes(corrupted))
+            self.assertFalse(context.SetReplaceTable(corruptedPath))
+        self.assertEqual(context, ReplaceResolver.ReplaceResolverContext([rootDir]))
+
+    def test_SharedCache(self):
+        """ Resolved paths are found in the shared cache of the host """
+        context = ReplaceResolver.ReplaceResolverContext(
+            [os.path.abspath(TestReplaceResolver.rootDir)]
+        )
+        context.AddReplacePair("component/c/v1/c.usda", "component/c/v2/c.usda")
+        name = "/rdoReplaceResolverTest.%d" % os.getpid()
+
+        resolver = Ar.GetResolver()
+        replaceResolver = Ar.GetUnderlyingResolver()
+        self.assertTrue(replaceResolver.SetSharedCache(name, 1 << 20))
+        try:
+            with Ar.ResolverContextBinder(context):
+                expected = resolver.Resolve("component/c/v1/c.usda")
+
+            # Emptying the cache of the process leaves the shared one.
+            budget = replaceResolver.GetResolveCacheBudget()
+            replaceResolver.SetResolveCacheBudget(0)
+            replaceResolver.SetResolveCacheBudget(budget)
+            replaceResolver.ResetStats()
+            with Ar.ResolverContextBinder(context):
+                self.assertPathsEqual(resolver.Resolve("component/c/v1/c.usda"), expected)
+
+            stats = replaceResolver.GetStats()
+            self.assertEqual(stats["sharedCacheHits"], 1)
+            self.assertEqual(stats["sharedCache"]["name"], name)
+            self.assertGreaterEqual(stats["sharedCache"]["entries"], 1)
+
+            # Refreshing drops the entries of the context for every process,
+            # the entries of other contexts are kept. Contexts share a few
+            # epochs, at least one of two others keeps its entries.
+            otherContexts = []
+            for otherPath in ("component/c/v2/c.usda", "assembly/b/v2/b.usda"):
+                otherContext = ReplaceResolver.ReplaceResolverContext(
+                    [os.path.abspath(TestReplaceResolver.rootDir)]
+                )
+                otherContext.AddReplacePair("test_SharedCache.usda", otherPath)
+                with Ar.ResolverContextBinder(otherContext):
+                    resolver.Resolve("test_SharedCache.usda")
+                otherContexts.append(otherContext)
+
+            resolver.RefreshContext(context)
+            replaceResolver.SetResolveCacheBudget(0)
+            replaceResolver.SetResolveCacheBudget(budget)
+            replaceResolver.ResetStats()
+            with Ar.ResolverContextBinder(context):
+                self.assertPathsEqual(resolver.Resolve("component/c/v1/c.usda"), expected)
+            self.assertEqual(replaceResolver.GetStats()["sharedCacheHits"], 0)
+            for otherContext in otherContexts:
+                with Ar.ResolverContextBinder(otherContext):
+                    resolver.Resolve("test_SharedCache.usda")
+            self.assertGreaterEqual(replaceResolver.GetStats()["sharedCacheHits"], 1)
+            resolver.RefreshContext(context)
+        finally:
+            replaceResolver.SetSharedCache("")
+
+    @unittest.skipUnless(os.path.isdir("/dev/shm"), "POSIX shared memory")
+    def test_SharedCacheNotPrivate(self):
+        """ Segments other users may write are not used """
+        name = "rdoReplaceResolverTest.%d.open" % os.getpid()
+        segmentPath = os.path.join("/dev/shm", name)
+        with open(segmentPath, "w") as ofp:
+            ofp.write("Garbage")
+        os.chmod(segmentPath, 0o666)
+
+        replaceResolver = Ar.GetUnderlyingResolver()
+        try:
+            self.assertFalse(replaceResolver.SetSharedCache("/" + name, 1 << 20))
+        finally:
+            replaceResolver.SetSharedCache("")
+            os.remove(segmentPath)
+
+    def test_Daemon(self):
+        """ Paths are resolved by the daemon, or in process without it """
+        context = ReplaceResolver.ReplaceResolverContext(
+            [os.path.abspath(TestReplaceResolver.rootDir)]
+        )
+        context.AddReplacePair("component/c/v1/c.usda", "component/c/v2/c.usda")
+        # Socket paths are limited to about a hundred characters.
+        socketPath = os.path.join(
+            tempfile.gettempdir(), "rdoResolverdTest.%d.sock" % os.getpid()
+        )
+
+        resolver = Ar.GetResolver()
+        replaceResolver = Ar.GetUnderlyingResolver()
+        budget = replaceResolver.GetResolveCacheBudget()
+        with Ar.ResolverContextBinder(context):
+            expected = resolver.Resolve("component/c/v1/c.usda")
+
+        # Without a daemon, paths are resolved in process.
+        self.assertFalse(replaceResolver.SetDaemon(socketPath))
+        daemon = None
+        try:
+            replaceResolver.SetResolveCacheBudget(0)
+            replaceResolver.SetResolveCacheBudget(budget)
+            replaceResolver.ResetStats()
+            with Ar.ResolverContextBinder(context):
+                self.assertPathsEqual(resolver.Resolve("component/c/v1/c.usda"), expected)
+            self.assertGreaterEqual(replaceResolver.GetStats()["daemonFallbacks"], 1)
+
+            daemonPath = os.environ.get("RDO_RESOLVERD")
+            if not daemonPath or not os.path.exists(daemonPath):
+                self.skipTest("rdo-resolverd is not installed")
+
+            daemon = subprocess.Popen([daemonPath, "--socket", socketPath])
+            for _ in range(100):
+                if os.path.exists(socketPath):
+                    break
+                time.sleep(0.05)
+            self.assertTrue(replaceResolver.SetDaemon(socketPath))
+
+            replaceResolver.SetResolveCacheBudget(0)
+            replaceResolver.SetResolveCacheBudget(budget)
+            replaceResolver.ResetStats()
+            with Ar.ResolverContextBinder(context):
+                self.assertPathsEqual(resolver.Resolve("component/c/v1/c.usda"), expected)
+            stats = replaceResolver.GetStats()
+            self.assertEqual(stats["daemonResolves"], 1)
+            self.assertEqual(stats["daemonFallbacks"], 0)
+            self.assertEqual(stats["daemon"]["socketPath"], socketPath)
+        finally:
+            replaceResolver.SetDaemon("")
+            if daemon:
+                daemon.terminate()
+                daemon.wait()
+
+    def test_DaemonNotPrivate(self):
+        """ Daemons whose socket other users may replace are not used """
+        daemonPath = os.environ.get("RDO_RESOLVERD")
+        if not daemonPath or not os.path.exists(daemonPath):
+            self.skipTest("rdo-resolverd is not installed")
+
+        # Writable by all, without the sticky bit of /tmp.
+        socketDir = tempfile.mkdtemp()
+        os.chmod(socketDir, 0o777)
+        socketPath = os.path.join(socketDir, "resolverd.sock")
+
+        replaceResolver = Ar.GetUnderlyingResolver()
+        daemon = subprocess.Popen([daemonPath, "--socket", socketPath])
+        try:
+            for _ in range(100):
+                if os.path.exists(socketPath):
+                    break
+                time.sleep(0.05)
+            self.assertTrue(os.path.exists(socketPath))
+            self.assertFalse(replaceResolver.SetDaemon(socketPath))
+
+            os.chmod(socketDir, 0o700)
+            self.assertTrue(replaceResolver.SetDaemon(socketPath))
+        finally:
+            replaceResolver.SetDaemon("")
+            daemon.terminate()
+            daemon.wait()
+            shutil.rmtree(socketDir)
+
+    def test_DirectoryCache(self):
+        """ Listings are trusted until their time to live or a change """
+        # The directory cache is enabled when the resolver is created, it is
+        # tested in a new process.
+        script = """
+import os, sys, time
+from pxr import Ar
+from rdo import ReplaceResolver
+
+Ar.SetPreferredResolver("ReplaceResolver")
+rootDir, timeToLive = sys.argv[1], float(sys.argv[2])
+os.chdir(rootDir)
+resolver = Ar.GetResolver()
+replaceResolver = Ar.GetUnderlyingResolver()
+
+def Resolve(path, i):
+    # A context of its own skips the caches in front of the listings.
+    context = ReplaceResolver.ReplaceResolverContext([rootDir])
+    context.AddReplacePair("unused%d" % i, "unused%d" % i)
+    with Ar.ResolverContextBinder(context):
+        return resolver.Resolve(path)
+
+def Counters():
+    return replaceResolver.GetStats()["directoryCache"]
+
+def StatsAvoided(path, i, expected):
+    before = Counters()["statsAvoided"]
+    assert Resolve(path, i) == expected, (path, expected)
+    return Counters()["statsAvoided"] - before
+
+filePath = os.path.join(rootDir, "x", "c.usda")
+
+# Listing the directories is not a hit, negative queries answered from the
+# listings are.
+assert StatsAvoided("x/a.usda", 0, os.path.join(rootDir, "x", "a.usda")) == 0
+assert StatsAvoided("x/b.usda", 1, "") > 0
+
+# Until the time to live, the listing is trusted.
+open(filePath, "w").close()
+assert StatsAvoided("x/c.usda", 2, "") > 0
+
+# Then it is revalidated, which is not a hit.
+time.sleep(timeToLive + 0.5)
+revalidations = Counters()["revalidations"]
+assert StatsAvoided("x/c.usda", 3, filePath) == 0
+assert Counters()["revalidations"] > revalidations
+
+# Watched changes invalidate the listing before the time to live.
+if replaceResolver.StartWatching():
+    assert Resolve("x/c.usda", 4) == filePath
+    os.remove(filePath)
+    deadline = time.time() + 5.0
+    while Resolve("x/c.usda", 5) and time.time() < deadline:
+        time.sleep(0.05)
+    assert Resolve("x/c.usda", 6) == ""
+    replaceResolver.StopWatching()
+"""
+        tmpDir = tempfile.mkdtemp()
+        try:
+            os.makedirs(os.path.join(tmpDir, "x"))
+            open(os.path.join(tmpDir, "x", "a.usda"), "w").close()
+
+            env = dict(os.environ)
+            env["REPLACE_RESOLVER_DIRECTORY_CACHE"] = "1"
+            env["REPLACE_RESOLVER_DIRECTORY_CACHE_TTL"] = "2"
+            process = subprocess.Popen(
+                [sys.executable, "-c", script, tmpDir, "2"],
+                env=env,
+                stdout=subprocess.PIPE,
+                stderr=subprocess.STDOUT,
+            )
+            output = process.communicate()[0]
+            self.assertEqual(process.returncode, 0, output)
+        finally:
+            shutil.rmtree(tmpDir)
+
+    def test_Watch(self):
+        """ Resolved paths deleted on disk are dropped from the caches """
+        context = ReplaceResolver.ReplaceResolverContext(
+            [os.path.abspath(TestReplaceResolver.rootDir)]
+        )
+        filePath = os.path.abspath(
+            os.path.join(TestReplaceResolver.rootDir, "test_Watch.txt")
+        )
+        with open(filePath, "w") as ofp:
+            ofp.write("Garbage")
+
+        resolver = Ar.GetResolver()
+        replaceResolver = Ar.GetUnderlyingResolver()
+        if not replaceResolver.StartWatching():
+            self.skipTest("Watching is not supported on this platform")
+
+        changedPaths = []
+        listener = Tf.Notice.RegisterGlobally(
+            ReplaceResolver.FilesChangedNotice,
+            lambda notice, sender: changedPaths.extend(notice.GetChangedPaths()),
+        )
+        try:
+            with Ar.ResolverContextBinder(context):
+                self.assertPathsEqual(resolver.Resolve("test_Watch.txt"), filePath)
+
+                os.remove(filePath)
+                deadline = time.time() + 5.0
+                while filePath not in changedPaths and time.time() < deadline:
+                    time.sleep(0.05)
+
+                self.assertIn(filePath, changedPaths)
+                self.assertPathsEqual(resolver.Resolve("test_Watch.txt"), "")
+        finally:
+            listener.Revoke()
+            replaceResolver.StopWatching()
+
+    def test_WatchOtherSearchRoots(self):
+        """ A path published under an earlier search root hides the cached one """
+        tmpDir = tempfile.mkdtemp()
+        try:
+            workDir = os.path.join(tmpDir, "work")
+            publishDir = os.path.join(tmpDir, "publish")
+            os.makedirs(workDir)
+            os.makedirs(os.path.join(publishDir, "asset", "v1"))
+            publishedPath = os.path.join(publishDir, "asset", "v1", "a.usda")
+            with open(publishedPath, "w") as ofp:
+                ofp.write("Garbage")
+
+            context = ReplaceResolver.ReplaceResolverContext([workDir, publishDir])
+            resolver = Ar.GetResolver()
+            replaceResolver = Ar.GetUnderlyingResolver()
+            if not replaceResolver.StartWatching():
+                self.skipTest("Watching is not supported on this platform")
+
+            workPath = os.path.join(workDir, "asset", "v1", "a.usda")
+            changedPaths = []
+            listener = Tf.Notice.RegisterGlobally(
+                ReplaceResolver.FilesChangedNotice,
+                lambda notice, sender: changedPaths.extend(notice.GetChangedPaths()),
+            )
+            try:
+                with Ar.ResolverContextBinder(context):
+                    self.assertPathsEqual(
+                        resolver.Resolve("asset/v1/a.usda"), publishedPath
+                    )
+
+                    # The directories are missing under the work root, their
+                    # creation is seen from the root.
+                    os.makedirs(os.path.dirname(workPath))
+                    with open(workPath, "w") as ofp:
+                        ofp.write("Garbage")
+                    createdPath = os.path.join(workDir, "asset")
+                    deadline = time.time() + 5.0
+                    while createdPath not in changedPaths and time.time() < deadline:
+                        time.sleep(0.05)
+
+                    self.assertIn(createdPath, changedPaths)
+                    self.assertPathsEqual(
+                        resolver.Resolve("asset/v1/a.usda"), workPath
+                    )
+            finally:
+                listener.Revoke()
+                replaceResolver.StopWatching()
+        finally:
+            shutil.rmtree(tmpDir)
+
+    def test_Stats(self):
+        """ Resolves are counted until the stats are reset """
+        context = ReplaceResolver.ReplaceResolverContext(
+            [os.path.abspath(TestReplaceResolver.rootDir)]
+        )
+        context.AddReplacePair("component/c/v1/c.usda", "component/c/v2/c.usda")
+
+        resolver = Ar.GetResolver()
+        replaceResolver = Ar.GetUnderlyingResolver()
+        replaceResolver.ResetStats()
+        with Ar.ResolverContextBinder(context):
+            resolver.Resolve("component/c/v1/c.usda")
+            resolver.Resolve("component/c/v1/c.usda")
+
+        stats = replaceResolver.GetStats()
+        self.assertEqual(stats["resolves"], 2)
+        # The second resolve is answered by the cache of the thread.
+        self.assertGreaterEqual(stats["threadCacheHits"], 1)
+        self.assertEqual(
+            stats["threadCacheHits"]
+            + stats["resolveCacheMisses"]
+            + stats["resolveCacheHits"],
+            2,
+        )
+        self.assertGreaterEqual(stats["replaceHits"], 1)
+        self.assertIn(os.path.abspath(TestReplaceResolver.rootDir), stats["statCalls"])
+        self.assertGreater(stats["latency"]["p99Ns"], 0)
+        self.assertGreater(stats["internedPaths"]["size"], 0)
+
+        replaceResolver.ResetStats()
+        stats = replaceResolver.GetStats()
+        self.assertEqual(stats["resolves"], 0)
+        self.assertEqual(stats["statCalls"], {})
+
+    def test_InternedPaths(self):
+        """ Only paths that resolved are interned, and not without budget """
+        context = ReplaceResolver.ReplaceResolverContext(
+            [os.path.abspath(TestReplaceResolver.rootDir)]
+        )
+        filePath = os.path.abspath(
+            os.path.join(TestReplaceResolver.rootDir, "test_InternedPaths.txt")
+        )
+        with open(filePath, "w") as ofp:
+            ofp.write("Garbage")
+
+        resolver = Ar.GetResolver()
+        replaceResolver = Ar.GetUnderlyingResolver()
+
+        def _GetNumInternedPaths():
+            return replaceResolver.GetStats()["internedPaths"]["size"]
+
+        with Ar.ResolverContextBinder(context):
+            # The current directory of relative paths is interned once.
+            resolver.Resolve("test_InternedPaths/missing.usda")
+            numPaths = _GetNumInternedPaths()
+            for i in range(100):
+                self.assertEqual(
+                    resolver.Resolve("test_InternedPaths/missing%d.usda" % i), ""
+                )
+            self.assertEqual(_GetNumInternedPaths(), numPaths)
+
+            budget = replaceResolver.GetResolveCacheBudget()
+            replaceResolver.SetResolveCacheBudget(0)
+            try:
+                self.assertPathsEqual(
+                    resolver.Resolve("test_InternedPaths.txt"), filePath
+                )
+                self.assertEqual(_GetNumInternedPaths(), numPaths)
+            finally:
+                replaceResolver.SetResolveCacheBudget(budget)
+
+            # With a budget, resolved paths are interned to be cached.
+            self.assertPathsEqual(
+                resolver.Resolve("test_InternedPaths.txt"), filePath
+            )
+            self.assertEqual(_GetNumInternedPaths(), numPaths + 2)
+
     def test_ResolveFromStageOneLevel(self):
         """ Replace reference to c/v1 by c/v2 and open stage to check x value """
         context = ReplaceResolver.ReplaceResolverContext(
@@ -0,0 +1,50 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "threadCache.h"
+
+#include <pxr/pxr.h>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+constexpr size_t ReplaceResolverThreadCache::NumSlots;
+
+bool
+ReplaceResolverThreadCache::Find(
+    const ReplaceResolverFingerprint& context,
+    ReplaceResolverPathTable::Id cwd,
+    const std::string& path,
+    size_t pathHash,
+    uint64_t generation,
+    ReplaceResolverPathTable::Id* resolvedPath) const
+{
+    const _Slot& slot = _slots[_GetIndex(context, pathHash)];
+    if (slot.resolvedPath == ReplaceResolverPathTable::InvalidId ||
+        slot.generation != generation ||
+        slot.context != context ||
+        slot.cwd != cwd ||
+        slot.path != path) {
+        return false;
+    }
+
+    *resolvedPath = slot.resolvedPath;
+    return true;
+}
+
+void
+ReplaceResolverThreadCache::Insert(
+    const ReplaceResolverFingerprint& context,
+    ReplaceResolverPathTable::Id cwd,
+    const std::string& path,
+    size_t pathHash,
+    uint64_t generation,
+    ReplaceResolverPathTable::Id resolvedPath)
+{
+    // Assigning reuses the capacity of the evicted path.
+    _Slot& slot = _slots[_GetIndex(context, pathHash)];
+    slot.context = context;
+    slot.cwd = cwd;
+    slot.path = path;
+    slot.generation = generation;
+    slot.resolvedPath = resolvedPath;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,77 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_THREAD_CACHE_H
+#define USD_REPLACE_RESOLVER_THREAD_CACHE_H
+
+#include "fingerprint.h"
+#include "pathTable.h"
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplaceResolverThreadCache
+///
+/// Small direct mapped cache of the paths recently resolved by one thread,
+/// looked up before any shared cache.
+///
+/// Entries are tagged with the fingerprint of the bound context, with the
+/// interned current directory for relative paths, and with the generation
+/// of the resolver caches when they were resolved. Bumping the generation
+/// invalidates the entries of every thread at once.
+///
+/// Not thread safe, each thread has its own.
+///
+class ReplaceResolverThreadCache
+{
+public:
+    static constexpr size_t NumSlots = 64;
+
+    /// Return true and set \p resolvedPath if \p path was resolved with
+    /// \p context bound and \p cwd as current directory during
+    /// \p generation. \p pathHash is the std::hash of \p path.
+    AR_API bool Find(
+        const ReplaceResolverFingerprint& context,
+        ReplaceResolverPathTable::Id cwd,
+        const std::string& path,
+        size_t pathHash,
+        uint64_t generation,
+        ReplaceResolverPathTable::Id* resolvedPath) const;
+
+    /// Remember \p resolvedPath, replacing the entry in the same slot.
+    AR_API void Insert(
+        const ReplaceResolverFingerprint& context,
+        ReplaceResolverPathTable::Id cwd,
+        const std::string& path,
+        size_t pathHash,
+        uint64_t generation,
+        ReplaceResolverPathTable::Id resolvedPath);
+
+private:
+    struct _Slot
+    {
+        ReplaceResolverFingerprint context;
+        ReplaceResolverPathTable::Id cwd = ReplaceResolverPathTable::InvalidId;
+        std::string path;
+        uint64_t generation = 0;
+        ReplaceResolverPathTable::Id resolvedPath =
+            ReplaceResolverPathTable::InvalidId;
+    };
+
+    static size_t _GetIndex(
+        const ReplaceResolverFingerprint& context,
+        size_t pathHash)
+    {
+        return (pathHash ^ context.GetHash()) & (NumSlots - 1);
+    }
+
+    _Slot _slots[NumSlots];
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_THREAD_CACHE_H
@@ -5,9 +5,14 @@ PXR_NAMESPACE_OPEN_SCOPE
 
 ReplaceResolverTokensType::ReplaceResolverTokensType() :
     replacePairs("replacePairs", TfToken::Immortal),
+    replacePatterns("replacePatterns", TfToken::Immortal),
     replaceFileName("replace.json", TfToken::Immortal),
+    replaceTable("replaceTable", TfToken::Immortal),
+    replaceTableFileName("replace.table", TfToken::Immortal),
     allTokens({
-        replacePairs
+        replacePairs,
+        replacePatterns,
+        replaceTable
     })
 {
 }
@@ -23,8 +23,14 @@ struct ReplaceResolverTokensType {
 
     const TfToken replacePairs;
 
+    const TfToken replacePatterns;
+
     const TfToken replaceFileName;
 
+    const TfToken replaceTable;
+
+    const TfToken replaceTableFileName;
+
     /// A vector of all of the tokens listed above.
     const std::vector<TfToken> allTokens;
 };
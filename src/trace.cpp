@@ -0,0 +1,372 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "trace.h"
+#include "replaceResolverContext.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/tf/diagnostic.h>
+#include <pxr/base/tf/stringUtils.h>
+
+#include <cstring>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+
+const char _Magic[8] = {'R', 'R', 'T', 'R', 'A', 'C', 'E', 'S'};
+constexpr uint32_t _Version = 1;
+
+// Record kinds, events use their ReplaceResolverTrace::EventType.
+constexpr uint8_t _StringRecord = 0x80;
+constexpr uint8_t _ContextRecord = 0x81;
+
+constexpr size_t _FileBufferSize = 1 << 20;
+
+void
+_SetError(std::string* errMsg, const std::string& msg)
+{
+    if (errMsg) {
+        *errMsg = msg;
+    }
+}
+
+// LEB128, most values are small indices.
+size_t
+_EncodeVarint(uint64_t value, char* out)
+{
+    size_t size = 0;
+    while (value >= 0x80) {
+        out[size++] = static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out[size++] = static_cast<char>(value);
+    return size;
+}
+
+class _Reader
+{
+public:
+    explicit _Reader(FILE* file) : _file(file) {}
+
+    bool ReadByte(uint8_t* value)
+    {
+        const int c = getc(_file);
+        if (c == EOF) {
+            return false;
+        }
+        *value = static_cast<uint8_t>(c);
+        return true;
+    }
+
+    bool ReadVarint(uint64_t* value)
+    {
+        *value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            uint8_t byte;
+            if (!ReadByte(&byte)) {
+                return false;
+            }
+            *value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ReadBytes(void* data, size_t size)
+    {
+        return fread(data, 1, size, _file) == size;
+    }
+
+private:
+    FILE* _file;
+};
+
+} // anonymous
+
+const char*
+ReplaceResolverTrace::GetEventName(EventType type)
+{
+    switch (type) {
+    case Resolve: return "Resolve";
+    case AnchorRelativePath: return "AnchorRelativePath";
+    case BindContext: return "BindContext";
+    case UnbindContext: return "UnbindContext";
+    case CreateDefaultContextForAsset: return "CreateDefaultContextForAsset";
+    }
+    return "Unknown";
+}
+
+bool
+ReplaceResolverTrace::Read(const std::string& filePath, std::string* errMsg)
+{
+    contexts.clear();
+    events.clear();
+
+    FILE* file = ArchOpenFile(filePath.c_str(), "rb");
+    if (!file) {
+        _SetError(errMsg, TfStringPrintf(
+            "Could not open trace '%s'", filePath.c_str()));
+        return false;
+    }
+    std::unique_ptr<FILE, int (*)(FILE*)> closer(file, fclose);
+
+    char magic[sizeof(_Magic)];
+    uint32_t version = 0;
+    uint32_t reserved = 0;
+    if (fread(magic, sizeof(magic), 1, file) != 1 ||
+        memcmp(magic, _Magic, sizeof(_Magic)) != 0 ||
+        fread(&version, sizeof(version), 1, file) != 1 ||
+        version != _Version ||
+        fread(&reserved, sizeof(reserved), 1, file) != 1) {
+        _SetError(errMsg, TfStringPrintf(
+            "Invalid trace '%s'", filePath.c_str()));
+        return false;
+    }
+
+    _Reader reader(file);
+    // String 0 is the empty string.
+    std::vector<std::string> strings(1);
+    bool isValid = true;
+
+    auto readString = [&](std::string* str) {
+        uint64_t index;
+        if (!reader.ReadVarint(&index) || index >= strings.size()) {
+            return false;
+        }
+        *str = strings[index];
+        return true;
+    };
+    auto readStrings = [&](std::vector<std::string>* result) {
+        uint64_t size;
+        if (!reader.ReadVarint(&size)) {
+            return false;
+        }
+        for (uint64_t i = 0; i < size; ++i) {
+            std::string str;
+            if (!readString(&str)) {
+                return false;
+            }
+            result->push_back(std::move(str));
+        }
+        return true;
+    };
+
+    uint8_t kind;
+    while (isValid && reader.ReadByte(&kind)) {
+        if (kind == _StringRecord) {
+            uint64_t size;
+            std::string str;
+            isValid = reader.ReadVarint(&size) && size < (uint64_t(1) << 32);
+            if (isValid) {
+                str.resize(static_cast<size_t>(size));
+                isValid = reader.ReadBytes(&str[0], str.size());
+            }
+            strings.push_back(std::move(str));
+        }
+        else if (kind == _ContextRecord) {
+            Context context;
+            std::vector<std::string> pairs, patterns;
+            isValid =
+                reader.ReadBytes(&context.fingerprint.hi, 8) &&
+                reader.ReadBytes(&context.fingerprint.lo, 8) &&
+                readString(&context.assetPath) &&
+                readStrings(&context.searchPath) &&
+                readStrings(&pairs) && pairs.size() % 2 == 0 &&
+                readStrings(&patterns) && patterns.size() % 2 == 0 &&
+                readString(&context.replaceTable);
+            for (size_t i = 0; isValid && i < pairs.size(); i += 2) {
+                context.pairs.emplace(pairs[i], pairs[i + 1]);
+            }
+            for (size_t i = 0; isValid && i < patterns.size(); i += 2) {
+                context.patterns.emplace_back(patterns[i], patterns[i + 1]);
+            }
+            contexts.push_back(std::move(context));
+        }
+        else if (kind >= Resolve && kind <= CreateDefaultContextForAsset) {
+            Event event;
+            event.type = static_cast<EventType>(kind);
+            uint64_t thread, context;
+            isValid =
+                reader.ReadVarint(&thread) &&
+                reader.ReadVarint(&event.time) &&
+                reader.ReadVarint(&event.duration) &&
+                reader.ReadVarint(&context) && context <= contexts.size() &&
+                readString(&event.path) &&
+                readString(&event.argument) &&
+                readString(&event.result);
+            event.thread = static_cast<uint32_t>(thread);
+            event.context = static_cast<uint32_t>(context);
+            events.push_back(std::move(event));
+        }
+        else {
+            isValid = false;
+        }
+    }
+
+    // A trace cut short by a crash keeps its complete records.
+    if (!isValid) {
+        if (!events.empty() && kind >= Resolve &&
+            kind <= CreateDefaultContextForAsset) {
+            events.pop_back();
+        }
+        TF_WARN("Trace '%s' is truncated after %zu events",
+                filePath.c_str(), events.size());
+    }
+    return true;
+}
+
+std::unique_ptr<ReplaceResolverTraceRecorder>
+ReplaceResolverTraceRecorder::Create(
+    const std::string& filePath,
+    std::string* errMsg)
+{
+    FILE* file = ArchOpenFile(filePath.c_str(), "wb");
+    if (!file) {
+        _SetError(errMsg, TfStringPrintf(
+            "Could not open trace '%s' for writing", filePath.c_str()));
+        return nullptr;
+    }
+
+    std::unique_ptr<ReplaceResolverTraceRecorder> recorder(
+        new ReplaceResolverTraceRecorder());
+    recorder->_filePath = filePath;
+    recorder->_start = Now();
+    recorder->_file = file;
+    recorder->_fileBuffer.reset(new char[_FileBufferSize]);
+    setvbuf(file, recorder->_fileBuffer.get(), _IOFBF, _FileBufferSize);
+
+    const uint32_t reserved = 0;
+    fwrite(_Magic, sizeof(_Magic), 1, file);
+    fwrite(&_Version, sizeof(_Version), 1, file);
+    fwrite(&reserved, sizeof(reserved), 1, file);
+    return recorder;
+}
+
+ReplaceResolverTraceRecorder::~ReplaceResolverTraceRecorder()
+{
+    if (_file) {
+        const bool failed = ferror(_file) != 0;
+        if (fclose(_file) != 0 || failed) {
+            TF_WARN("Could not write trace '%s'", _filePath.c_str());
+        }
+    }
+}
+
+uint32_t
+ReplaceResolverTraceRecorder::_GetThreadIndex()
+{
+    const auto inserted = _threads.emplace(
+        std::this_thread::get_id(), static_cast<uint32_t>(_threads.size()));
+    return inserted.first->second;
+}
+
+void
+ReplaceResolverTraceRecorder::_WriteVarint(uint64_t value)
+{
+    char buffer[10];
+    fwrite(buffer, 1, _EncodeVarint(value, buffer), _file);
+}
+
+uint64_t
+ReplaceResolverTraceRecorder::_InternString(const std::string& str)
+{
+    if (str.empty()) {
+        return 0;
+    }
+
+    const auto inserted = _strings.emplace(str, _strings.size() + 1);
+    if (inserted.second) {
+        putc(_StringRecord, _file);
+        _WriteVarint(str.size());
+        fwrite(str.data(), 1, str.size(), _file);
+    }
+    return inserted.first->second;
+}
+
+uint64_t
+ReplaceResolverTraceRecorder::_InternContext(
+    const ReplaceResolverContext& context)
+{
+    const ReplaceResolverFingerprint& fingerprint = context.GetFingerprint();
+    const auto it = _contexts.find(fingerprint);
+    if (it != _contexts.end()) {
+        return it->second;
+    }
+
+    // The strings of the context are written before it.
+    const uint64_t assetPath = _InternString(context.GetAssetPath());
+    std::vector<uint64_t> searchPath;
+    for (const std::string& path : context.GetSearchPath()) {
+        searchPath.push_back(_InternString(path));
+    }
+    std::vector<uint64_t> pairs;
+    for (const auto& pair : context.GetReplaceMap()) {
+        pairs.push_back(_InternString(pair.first));
+        pairs.push_back(_InternString(pair.second));
+    }
+    std::vector<uint64_t> patterns;
+    for (const auto& rule : context.GetReplacePatterns()) {
+        patterns.push_back(_InternString(rule.first));
+        patterns.push_back(_InternString(rule.second));
+    }
+    const ReplaceTableFileConstPtr& table = context.GetReplaceTable();
+    const uint64_t replaceTable =
+        _InternString(table ? table->GetFilePath() : std::string());
+
+    putc(_ContextRecord, _file);
+    fwrite(&fingerprint.hi, 8, 1, _file);
+    fwrite(&fingerprint.lo, 8, 1, _file);
+    _WriteVarint(assetPath);
+    for (const std::vector<uint64_t>* indices :
+             {&searchPath, &pairs, &patterns}) {
+        _WriteVarint(indices->size());
+        for (uint64_t index : *indices) {
+            _WriteVarint(index);
+        }
+    }
+    _WriteVarint(replaceTable);
+
+    const uint64_t index = _contexts.size() + 1;
+    _contexts.emplace(fingerprint, index);
+    return index;
+}
+
+void
+ReplaceResolverTraceRecorder::Record(
+    ReplaceResolverTrace::EventType type,
+    std::chrono::steady_clock::time_point start,
+    const ReplaceResolverContext* context,
+    const std::string& path,
+    const std::string& argument,
+    const std::string& result)
+{
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+
+    const auto end = Now();
+    const uint64_t time = start > _start
+        ? duration_cast<nanoseconds>(start - _start).count() : 0;
+    const uint64_t duration = end > start
+        ? duration_cast<nanoseconds>(end - start).count() : 0;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    const uint64_t contextIndex = context ? _InternContext(*context) : 0;
+    const uint64_t strings[3] = {
+        _InternString(path), _InternString(argument), _InternString(result)};
+
+    char buffer[1 + 10 * 7];
+    size_t size = 0;
+    buffer[size++] = static_cast<char>(type);
+    size += _EncodeVarint(_GetThreadIndex(), buffer + size);
+    size += _EncodeVarint(time, buffer + size);
+    size += _EncodeVarint(duration, buffer + size);
+    size += _EncodeVarint(contextIndex, buffer + size);
+    for (uint64_t index : strings) {
+        size += _EncodeVarint(index, buffer + size);
+    }
+    fwrite(buffer, 1, size, _file);
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
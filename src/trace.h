@@ -0,0 +1,150 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_TRACE_H
+#define USD_REPLACE_RESOLVER_TRACE_H
+
+#include "fingerprint.h"
+#include "replaceRuleTable.h"
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+class ReplaceResolverContext;
+
+/// \class ReplaceResolverTrace
+///
+/// Calls made to the resolver, recorded by ReplaceResolverTraceRecorder to
+/// be replayed offline.
+///
+/// A trace holds the paths and the contexts of the calls, not the files
+/// they resolved to, so that it can be shared without the stages.
+///
+class ReplaceResolverTrace
+{
+public:
+    enum EventType : uint8_t
+    {
+        Resolve = 1,
+        AnchorRelativePath,
+        BindContext,
+        UnbindContext,
+        CreateDefaultContextForAsset,
+    };
+
+    /// Content of a context used by the recorded calls.
+    struct Context
+    {
+        ReplaceResolverFingerprint fingerprint;
+        std::string assetPath;
+        std::vector<std::string> searchPath;
+        ReplaceRuleTable::PairMap pairs;
+        ReplaceRuleTable::PatternList patterns;
+        std::string replaceTable;
+    };
+
+    struct Event
+    {
+        EventType type = Resolve;
+        /// Index of the recording thread, in order of first call.
+        uint32_t thread = 0;
+        /// Start of the call, in nanoseconds since recording started.
+        uint64_t time = 0;
+        /// Duration of the call, in nanoseconds.
+        uint64_t duration = 0;
+        /// Index of the context bound, or created, plus one. Zero when no
+        /// context was bound.
+        uint32_t context = 0;
+        /// The path resolved, the anchor path or the asset path.
+        std::string path;
+        /// The path anchored by AnchorRelativePath.
+        std::string argument;
+        /// The resolved or anchored path.
+        std::string result;
+    };
+
+    /// Return the name of \p type, such as "Resolve".
+    AR_API static const char* GetEventName(EventType type);
+
+    /// Read the trace at \p filePath.
+    AR_API bool Read(const std::string& filePath, std::string* errMsg = nullptr);
+
+    std::vector<Context> contexts;
+    std::vector<Event> events;
+};
+
+/// \class ReplaceResolverTraceRecorder
+///
+/// Append the calls made to the resolver to a trace file, from any thread.
+///
+/// Strings and contexts are written once, the first time they are used,
+/// and then referred to by index, so that a trace of millions of resolves
+/// of a few thousand assets stays small.
+///
+class ReplaceResolverTraceRecorder
+{
+public:
+    /// Create the trace file at \p filePath. Returns null if it cannot be
+    /// written.
+    AR_API static std::unique_ptr<ReplaceResolverTraceRecorder> Create(
+        const std::string& filePath,
+        std::string* errMsg = nullptr);
+
+    /// Flush and close the trace file.
+    AR_API ~ReplaceResolverTraceRecorder();
+
+    ReplaceResolverTraceRecorder(const ReplaceResolverTraceRecorder&) = delete;
+    ReplaceResolverTraceRecorder& operator=(
+        const ReplaceResolverTraceRecorder&) = delete;
+
+    /// Return the current time on the clock of the events.
+    static std::chrono::steady_clock::time_point Now()
+    {
+        return std::chrono::steady_clock::now();
+    }
+
+    /// Record a call that started at \p start, made with \p context bound
+    /// or, for CreateDefaultContextForAsset, creating it.
+    AR_API void Record(
+        ReplaceResolverTrace::EventType type,
+        std::chrono::steady_clock::time_point start,
+        const ReplaceResolverContext* context,
+        const std::string& path,
+        const std::string& argument,
+        const std::string& result);
+
+    const std::string& GetFilePath() const { return _filePath; }
+
+private:
+    ReplaceResolverTraceRecorder() = default;
+
+    uint32_t _GetThreadIndex();
+    uint64_t _InternString(const std::string& str);
+    uint64_t _InternContext(const ReplaceResolverContext& context);
+    void _WriteVarint(uint64_t value);
+
+    std::string _filePath;
+    std::chrono::steady_clock::time_point _start;
+
+    std::mutex _mutex;
+    FILE* _file = nullptr;
+    std::unique_ptr<char[]> _fileBuffer;
+    std::unordered_map<std::string, uint64_t> _strings;
+    std::map<ReplaceResolverFingerprint, uint64_t> _contexts;
+    std::unordered_map<std::thread::id, uint32_t> _threads;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_TRACE_H
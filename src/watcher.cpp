@@ -0,0 +1,279 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "watcher.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/tf/diagnostic.h>
+#include <pxr/base/tf/stringUtils.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+
+#ifdef __linux__
+// Creations, deletions and renames change what resolves, writes are
+// reported for the sidecar files.
+constexpr uint32_t _WatchMask =
+    IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE |
+    IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+#endif
+
+bool
+_IsUnder(const std::string& path, const std::string& directory)
+{
+    return path.size() > directory.size() &&
+        path.compare(0, directory.size(), directory) == 0 &&
+        (path[directory.size()] == '/' || directory.back() == '/');
+}
+
+} // anonymous
+
+ReplaceResolverWatcher::ReplaceResolverWatcher(
+    const Callback& callback,
+    double coalesceDelay)
+    : _callback(callback)
+    , _coalesceDelayMs(std::max(0, static_cast<int>(coalesceDelay * 1000.0)))
+    , _inotifyFd(-1)
+    , _stopFd(-1)
+{
+#ifdef __linux__
+    _inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotifyFd < 0) {
+        TF_WARN("Could not watch the search paths: %s", strerror(errno));
+        return;
+    }
+    _stopFd = eventfd(0, EFD_CLOEXEC);
+    if (_stopFd < 0) {
+        TF_WARN("Could not watch the search paths: %s", strerror(errno));
+        close(_inotifyFd);
+        _inotifyFd = -1;
+        return;
+    }
+    _thread = std::thread(&ReplaceResolverWatcher::_Run, this);
+#else
+    TF_WARN("Watching the search paths is only supported on Linux");
+#endif
+}
+
+ReplaceResolverWatcher::~ReplaceResolverWatcher()
+{
+#ifdef __linux__
+    if (_thread.joinable()) {
+        const uint64_t one = 1;
+        if (write(_stopFd, &one, sizeof(one)) != sizeof(one)) {
+            TF_WARN("Could not stop watching the search paths");
+        }
+        _thread.join();
+    }
+    if (_stopFd >= 0) {
+        close(_stopFd);
+    }
+    if (_inotifyFd >= 0) {
+        close(_inotifyFd);
+    }
+#endif
+}
+
+void
+ReplaceResolverWatcher::Watch(
+    const std::string& root,
+    const std::string& directory)
+{
+    if (!IsValid() || directory.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (root.empty() || (directory != root && !_IsUnder(directory, root))) {
+        _AddWatch(directory);
+        return;
+    }
+
+    if (std::find(_roots.begin(), _roots.end(), root) == _roots.end()) {
+        _roots.push_back(root);
+    }
+    if (_watched.count(directory)) {
+        return;
+    }
+
+    // Watch from the root down, parents are usually already watched.
+    _AddWatch(root);
+    size_t end = root.size();
+    while ((end = directory.find('/', end + 1)) != std::string::npos) {
+        _AddWatch(directory.substr(0, end));
+    }
+    _AddWatch(directory);
+}
+
+void
+ReplaceResolverWatcher::_AddWatch(const std::string& directory)
+{
+#ifdef __linux__
+    if (_limitReached || _watched.count(directory)) {
+        return;
+    }
+
+    const int wd = inotify_add_watch(_inotifyFd, directory.c_str(), _WatchMask);
+    if (wd < 0) {
+        if (errno == ENOSPC || errno == ENOMEM) {
+            // Keep the watches we have, fs.inotify.max_user_watches may be
+            // raised for very large search paths.
+            _limitReached = true;
+            TF_WARN("Reached the inotify watch limit after %zu directories, "
+                    "changes in other directories are not seen",
+                    _watched.size());
+        }
+        return;
+    }
+
+    // Watching an already watched inode returns its descriptor again, for
+    // example through a symbolic link.
+    const auto it = _directories.find(wd);
+    if (it != _directories.end()) {
+        _watched.erase(it->second);
+    }
+    _directories[wd] = directory;
+    _watched.insert(directory);
+#endif
+}
+
+size_t
+ReplaceResolverWatcher::GetNumWatches() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _directories.size();
+}
+
+bool
+ReplaceResolverWatcher::_ReadEvents(std::vector<std::string>* changedPaths)
+{
+    bool complete = true;
+#ifdef __linux__
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (true) {
+        const ssize_t size = read(_inotifyFd, buffer, sizeof(buffer));
+        if (size <= 0) {
+            if (size < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const char* ptr = buffer; ptr < buffer + size; ) {
+            const inotify_event* event =
+                reinterpret_cast<const inotify_event*>(ptr);
+            ptr += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                complete = false;
+                continue;
+            }
+
+            const auto it = _directories.find(event->wd);
+            if (it == _directories.end()) {
+                continue;
+            }
+            const std::string directory = it->second;
+
+            if (event->mask & IN_IGNORED) {
+                // The directory was deleted or the watch removed, it is
+                // watched again if a path is resolved under it later.
+                _watched.erase(directory);
+                _directories.erase(it);
+                continue;
+            }
+
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                changedPaths->push_back(directory);
+                if (event->mask & IN_MOVE_SELF) {
+                    // The watch follows the inode, not the path.
+                    inotify_rm_watch(_inotifyFd, event->wd);
+                    _watched.erase(directory);
+                    _directories.erase(it);
+                }
+                continue;
+            }
+
+            if (event->len == 0) {
+                continue;
+            }
+            changedPaths->push_back(TfStringCatPaths(directory, event->name));
+
+            if ((event->mask & IN_MOVED_FROM) && (event->mask & IN_ISDIR)) {
+                // Watches under a moved directory would report its old
+                // paths.
+                const std::string& movedPath = changedPaths->back();
+                for (auto dirIt = _directories.begin();
+                     dirIt != _directories.end(); ) {
+                    if (dirIt->second == movedPath ||
+                        _IsUnder(dirIt->second, movedPath)) {
+                        inotify_rm_watch(_inotifyFd, dirIt->first);
+                        _watched.erase(dirIt->second);
+                        dirIt = _directories.erase(dirIt);
+                    }
+                    else {
+                        ++dirIt;
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort(changedPaths->begin(), changedPaths->end());
+    changedPaths->erase(
+        std::unique(changedPaths->begin(), changedPaths->end()),
+        changedPaths->end());
+#endif
+    return complete;
+}
+
+void
+ReplaceResolverWatcher::_Run()
+{
+#ifdef __linux__
+    while (true) {
+        pollfd fds[2] = {{_inotifyFd, POLLIN, 0}, {_stopFd, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            TF_WARN("Stopped watching the search paths: %s", strerror(errno));
+            return;
+        }
+        if (fds[1].revents) {
+            return;
+        }
+
+        // Let the rest of a publish land, so that it is reported once.
+        pollfd stop = {_stopFd, POLLIN, 0};
+        if (_coalesceDelayMs > 0 && poll(&stop, 1, _coalesceDelayMs) > 0) {
+            return;
+        }
+
+        std::vector<std::string> changedPaths;
+        const bool all = !_ReadEvents(&changedPaths);
+        if (all || !changedPaths.empty()) {
+            std::vector<std::string> roots;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                roots = _roots;
+            }
+            _callback(changedPaths, roots, all);
+        }
+    }
+#endif
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
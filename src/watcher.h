@@ -0,0 +1,87 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#ifndef USD_REPLACE_RESOLVER_WATCHER_H
+#define USD_REPLACE_RESOLVER_WATCHER_H
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/api.h>
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class ReplaceResolverWatcher
+///
+/// Watch directories with inotify and report the paths created, deleted,
+/// moved or written in them.
+///
+/// Events are read on a thread of the watcher and coalesced for
+/// \p coalesceDelay seconds, so that a publish writing many files is
+/// reported once. The callback is called on that thread.
+///
+/// Watching is only supported on Linux, elsewhere IsValid returns false.
+/// Like any inotify client, changes made by other hosts on a network
+/// filesystem are not seen.
+///
+class ReplaceResolverWatcher
+{
+public:
+    /// Called with the changed paths and the roots given to Watch. When
+    /// events were lost, \p all is true and any watched path may have
+    /// changed.
+    using Callback = std::function<void(
+        const std::vector<std::string>& changedPaths,
+        const std::vector<std::string>& roots,
+        bool all)>;
+
+    AR_API ReplaceResolverWatcher(const Callback& callback, double coalesceDelay);
+
+    /// Stop the thread of the watcher. Must not be called from the
+    /// callback.
+    AR_API ~ReplaceResolverWatcher();
+
+    ReplaceResolverWatcher(const ReplaceResolverWatcher&) = delete;
+    ReplaceResolverWatcher& operator=(const ReplaceResolverWatcher&) = delete;
+
+    /// Return false if inotify is not available.
+    bool IsValid() const { return _inotifyFd >= 0; }
+
+    /// Watch \p directory and, when it is under \p root, all the
+    /// directories between them, so that a directory created or moved in
+    /// place anywhere in between is reported. Missing directories are
+    /// skipped.
+    AR_API void Watch(const std::string& root, const std::string& directory);
+
+    /// Return the number of directories watched.
+    AR_API size_t GetNumWatches() const;
+
+private:
+    void _AddWatch(const std::string& directory);
+    void _Run();
+    // Read the pending events, return false when events were lost.
+    bool _ReadEvents(std::vector<std::string>* changedPaths);
+
+    const Callback _callback;
+    const int _coalesceDelayMs;
+
+    int _inotifyFd;
+    int _stopFd;
+
+    mutable std::mutex _mutex;
+    std::unordered_map<int, std::string> _directories;
+    std::unordered_set<std::string> _watched;
+    std::vector<std::string> _roots;
+    bool _limitReached = false;
+
+    std::thread _thread;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // USD_REPLACE_RESOLVER_WATCHER_H
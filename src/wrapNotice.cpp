@@ -0,0 +1,32 @@
+// Copyright 2019 Rodeo FX.  All rights reserved.
+#include "notice.h"
+
+#include "boost_include_wrapper.h"
+
+#include <pxr/pxr.h>
+#include <pxr/base/tf/pyNoticeWrapper.h>
+#include <pxr/base/tf/pyResultConversions.h>
+
+#include BOOST_INCLUDE(python/class.hpp)
+
+using namespace BOOST_NAMESPACE::python;
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+
+TF_INSTANTIATE_NOTICE_WRAPPER(ReplaceResolverFilesChangedNotice, TfNotice);
+
+} // anonymous
+
+void
+wrapReplaceResolverNotice()
+{
+    using This = ReplaceResolverFilesChangedNotice;
+
+    TfPyNoticeWrapper<This, TfNotice>::Wrap("FilesChangedNotice")
+        .def("GetChangedPaths", &This::GetChangedPaths,
+             return_value_policy<TfPySequenceToList>())
+        .def("AffectsAll", &This::AffectsAll)
+        ;
+}
@@ -4,6 +4,9 @@
 #include "boost_include_wrapper.h"
 
 #include <pxr/pxr.h>
+#include <pxr/base/tf/pyLock.h>
+#include <pxr/base/tf/pyResultConversions.h>
+#include <pxr/usd/sdf/layer.h>
 
 #include BOOST_INCLUDE(python/class.hpp)
 
@@ -11,6 +14,26 @@ using namespace BOOST_NAMESPACE::python;
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
+static std::vector<std::string>
+_ResolveMany(
+    ReplaceResolver& resolver,
+    const std::vector<std::string>& paths,
+    const ArResolverContext& context)
+{
+    TF_PY_ALLOW_THREADS_IN_SCOPE();
+    return resolver.ResolveMany(paths, context);
+}
+
+static std::vector<SdfLayerRefPtr>
+_Prewarm(
+    ReplaceResolver& resolver,
+    const std::string& rootLayerPath,
+    const ArResolverContext& context)
+{
+    TF_PY_ALLOW_THREADS_IN_SCOPE();
+    return resolver.Prewarm(rootLayerPath, context);
+}
+
 void
 wrapReplaceResolver()
 {
@@ -22,5 +45,47 @@ wrapReplaceResolver()
         .def("SetDefaultSearchPath", &This::SetDefaultSearchPath,
              args("searchPath"))
         .staticmethod("SetDefaultSearchPath")
+
+        .def("SetResolveCacheBudget", &This::SetResolveCacheBudget,
+             args("budget"))
+        .def("GetResolveCacheBudget", &This::GetResolveCacheBudget)
+
+        .def("GetStats", &This::GetStats)
+        .def("ResetStats", &This::ResetStats)
+
+        .def("LoadManifest", &This::LoadManifest,
+             args("filePath"))
+        .def("StartManifestRecording", &This::StartManifestRecording)
+        .def("StopManifestRecording", &This::StopManifestRecording,
+             args("filePath"))
+
+        .def("SetSharedCache", &This::SetSharedCache,
+             (arg("name"), arg("capacity") = size_t(64 << 20)))
+
+        .def("SetDaemon", &This::SetDaemon,
+             args("socketPath"))
+
+        .def("StartTraceRecording", &This::StartTraceRecording,
+             args("filePath"))
+        .def("StopTraceRecording", &This::StopTraceRecording)
+
+        .def("StartWatching", &This::StartWatching)
+        .def("StopWatching", &This::StopWatching)
+
+        .def("BuildSearchIndex", &This::BuildSearchIndex,
+             (arg("rootDir"), arg("filePath")))
+        .staticmethod("BuildSearchIndex")
+
+        .def("ConvertReplaceTable", &This::ConvertReplaceTable,
+             (arg("jsonFilePath"), arg("tableFilePath")))
+        .staticmethod("ConvertReplaceTable")
+
+        .def("ResolveMany", &_ResolveMany,
+             (arg("paths"), arg("context") = ArResolverContext()),
+             return_value_policy<TfPySequenceToList>())
+
+        .def("Prewarm", &_Prewarm,
+             (arg("rootLayerPath"), arg("context") = ArResolverContext()),
+             return_value_policy<TfPySequenceToList>())
         ;
 }
@@ -26,6 +26,12 @@ _Repr(const ReplaceResolverContext& ctx)
     return repr;
 }
 
+static std::string
+_GetFingerprint(const ReplaceResolverContext& ctx)
+{
+    return ctx.GetFingerprint().GetAsString();
+}
+
 static size_t
 _Hash(const ReplaceResolverContext& ctx)
 {
@@ -52,6 +58,20 @@ wrapReplaceResolverContext()
         .def("AddReplacePair", &This::AddReplacePair,
              return_value_policy<return_by_value>())
 
+        .def("AddReplacePattern", &This::AddReplacePattern,
+             (arg("pattern"), arg("replacement")))
+
+        .def("SetReplaceTable", &This::SetReplaceTable,
+             arg("filePath"))
+
+        .def("SetSearchIndex", &This::SetSearchIndex,
+             (arg("root"), arg("indexFilePath")))
+
+        .def("GetFingerprint", &_GetFingerprint)
+
+        .def("GetAssetPath", &This::GetAssetPath,
+             return_value_policy<return_by_value>())
+
         .def("__str__", &This::GetAsString)
         .def("__repr__", &_Repr)
         .def("__hash__", &_Hash)
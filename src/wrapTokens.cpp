@@ -45,5 +45,9 @@ void wrapReplaceResolverTokens()
     BOOST_NAMESPACE::python::class_<ReplaceResolverTokensType, BOOST_NAMESPACE::noncopyable>
         cls("Tokens", BOOST_NAMESPACE::python::no_init);
     _AddToken(cls, "replacePairs", ReplaceResolverTokens->replacePairs);
+    _AddToken(cls, "replacePatterns", ReplaceResolverTokens->replacePatterns);
     _AddToken(cls, "replaceFileName", ReplaceResolverTokens->replaceFileName);
+    _AddToken(cls, "replaceTable", ReplaceResolverTokens->replaceTable);
+    _AddToken(cls, "replaceTableFileName",
+              ReplaceResolverTokens->replaceTableFileName);
 }